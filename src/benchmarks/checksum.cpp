@@ -0,0 +1,158 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * checksum.cpp -- benchmark implementation for util_checksum and
+ * util_checksum_seq
+ */
+
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "benchmark.hpp"
+#include "os.h"
+#include "util.h"
+
+/*
+ * checksum_args -- benchmark specific command line options
+ */
+struct checksum_args {
+	char *operation; /* compute, seq */
+};
+
+/*
+ * checksum_bench -- benchmark context
+ */
+struct checksum_bench {
+	struct checksum_args *pa; /* prog_args structure */
+	char *bufs;		  /* per-thread buffers */
+	size_t buf_size;	  /* size of a single buffer */
+	bool seq;		  /* use util_checksum_seq */
+};
+
+/*
+ * checksum_op -- checksums the buffer of the worker thread
+ */
+static int
+checksum_op(struct benchmark *bench, struct operation_info *info)
+{
+	auto *cb = (struct checksum_bench *)pmembench_get_priv(bench);
+	char *buf = cb->bufs + info->worker->index * cb->buf_size;
+	size_t len = info->args->dsize;
+
+	if (cb->seq) {
+		uint64_t csum = util_checksum_seq(buf, len, 0);
+		*(volatile uint64_t *)buf = csum;
+	} else {
+		/* the checksum lives at the beginning of the buffer */
+		util_checksum(buf, len, (uint64_t *)buf, 1, 0);
+	}
+
+	return 0;
+}
+
+/*
+ * checksum_init -- allocates and fills the buffers of all the threads
+ */
+static int
+checksum_init(struct benchmark *bench, struct benchmark_args *args)
+{
+	assert(bench != nullptr);
+	assert(args != nullptr);
+	assert(args->opts != nullptr);
+
+	auto *pa = (struct checksum_args *)args->opts;
+
+	if (args->dsize < sizeof(uint64_t) || args->dsize % 4 != 0) {
+		fprintf(stderr,
+			"data size must be a multiple of 4 and at least 8\n");
+		return -1;
+	}
+
+	bool seq;
+	if (strcmp(pa->operation, "compute") == 0) {
+		seq = false;
+	} else if (strcmp(pa->operation, "seq") == 0) {
+		seq = true;
+	} else {
+		fprintf(stderr, "invalid operation: %s\n", pa->operation);
+		return -1;
+	}
+
+	auto *cb = (struct checksum_bench *)malloc(sizeof(struct checksum_bench));
+	if (cb == nullptr) {
+		perror("malloc");
+		return -1;
+	}
+
+	cb->pa = pa;
+	cb->seq = seq;
+	cb->buf_size = ALIGN_UP(args->dsize, CACHELINE_SIZE);
+	cb->bufs = (char *)util_aligned_malloc(CACHELINE_SIZE,
+					       cb->buf_size * args->n_threads);
+	if (cb->bufs == nullptr) {
+		perror("util_aligned_malloc");
+		free(cb);
+		return -1;
+	}
+
+	unsigned seed = args->seed;
+	for (size_t i = 0; i < cb->buf_size * args->n_threads; ++i)
+		cb->bufs[i] = (char)os_rand_r(&seed);
+
+	/* selects the checksum kernel supported by the cpu */
+	util_init();
+
+	pmembench_set_priv(bench, cb);
+
+	return 0;
+}
+
+/*
+ * checksum_exit -- benchmark cleanup function
+ */
+static int
+checksum_exit(struct benchmark *bench, struct benchmark_args *args)
+{
+	auto *cb = (struct checksum_bench *)pmembench_get_priv(bench);
+
+	util_aligned_free(cb->bufs);
+	free(cb);
+
+	return 0;
+}
+
+static struct benchmark_clo checksum_clo[1];
+
+/* Stores information about benchmark. */
+static struct benchmark_info checksum_info;
+CONSTRUCTOR(checksum_constructor)
+void
+checksum_constructor(void)
+{
+	checksum_clo[0].opt_short = 'o';
+	checksum_clo[0].opt_long = "operation";
+	checksum_clo[0].descr = "Operation type - compute, seq";
+	checksum_clo[0].type = CLO_TYPE_STR;
+	checksum_clo[0].off = clo_field_offset(struct checksum_args, operation);
+	checksum_clo[0].def = "compute";
+
+	checksum_info.name = "checksum";
+	checksum_info.brief = "Benchmark for util_checksum() and "
+			      "util_checksum_seq() operations";
+	checksum_info.init = checksum_init;
+	checksum_info.exit = checksum_exit;
+	checksum_info.multithread = true;
+	checksum_info.multiops = true;
+	checksum_info.operation = checksum_op;
+	checksum_info.measure_time = true;
+	checksum_info.clos = checksum_clo;
+	checksum_info.nclos = ARRAY_SIZE(checksum_clo);
+	checksum_info.opts_size = sizeof(struct checksum_args);
+	checksum_info.rm_file = false;
+	checksum_info.allow_poolset = false;
+	REGISTER_BENCHMARK(checksum_info);
+};
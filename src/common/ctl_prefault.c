@@ -1,14 +1,17 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2016-2019, Intel Corporation */
+/* Copyright 2016-2021, Intel Corporation */
 
 /*
  * ctl_prefault.c -- implementation of the prefault CTL namespace
  */
 
+#include <errno.h>
+
 #include "ctl.h"
 #include "set.h"
 #include "out.h"
 #include "ctl_global.h"
+#include "util.h"
 
 static int
 CTL_READ_HANDLER(at_create)(void *ctx, enum ctl_query_source source,
@@ -52,12 +55,48 @@ CTL_WRITE_HANDLER(at_open)(void *ctx, enum ctl_query_source source,
 	return 0;
 }
 
+static int
+CTL_READ_HANDLER(nthreads)(void *ctx, enum ctl_query_source source,
+	void *arg, struct ctl_indexes *indexes)
+{
+	int *arg_out = arg;
+
+	unsigned nthreads;
+	util_atomic_load_explicit32(&Prefault_nthreads, &nthreads,
+		memory_order_relaxed);
+	*arg_out = (int)nthreads;
+
+	return 0;
+}
+
+static int
+CTL_WRITE_HANDLER(nthreads)(void *ctx, enum ctl_query_source source,
+	void *arg, struct ctl_indexes *indexes)
+{
+	int arg_in = *(int *)arg;
+
+	if (arg_in < 1 || arg_in > PREFAULT_MAX_THREADS) {
+		ERR("invalid number of prefault threads %d, "
+			"must be between 1 and %d",
+			arg_in, PREFAULT_MAX_THREADS);
+		errno = EINVAL;
+		return -1;
+	}
+
+	util_atomic_store_explicit32(&Prefault_nthreads, (unsigned)arg_in,
+		memory_order_relaxed);
+
+	return 0;
+}
+
 static const struct ctl_argument CTL_ARG(at_create) = CTL_ARG_BOOLEAN;
 static const struct ctl_argument CTL_ARG(at_open) = CTL_ARG_BOOLEAN;
+static const struct ctl_argument CTL_ARG(nthreads) = CTL_ARG_INT;
 
 static const struct ctl_node CTL_NODE(prefault)[] = {
 	CTL_LEAF_RW(at_create),
 	CTL_LEAF_RW(at_open),
+	CTL_LEAF_RW(nthreads),
 
 	CTL_NODE_END
 };
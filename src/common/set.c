@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2015-2020, Intel Corporation */
+/* Copyright 2015-2021, Intel Corporation */
 /*
  * Copyright (c) 2016, Microsoft Corporation. All rights reserved.
  *
@@ -51,6 +51,7 @@
 #include <endian.h>
 #include <errno.h>
 #include <stddef.h>
+#include <inttypes.h>
 #include <time.h>
 #include <ctype.h>
 #include <linux/limits.h>
@@ -61,6 +62,7 @@
 #include "set.h"
 #include "file.h"
 #include "os.h"
+#include "os_thread.h"
 #include "mmap.h"
 #include "util.h"
 #include "out.h"
@@ -103,6 +105,7 @@ static void *Rpmem_handle_remote;
 
 int Prefault_at_open = 0;
 int Prefault_at_create = 0;
+unsigned Prefault_nthreads = 1;
 int SDS_at_create = POOL_FEAT_INCOMPAT_DEFAULT & POOL_E_FEAT_SDS ? 1 : 0;
 int Fallocate_at_create = 1;
 int COW_at_open = 0;
@@ -341,19 +344,168 @@ static const char *parser_errstr[PARSER_MAX_CODE] = {
 	"" /* format correct */
 };
 
+#if defined(__linux__) && !defined(MADV_POPULATE_WRITE)
+#define MADV_POPULATE_WRITE 23 /* since Linux 5.14 */
+#endif
+
+/*
+ * The replica is prefaulted in slices claimed by the threads one by one, so
+ * that a thread which gets slower pages does not delay the others.
+ */
+#define PREFAULT_SLICE_SIZE ((size_t)16 << 20)
+
+struct prefault_job {
+	char *addr;
+	size_t size;
+	size_t step; /* distance between the touched bytes */
+	size_t slice_size; /* multiple of the step */
+	uint64_t nslices;
+	uint64_t next; /* index of the next slice to be claimed */
+	uint64_t done; /* number of bytes prefaulted so far */
+	int populate; /* MADV_POPULATE_WRITE is supported */
+};
+
+/*
+ * util_prefault_touch -- (internal) forces page allocation by writing one
+ *	byte of every page of the range
+ */
+static void
+util_prefault_touch(struct prefault_job *job, char *addr, size_t size)
+{
+	volatile char *cur_addr = addr;
+	char *addr_end = addr + size;
+	for (; cur_addr < addr_end; cur_addr += job->step) {
+		*cur_addr = *cur_addr;
+		VALGRIND_SET_CLEAN(cur_addr, 1);
+	}
+}
+
+/*
+ * util_prefault_slice -- (internal) forces page allocation for a single slice
+ *	of the replica
+ *
+ * The kernel populates the range in a single call if it supports
+ * MADV_POPULATE_WRITE, otherwise the pages are touched one by one.
+ */
+static void
+util_prefault_slice(struct prefault_job *job, char *addr, size_t size)
+{
+#ifdef MADV_POPULATE_WRITE
+	int populate;
+	util_atomic_load_explicit32(&job->populate, &populate,
+		memory_order_relaxed);
+	if (populate) {
+		if (os_madvise(addr, size, MADV_POPULATE_WRITE) == 0)
+			return;
+
+		LOG(4, "!madvise(MADV_POPULATE_WRITE), touching the pages");
+		if (errno == EINVAL)
+			util_atomic_store_explicit32(&job->populate, 0,
+				memory_order_relaxed);
+	}
+#endif
+	util_prefault_touch(job, addr, size);
+}
+
+/*
+ * util_prefault_worker -- (internal) prefaults the slices of the replica until
+ *	there are none left
+ */
+static void *
+util_prefault_worker(void *arg)
+{
+	struct prefault_job *job = arg;
+
+	uint64_t idx;
+	while ((idx = util_fetch_and_add64(&job->next, 1)) < job->nslices) {
+		size_t off = idx * job->slice_size;
+		size_t size = job->size - off;
+		if (size > job->slice_size)
+			size = job->slice_size;
+
+		util_prefault_slice(job, job->addr + off, size);
+
+		/* report every 10% of the replica */
+		uint64_t done = util_fetch_and_add64(&job->done, size);
+		if (done * 10 / job->size != (done + size) * 10 / job->size)
+			LOG(3, "prefaulted %" PRIu64 "%% of %zu bytes",
+				(done + size) * 100 / job->size, job->size);
+	}
+
+	return NULL;
+}
+
 /*
  * util_replica_force_page_allocation - (internal) forces page allocation for
  * replica
+ *
+ * The replica is split between the number of threads configured with the
+ * prefault.nthreads ctl entry. On Device DAX only one byte of every
+ * internal alignment unit is touched, as the device is mapped with pages of
+ * that size.
  */
 static void
 util_replica_force_page_allocation(struct pool_replica *rep)
 {
-	volatile char *cur_addr = rep->part[0].addr;
-	char *addr_end = (char *)cur_addr + rep->resvsize;
-	for (; cur_addr < addr_end; cur_addr += Pagesize) {
-		*cur_addr = *cur_addr;
-		VALGRIND_SET_CLEAN(cur_addr, 1);
+	size_t step = 0;
+	for (unsigned p = 0; p < rep->nparts; ++p) {
+		size_t alignment = Pagesize;
+		if (rep->part[p].is_dev_dax &&
+		    rep->part[p].alignment > alignment)
+			alignment = rep->part[p].alignment;
+
+		/* all the alignments are powers of two */
+		if (step == 0 || alignment < step)
+			step = alignment;
+	}
+
+	struct prefault_job job;
+	job.addr = rep->part[0].addr;
+	job.size = rep->resvsize;
+	job.step = step;
+	job.slice_size = PREFAULT_SLICE_SIZE;
+	if (step > job.slice_size)
+		job.slice_size = step;
+	job.nslices = (job.size + job.slice_size - 1) / job.slice_size;
+	job.next = 0;
+	job.done = 0;
+	/* valgrind does not see the writes done by the kernel */
+	job.populate = !On_valgrind;
+
+	unsigned nthreads;
+	util_atomic_load_explicit32(&Prefault_nthreads, &nthreads,
+		memory_order_relaxed);
+	if (nthreads > job.nslices)
+		nthreads = (unsigned)job.nslices;
+
+	os_thread_t *workers = NULL;
+	unsigned nworkers = 0;
+	if (nthreads > 1) {
+		workers = Malloc(sizeof(*workers) * (nthreads - 1));
+		if (workers == NULL)
+			LOG(2, "!Malloc, prefaulting sequentially");
+	}
+
+	for (; workers != NULL && nworkers < nthreads - 1; ++nworkers) {
+		int ret = os_thread_create(&workers[nworkers], NULL,
+			util_prefault_worker, &job);
+		if (ret != 0) {
+			errno = ret;
+			LOG(2, "!os_thread_create, using %u prefault threads",
+				nworkers + 1);
+			break;
+		}
 	}
+
+	LOG(4, "addr %p size %zu step %zu, %u workers", job.addr, job.size,
+		step, nworkers);
+
+	util_prefault_worker(&job);
+
+	for (unsigned i = 0; i < nworkers; ++i)
+		os_thread_join(&workers[i], NULL);
+
+	Free(workers);
 }
 
 /*
@@ -1,5 +1,5 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
-/* Copyright 2014-2020, Intel Corporation */
+/* Copyright 2014-2021, Intel Corporation */
 /*
  * Copyright (c) 2016, Microsoft Corporation. All rights reserved.
  *
@@ -331,10 +331,13 @@ HDRP(struct pool_replica *rep, unsigned p)
 
 extern int Prefault_at_open;
 extern int Prefault_at_create;
+extern unsigned Prefault_nthreads;
 extern int SDS_at_create;
 extern int Fallocate_at_create;
 extern int COW_at_open;
 
+#define PREFAULT_MAX_THREADS 256
+
 int util_poolset_parse(struct pool_set **setp, const char *path, int fd);
 int util_poolset_read(struct pool_set **setp, const char *path);
 int util_poolset_create_set(struct pool_set **setp, const char *path,
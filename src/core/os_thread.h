@@ -1,5 +1,5 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
-/* Copyright 2015-2020, Intel Corporation */
+/* Copyright 2015-2021, Intel Corporation */
 /*
  * Copyright (c) 2016, Microsoft Corporation. All rights reserved.
  *
@@ -159,12 +159,19 @@ int os_thread_create(os_thread_t *thread, const os_thread_attr_t *attr,
 
 int os_thread_join(os_thread_t *thread, void **result);
 
+int os_thread_attr_init(os_thread_attr_t *attr);
+int os_thread_attr_destroy(os_thread_attr_t *attr);
+
 void os_thread_self(os_thread_t *thread);
 
 /* thread affinity */
 
 int os_thread_setaffinity_np(os_thread_t *thread, size_t set_size,
 	const os_cpu_set_t *set);
+int os_thread_attr_setaffinity_np(os_thread_attr_t *attr, size_t set_size,
+	const os_cpu_set_t *set);
+int os_thread_getcpu(void);
+unsigned os_numa_node_cpus(int numa_node, os_cpu_set_t *set);
 
 int os_thread_atfork(void (*prepare)(void), void (*parent)(void),
 	void (*child)(void));
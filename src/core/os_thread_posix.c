@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2017-2020, Intel Corporation */
+/* Copyright 2017-2021, Intel Corporation */
 
 /*
  * os_thread_posix.c -- Posix thread abstraction layer
@@ -12,8 +12,13 @@
 #ifdef __FreeBSD__
 #include <pthread_np.h>
 #endif
+#include <sched.h>
 #include <semaphore.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
 
+#include "os.h"
 #include "os_thread.h"
 #include "util.h"
 
@@ -338,6 +343,25 @@ os_thread_join(os_thread_t *thread, void **result)
 	return pthread_join(thread_info->thread, result);
 }
 
+/*
+ * os_thread_attr_init -- pthread_attr_init abstraction layer
+ */
+int
+os_thread_attr_init(os_thread_attr_t *attr)
+{
+	COMPILE_ERROR_ON(sizeof(os_thread_attr_t) < sizeof(pthread_attr_t));
+	return pthread_attr_init((pthread_attr_t *)attr);
+}
+
+/*
+ * os_thread_attr_destroy -- pthread_attr_destroy abstraction layer
+ */
+int
+os_thread_attr_destroy(os_thread_attr_t *attr)
+{
+	return pthread_attr_destroy((pthread_attr_t *)attr);
+}
+
 /*
  * os_thread_self -- pthread_self abstraction layer
  */
@@ -373,6 +397,32 @@ os_thread_setaffinity_np(os_thread_t *thread, size_t set_size,
 		(cpu_set_t *)set);
 }
 
+/*
+ * os_thread_attr_setaffinity_np -- pthread_attr_setaffinity_np abstraction
+ *	layer
+ */
+int
+os_thread_attr_setaffinity_np(os_thread_attr_t *attr, size_t set_size,
+			const os_cpu_set_t *set)
+{
+	return pthread_attr_setaffinity_np((pthread_attr_t *)attr, set_size,
+		(cpu_set_t *)set);
+}
+
+/*
+ * os_thread_getcpu -- sched_getcpu abstraction layer, returns -1 if the cpu
+ *	cannot be determined
+ */
+int
+os_thread_getcpu(void)
+{
+#ifdef __FreeBSD__
+	return -1;
+#else
+	return sched_getcpu();
+#endif
+}
+
 /*
  * os_cpu_zero -- CP_ZERO abstraction layer
  */
@@ -391,6 +441,65 @@ os_cpu_set(size_t cpu, os_cpu_set_t *set)
 	CPU_SET(cpu, (cpu_set_t *)set);
 }
 
+/*
+ * os_numa_node_cpus -- fills the set with CPUs of the NUMA node
+ *
+ * Returns the number of CPUs in the set, 0 if they cannot be determined.
+ */
+unsigned
+os_numa_node_cpus(int numa_node, os_cpu_set_t *set)
+{
+#ifdef __linux__
+	char path[PATH_MAX];
+	if (util_snprintf(path, PATH_MAX,
+			"/sys/devices/system/node/node%d/cpulist",
+			numa_node) < 0)
+		return 0;
+
+	FILE *file = os_fopen(path, "r");
+	if (file == NULL)
+		return 0;
+
+	char buf[1024];
+	char *list = fgets(buf, sizeof(buf), file);
+	(void) fclose(file);
+	if (list == NULL)
+		return 0;
+
+	/* the list looks like this: "0-3,8,10-11" */
+	unsigned ncpus = 0;
+	os_cpu_zero(set);
+	while (*list != '\0' && *list != '\n') {
+		char *endptr;
+		unsigned long first = strtoul(list, &endptr, 10);
+		unsigned long last = first;
+		if (endptr == list)
+			return 0;
+
+		if (*endptr == '-') {
+			list = endptr + 1;
+			last = strtoul(list, &endptr, 10);
+			if (endptr == list)
+				return 0;
+		}
+
+		for (unsigned long cpu = first; cpu <= last &&
+				cpu < sizeof(*set) * 8; ++cpu) {
+			os_cpu_set(cpu, set);
+			ncpus++;
+		}
+
+		list = endptr;
+		if (*list == ',')
+			list++;
+	}
+
+	return ncpus;
+#else
+	return 0;
+#endif
+}
+
 /*
  * os_semaphore_init -- initializes semaphore instance
  */
@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2015-2020, Intel Corporation */
+/* Copyright 2015-2021, Intel Corporation */
 /*
  * Copyright (c) 2016, Microsoft Corporation. All rights reserved.
  *
@@ -526,6 +526,25 @@ os_thread_join(os_thread_t *thread, void **result)
 	return 0;
 }
 
+/*
+ * os_thread_attr_init -- the attributes are ignored by os_thread_create
+ */
+int
+os_thread_attr_init(os_thread_attr_t *attr)
+{
+	memset(attr, 0, sizeof(*attr));
+	return 0;
+}
+
+/*
+ * os_thread_attr_destroy -- the attributes are ignored by os_thread_create
+ */
+int
+os_thread_attr_destroy(os_thread_attr_t *attr)
+{
+	return 0;
+}
+
 /*
  * os_thread_self -- returns handle to calling thread
  */
@@ -593,6 +612,36 @@ os_thread_setaffinity_np(os_thread_t *thread, size_t set_size,
 	return ret != 0 ? 0 : EINVAL;
 }
 
+/*
+ * os_thread_attr_setaffinity_np -- not supported, the affinity of a thread
+ *	can only be changed after it's created
+ */
+int
+os_thread_attr_setaffinity_np(os_thread_attr_t *attr, size_t set_size,
+	const os_cpu_set_t *set)
+{
+	return ENOTSUP;
+}
+
+/*
+ * os_thread_getcpu -- returns the number of the cpu the calling thread is
+ *	running on
+ */
+int
+os_thread_getcpu(void)
+{
+	return (int)GetCurrentProcessorNumber();
+}
+
+/*
+ * os_numa_node_cpus -- CPUs of NUMA nodes are not exposed on this platform
+ */
+unsigned
+os_numa_node_cpus(int numa_node, os_cpu_set_t *set)
+{
+	return 0;
+}
+
 /*
  * os_semaphore_init -- initializes a new semaphore instance
  */
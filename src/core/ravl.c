@@ -36,6 +36,11 @@ struct ravl {
 	struct ravl_node *root;
 	ravl_compare *compare;
 	size_t data_size;
+
+	/* optional allocator of the nodes, Malloc/Free are used if NULL */
+	ravl_node_alloc *node_alloc;
+	ravl_node_free *node_free;
+	void *node_alloc_arg;
 };
 
 /*
@@ -53,6 +58,28 @@ ravl_new_sized(ravl_compare *compare, size_t data_size)
 	r->compare = compare;
 	r->root = NULL;
 	r->data_size = data_size;
+	r->node_alloc = NULL;
+	r->node_free = NULL;
+	r->node_alloc_arg = NULL;
+
+	return r;
+}
+
+/*
+ * ravl_new_sized_alloc -- creates a new tree whose nodes are allocated and
+ *	freed using the provided functions
+ */
+struct ravl *
+ravl_new_sized_alloc(ravl_compare *compare, size_t data_size,
+	ravl_node_alloc *node_alloc, ravl_node_free *node_free, void *arg)
+{
+	struct ravl *r = ravl_new_sized(compare, data_size);
+	if (r == NULL)
+		return NULL;
+
+	r->node_alloc = node_alloc;
+	r->node_free = node_free;
+	r->node_alloc_arg = arg;
 
 	return r;
 }
@@ -66,23 +93,36 @@ ravl_new(ravl_compare *compare)
 	return ravl_new_sized(compare, RAVL_DEFAULT_DATA_SIZE);
 }
 
+/*
+ * ravl_free_node -- (internal) frees the memory of the given node
+ */
+static void
+ravl_free_node(struct ravl *ravl, struct ravl_node *n)
+{
+	if (ravl->node_free != NULL)
+		ravl->node_free(n, ravl->node_alloc_arg);
+	else
+		Free(n);
+}
+
 /*
  * ravl_clear_node -- (internal) recursively clears the given subtree,
  *	calls callback in an in-order fashion. Optionally frees the given node.
  */
 static void
-ravl_foreach_node(struct ravl_node *n, ravl_cb cb, void *arg, int free_node)
+ravl_foreach_node(struct ravl *ravl, struct ravl_node *n, ravl_cb cb,
+	void *arg, int free_node)
 {
 	if (n == NULL)
 		return;
 
-	ravl_foreach_node(n->slots[RAVL_LEFT], cb, arg, free_node);
+	ravl_foreach_node(ravl, n->slots[RAVL_LEFT], cb, arg, free_node);
 	if (cb)
 		cb((void *)n->data, arg);
-	ravl_foreach_node(n->slots[RAVL_RIGHT], cb, arg, free_node);
+	ravl_foreach_node(ravl, n->slots[RAVL_RIGHT], cb, arg, free_node);
 
 	if (free_node)
-		Free(n);
+		ravl_free_node(ravl, n);
 }
 
 /*
@@ -91,7 +131,7 @@ ravl_foreach_node(struct ravl_node *n, ravl_cb cb, void *arg, int free_node)
 void
 ravl_clear(struct ravl *ravl)
 {
-	ravl_foreach_node(ravl->root, NULL, NULL, 1);
+	ravl_foreach_node(ravl, ravl->root, NULL, NULL, 1);
 	ravl->root = NULL;
 }
 
@@ -101,7 +141,7 @@ ravl_clear(struct ravl *ravl)
 void
 ravl_delete_cb(struct ravl *ravl, ravl_cb cb, void *arg)
 {
-	ravl_foreach_node(ravl->root, cb, arg, 1);
+	ravl_foreach_node(ravl, ravl->root, cb, arg, 1);
 	Free(ravl);
 }
 
@@ -120,7 +160,7 @@ ravl_delete(struct ravl *ravl)
 void
 ravl_foreach(struct ravl *ravl, ravl_cb cb, void *arg)
 {
-	ravl_foreach_node(ravl->root, cb, arg, 0);
+	ravl_foreach_node(ravl, ravl->root, cb, arg, 0);
 }
 
 /*
@@ -157,10 +197,18 @@ ravl_node_copy_constructor(void *data, size_t data_size, const void *arg)
 static struct ravl_node *
 ravl_new_node(struct ravl *ravl, ravl_constr constr, const void *arg)
 {
-	struct ravl_node *n = Malloc(sizeof(*n) + ravl->data_size);
-	if (n == NULL) {
-		ERR("!Malloc");
-		return n;
+	struct ravl_node *n;
+	if (ravl->node_alloc != NULL) {
+		n = ravl->node_alloc(sizeof(*n) + ravl->data_size,
+			ravl->node_alloc_arg);
+		if (n == NULL)
+			return n;
+	} else {
+		n = Malloc(sizeof(*n) + ravl->data_size);
+		if (n == NULL) {
+			ERR("!Malloc");
+			return n;
+		}
 	}
 
 	n->parent = NULL;
@@ -415,7 +463,7 @@ ravl_emplace(struct ravl *ravl, ravl_constr constr, const void *arg)
 
 error_duplicate:
 	errno = EEXIST;
-	Free(n);
+	ravl_free_node(ravl, n);
 	return -1;
 }
 
@@ -557,7 +605,7 @@ ravl_remove(struct ravl *ravl, struct ravl_node *n)
 			r->parent = n->parent;
 
 		*ravl_node_ref(ravl, n) = r;
-		Free(n);
+		ravl_free_node(ravl, n);
 	}
 }
 
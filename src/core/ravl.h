@@ -30,9 +30,13 @@ enum ravl_predicate {
 typedef int ravl_compare(const void *lhs, const void *rhs);
 typedef void ravl_cb(void *data, void *arg);
 typedef void ravl_constr(void *data, size_t data_size, const void *arg);
+typedef void *ravl_node_alloc(size_t size, void *arg);
+typedef void ravl_node_free(void *ptr, void *arg);
 
 struct ravl *ravl_new(ravl_compare *compare);
 struct ravl *ravl_new_sized(ravl_compare *compare, size_t data_size);
+struct ravl *ravl_new_sized_alloc(ravl_compare *compare, size_t data_size,
+	ravl_node_alloc *node_alloc, ravl_node_free *node_free, void *arg);
 void ravl_delete(struct ravl *ravl);
 void ravl_delete_cb(struct ravl *ravl, ravl_cb cb, void *arg);
 void ravl_foreach(struct ravl *ravl, ravl_cb cb, void *arg);
@@ -0,0 +1,259 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2016-2021, Intel Corporation */
+
+/*
+ * ringbuf.c -- implementation of a simple multi-producer/multi-consumer (MPMC)
+ *	bounded queue of pointers
+ *
+ * The queue is meant for handing off units of work between threads. The
+ * critical section of every operation is a couple of stores, so a single
+ * mutex is enough, and it keeps the stop/drain semantics simple: once the
+ * queue is stopped, consumers still receive all the remaining entries, and
+ * only after the queue becomes empty they get NULL.
+ */
+
+#include <errno.h>
+
+#include "alloc.h"
+#include "os_thread.h"
+#include "out.h"
+#include "ringbuf.h"
+#include "sys_util.h"
+#include "util.h"
+
+struct ringbuf {
+	os_mutex_t lock;
+	os_cond_t not_empty; /* signaled when an entry is enqueued */
+	os_cond_t not_full; /* signaled when an entry is dequeued */
+
+	unsigned read_pos;
+	unsigned write_pos;
+	unsigned count;
+	unsigned length; /* always a power of two */
+	unsigned length_mask;
+
+	int running;
+
+	void *data[];
+};
+
+/*
+ * ringbuf_new -- creates a new ring buffer instance, the length is rounded up
+ *	to the nearest power of two
+ */
+struct ringbuf *
+ringbuf_new(unsigned length)
+{
+	LOG(4, NULL);
+
+	if (length == 0 || length > (1U << 31)) {
+		ERR("invalid ring buffer length %u", length);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	unsigned len = 1;
+	while (len < length)
+		len <<= 1;
+
+	struct ringbuf *rbuf =
+		Zalloc(sizeof(*rbuf) + (len * sizeof(void *)));
+	if (rbuf == NULL)
+		return NULL;
+
+	util_mutex_init(&rbuf->lock);
+	util_cond_init(&rbuf->not_empty);
+	util_cond_init(&rbuf->not_full);
+
+	rbuf->length = len;
+	rbuf->length_mask = len - 1;
+	rbuf->running = 1;
+
+	return rbuf;
+}
+
+/*
+ * ringbuf_length -- returns the length of the ring buffer
+ */
+unsigned
+ringbuf_length(struct ringbuf *rbuf)
+{
+	return rbuf->length;
+}
+
+/*
+ * ringbuf_count -- returns the number of entries currently in the ring buffer
+ */
+unsigned
+ringbuf_count(struct ringbuf *rbuf)
+{
+	util_mutex_lock(&rbuf->lock);
+	unsigned count = rbuf->count;
+	util_mutex_unlock(&rbuf->lock);
+
+	return count;
+}
+
+/*
+ * ringbuf_stop -- stops accepting new entries and wakes up all the threads
+ *	waiting on the queue
+ */
+void
+ringbuf_stop(struct ringbuf *rbuf)
+{
+	util_mutex_lock(&rbuf->lock);
+	rbuf->running = 0;
+	os_cond_broadcast(&rbuf->not_empty);
+	os_cond_broadcast(&rbuf->not_full);
+	util_mutex_unlock(&rbuf->lock);
+}
+
+/*
+ * ringbuf_running -- returns whether the ring buffer still accepts entries
+ */
+int
+ringbuf_running(struct ringbuf *rbuf)
+{
+	util_mutex_lock(&rbuf->lock);
+	int running = rbuf->running;
+	util_mutex_unlock(&rbuf->lock);
+
+	return running;
+}
+
+/*
+ * ringbuf_delete -- destroys an existing ring buffer instance, the caller is
+ *	responsible for making sure that no thread uses the queue anymore
+ */
+void
+ringbuf_delete(struct ringbuf *rbuf)
+{
+	ASSERTeq(rbuf->count, 0);
+
+	util_cond_destroy(&rbuf->not_full);
+	util_cond_destroy(&rbuf->not_empty);
+	util_mutex_destroy(&rbuf->lock);
+
+	Free(rbuf);
+}
+
+/*
+ * ringbuf_push -- (internal) inserts an entry, must be called under lock
+ */
+static void
+ringbuf_push(struct ringbuf *rbuf, void *data)
+{
+	ASSERT(rbuf->count < rbuf->length);
+
+	rbuf->data[rbuf->write_pos] = data;
+	rbuf->write_pos = (rbuf->write_pos + 1) & rbuf->length_mask;
+	rbuf->count++;
+
+	os_cond_signal(&rbuf->not_empty);
+}
+
+/*
+ * ringbuf_pop -- (internal) removes an entry, must be called under lock
+ */
+static void *
+ringbuf_pop(struct ringbuf *rbuf)
+{
+	ASSERT(rbuf->count > 0);
+
+	void *data = rbuf->data[rbuf->read_pos];
+	rbuf->data[rbuf->read_pos] = NULL;
+	rbuf->read_pos = (rbuf->read_pos + 1) & rbuf->length_mask;
+	rbuf->count--;
+
+	os_cond_signal(&rbuf->not_full);
+
+	return data;
+}
+
+/*
+ * ringbuf_enqueue -- places a new value in the ring buffer, waits until
+ *	a free slot becomes available
+ *
+ * Returns -1 if the ring buffer was stopped.
+ */
+int
+ringbuf_enqueue(struct ringbuf *rbuf, void *data)
+{
+	ASSERTne(data, NULL);
+
+	int ret = 0;
+
+	util_mutex_lock(&rbuf->lock);
+	while (rbuf->running && rbuf->count == rbuf->length)
+		os_cond_wait(&rbuf->not_full, &rbuf->lock);
+
+	if (rbuf->running)
+		ringbuf_push(rbuf, data);
+	else
+		ret = -1;
+	util_mutex_unlock(&rbuf->lock);
+
+	return ret;
+}
+
+/*
+ * ringbuf_tryenqueue -- places a new value in the ring buffer if there's
+ *	a free slot available
+ *
+ * Returns -1 if the ring buffer is full or was stopped.
+ */
+int
+ringbuf_tryenqueue(struct ringbuf *rbuf, void *data)
+{
+	ASSERTne(data, NULL);
+
+	int ret = -1;
+
+	util_mutex_lock(&rbuf->lock);
+	if (rbuf->running && rbuf->count < rbuf->length) {
+		ringbuf_push(rbuf, data);
+		ret = 0;
+	}
+	util_mutex_unlock(&rbuf->lock);
+
+	return ret;
+}
+
+/*
+ * ringbuf_dequeue -- retrieves one item from the ring buffer, waits until
+ *	an entry becomes available
+ *
+ * Returns NULL only once the ring buffer was stopped and drained.
+ */
+void *
+ringbuf_dequeue(struct ringbuf *rbuf)
+{
+	void *data = NULL;
+
+	util_mutex_lock(&rbuf->lock);
+	while (rbuf->running && rbuf->count == 0)
+		os_cond_wait(&rbuf->not_empty, &rbuf->lock);
+
+	if (rbuf->count != 0)
+		data = ringbuf_pop(rbuf);
+	util_mutex_unlock(&rbuf->lock);
+
+	return data;
+}
+
+/*
+ * ringbuf_trydequeue -- retrieves one item from the ring buffer if it's not
+ *	empty
+ */
+void *
+ringbuf_trydequeue(struct ringbuf *rbuf)
+{
+	void *data = NULL;
+
+	util_mutex_lock(&rbuf->lock);
+	if (rbuf->count != 0)
+		data = ringbuf_pop(rbuf);
+	util_mutex_unlock(&rbuf->lock);
+
+	return data;
+}
@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2016-2021, Intel Corporation */
+
+/*
+ * ringbuf.h -- internal definitions for mpmc bounded queue
+ */
+
+#ifndef RINGBUF_H
+#define RINGBUF_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct ringbuf;
+
+struct ringbuf *ringbuf_new(unsigned length);
+void ringbuf_delete(struct ringbuf *rbuf);
+unsigned ringbuf_length(struct ringbuf *rbuf);
+unsigned ringbuf_count(struct ringbuf *rbuf);
+void ringbuf_stop(struct ringbuf *rbuf);
+int ringbuf_running(struct ringbuf *rbuf);
+
+int ringbuf_enqueue(struct ringbuf *rbuf, void *data);
+int ringbuf_tryenqueue(struct ringbuf *rbuf, void *data);
+void *ringbuf_dequeue(struct ringbuf *rbuf);
+void *ringbuf_trydequeue(struct ringbuf *rbuf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2014-2020, Intel Corporation */
+/* Copyright 2014-2021, Intel Corporation */
 
 /*
  * util.c -- very basic utilities
@@ -19,6 +19,18 @@
 #include "valgrind_internal.h"
 #include "alloc.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__amd64__))
+#define CHECKSUM_X86_64 1
+#include <immintrin.h>
+#ifndef AVX512F_AVAILABLE
+#define AVX512F_AVAILABLE 1
+#endif
+#elif defined(__aarch64__) && defined(__ARM_NEON) &&\
+	__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define CHECKSUM_NEON 1
+#include <arm_neon.h>
+#endif
+
 /* library-wide page size */
 unsigned long long Pagesize;
 
@@ -123,6 +135,179 @@ util_is_zeroed(const void *addr, size_t len)
 	return 0;
 }
 
+/*
+ * checksum_words_fn -- advances the Fletcher64-like checksum, kept in the
+ *	*lo and *hi halves, by the given number of 32-bit words
+ */
+typedef void (*checksum_words_fn)(const uint32_t *p32, size_t nwords,
+		uint32_t *lo, uint32_t *hi);
+
+/*
+ * checksum_words_generic -- (internal) the scalar checksum kernel
+ */
+static void
+checksum_words_generic(const uint32_t *p32, size_t nwords,
+		uint32_t *lo, uint32_t *hi)
+{
+	uint32_t lo32 = *lo;
+	uint32_t hi32 = *hi;
+
+	for (size_t i = 0; i < nwords; ++i) {
+		lo32 += le32toh(p32[i]);
+		hi32 += lo32;
+	}
+
+	*lo = lo32;
+	*hi = hi32;
+}
+
+#if defined(CHECKSUM_X86_64) || defined(CHECKSUM_NEON)
+/*
+ * checksum_words_merge -- (internal) merges the per-lane sums of a vector
+ *	kernel that consumed nvec vectors of nlanes words into the checksum
+ *
+ * Lane l of the vector number j holds the word number i = j * nlanes + l,
+ * which is counted n - i times into hi, where n = nvec * nlanes. Each lane
+ * accumulates a[l], the sum of its words, and b[l], the sum of its words
+ * weighted by nvec - j, so the weight of the word is nlanes * (nvec - j) - l.
+ */
+static void
+checksum_words_merge(const uint32_t *a, const uint32_t *b, unsigned nlanes,
+		size_t nvec, uint32_t *lo, uint32_t *hi)
+{
+	uint32_t sum = 0;
+	uint32_t wsum = 0;
+
+	for (unsigned l = 0; l < nlanes; ++l) {
+		sum += a[l];
+		wsum += nlanes * b[l] - l * a[l];
+	}
+
+	*hi += (uint32_t)(nvec * nlanes) * *lo + wsum;
+	*lo += sum;
+}
+#endif
+
+#ifdef CHECKSUM_X86_64
+/*
+ * checksum_words_avx2 -- (internal) the AVX2 checksum kernel
+ */
+__attribute__((target("avx2")))
+static void
+checksum_words_avx2(const uint32_t *p32, size_t nwords,
+		uint32_t *lo, uint32_t *hi)
+{
+	size_t nvec = nwords / 8;
+	__m256i a = _mm256_setzero_si256();
+	__m256i b = _mm256_setzero_si256();
+
+	for (size_t i = 0; i < nvec; ++i) {
+		__m256i w = _mm256_loadu_si256((const __m256i *)p32 + i);
+		a = _mm256_add_epi32(a, w);
+		b = _mm256_add_epi32(b, a);
+	}
+
+	uint32_t la[8];
+	uint32_t lb[8];
+	_mm256_storeu_si256((__m256i *)la, a);
+	_mm256_storeu_si256((__m256i *)lb, b);
+	checksum_words_merge(la, lb, 8, nvec, lo, hi);
+
+	checksum_words_generic(p32 + nvec * 8, nwords % 8, lo, hi);
+}
+
+#if AVX512F_AVAILABLE
+/*
+ * checksum_words_avx512f -- (internal) the AVX-512 checksum kernel
+ */
+__attribute__((target("avx512f")))
+static void
+checksum_words_avx512f(const uint32_t *p32, size_t nwords,
+		uint32_t *lo, uint32_t *hi)
+{
+	size_t nvec = nwords / 16;
+	__m512i a = _mm512_setzero_si512();
+	__m512i b = _mm512_setzero_si512();
+
+	for (size_t i = 0; i < nvec; ++i) {
+		__m512i w = _mm512_loadu_si512((const __m512i *)p32 + i);
+		a = _mm512_add_epi32(a, w);
+		b = _mm512_add_epi32(b, a);
+	}
+
+	uint32_t la[16];
+	uint32_t lb[16];
+	_mm512_storeu_si512((__m512i *)la, a);
+	_mm512_storeu_si512((__m512i *)lb, b);
+	checksum_words_merge(la, lb, 16, nvec, lo, hi);
+
+	checksum_words_generic(p32 + nvec * 16, nwords % 16, lo, hi);
+}
+#endif
+#endif
+
+#ifdef CHECKSUM_NEON
+/*
+ * checksum_words_neon -- (internal) the NEON checksum kernel
+ */
+static void
+checksum_words_neon(const uint32_t *p32, size_t nwords,
+		uint32_t *lo, uint32_t *hi)
+{
+	size_t nvec = nwords / 4;
+	uint32x4_t a = vdupq_n_u32(0);
+	uint32x4_t b = vdupq_n_u32(0);
+
+	for (size_t i = 0; i < nvec; ++i) {
+		uint32x4_t w = vld1q_u32(p32 + i * 4);
+		a = vaddq_u32(a, w);
+		b = vaddq_u32(b, a);
+	}
+
+	uint32_t la[4];
+	uint32_t lb[4];
+	vst1q_u32(la, a);
+	vst1q_u32(lb, b);
+	checksum_words_merge(la, lb, 4, nvec, lo, hi);
+
+	checksum_words_generic(p32 + nvec * 4, nwords % 4, lo, hi);
+}
+#endif
+
+static checksum_words_fn Checksum_words = checksum_words_generic;
+
+/*
+ * util_checksum_init -- (internal) selects the fastest checksum kernel
+ *	supported by the cpu
+ *
+ * The AVX kernels can be disabled with the same PMEM_AVX and PMEM_AVX512F
+ * environment variables that control the memcpy/memset variants of libpmem2.
+ */
+static void
+util_checksum_init(void)
+{
+#if defined(CHECKSUM_X86_64)
+	__builtin_cpu_init();
+
+	char *e;
+#if AVX512F_AVAILABLE
+	e = os_getenv("PMEM_AVX512F");
+	int avx512f = e == NULL || strcmp(e, "0") != 0;
+	if (avx512f && __builtin_cpu_supports("avx512f")) {
+		Checksum_words = checksum_words_avx512f;
+		return;
+	}
+#endif
+
+	e = os_getenv("PMEM_AVX");
+	int avx = e == NULL || strcmp(e, "0") != 0;
+	if (avx && __builtin_cpu_supports("avx2"))
+		Checksum_words = checksum_words_avx2;
+#elif defined(CHECKSUM_NEON)
+	Checksum_words = checksum_words_neon;
+#endif
+}
+
 /*
  * util_checksum_compute -- compute Fletcher64-like checksum
  *
@@ -136,31 +321,40 @@ util_checksum_compute(void *addr, size_t len, uint64_t *csump, size_t skip_off)
 	if (len % 4 != 0)
 		abort();
 
-	uint32_t *p32 = addr;
-	uint32_t *p32end = (uint32_t *)((char *)addr + len);
-	uint32_t *skip;
+	const uint32_t *p32 = addr;
+	size_t nwords = len / 4;
 	uint32_t lo32 = 0;
 	uint32_t hi32 = 0;
 
-	if (skip_off)
-		skip = (uint32_t *)((char *)addr + skip_off);
-	else
-		skip = (uint32_t *)((char *)addr + len);
-
-	while (p32 < p32end)
-		if (p32 == (uint32_t *)csump || p32 >= skip) {
-			/* lo32 += 0; treat first 32-bits as zero */
-			p32++;
-			hi32 += lo32;
-			/* lo32 += 0; treat second 32-bits as zero */
-			p32++;
-			hi32 += lo32;
-		} else {
-			lo32 += le32toh(*p32);
-			++p32;
-			hi32 += lo32;
+	/*
+	 * The checksum and everything from skip_off onwards is treated as
+	 * pairs of zeroed words, even if the skipped part has an odd length.
+	 */
+	size_t skip = skip_off ? (skip_off + 3) / 4 : nwords;
+	size_t csum_off = (size_t)((char *)csump - (char *)addr);
+	size_t csum = csum_off % 4 == 0 ? csum_off / 4 : SIZE_MAX;
+
+	size_t i = 0;
+	while (i < nwords) {
+		if (i >= skip) {
+			hi32 += (uint32_t)((nwords - i + 1) / 2 * 2) * lo32;
+			break;
 		}
 
+		if (i == csum) {
+			hi32 += 2 * lo32;
+			i += 2;
+			continue;
+		}
+
+		size_t end = MIN(skip, nwords);
+		if (csum > i && csum < end)
+			end = csum;
+
+		Checksum_words(p32 + i, end - i, &lo32, &hi32);
+		i = end;
+	}
+
 	return (uint64_t)hi32 << 32 | lo32;
 }
 
@@ -198,15 +392,9 @@ util_checksum_seq(const void *addr, size_t len, uint64_t csum)
 {
 	if (len % 4 != 0)
 		abort();
-	const uint32_t *p32 = addr;
-	const uint32_t *p32end = (const uint32_t *)((const char *)addr + len);
 	uint32_t lo32 = (uint32_t)csum;
 	uint32_t hi32 = (uint32_t)(csum >> 32);
-	while (p32 < p32end) {
-		lo32 += le32toh(*p32);
-		++p32;
-		hi32 += lo32;
-	}
+	Checksum_words(addr, len / 4, &lo32, &hi32);
 	return (uint64_t)hi32 << 32 | lo32;
 }
 
@@ -312,6 +500,8 @@ util_init(void)
 	_On_valgrind = RUNNING_ON_VALGRIND;
 #endif
 
+	util_checksum_init();
+
 #if VG_MEMCHECK_ENABLED
 	if (_On_valgrind) {
 		unsigned tmp;
@@ -71,6 +71,7 @@ extern "C" {
 #define PMEM2_E_VM_RESERVATION_NOT_EMPTY	(-100033)
 #define PMEM2_E_MAP_EXISTS			(-100034)
 #define PMEM2_E_FILE_DESCRIPTOR_NOT_SET		(-100035)
+#define PMEM2_E_INVALID_MOVNT_OP		(-100036)
 
 /* source setup */
 
@@ -166,6 +167,14 @@ int pmem2_config_set_protection(struct pmem2_config *cfg,
 int pmem2_config_set_vm_reservation(struct pmem2_config *cfg,
 		struct pmem2_vm_reservation *rsv, size_t offset);
 
+enum pmem2_movnt_op {
+	PMEM2_MOVNT_MEMMOVE,
+	PMEM2_MOVNT_MEMSET,
+};
+
+int pmem2_config_set_movnt_threshold(struct pmem2_config *cfg,
+		enum pmem2_movnt_op op, size_t threshold);
+
 /* mapping */
 
 struct pmem2_map;
@@ -184,6 +193,9 @@ size_t pmem2_map_get_size(struct pmem2_map *map);
 
 enum pmem2_granularity pmem2_map_get_store_granularity(struct pmem2_map *map);
 
+int pmem2_map_get_movnt_threshold(struct pmem2_map *map,
+		enum pmem2_movnt_op op, size_t *threshold);
+
 /* flushing */
 
 typedef void (*pmem2_persist_fn)(const void *ptr, size_t size);
@@ -192,8 +204,18 @@ typedef void (*pmem2_flush_fn)(const void *ptr, size_t size);
 
 typedef void (*pmem2_drain_fn)(void);
 
+struct pmem2_range {
+	const void *ptr;
+	size_t size;
+};
+
+typedef void (*pmem2_persistv_fn)(const struct pmem2_range *ranges,
+		size_t nranges);
+
 pmem2_persist_fn pmem2_get_persist_fn(struct pmem2_map *map);
 
+pmem2_persistv_fn pmem2_get_persistv_fn(struct pmem2_map *map);
+
 pmem2_flush_fn pmem2_get_flush_fn(struct pmem2_map *map);
 
 pmem2_drain_fn pmem2_get_drain_fn(struct pmem2_map *map);
@@ -230,6 +252,24 @@ pmem2_memcpy_fn pmem2_get_memcpy_fn(struct pmem2_map *map);
 
 pmem2_memset_fn pmem2_get_memset_fn(struct pmem2_map *map);
 
+/* asynchronous operations */
+
+struct pmem2_future;
+
+enum pmem2_future_state {
+	PMEM2_FUTURE_STATE_RUNNING,
+	PMEM2_FUTURE_STATE_COMPLETE,
+};
+
+int pmem2_memcpy_async(struct pmem2_future **future, struct pmem2_map *map,
+		void *pmemdest, const void *src, size_t len, unsigned flags);
+
+enum pmem2_future_state pmem2_future_poll(struct pmem2_future *future);
+
+void pmem2_future_wait(struct pmem2_future *future);
+
+int pmem2_future_delete(struct pmem2_future **future);
+
 /* RAS */
 
 int pmem2_deep_flush(struct pmem2_map *map, void *ptr, size_t size);
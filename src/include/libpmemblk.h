@@ -1,5 +1,5 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
-/* Copyright 2014-2020, Intel Corporation */
+/* Copyright 2014-2021, Intel Corporation */
 
 /*
  * libpmemblk.h -- definitions of libpmemblk entry points
@@ -39,6 +39,8 @@
 #define pmemblk_ctl_exec pmemblk_ctl_execU
 #endif
 
+#else
+#include <sys/uio.h>
 #endif
 
 #ifdef __cplusplus
@@ -123,6 +125,13 @@ size_t pmemblk_bsize(PMEMblkpool *pbp);
 size_t pmemblk_nblock(PMEMblkpool *pbp);
 int pmemblk_read(PMEMblkpool *pbp, void *buf, long long blockno);
 int pmemblk_write(PMEMblkpool *pbp, const void *buf, long long blockno);
+int pmemblk_readv(PMEMblkpool *pbp, const struct iovec *iov, int iovcnt,
+		long long blockno);
+int pmemblk_writev(PMEMblkpool *pbp, const struct iovec *iov, int iovcnt,
+		long long blockno);
+int pmemblk_read_direct(PMEMblkpool *pbp, const void **addrp, unsigned *refp,
+		long long blockno);
+void pmemblk_read_direct_release(PMEMblkpool *pbp, unsigned ref);
 int pmemblk_set_zero(PMEMblkpool *pbp, long long blockno);
 int pmemblk_set_error(PMEMblkpool *pbp, long long blockno);
 
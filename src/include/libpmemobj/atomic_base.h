@@ -1,5 +1,5 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
-/* Copyright 2014-2020, Intel Corporation */
+/* Copyright 2014-2021, Intel Corporation */
 
 /*
  * libpmemobj/atomic_base.h -- definitions of libpmemobj atomic entry points
@@ -24,6 +24,10 @@ extern "C" {
 #define POBJ_XALLOC_VALID_FLAGS	(POBJ_XALLOC_ZERO |\
 	POBJ_XALLOC_CLASS_MASK)
 
+#define POBJ_XALLOC_BATCH_VALID_FLAGS	(POBJ_XALLOC_ZERO |\
+	POBJ_XALLOC_CLASS_MASK |\
+	POBJ_XALLOC_ARENA_MASK)
+
 /*
  * Allocates a new object from the pool and calls a constructor function before
  * returning. It is guaranteed that allocated object is either properly
@@ -40,6 +44,13 @@ int pmemobj_xalloc(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
 	uint64_t type_num, uint64_t flags,
 	pmemobj_constr constructor, void *arg);
 
+/*
+ * Allocates with flags oidcnt new objects of the same size and type from
+ * the pool. Either all of the objects are allocated or none.
+ */
+int pmemobj_xalloc_batch(PMEMobjpool *pop, PMEMoid *oidv, size_t oidcnt,
+	size_t size, uint64_t type_num, uint64_t flags);
+
 /*
  * Allocates a new zeroed object from the pool.
  */
@@ -1,5 +1,5 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
-/* Copyright 2014-2020, Intel Corporation */
+/* Copyright 2014-2021, Intel Corporation */
 
 /*
  * libpmemobj/base.h -- definitions of base libpmemobj entry points
@@ -47,6 +47,7 @@ typedef struct pmemobjpool PMEMobjpool;
 #define POBJ_FLAG_NO_SNAPSHOT		(((uint64_t)1) << 2)
 #define POBJ_FLAG_ASSUME_INITIALIZED	(((uint64_t)1) << 3)
 #define POBJ_FLAG_TX_NO_ABORT		(((uint64_t)1) << 4)
+#define POBJ_FLAG_DEFERRED		(((uint64_t)1) << 5)
 
 #define POBJ_CLASS_ID(id)	(((uint64_t)(id)) << 48)
 #define POBJ_ARENA_ID(id)	(((uint64_t)(id)) << 32)
@@ -144,6 +144,18 @@ enum pobj_stats_enabled {
 	POBJ_STATS_DISABLED,
 };
 
+#define POBJ_STATS_LATENCY_BUCKETS 32
+
+/*
+ * Log-scale histogram of operation latencies. The n-th bucket counts the
+ * operations which took from 2^n to 2^(n+1) - 1 nanoseconds, the first one
+ * also includes operations shorter than 1 nanosecond and the last one all
+ * the operations longer than its lower bound.
+ */
+struct pobj_stats_latency {
+	uint64_t buckets[POBJ_STATS_LATENCY_BUCKETS];
+};
+
 enum pobj_arenas_assignment_type {
 	POBJ_ARENAS_ASSIGNMENT_THREAD_KEY,
 	POBJ_ARENAS_ASSIGNMENT_GLOBAL,
@@ -1,5 +1,5 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
-/* Copyright 2014-2020, Intel Corporation */
+/* Copyright 2014-2021, Intel Corporation */
 
 /*
  * libpmemobj/tx_base.h -- definitions of libpmemobj transactional entry points
@@ -107,10 +107,12 @@ typedef void (*pmemobj_tx_callback)(PMEMobjpool *pop, enum pobj_tx_stage stage,
 #define POBJ_XADD_NO_SNAPSHOT		POBJ_FLAG_NO_SNAPSHOT
 #define POBJ_XADD_ASSUME_INITIALIZED	POBJ_FLAG_ASSUME_INITIALIZED
 #define POBJ_XADD_NO_ABORT		POBJ_FLAG_TX_NO_ABORT
+#define POBJ_XADD_DEFERRED		POBJ_FLAG_DEFERRED
 #define POBJ_XADD_VALID_FLAGS	(POBJ_XADD_NO_FLUSH |\
 	POBJ_XADD_NO_SNAPSHOT |\
 	POBJ_XADD_ASSUME_INITIALIZED |\
-	POBJ_XADD_NO_ABORT)
+	POBJ_XADD_NO_ABORT |\
+	POBJ_XADD_DEFERRED)
 
 #define POBJ_XLOCK_NO_ABORT		POBJ_FLAG_TX_NO_ABORT
 #define POBJ_XLOCK_VALID_FLAGS	(POBJ_XLOCK_NO_ABORT)
@@ -227,6 +229,8 @@ int pmemobj_tx_add_range_direct(const void *ptr, size_t size);
  *  - POBJ_XADD_ASSUME_INITIALIZED - added range is assumed to be initialized
  *  - POBJ_XADD_NO_ABORT - if the function does not end successfully,
  *  do not abort the transaction and return the error number.
+ *  - POBJ_XADD_DEFERRED - the snapshot of the range is deferred, only the
+ *  cache lines passed to pmemobj_tx_touch_range are snapshotted
  */
 int pmemobj_tx_xadd_range(PMEMoid oid, uint64_t off, size_t size,
 		uint64_t flags);
@@ -239,9 +243,31 @@ int pmemobj_tx_xadd_range(PMEMoid oid, uint64_t off, size_t size,
  *  - POBJ_XADD_ASSUME_INITIALIZED - added range is assumed to be initialized
  *  - POBJ_XADD_NO_ABORT - if the function does not end successfully,
  *  do not abort the transaction and return the error number.
+ *  - POBJ_XADD_DEFERRED - the snapshot of the range is deferred, only the
+ *  cache lines passed to pmemobj_tx_touch_range are snapshotted
  */
 int pmemobj_tx_xadd_range_direct(const void *ptr, size_t size, uint64_t flags);
 
+/*
+ * Snapshots the cache lines of the given memory block which belong to a range
+ * added with POBJ_XADD_DEFERRED and were not touched before in the
+ * transaction. The application is then free to directly modify the object in
+ * that memory range. If the block is not within a single deferred range, the
+ * whole block is snapshotted, just like in pmemobj_tx_add_range.
+ *
+ * If successful, returns zero.
+ * Otherwise, stage changes to TX_STAGE_ONABORT and an error number is returned.
+ *
+ * This function must be called during TX_STAGE_WORK.
+ */
+int pmemobj_tx_touch_range(PMEMoid oid, uint64_t off, size_t size);
+
+/*
+ * Behaves exactly the same as pmemobj_tx_touch_range with the exception that
+ * it operates on virtual memory addresses.
+ */
+int pmemobj_tx_touch_range_direct(const void *ptr, size_t size);
+
 /*
  * Transactionally allocates a new object.
  *
@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2014-2020, Intel Corporation */
+/* Copyright 2014-2021, Intel Corporation */
 
 /*
  * pmem.c -- pmem entry points for libpmem
@@ -160,6 +160,8 @@ struct pmem_funcs {
 	flush_func deep_flush;
 	flush_func flush;
 	fence_func fence;
+
+	size_t movnt_threshold;
 };
 
 static struct pmem_funcs Funcs;
@@ -603,7 +605,7 @@ pmem_memmove(void *pmemdest, const void *src, size_t len, unsigned flags)
 #endif
 	PMEM_API_START();
 	Funcs.memmove_nodrain(pmemdest, src, len, flags & ~PMEM_F_MEM_NODRAIN,
-			Funcs.flush);
+			Funcs.flush, Funcs.movnt_threshold);
 
 	if ((flags & (PMEM_F_MEM_NODRAIN | PMEM_F_MEM_NOFLUSH)) == 0)
 		pmem_drain();
@@ -627,7 +629,7 @@ pmem_memcpy(void *pmemdest, const void *src, size_t len, unsigned flags)
 #endif
 	PMEM_API_START();
 	Funcs.memmove_nodrain(pmemdest, src, len, flags & ~PMEM_F_MEM_NODRAIN,
-			Funcs.flush);
+			Funcs.flush, Funcs.movnt_threshold);
 
 	if ((flags & (PMEM_F_MEM_NODRAIN | PMEM_F_MEM_NOFLUSH)) == 0)
 		pmem_drain();
@@ -652,7 +654,7 @@ pmem_memset(void *pmemdest, int c, size_t len, unsigned flags)
 
 	PMEM_API_START();
 	Funcs.memset_nodrain(pmemdest, c, len, flags & ~PMEM_F_MEM_NODRAIN,
-			Funcs.flush);
+			Funcs.flush, Funcs.movnt_threshold);
 
 	if ((flags & (PMEM_F_MEM_NODRAIN | PMEM_F_MEM_NOFLUSH)) == 0)
 		pmem_drain();
@@ -671,7 +673,8 @@ pmem_memmove_nodrain(void *pmemdest, const void *src, size_t len)
 
 	PMEM_API_START();
 
-	Funcs.memmove_nodrain(pmemdest, src, len, 0, Funcs.flush);
+	Funcs.memmove_nodrain(pmemdest, src, len, 0, Funcs.flush,
+			Funcs.movnt_threshold);
 
 	PMEM_API_END();
 	return pmemdest;
@@ -687,7 +690,8 @@ pmem_memcpy_nodrain(void *pmemdest, const void *src, size_t len)
 
 	PMEM_API_START();
 
-	Funcs.memmove_nodrain(pmemdest, src, len, 0, Funcs.flush);
+	Funcs.memmove_nodrain(pmemdest, src, len, 0, Funcs.flush,
+			Funcs.movnt_threshold);
 
 	PMEM_API_END();
 	return pmemdest;
@@ -703,7 +707,8 @@ pmem_memmove_persist(void *pmemdest, const void *src, size_t len)
 
 	PMEM_API_START();
 
-	Funcs.memmove_nodrain(pmemdest, src, len, 0, Funcs.flush);
+	Funcs.memmove_nodrain(pmemdest, src, len, 0, Funcs.flush,
+			Funcs.movnt_threshold);
 	pmem_drain();
 
 	PMEM_API_END();
@@ -720,7 +725,8 @@ pmem_memcpy_persist(void *pmemdest, const void *src, size_t len)
 
 	PMEM_API_START();
 
-	Funcs.memmove_nodrain(pmemdest, src, len, 0, Funcs.flush);
+	Funcs.memmove_nodrain(pmemdest, src, len, 0, Funcs.flush,
+			Funcs.movnt_threshold);
 	pmem_drain();
 
 	PMEM_API_END();
@@ -737,7 +743,8 @@ pmem_memset_nodrain(void *pmemdest, int c, size_t len)
 
 	PMEM_API_START();
 
-	Funcs.memset_nodrain(pmemdest, c, len, 0, Funcs.flush);
+	Funcs.memset_nodrain(pmemdest, c, len, 0, Funcs.flush,
+			Funcs.movnt_threshold);
 
 	PMEM_API_END();
 	return pmemdest;
@@ -753,7 +760,8 @@ pmem_memset_persist(void *pmemdest, int c, size_t len)
 
 	PMEM_API_START();
 
-	Funcs.memset_nodrain(pmemdest, c, len, 0, Funcs.flush);
+	Funcs.memset_nodrain(pmemdest, c, len, 0, Funcs.flush,
+			Funcs.movnt_threshold);
 	pmem_drain();
 
 	PMEM_API_END();
@@ -765,7 +773,7 @@ pmem_memset_persist(void *pmemdest, int c, size_t len)
  */
 static void *
 memmove_nodrain_libc(void *pmemdest, const void *src, size_t len,
-		unsigned flags, flush_func flush)
+		unsigned flags, flush_func flush, size_t movnt_threshold)
 {
 	LOG(15, "pmemdest %p src %p len %zu flags 0x%x", pmemdest, src, len,
 			flags);
@@ -783,7 +791,7 @@ memmove_nodrain_libc(void *pmemdest, const void *src, size_t len,
  */
 static void *
 memset_nodrain_libc(void *pmemdest, int c, size_t len, unsigned flags,
-		flush_func flush)
+		flush_func flush, size_t movnt_threshold)
 {
 	LOG(15, "pmemdest %p c 0x%x len %zu flags 0x%x", pmemdest, c, len,
 			flags);
@@ -832,9 +840,12 @@ pmem_init(void)
 	info.flush = NULL;
 	info.fence = NULL;
 	info.flush_has_builtin_fence = 0;
+	info.movnt_threshold = SIZE_MAX;
 
 	pmem2_arch_init(&info);
 
+	Funcs.movnt_threshold = info.movnt_threshold;
+
 	int flush;
 	char *e = os_getenv("PMEM_NO_FLUSH");
 	if (e && (strcmp(e, "1") == 0)) {
@@ -861,8 +872,6 @@ pmem_init(void)
 		else
 			Funcs.fence = info.fence;
 	} else {
-		Funcs.memmove_nodrain = info.memmove_nodrain_eadr;
-		Funcs.memset_nodrain = info.memset_nodrain_eadr;
 		Funcs.flush = flush_empty;
 		Funcs.fence = info.fence;
 	}
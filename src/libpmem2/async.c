@@ -0,0 +1,406 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * async.c -- pmem2_memcpy_async and pmem2_future_*
+ *
+ * Asynchronous copies are split into chunks which are processed by a pool
+ * of worker threads, started on the first submission. Every chunk is copied
+ * with the memcpy function of the mapping, so it uses the same non-temporal
+ * kernels and the same flushing as the synchronous copy, and is drained by
+ * the thread which copied it. The future becomes complete once all of its
+ * chunks are durable.
+ *
+ * The worker threads are not inherited by a child process, so the child
+ * starts its own on its first submission. The copies submitted by
+ * the parent are not continued in the child.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "libpmem2.h"
+#include "alloc.h"
+#include "async.h"
+#include "map.h"
+#include "os.h"
+#include "os_thread.h"
+#include "out.h"
+#include "pmem2_utils.h"
+#include "sys_util.h"
+#include "util.h"
+
+/* the size of a chunk claimed at once by a worker thread */
+#define ASYNC_CHUNK_SIZE ((size_t)(2 << 20)) /* 2 MiB */
+
+/* copies shorter than this are done synchronously by the caller */
+#define ASYNC_MIN_SIZE ((size_t)(64 << 10)) /* 64 KiB */
+
+/* the default maximum number of worker threads */
+#define ASYNC_THREADS_DEFAULT_MAX 4
+
+struct pmem2_future {
+	pmem2_memcpy_fn memcpy_fn;
+	char *dest;
+	const char *src;
+	size_t len;
+	unsigned flags;
+
+	uint64_t nchunks;
+	uint64_t next_chunk;	/* protected by the pool lock */
+	uint64_t done_chunks;	/* modified under the future lock */
+
+	os_mutex_t lock;
+	os_cond_t cond;
+
+	struct pmem2_future *next; /* in the submission queue */
+};
+
+static struct {
+	os_mutex_t lock;
+	os_cond_t cond;
+
+	/* futures which still have chunks to be claimed */
+	struct pmem2_future *head;
+	struct pmem2_future *tail;
+
+	os_thread_t *threads;
+	unsigned nthreads;
+	int started;
+	int stop;
+} Pool;
+
+/*
+ * async_nthreads -- (internal) returns the number of worker threads
+ */
+static unsigned
+async_nthreads(void)
+{
+	char *env = os_getenv(PMEM2_ASYNC_THREADS_ENV_VARIABLE);
+	if (env != NULL) {
+		char *endptr;
+		errno = 0;
+		long nthreads = strtol(env, &endptr, 10);
+		if (errno == 0 && *endptr == '\0' && nthreads > 0 &&
+				nthreads <= UINT16_MAX)
+			return (unsigned)nthreads;
+
+		LOG(2, "invalid value of %s variable: %s, using the default",
+			PMEM2_ASYNC_THREADS_ENV_VARIABLE, env);
+	}
+
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpus <= 0)
+		return 1;
+
+	return (unsigned)MIN(ncpus, ASYNC_THREADS_DEFAULT_MAX);
+}
+
+/*
+ * async_copy_chunk -- (internal) copies one chunk of the future and marks
+ * it as done
+ */
+static void
+async_copy_chunk(struct pmem2_future *future, uint64_t chunk)
+{
+	size_t off = chunk * ASYNC_CHUNK_SIZE;
+	size_t len = MIN(ASYNC_CHUNK_SIZE, future->len - off);
+
+	future->memcpy_fn(future->dest + off, future->src + off, len,
+			future->flags);
+
+	util_mutex_lock(&future->lock);
+	uint64_t done = future->done_chunks + 1;
+	util_atomic_store_explicit64(&future->done_chunks, done,
+			memory_order_release);
+	if (done == future->nchunks)
+		os_cond_broadcast(&future->cond);
+	util_mutex_unlock(&future->lock);
+}
+
+/*
+ * async_worker -- (internal) worker thread routine
+ */
+static void *
+async_worker(void *arg)
+{
+	util_mutex_lock(&Pool.lock);
+	while (1) {
+		while (Pool.head == NULL && !Pool.stop)
+			os_cond_wait(&Pool.cond, &Pool.lock);
+
+		/* the queue is drained before the pool is stopped */
+		if (Pool.head == NULL)
+			break;
+
+		struct pmem2_future *future = Pool.head;
+		uint64_t chunk = future->next_chunk++;
+		if (future->next_chunk == future->nchunks) {
+			Pool.head = future->next;
+			if (Pool.head == NULL)
+				Pool.tail = NULL;
+		}
+		util_mutex_unlock(&Pool.lock);
+
+		async_copy_chunk(future, chunk);
+
+		util_mutex_lock(&Pool.lock);
+	}
+	util_mutex_unlock(&Pool.lock);
+
+	return NULL;
+}
+
+/*
+ * async_pool_start -- (internal) starts the worker threads, must be called
+ * with the pool lock held
+ *
+ * If none of the threads can be started, the copies are done synchronously.
+ */
+static void
+async_pool_start(void)
+{
+	Pool.started = 1;
+
+	unsigned nthreads = async_nthreads();
+	Pool.threads = Malloc(nthreads * sizeof(*Pool.threads));
+	if (Pool.threads == NULL) {
+		LOG(1, "!cannot allocate worker threads");
+		return;
+	}
+
+	for (unsigned i = 0; i < nthreads; ++i) {
+		errno = os_thread_create(&Pool.threads[i], NULL,
+				async_worker, NULL);
+		if (errno) {
+			LOG(1, "!cannot create worker thread");
+			break;
+		}
+		Pool.nthreads++;
+	}
+
+	LOG(3, "started %u asynchronous copy threads", Pool.nthreads);
+}
+
+#ifndef _WIN32
+/*
+ * async_atfork_prepare -- (internal) makes sure the pool isn't modified
+ * while the process is being forked
+ */
+static void
+async_atfork_prepare(void)
+{
+	util_mutex_lock(&Pool.lock);
+}
+
+/*
+ * async_atfork_parent -- (internal) unlocks the pool after fork
+ */
+static void
+async_atfork_parent(void)
+{
+	util_mutex_unlock(&Pool.lock);
+}
+
+/*
+ * async_atfork_child -- (internal) resets the pool in the child process,
+ * which has none of the worker threads of the parent
+ */
+static void
+async_atfork_child(void)
+{
+	Free(Pool.threads);
+	Pool.threads = NULL;
+	Pool.nthreads = 0;
+	Pool.started = 0;
+	Pool.stop = 0;
+	Pool.head = NULL;
+	Pool.tail = NULL;
+
+	/*
+	 * The parent's workers might have been waiting on these, which is
+	 * still accounted for in them.
+	 */
+	if (os_cond_init(&Pool.cond))
+		abort();
+
+	util_mutex_init(&Pool.lock);
+}
+#endif
+
+/*
+ * pmem2_async_init -- initialize the asynchronous copy module
+ */
+void
+pmem2_async_init(void)
+{
+	util_mutex_init(&Pool.lock);
+	if (os_cond_init(&Pool.cond))
+		abort();
+
+#ifndef _WIN32
+	if (os_thread_atfork(async_atfork_prepare, async_atfork_parent,
+			async_atfork_child))
+		abort();
+#endif
+}
+
+/*
+ * pmem2_async_fini -- stop the worker threads
+ *
+ * The workers finish the pending copies before they exit. On Windows this is
+ * called with the loader lock held, which the exiting threads need as well,
+ * so there they are only told to stop and are not waited for, and the pool
+ * lock and condition variable are never destroyed.
+ */
+void
+pmem2_async_fini(void)
+{
+	util_mutex_lock(&Pool.lock);
+	Pool.stop = 1;
+	os_cond_broadcast(&Pool.cond);
+	util_mutex_unlock(&Pool.lock);
+
+#ifndef _WIN32
+	for (unsigned i = 0; i < Pool.nthreads; ++i) {
+		errno = os_thread_join(&Pool.threads[i], NULL);
+		if (errno)
+			LOG(1, "!cannot join worker thread");
+	}
+
+	Free(Pool.threads);
+	Pool.threads = NULL;
+	Pool.nthreads = 0;
+
+	os_cond_destroy(&Pool.cond);
+	util_mutex_destroy(&Pool.lock);
+#endif
+}
+
+/*
+ * pmem2_memcpy_async -- submit an asynchronous memcpy to the mapping
+ */
+int
+pmem2_memcpy_async(struct pmem2_future **future, struct pmem2_map *map,
+		void *pmemdest, const void *src, size_t len, unsigned flags)
+{
+	LOG(3, "future %p map %p pmemdest %p src %p len %zu flags 0x%x",
+			future, map, pmemdest, src, len, flags);
+	PMEM2_ERR_CLR();
+
+	*future = NULL;
+
+	int ret;
+	struct pmem2_future *f = pmem2_malloc(sizeof(*f), &ret);
+	if (f == NULL)
+		return ret;
+
+	f->memcpy_fn = map->memcpy_fn;
+	f->dest = pmemdest;
+	f->src = src;
+	f->len = len;
+	/* stores have to be drained by the threads which issued them */
+	f->flags = flags & ~PMEM2_F_MEM_NODRAIN;
+	f->nchunks = (len + ASYNC_CHUNK_SIZE - 1) / ASYNC_CHUNK_SIZE;
+	f->next_chunk = 0;
+	f->done_chunks = 0;
+	f->next = NULL;
+
+	util_mutex_init(&f->lock);
+	if ((errno = os_cond_init(&f->cond)) != 0) {
+		ERR("!os_cond_init");
+		ret = PMEM2_E_ERRNO;
+		util_mutex_destroy(&f->lock);
+		Free(f);
+		return ret;
+	}
+
+	*future = f;
+
+	if (len == 0)
+		return 0;
+
+	if (len >= ASYNC_MIN_SIZE) {
+		util_mutex_lock(&Pool.lock);
+		if (!Pool.started)
+			async_pool_start();
+
+		if (Pool.nthreads > 0 && !Pool.stop) {
+			if (Pool.tail)
+				Pool.tail->next = f;
+			else
+				Pool.head = f;
+			Pool.tail = f;
+			os_cond_broadcast(&Pool.cond);
+			util_mutex_unlock(&Pool.lock);
+
+			return 0;
+		}
+		util_mutex_unlock(&Pool.lock);
+	}
+
+	/* not worth handing off, or there are no workers */
+	for (uint64_t chunk = 0; chunk < f->nchunks; ++chunk) {
+		f->next_chunk++;
+		async_copy_chunk(f, chunk);
+	}
+
+	return 0;
+}
+
+/*
+ * pmem2_future_poll -- check whether the operation has completed
+ */
+enum pmem2_future_state
+pmem2_future_poll(struct pmem2_future *future)
+{
+	LOG(15, "future %p", future);
+
+	uint64_t done;
+	util_atomic_load_explicit64(&future->done_chunks, &done,
+			memory_order_acquire);
+
+	return done == future->nchunks ? PMEM2_FUTURE_STATE_COMPLETE :
+			PMEM2_FUTURE_STATE_RUNNING;
+}
+
+/*
+ * pmem2_future_wait -- wait for the operation to complete
+ */
+void
+pmem2_future_wait(struct pmem2_future *future)
+{
+	LOG(3, "future %p", future);
+
+	util_mutex_lock(&future->lock);
+	while (future->done_chunks != future->nchunks)
+		os_cond_wait(&future->cond, &future->lock);
+	util_mutex_unlock(&future->lock);
+}
+
+/*
+ * pmem2_future_delete -- wait for the operation to complete and free
+ * the future
+ */
+int
+pmem2_future_delete(struct pmem2_future **future)
+{
+	LOG(3, "future %p", future);
+	PMEM2_ERR_CLR();
+
+	struct pmem2_future *f = *future;
+	if (f == NULL)
+		return 0;
+
+	/* also makes sure that no worker touches the future anymore */
+	pmem2_future_wait(f);
+
+	os_cond_destroy(&f->cond);
+	util_mutex_destroy(&f->lock);
+	Free(f);
+
+	*future = NULL;
+
+	return 0;
+}
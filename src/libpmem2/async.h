@@ -0,0 +1,23 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * async.h -- internal definitions for libpmem2 asynchronous copy module
+ */
+#ifndef PMEM2_ASYNC_H
+#define PMEM2_ASYNC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PMEM2_ASYNC_THREADS_ENV_VARIABLE "PMEM2_ASYNC_THREADS"
+
+void pmem2_async_init(void);
+void pmem2_async_fini(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -26,6 +26,10 @@ pmem2_config_init(struct pmem2_config *cfg)
 	cfg->protection_flag = PMEM2_PROT_READ | PMEM2_PROT_WRITE;
 	cfg->reserv = NULL;
 	cfg->reserv_offset = 0;
+	for (int i = 0; i < PMEM2_MOVNT_OPS; ++i) {
+		cfg->movnt_threshold[i] = 0;
+		cfg->movnt_threshold_set[i] = false;
+	}
 }
 
 /*
@@ -213,3 +217,28 @@ pmem2_config_set_protection(struct pmem2_config *cfg,
 	cfg->protection_flag = prot;
 	return 0;
 }
+
+/*
+ * pmem2_config_set_movnt_threshold -- set the length from which
+ * the mem[move|cpy|set] functions of the mapping use non-temporal stores
+ */
+int
+pmem2_config_set_movnt_threshold(struct pmem2_config *cfg,
+		enum pmem2_movnt_op op, size_t threshold)
+{
+	PMEM2_ERR_CLR();
+
+	switch (op) {
+		case PMEM2_MOVNT_MEMMOVE:
+		case PMEM2_MOVNT_MEMSET:
+			break;
+		default:
+			ERR("unknown non-temporal operation %d", op);
+			return PMEM2_E_INVALID_MOVNT_OP;
+	}
+
+	cfg->movnt_threshold[op] = threshold;
+	cfg->movnt_threshold_set[op] = true;
+
+	return 0;
+}
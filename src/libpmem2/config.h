@@ -1,5 +1,5 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
-/* Copyright 2019-2020, Intel Corporation */
+/* Copyright 2019-2021, Intel Corporation */
 
 /*
  * config.h -- internal definitions for pmem2_config
@@ -7,10 +7,12 @@
 #ifndef PMEM2_CONFIG_H
 #define PMEM2_CONFIG_H
 
+#include <stdbool.h>
 #include "libpmem2.h"
 
 #define PMEM2_GRANULARITY_INVALID ((enum pmem2_granularity) (-1))
 #define PMEM2_ADDRESS_ANY 0 /* default value of the address request type */
+#define PMEM2_MOVNT_OPS (PMEM2_MOVNT_MEMSET + 1)
 
 struct pmem2_config {
 	/* offset from the beginning of the file */
@@ -24,6 +26,9 @@ struct pmem2_config {
 	unsigned protection_flag;
 	struct pmem2_vm_reservation *reserv;
 	size_t reserv_offset;
+	/* non-temporal store thresholds requested by user */
+	size_t movnt_threshold[PMEM2_MOVNT_OPS];
+	bool movnt_threshold_set[PMEM2_MOVNT_OPS];
 };
 
 void pmem2_config_init(struct pmem2_config *cfg);
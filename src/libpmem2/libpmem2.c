@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2019-2020, Intel Corporation */
+/* Copyright 2019-2021, Intel Corporation */
 
 /*
  * libpmem2.c -- pmem2 library constructor & destructor
@@ -7,6 +7,7 @@
 
 #include "libpmem2.h"
 
+#include "async.h"
 #include "map.h"
 #include "out.h"
 #include "persist.h"
@@ -30,6 +31,7 @@ libpmem2_init(void)
 
 	pmem2_map_init();
 	pmem2_persist_init();
+	pmem2_async_init();
 }
 
 /*
@@ -43,6 +45,7 @@ libpmem2_fini(void)
 {
 	LOG(3, NULL);
 
+	pmem2_async_fini();
 	pmem2_map_fini();
 	out_fini();
 }
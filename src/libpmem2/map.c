@@ -59,6 +59,31 @@ pmem2_map_get_store_granularity(struct pmem2_map *map)
 	return map->effective_granularity;
 }
 
+/*
+ * pmem2_map_get_movnt_threshold -- returns the length from which
+ * the mem[move|cpy|set] functions of the mapping use non-temporal stores
+ */
+int
+pmem2_map_get_movnt_threshold(struct pmem2_map *map, enum pmem2_movnt_op op,
+		size_t *threshold)
+{
+	LOG(3, "map %p op %d", map, op);
+	PMEM2_ERR_CLR();
+
+	switch (op) {
+		case PMEM2_MOVNT_MEMMOVE:
+		case PMEM2_MOVNT_MEMSET:
+			break;
+		default:
+			ERR("unknown non-temporal operation %d", op);
+			return PMEM2_E_INVALID_MOVNT_OP;
+	}
+
+	*threshold = map->movnt_threshold[op];
+
+	return 0;
+}
+
 /*
  * parse_force_granularity -- parse PMEM2_FORCE_GRANULARITY environment variable
  */
@@ -154,11 +179,274 @@ mapping_max(void *addr)
 	return (size_t)map->addr + map->content_length;
 }
 
+/*
+ * The smallest and the biggest non-temporal store thresholds of
+ * the registered mappings. The mappings with the eADR variants of
+ * the mem[move|cpy|set] functions are not taken into account, as those
+ * don't use the thresholds.
+ */
+struct movnt_bounds {
+	size_t min;
+	size_t max;
+};
+
+/*
+ * map_index -- the registered mappings sorted by their addresses, searched by
+ * pmem2_map_find without taking any lock
+ *
+ * The index is modified in place by the writers, which are serialized by
+ * range_map_lock. The sequence number is odd while a modification is in
+ * progress and the readers retry the search if they observe that it changed.
+ * An index that had to be replaced by a bigger one might still be read, so it
+ * is kept until pmem2_map_fini.
+ */
+#define MAP_INDEX_INIT_CAPACITY 16
+
+struct map_index_entry {
+	uint64_t start;
+	uint64_t end;
+	uint64_t map; /* struct pmem2_map * */
+};
+
+struct map_index {
+	struct map_index *prev; /* the replaced, smaller, index */
+	uint64_t capacity;
+	uint64_t count;
+	struct map_index_entry entries[];
+};
+
 static struct pmem2_state {
 	struct ravl_interval *range_map;
 	os_rwlock_t range_map_lock;
+
+	struct map_index *index;
+	uint64_t index_seq;
+
+	struct movnt_bounds movnt[PMEM2_MOVNT_OPS];
 } State;
 
+/*
+ * map_index_entry_load -- (internal) atomically loads the entry of the index
+ */
+static void
+map_index_entry_load(struct map_index_entry *e, struct map_index_entry *dst)
+{
+	util_atomic_load_explicit64(&e->start, &dst->start,
+		memory_order_acquire);
+	util_atomic_load_explicit64(&e->end, &dst->end, memory_order_acquire);
+	util_atomic_load_explicit64(&e->map, &dst->map, memory_order_acquire);
+}
+
+/*
+ * map_index_entry_store -- (internal) atomically stores the entry of the index
+ */
+static void
+map_index_entry_store(struct map_index_entry *e,
+	const struct map_index_entry *src)
+{
+	util_atomic_store_explicit64(&e->start, src->start,
+		memory_order_release);
+	util_atomic_store_explicit64(&e->end, src->end, memory_order_release);
+	util_atomic_store_explicit64(&e->map, src->map, memory_order_release);
+}
+
+/*
+ * map_index_write_begin -- (internal) marks the index as being modified
+ */
+static void
+map_index_write_begin(void)
+{
+	util_atomic_store_explicit64(&State.index_seq, State.index_seq + 1,
+		memory_order_release);
+}
+
+/*
+ * map_index_write_end -- (internal) publishes the modification of the index
+ */
+static void
+map_index_write_end(void)
+{
+	util_atomic_store_explicit64(&State.index_seq, State.index_seq + 1,
+		memory_order_release);
+}
+
+/*
+ * map_index_position -- (internal) returns the index of the first entry that
+ * ends above the given address, the number of entries is passed explicitly
+ * because the readers might observe a torn index
+ */
+static uint64_t
+map_index_position(struct map_index *idx, uint64_t count, uint64_t addr)
+{
+	uint64_t lo = 0;
+	uint64_t hi = count;
+
+	while (lo < hi) {
+		uint64_t mid = lo + (hi - lo) / 2;
+		uint64_t end;
+		util_atomic_load_explicit64(&idx->entries[mid].end, &end,
+			memory_order_acquire);
+		if (end <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/*
+ * map_index_insert -- (internal) inserts the mapping into the index, must be
+ * called with the write lock held
+ */
+static int
+map_index_insert(struct pmem2_map *map)
+{
+	struct map_index *idx = State.index;
+
+	if (idx == NULL || idx->count == idx->capacity) {
+		uint64_t capacity = idx ? idx->capacity * 2 :
+			MAP_INDEX_INIT_CAPACITY;
+
+		int ret;
+		struct map_index *nidx = pmem2_malloc(sizeof(*nidx) +
+			capacity * sizeof(struct map_index_entry), &ret);
+		if (nidx == NULL)
+			return ret;
+
+		nidx->prev = idx;
+		nidx->capacity = capacity;
+		nidx->count = idx ? idx->count : 0;
+		if (idx) {
+			memcpy(nidx->entries, idx->entries,
+				idx->count * sizeof(struct map_index_entry));
+		}
+
+		util_atomic_store_explicit64(&State.index, nidx,
+			memory_order_release);
+		idx = nidx;
+	}
+
+	struct map_index_entry e;
+	e.start = (uint64_t)map->addr;
+	e.end = e.start + map->content_length;
+	e.map = (uint64_t)map;
+
+	uint64_t pos = map_index_position(idx, idx->count, e.start);
+
+	map_index_write_begin();
+	for (uint64_t i = idx->count; i > pos; --i)
+		map_index_entry_store(&idx->entries[i], &idx->entries[i - 1]);
+	map_index_entry_store(&idx->entries[pos], &e);
+	util_atomic_store_explicit64(&idx->count, idx->count + 1,
+		memory_order_release);
+	map_index_write_end();
+
+	return 0;
+}
+
+/*
+ * map_index_remove -- (internal) removes the mapping from the index, must be
+ * called with the write lock held
+ */
+static void
+map_index_remove(struct pmem2_map *map)
+{
+	struct map_index *idx = State.index;
+	ASSERTne(idx, NULL);
+
+	uint64_t pos = map_index_position(idx, idx->count,
+		(uint64_t)map->addr);
+	ASSERT(pos < idx->count);
+	ASSERTeq(idx->entries[pos].map, (uint64_t)map);
+
+	map_index_write_begin();
+	for (uint64_t i = pos; i + 1 < idx->count; ++i)
+		map_index_entry_store(&idx->entries[i], &idx->entries[i + 1]);
+	util_atomic_store_explicit64(&idx->count, idx->count - 1,
+		memory_order_release);
+	map_index_write_end();
+}
+
+/*
+ * map_index_find -- (internal) searches the index for the earliest mapping
+ * overlapping with (addr, addr+len) range, returns -1 if the index was
+ * modified during the search
+ */
+static int
+map_index_find(uint64_t addr, size_t len, struct pmem2_map **map)
+{
+	uint64_t seq;
+	util_atomic_load_explicit64(&State.index_seq, &seq,
+		memory_order_acquire);
+	if (seq % 2 != 0)
+		return -1;
+
+	*map = NULL;
+
+	struct map_index *idx;
+	util_atomic_load_explicit64(&State.index, &idx, memory_order_acquire);
+	if (idx != NULL) {
+		uint64_t count;
+		util_atomic_load_explicit64(&idx->count, &count,
+			memory_order_acquire);
+		count = MIN(count, idx->capacity);
+
+		uint64_t pos = map_index_position(idx, count, addr);
+		if (pos < count) {
+			struct map_index_entry e;
+			map_index_entry_load(&idx->entries[pos], &e);
+			if (e.start < addr + len || e.start == addr)
+				*map = (struct pmem2_map *)e.map;
+		}
+	}
+
+	uint64_t nseq;
+	util_atomic_load_explicit64(&State.index_seq, &nseq,
+		memory_order_acquire);
+
+	return nseq == seq ? 0 : -1;
+}
+
+/*
+ * movnt_bounds_update -- (internal) recalculate the bounds of the thresholds
+ * of all the registered mappings, must be called with the write lock held
+ */
+static void
+movnt_bounds_update(void)
+{
+	struct movnt_bounds bounds[PMEM2_MOVNT_OPS];
+	for (int op = 0; op < PMEM2_MOVNT_OPS; ++op) {
+		bounds[op].min = SIZE_MAX;
+		bounds[op].max = 0;
+	}
+
+	struct ravl_interval_node *node =
+		ravl_interval_find_first(State.range_map);
+	while (node) {
+		struct pmem2_map *map = ravl_interval_data(node);
+		node = ravl_interval_find_next(State.range_map, map);
+
+		if (map->effective_granularity == PMEM2_GRANULARITY_BYTE)
+			continue;
+
+		for (int op = 0; op < PMEM2_MOVNT_OPS; ++op) {
+			size_t thr = map->movnt_threshold[op];
+			if (thr < bounds[op].min)
+				bounds[op].min = thr;
+			if (thr > bounds[op].max)
+				bounds[op].max = thr;
+		}
+	}
+
+	for (int op = 0; op < PMEM2_MOVNT_OPS; ++op) {
+		util_atomic_store_explicit64(&State.movnt[op].min,
+			bounds[op].min, memory_order_relaxed);
+		util_atomic_store_explicit64(&State.movnt[op].max,
+			bounds[op].max, memory_order_relaxed);
+	}
+}
+
 /*
  * pmem2_map_init -- initialize the map module
  */
@@ -183,6 +471,14 @@ pmem2_map_fini(void)
 {
 	util_rwlock_wrlock(&State.range_map_lock);
 	ravl_interval_delete(State.range_map);
+
+	struct map_index *idx = State.index;
+	while (idx != NULL) {
+		struct map_index *prev = idx->prev;
+		Free(idx);
+		idx = prev;
+	}
+	State.index = NULL;
 	util_rwlock_unlock(&State.range_map_lock);
 }
 
@@ -194,6 +490,16 @@ pmem2_register_mapping(struct pmem2_map *map)
 {
 	util_rwlock_wrlock(&State.range_map_lock);
 	int ret = ravl_interval_insert(State.range_map, map);
+	if (ret == 0) {
+		ret = map_index_insert(map);
+		if (ret == 0) {
+			movnt_bounds_update();
+		} else {
+			struct ravl_interval_node *node =
+				ravl_interval_find_equal(State.range_map, map);
+			ravl_interval_remove(State.range_map, node);
+		}
+	}
 	util_rwlock_unlock(&State.range_map_lock);
 
 	return ret;
@@ -213,6 +519,9 @@ pmem2_unregister_mapping(struct pmem2_map *map)
 	if (!(node && !ravl_interval_remove(State.range_map, node))) {
 		ERR("Cannot find mapping %p to delete", map);
 		ret = PMEM2_E_MAPPING_NOT_FOUND;
+	} else {
+		map_index_remove(map);
+		movnt_bounds_update();
 	}
 
 	util_rwlock_unlock(&State.range_map_lock);
@@ -223,24 +532,49 @@ pmem2_unregister_mapping(struct pmem2_map *map)
 /*
  * pmem2_map_find -- find the earliest mapping overlapping with
  * (addr, addr+size) range
+ *
+ * The lookup does not take any lock, it is only repeated if the mappings were
+ * modified in the meantime.
  */
 struct pmem2_map *
 pmem2_map_find(const void *addr, size_t len)
 {
-	struct pmem2_map map;
-	map.addr = (void *)addr;
-	map.content_length = len;
+	struct pmem2_map *map;
 
-	struct ravl_interval_node *node;
+	while (map_index_find((uint64_t)addr, len, &map) != 0)
+		;
 
-	util_rwlock_rdlock(&State.range_map_lock);
-	node = ravl_interval_find(State.range_map, &map);
-	util_rwlock_unlock(&State.range_map_lock);
+	return map;
+}
+
+/*
+ * pmem2_map_movnt_threshold -- returns the non-temporal store threshold
+ * to be used for the (addr, addr+len) range
+ *
+ * The lookup of the mapping is only needed if the mappings do not agree
+ * on whether the operation of this length should use non-temporal stores,
+ * which in practice means that the mappings were created with different
+ * thresholds.
+ */
+size_t
+pmem2_map_movnt_threshold(const void *addr, size_t len,
+		enum pmem2_movnt_op op)
+{
+	struct movnt_bounds *b = &State.movnt[op];
+	size_t min;
+	size_t max;
+
+	util_atomic_load_explicit64(&b->min, &min, memory_order_relaxed);
+	if (len < min)
+		return min;
+
+	util_atomic_load_explicit64(&b->max, &max, memory_order_relaxed);
+	if (len >= max)
+		return max;
 
-	if (!node)
-		return NULL;
+	struct pmem2_map *map = pmem2_map_find(addr, len);
 
-	return (struct pmem2_map *)ravl_interval_data(node);
+	return map ? map->movnt_threshold[op] : max;
 }
 
 /*
@@ -265,6 +599,7 @@ pmem2_map_from_existing(struct pmem2_map **map_ptr,
 	map->effective_granularity = gran;
 	pmem2_set_flush_fns(map);
 	pmem2_set_mem_fns(map);
+	pmem2_set_movnt_thresholds(map, NULL);
 	map->source = *src;
 
 #ifndef _WIN32
@@ -1,5 +1,5 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
-/* Copyright 2019-2020, Intel Corporation */
+/* Copyright 2019-2021, Intel Corporation */
 
 /*
  * map.h -- internal definitions for libpmem2
@@ -10,6 +10,7 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include "libpmem2.h"
+#include "config.h"
 #include "os.h"
 #include "source.h"
 #include "vm_reservation.h"
@@ -33,6 +34,7 @@ struct pmem2_map {
 	enum pmem2_granularity effective_granularity;
 
 	pmem2_persist_fn persist_fn;
+	pmem2_persistv_fn persistv_fn;
 	pmem2_flush_fn flush_fn;
 	pmem2_drain_fn drain_fn;
 	pmem2_deep_flush_fn deep_flush_fn;
@@ -41,6 +43,9 @@ struct pmem2_map {
 	pmem2_memcpy_fn memcpy_fn;
 	pmem2_memset_fn memset_fn;
 
+	/* lengths from which non-temporal stores are used by default */
+	size_t movnt_threshold[PMEM2_MOVNT_OPS];
+
 	struct pmem2_source source;
 	struct pmem2_vm_reservation *reserv;
 };
@@ -48,6 +53,8 @@ struct pmem2_map {
 enum pmem2_granularity get_min_granularity(bool eADR, bool is_pmem,
 					enum pmem2_sharing_type sharing);
 struct pmem2_map *pmem2_map_find(const void *addr, size_t len);
+size_t pmem2_map_movnt_threshold(const void *addr, size_t len,
+		enum pmem2_movnt_op op);
 int pmem2_register_mapping(struct pmem2_map *map);
 int pmem2_unregister_mapping(struct pmem2_map *map);
 void pmem2_map_init(void);
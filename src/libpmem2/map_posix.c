@@ -507,6 +507,10 @@ pmem2_map_new(struct pmem2_map **map_ptr, const struct pmem2_config *cfg,
 	map->source = *src;
 	map->source.value.fd = INVALID_FD; /* fd should not be used after map */
 
+	ret = pmem2_set_movnt_thresholds(map, cfg);
+	if (ret)
+		goto err_free_map_struct;
+
 	ret = pmem2_register_mapping(map);
 	if (ret) {
 		goto err_free_map_struct;
@@ -393,6 +393,9 @@ pmem2_map_new(struct pmem2_map **map_ptr, const struct pmem2_config *cfg,
 	map->source = *src;
 	pmem2_set_flush_fns(map);
 	pmem2_set_mem_fns(map);
+	ret = pmem2_set_movnt_thresholds(map, cfg);
+	if (ret)
+		goto err_free_map_struct;
 
 	ret = pmem2_register_mapping(map);
 	if (ret) {
@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2018-2020, Intel Corporation */
+/* Copyright 2018-2021, Intel Corporation */
 
 /*
  * memops_generic.c -- architecture-independent memmove & memset fallback
@@ -130,7 +130,7 @@ store8(uint64_t *dst, uint64_t c)
  */
 void *
 memmove_nodrain_generic(void *dst, const void *src, size_t len,
-		unsigned flags, flush_func flush)
+		unsigned flags, flush_func flush, size_t movnt_threshold)
 {
 	LOG(15, "pmemdest %p src %p len %zu flags 0x%x", dst, src, len,
 			flags);
@@ -257,7 +257,7 @@ memmove_nodrain_generic(void *dst, const void *src, size_t len,
  */
 void *
 memset_nodrain_generic(void *dst, int c, size_t len, unsigned flags,
-		flush_func flush)
+		flush_func flush, size_t movnt_threshold)
 {
 	LOG(15, "pmemdest %p c 0x%x len %zu flags 0x%x", dst, c, len,
 			flags);
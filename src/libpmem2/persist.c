@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2019-2020, Intel Corporation */
+/* Copyright 2019-2021, Intel Corporation */
 
 /*
  * persist.c -- pmem2_get_[persist|flush|drain]_fn
@@ -7,7 +7,9 @@
 
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "config.h"
 #include "libpmem2.h"
 #include "map.h"
 #include "out.h"
@@ -25,7 +27,7 @@ static struct pmem2_arch_info Info;
  */
 static void *
 memmove_nodrain_libc(void *pmemdest, const void *src, size_t len,
-		unsigned flags, flush_func flush)
+		unsigned flags, flush_func flush, size_t movnt_threshold)
 {
 #ifdef DEBUG
 	if (flags & ~PMEM2_F_MEM_VALID_FLAGS)
@@ -47,7 +49,7 @@ memmove_nodrain_libc(void *pmemdest, const void *src, size_t len,
  */
 static void *
 memset_nodrain_libc(void *pmemdest, int c, size_t len, unsigned flags,
-		flush_func flush)
+		flush_func flush, size_t movnt_threshold)
 {
 #ifdef DEBUG
 	if (flags & ~PMEM2_F_MEM_VALID_FLAGS)
@@ -64,6 +66,51 @@ memset_nodrain_libc(void *pmemdest, int c, size_t len, unsigned flags,
 	return pmemdest;
 }
 
+/*
+ * memmove_nodrain_libc_eadr -- (internal) memmove_nodrain_libc for
+ *	the platforms with eADR
+ */
+static void *
+memmove_nodrain_libc_eadr(void *pmemdest, const void *src, size_t len,
+		unsigned flags, flush_func flush)
+{
+	return memmove_nodrain_libc(pmemdest, src, len, flags, flush, SIZE_MAX);
+}
+
+/*
+ * memset_nodrain_libc_eadr -- (internal) memset_nodrain_libc for
+ *	the platforms with eADR
+ */
+static void *
+memset_nodrain_libc_eadr(void *pmemdest, int c, size_t len, unsigned flags,
+		flush_func flush)
+{
+	return memset_nodrain_libc(pmemdest, c, len, flags, flush, SIZE_MAX);
+}
+
+/*
+ * memmove_nodrain_generic_eadr -- (internal) memmove_nodrain_generic for
+ *	the platforms with eADR
+ */
+static void *
+memmove_nodrain_generic_eadr(void *pmemdest, const void *src, size_t len,
+		unsigned flags, flush_func flush)
+{
+	return memmove_nodrain_generic(pmemdest, src, len, flags, flush,
+		SIZE_MAX);
+}
+
+/*
+ * memset_nodrain_generic_eadr -- (internal) memset_nodrain_generic for
+ *	the platforms with eADR
+ */
+static void *
+memset_nodrain_generic_eadr(void *pmemdest, int c, size_t len, unsigned flags,
+		flush_func flush)
+{
+	return memset_nodrain_generic(pmemdest, c, len, flags, flush, SIZE_MAX);
+}
+
 /*
  * pmem2_persist_init -- initialize persist module
  */
@@ -77,6 +124,7 @@ pmem2_persist_init(void)
 	Info.flush = NULL;
 	Info.fence = NULL;
 	Info.flush_has_builtin_fence = 0;
+	Info.movnt_threshold = SIZE_MAX;
 
 	pmem2_arch_init(&Info);
 
@@ -88,11 +136,12 @@ pmem2_persist_init(void)
 	if (Info.memmove_nodrain == NULL) {
 		if (no_generic) {
 			Info.memmove_nodrain = memmove_nodrain_libc;
-			Info.memmove_nodrain_eadr = memmove_nodrain_libc;
+			Info.memmove_nodrain_eadr = memmove_nodrain_libc_eadr;
 			LOG(3, "using libc memmove");
 		} else {
 			Info.memmove_nodrain = memmove_nodrain_generic;
-			Info.memmove_nodrain_eadr = memmove_nodrain_generic;
+			Info.memmove_nodrain_eadr =
+				memmove_nodrain_generic_eadr;
 			LOG(3, "using generic memmove");
 		}
 	}
@@ -100,11 +149,11 @@ pmem2_persist_init(void)
 	if (Info.memset_nodrain == NULL) {
 		if (no_generic) {
 			Info.memset_nodrain = memset_nodrain_libc;
-			Info.memset_nodrain_eadr = memset_nodrain_libc;
+			Info.memset_nodrain_eadr = memset_nodrain_libc_eadr;
 			LOG(3, "using libc memset");
 		} else {
 			Info.memset_nodrain = memset_nodrain_generic;
-			Info.memset_nodrain_eadr = memset_nodrain_generic;
+			Info.memset_nodrain_eadr = memset_nodrain_generic_eadr;
 			LOG(3, "using generic memset");
 		}
 	}
@@ -286,6 +335,122 @@ pmem2_drain_nop(void)
 	LOG(15, NULL);
 }
 
+/*
+ * The number of ranges which are sorted and coalesced together by the
+ * vectored persist functions. Longer vectors are processed in batches of this
+ * size, so a line shared by ranges from different batches may be flushed more
+ * than once, which is harmless.
+ */
+#define PERSISTV_BATCH 32
+
+struct persistv_span {
+	uintptr_t start;
+	uintptr_t end;
+};
+
+/*
+ * persistv_coalesce -- (internal) sort the spans and merge the overlapping
+ * and adjacent ones, returns the number of the remaining spans
+ */
+static size_t
+persistv_coalesce(struct persistv_span *spans, size_t nspans)
+{
+	if (nspans == 0)
+		return 0;
+
+	/* insertion sort, the batches are small and often almost sorted */
+	for (size_t i = 1; i < nspans; ++i) {
+		struct persistv_span s = spans[i];
+		size_t j = i;
+		while (j > 0 && spans[j - 1].start > s.start) {
+			spans[j] = spans[j - 1];
+			--j;
+		}
+		spans[j] = s;
+	}
+
+	size_t last = 0;
+	for (size_t i = 1; i < nspans; ++i) {
+		if (spans[i].start <= spans[last].end) {
+			if (spans[i].end > spans[last].end)
+				spans[last].end = spans[i].end;
+		} else {
+			spans[++last] = spans[i];
+		}
+	}
+
+	return last + 1;
+}
+
+/*
+ * persistv_flush -- (internal) flush the ranges, expanded to the multiples
+ * of the alignment, with each distinct span flushed only once
+ */
+static void
+persistv_flush(const struct pmem2_range *ranges, size_t nranges,
+		uintptr_t alignment, void (*flush)(const void *, size_t))
+{
+	struct persistv_span spans[PERSISTV_BATCH];
+
+	while (nranges > 0) {
+		size_t nspans = 0;
+		for (; nranges > 0 && nspans < PERSISTV_BATCH;
+				++ranges, --nranges) {
+			if (ranges->size == 0)
+				continue;
+
+			uintptr_t addr = (uintptr_t)ranges->ptr;
+			spans[nspans].start = ALIGN_DOWN(addr, alignment);
+			spans[nspans].end = ALIGN_UP(addr + ranges->size,
+					alignment);
+			++nspans;
+		}
+
+		nspans = persistv_coalesce(spans, nspans);
+		for (size_t i = 0; i < nspans; ++i)
+			flush((const void *)spans[i].start,
+				spans[i].end - spans[i].start);
+	}
+}
+
+/*
+ * pmem2_persistv_pages -- variant of pmem2_persistv for page granularity,
+ * performs one msync per distinct page span
+ */
+static void
+pmem2_persistv_pages(const struct pmem2_range *ranges, size_t nranges)
+{
+	LOG(15, "ranges %p nranges %zu", ranges, nranges);
+
+	persistv_flush(ranges, nranges, Pagesize, pmem2_persist_pages);
+}
+
+/*
+ * pmem2_persistv_cpu_cache -- variant of pmem2_persistv for cache line
+ * granularity, flushes each distinct cache line once and drains once
+ */
+static void
+pmem2_persistv_cpu_cache(const struct pmem2_range *ranges, size_t nranges)
+{
+	LOG(15, "ranges %p nranges %zu", ranges, nranges);
+
+	persistv_flush(ranges, nranges, CACHELINE_SIZE, pmem2_flush_cpu_cache);
+	pmem2_drain();
+}
+
+/*
+ * pmem2_persistv_noflush -- variant of pmem2_persistv for byte granularity
+ */
+static void
+pmem2_persistv_noflush(const struct pmem2_range *ranges, size_t nranges)
+{
+	LOG(15, "ranges %p nranges %zu", ranges, nranges);
+
+	for (size_t i = 0; i < nranges; ++i)
+		pmem2_flush_nop(ranges[i].ptr, ranges[i].size);
+	pmem2_drain();
+}
+
 /*
  * pmem2_deep_flush_page -- do nothing - pmem2_persist_fn already did msync
  */
@@ -366,18 +531,21 @@ pmem2_set_flush_fns(struct pmem2_map *map)
 	switch (map->effective_granularity) {
 		case PMEM2_GRANULARITY_PAGE:
 			map->persist_fn = pmem2_persist_pages;
+			map->persistv_fn = pmem2_persistv_pages;
 			map->flush_fn = pmem2_persist_pages;
 			map->drain_fn = pmem2_drain_nop;
 			map->deep_flush_fn = pmem2_deep_flush_page;
 			break;
 		case PMEM2_GRANULARITY_CACHE_LINE:
 			map->persist_fn = pmem2_persist_cpu_cache;
+			map->persistv_fn = pmem2_persistv_cpu_cache;
 			map->flush_fn = pmem2_flush_cpu_cache;
 			map->drain_fn = pmem2_drain;
 			map->deep_flush_fn = pmem2_deep_flush_cache;
 			break;
 		case PMEM2_GRANULARITY_BYTE:
 			map->persist_fn = pmem2_persist_noflush;
+			map->persistv_fn = pmem2_persistv_noflush;
 			map->flush_fn = pmem2_flush_nop;
 			map->drain_fn = pmem2_drain;
 			map->deep_flush_fn = pmem2_deep_flush_byte;
@@ -399,6 +567,17 @@ pmem2_get_persist_fn(struct pmem2_map *map)
 	return map->persist_fn;
 }
 
+/*
+ * pmem2_get_persistv_fn - return a pointer to a function responsible for
+ * persisting a vector of ranges owned by pmem2_map
+ */
+pmem2_persistv_fn
+pmem2_get_persistv_fn(struct pmem2_map *map)
+{
+	/* we do not need to clear err because this function cannot fail */
+	return map->persistv_fn;
+}
+
 /*
  * pmem2_get_flush_fn - return a pointer to a function responsible for
  * flushing data in range owned by pmem2_map
@@ -433,8 +612,10 @@ pmem2_memmove_nonpmem(void *pmemdest, const void *src, size_t len,
 		ERR("invalid flags 0x%x", flags);
 #endif
 	PMEM2_API_START("pmem2_memmove");
+	size_t thr = pmem2_map_movnt_threshold(pmemdest, len,
+			PMEM2_MOVNT_MEMMOVE);
 	Info.memmove_nodrain(pmemdest, src, len, flags & ~PMEM2_F_MEM_NODRAIN,
-			Info.flush);
+			Info.flush, thr);
 
 	pmem2_persist_pages(pmemdest, len);
 
@@ -453,8 +634,10 @@ pmem2_memset_nonpmem(void *pmemdest, int c, size_t len, unsigned flags)
 		ERR("invalid flags 0x%x", flags);
 #endif
 	PMEM2_API_START("pmem2_memset");
+	size_t thr = pmem2_map_movnt_threshold(pmemdest, len,
+			PMEM2_MOVNT_MEMSET);
 	Info.memset_nodrain(pmemdest, c, len, flags & ~PMEM2_F_MEM_NODRAIN,
-			Info.flush);
+			Info.flush, thr);
 
 	pmem2_persist_pages(pmemdest, len);
 
@@ -474,7 +657,9 @@ pmem2_memmove(void *pmemdest, const void *src, size_t len,
 		ERR("invalid flags 0x%x", flags);
 #endif
 	PMEM2_API_START("pmem2_memmove");
-	Info.memmove_nodrain(pmemdest, src, len, flags, Info.flush);
+	size_t thr = pmem2_map_movnt_threshold(pmemdest, len,
+			PMEM2_MOVNT_MEMMOVE);
+	Info.memmove_nodrain(pmemdest, src, len, flags, Info.flush, thr);
 	if ((flags & (PMEM2_F_MEM_NODRAIN | PMEM2_F_MEM_NOFLUSH)) == 0)
 		pmem2_drain();
 
@@ -493,7 +678,9 @@ pmem2_memset(void *pmemdest, int c, size_t len, unsigned flags)
 		ERR("invalid flags 0x%x", flags);
 #endif
 	PMEM2_API_START("pmem2_memset");
-	Info.memset_nodrain(pmemdest, c, len, flags, Info.flush);
+	size_t thr = pmem2_map_movnt_threshold(pmemdest, len,
+			PMEM2_MOVNT_MEMSET);
+	Info.memset_nodrain(pmemdest, c, len, flags, Info.flush, thr);
 	if ((flags & (PMEM2_F_MEM_NODRAIN | PMEM2_F_MEM_NOFLUSH)) == 0)
 		pmem2_drain();
 
@@ -568,6 +755,43 @@ pmem2_set_mem_fns(struct pmem2_map *map)
 
 }
 
+/*
+ * pmem2_set_movnt_thresholds -- set the lengths from which the mapping
+ * uses non-temporal stores, cfg can be NULL for the existing mappings
+ */
+int
+pmem2_set_movnt_thresholds(struct pmem2_map *map,
+		const struct pmem2_config *cfg)
+{
+	/*
+	 * Without the need to flush, the regular stores are always used unless
+	 * asked otherwise by the flags, to keep the data in the CPU cache.
+	 */
+	if (map->effective_granularity == PMEM2_GRANULARITY_BYTE) {
+		for (int op = 0; op < PMEM2_MOVNT_OPS; ++op)
+			map->movnt_threshold[op] = SIZE_MAX;
+
+		return 0;
+	}
+
+	for (int op = 0; op < PMEM2_MOVNT_OPS; ++op)
+		map->movnt_threshold[op] = Info.movnt_threshold;
+
+	if (!cfg)
+		return 0;
+
+	for (int op = 0; op < PMEM2_MOVNT_OPS; ++op) {
+		if (cfg->movnt_threshold_set[op])
+			map->movnt_threshold[op] = cfg->movnt_threshold[op];
+	}
+
+	LOG(3, "map %p non-temporal thresholds: memmove %zu memset %zu", map,
+		map->movnt_threshold[PMEM2_MOVNT_MEMMOVE],
+		map->movnt_threshold[PMEM2_MOVNT_MEMSET]);
+
+	return 0;
+}
+
 /*
  * pmem2_get_memmove_fn - return a pointer to a function
  */
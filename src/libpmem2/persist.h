@@ -1,5 +1,5 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
-/* Copyright 2019-2020, Intel Corporation */
+/* Copyright 2019-2021, Intel Corporation */
 
 /*
  * persist.h -- internal definitions for libpmem2 persist module
@@ -21,6 +21,8 @@ int pmem2_flush_file_buffers_os(struct pmem2_map *map, const void *addr,
 		size_t len, int autorestart);
 void pmem2_set_flush_fns(struct pmem2_map *map);
 void pmem2_set_mem_fns(struct pmem2_map *map);
+int pmem2_set_movnt_thresholds(struct pmem2_map *map,
+		const struct pmem2_config *cfg);
 
 #ifdef __cplusplus
 }
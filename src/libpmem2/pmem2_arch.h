@@ -1,5 +1,5 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
-/* Copyright 2014-2020, Intel Corporation */
+/* Copyright 2014-2021, Intel Corporation */
 
 /*
  * pmem2_arch.h -- core-arch interface
@@ -21,18 +21,27 @@ struct pmem2_arch_info;
 typedef void (*fence_func)(void);
 typedef void (*flush_func)(const void *, size_t);
 typedef void *(*memmove_nodrain_func)(void *pmemdest, const void *src,
-		size_t len, unsigned flags, flush_func flush);
+		size_t len, unsigned flags, flush_func flush,
+		size_t movnt_threshold);
 typedef void *(*memset_nodrain_func)(void *pmemdest, int c, size_t len,
+		unsigned flags, flush_func flush, size_t movnt_threshold);
+
+/* the eADR variants use non-temporal stores only if asked by the flags */
+typedef void *(*memmove_nodrain_eadr_func)(void *pmemdest, const void *src,
+		size_t len, unsigned flags, flush_func flush);
+typedef void *(*memset_nodrain_eadr_func)(void *pmemdest, int c, size_t len,
 		unsigned flags, flush_func flush);
 
 struct pmem2_arch_info {
 	memmove_nodrain_func memmove_nodrain;
-	memmove_nodrain_func memmove_nodrain_eadr;
+	memmove_nodrain_eadr_func memmove_nodrain_eadr;
 	memset_nodrain_func memset_nodrain;
-	memset_nodrain_func memset_nodrain_eadr;
+	memset_nodrain_eadr_func memset_nodrain_eadr;
 	flush_func flush;
 	fence_func fence;
 	int flush_has_builtin_fence;
+	/* default length from which non-temporal stores are used */
+	size_t movnt_threshold;
 };
 
 void pmem2_arch_init(struct pmem2_arch_info *info);
@@ -48,9 +57,9 @@ flush_empty_nolog(const void *addr, size_t len)
 }
 
 void *memmove_nodrain_generic(void *pmemdest, const void *src, size_t len,
-		unsigned flags, flush_func flush);
+		unsigned flags, flush_func flush, size_t movnt_threshold);
 void *memset_nodrain_generic(void *pmemdest, int c, size_t len, unsigned flags,
-		flush_func flush);
+		flush_func flush, size_t movnt_threshold);
 
 #ifdef __cplusplus
 }
@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2014-2020, Intel Corporation */
+/* Copyright 2014-2021, Intel Corporation */
 
 #include <string.h>
 #include <xmmintrin.h>
@@ -15,8 +15,6 @@
 
 #define MOVNT_THRESHOLD	256
 
-size_t Movnt_threshold = MOVNT_THRESHOLD;
-
 /*
  * memory_barrier -- (internal) issue the fence instruction
  */
@@ -67,7 +65,8 @@ flush_clwb(const void *addr, size_t len)
 #define MEMCPY_TEMPLATE(isa, flush, perfbarrier) \
 static void *\
 memmove_nodrain_##isa##_##flush##perfbarrier(void *dest, const void *src, \
-		size_t len, unsigned flags, flush_func flushf)\
+		size_t len, unsigned flags, flush_func flushf, \
+		size_t movnt_threshold)\
 {\
 	if (len == 0 || src == dest)\
 		return dest;\
@@ -78,7 +77,7 @@ memmove_nodrain_##isa##_##flush##perfbarrier(void *dest, const void *src, \
 		memmove_movnt_##isa ##_##flush##perfbarrier(dest, src, len);\
 	else if (flags & PMEM2_F_MEM_MOV)\
 		memmove_mov_##isa##_##flush(dest, src, len);\
-	else if (len < Movnt_threshold)\
+	else if (len < movnt_threshold)\
 		memmove_mov_##isa##_##flush(dest, src, len);\
 	else\
 		memmove_movnt_##isa##_##flush##perfbarrier(dest, src, len);\
@@ -107,7 +106,7 @@ memmove_nodrain_##isa##_eadr##perfbarrier(void *dest, const void *src, \
 #define MEMSET_TEMPLATE(isa, flush, perfbarrier)\
 static void *\
 memset_nodrain_##isa##_##flush##perfbarrier(void *dest, int c, size_t len, \
-		unsigned flags, flush_func flushf)\
+		unsigned flags, flush_func flushf, size_t movnt_threshold)\
 {\
 	if (len == 0)\
 		return dest;\
@@ -118,7 +117,7 @@ memset_nodrain_##isa##_##flush##perfbarrier(void *dest, int c, size_t len, \
 		memset_movnt_##isa##_##flush##perfbarrier(dest, c, len);\
 	else if (flags & PMEM2_F_MEM_MOV)\
 		memset_mov_##isa##_##flush(dest, c, len);\
-	else if (len < Movnt_threshold)\
+	else if (len < movnt_threshold)\
 		memset_mov_##isa##_##flush(dest, c, len);\
 	else\
 		memset_movnt_##isa##_##flush##perfbarrier(dest, c, len);\
@@ -492,6 +491,8 @@ pmem2_arch_init(struct pmem2_arch_info *info)
 
 	pmem_cpuinfo_to_funcs(info, &impl);
 
+	info->movnt_threshold = MOVNT_THRESHOLD;
+
 	/*
 	 * For testing, allow overriding the default threshold
 	 * for using non-temporal stores in pmem_memcpy_*(), pmem_memmove_*()
@@ -506,7 +507,7 @@ pmem2_arch_init(struct pmem2_arch_info *info)
 			LOG(3, "Invalid PMEM_MOVNT_THRESHOLD");
 		} else {
 			LOG(3, "PMEM_MOVNT_THRESHOLD set to %zu", (size_t)val);
-			Movnt_threshold = (size_t)val;
+			info->movnt_threshold = (size_t)val;
 		}
 	}
 
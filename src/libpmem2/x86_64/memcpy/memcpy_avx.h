@@ -1,5 +1,5 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
-/* Copyright 2017-2020, Intel Corporation */
+/* Copyright 2017-2021, Intel Corporation */
 
 #ifndef PMEM2_MEMCPY_AVX_H
 #define PMEM2_MEMCPY_AVX_H
@@ -89,7 +89,7 @@ memmove_small_avx(char *dest, const char *src, size_t len, flush_fn flush)
 	 */
 	if (On_pmemcheck) {
 		memmove_nodrain_generic(dest, src, len, PMEM2_F_MEM_NOFLUSH,
-				NULL);
+				NULL, 0);
 	} else {
 		memmove_small_avx_noflush(dest, src, len);
 	}
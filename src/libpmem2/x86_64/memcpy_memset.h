@@ -1,5 +1,5 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
-/* Copyright 2014-2020, Intel Corporation */
+/* Copyright 2014-2021, Intel Corporation */
 
 #ifndef MEMCPY_MEMSET_H
 #define MEMCPY_MEMSET_H
@@ -205,8 +205,6 @@ void memset_movnt_avx512f_empty(char *dest, int c, size_t len);
 void memset_movnt_avx512f_noflush(char *dest, int c, size_t len);
 #endif
 
-extern size_t Movnt_threshold;
-
 /*
  * SSE2/AVX1 only:
  *
@@ -1,5 +1,5 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
-/* Copyright 2017-2020, Intel Corporation */
+/* Copyright 2017-2021, Intel Corporation */
 
 #ifndef PMEM2_MEMSET_SSE2_H
 #define PMEM2_MEMSET_SSE2_H
@@ -93,7 +93,7 @@ memset_small_sse2(char *dest, __m128i xmm, size_t len, flush_fn flush)
 	 */
 	if (On_pmemcheck) {
 		memset_nodrain_generic(dest, (uint8_t)_mm_cvtsi128_si32(xmm),
-				len, PMEM2_F_MEM_NOFLUSH, NULL);
+				len, PMEM2_F_MEM_NOFLUSH, NULL, 0);
 	} else {
 		memset_small_sse2_noflush(dest, xmm, len);
 	}
@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2014-2020, Intel Corporation */
+/* Copyright 2014-2021, Intel Corporation */
 
 /*
  * blk.c -- block memory pool entry points for libpmem
@@ -44,20 +44,55 @@ static const struct pool_attr Blk_open_attr = {
 		{0}, {0}, {0}, {0}, {0}
 };
 
+/*
+ * lane_primary -- (internal) select the preferred lane of the calling thread
+ *
+ * The lanes are split into per-cpu shards and a thread prefers the first
+ * lane of the shard of the cpu it is running on, so threads on different
+ * cpus don't contend for lanes nor share a counter.  If the cpu cannot be
+ * determined, the lanes are assigned in a round-robin fashion.
+ */
+static unsigned
+lane_primary(PMEMblkpool *pbp)
+{
+	int cpu = os_thread_getcpu();
+	if (cpu < 0)
+		return util_fetch_and_add32(&pbp->next_lane, 1) % pbp->nlane;
+
+	unsigned shard_size = pbp->nlane / pbp->ncpus;
+	if (shard_size == 0)
+		shard_size = 1;
+
+	unsigned nshards = pbp->nlane / shard_size;
+
+	return ((unsigned)cpu % nshards) * shard_size;
+}
+
 /*
  * lane_enter -- (internal) acquire a unique lane number
+ *
+ * Starting from the preferred lane, the first idle lane is taken.  Only if
+ * all of them are busy, the thread sleeps waiting for the preferred one.
  */
 static void
 lane_enter(PMEMblkpool *pbp, unsigned *lane)
 {
-	unsigned mylane;
+	unsigned primary = lane_primary(pbp);
+	unsigned mylane = primary;
 
-	mylane = util_fetch_and_add32(&pbp->next_lane, 1) % pbp->nlane;
+	for (unsigned i = 0; i < pbp->nlane; i++) {
+		if (util_mutex_trylock(&pbp->lanes[mylane].lock) == 0) {
+			*lane = mylane;
+			return;
+		}
 
-	/* lane selected, grab the per-lane lock */
-	util_mutex_lock(&pbp->locks[mylane]);
+		if (++mylane == pbp->nlane)
+			mylane = 0;
+	}
+
+	util_mutex_lock(&pbp->lanes[primary].lock);
 
-	*lane = mylane;
+	*lane = primary;
 }
 
 /*
@@ -66,7 +101,7 @@ lane_enter(PMEMblkpool *pbp, unsigned *lane)
 static void
 lane_exit(PMEMblkpool *pbp, unsigned mylane)
 {
-	util_mutex_unlock(&pbp->locks[mylane]);
+	util_mutex_unlock(&pbp->lanes[mylane].lock);
 }
 
 /*
@@ -146,6 +181,77 @@ nswrite(void *ns, unsigned lane, const void *buf, size_t count,
 	return 0;
 }
 
+/*
+ * nswrite_nodrain -- (internal) write data to the namespace, without drain
+ *
+ * Same as nswrite(), except that on pmem the data is only flushed, and
+ * becomes durable after the next call to nsdrain() or nswrite().
+ *
+ * This routine is provided to btt_init() to allow the btt module to
+ * do I/O on the memory pool containing the BTT layout.
+ */
+static int
+nswrite_nodrain(void *ns, unsigned lane, const void *buf, size_t count,
+		uint64_t off)
+{
+	struct pmemblk *pbp = (struct pmemblk *)ns;
+
+	LOG(13, "pbp %p lane %u count %zu off %" PRIu64, pbp, lane, count, off);
+
+	if (off + count > pbp->datasize) {
+		ERR("offset + count (%zu) past end of data area (%zu)",
+				(size_t)off + count, pbp->datasize);
+		errno = EINVAL;
+		return -1;
+	}
+
+	void *dest = (char *)pbp->data + off;
+
+#ifdef DEBUG
+	/* grab debug write lock */
+	util_mutex_lock(&pbp->write_lock);
+#endif
+
+	/* unprotect the memory (debug version only) */
+	RANGE_RW(dest, count, pbp->is_dev_dax);
+
+	if (pbp->is_pmem)
+		pmem_memcpy_nodrain(dest, buf, count);
+	else
+		memcpy(dest, buf, count);
+
+	/* protect the memory again (debug version only) */
+	RANGE_RO(dest, count, pbp->is_dev_dax);
+
+#ifdef DEBUG
+	/* release debug write lock */
+	util_mutex_unlock(&pbp->write_lock);
+#endif
+
+	/* there is no way to defer msync, so do it right away */
+	if (!pbp->is_pmem)
+		pmem_msync(dest, count);
+
+	return 0;
+}
+
+/*
+ * nsdrain -- (internal) wait for writes done by nswrite_nodrain()
+ *
+ * This routine is provided to btt_init() to allow the btt module to
+ * do I/O on the memory pool containing the BTT layout.
+ */
+static void
+nsdrain(void *ns, unsigned lane)
+{
+	struct pmemblk *pbp = (struct pmemblk *)ns;
+
+	LOG(13, "pbp %p lane %u", pbp, lane);
+
+	if (pbp->is_pmem)
+		pmem_drain();
+}
+
 /*
  * nsmap -- (internal) allow direct access to a range of a namespace
  *
@@ -247,6 +353,8 @@ static struct ns_callback ns_cb = {
 	.nszero = nszero,
 	.nsmap = nsmap,
 	.nssync = nssync,
+	.nswrite_nodrain = nswrite_nodrain,
+	.nsdrain = nsdrain,
 	.ns_is_zeroed = 0
 };
 
@@ -326,7 +434,6 @@ blk_runtime_init(PMEMblkpool *pbp, size_t bsize, int rdonly)
 
 	/* things free by "goto err" if not NULL */
 	struct btt *bttp = NULL;
-	os_mutex_t *locks = NULL;
 
 	bttp = btt_init(pbp->datasize, (uint32_t)bsize, pbp->hdr.poolset_uuid,
 			(unsigned)ncpus * 2, pbp, &ns_cb);
@@ -338,15 +445,21 @@ blk_runtime_init(PMEMblkpool *pbp, size_t bsize, int rdonly)
 
 	pbp->nlane = btt_nlane(pbp->bttp);
 	pbp->next_lane = 0;
-	if ((locks = Malloc(pbp->nlane * sizeof(*locks))) == NULL) {
-		ERR("!Malloc for lane locks");
+	pbp->ncpus = (unsigned)ncpus;
+
+	/* allocate one more cache line to align the lanes */
+	void *lanes_buf = Malloc((pbp->nlane + 1) * sizeof(struct blk_lane));
+	if (lanes_buf == NULL) {
+		ERR("!Malloc for lanes");
 		goto err;
 	}
 
-	for (unsigned i = 0; i < pbp->nlane; i++)
-		util_mutex_init(&locks[i]);
+	pbp->lanes_buf = lanes_buf;
+	pbp->lanes = (struct blk_lane *)ALIGN_UP((uintptr_t)lanes_buf,
+			sizeof(struct blk_lane));
 
-	pbp->locks = locks;
+	for (unsigned i = 0; i < pbp->nlane; i++)
+		util_mutex_init(&pbp->lanes[i].lock);
 
 #ifdef DEBUG
 	/* initialize debug lock */
@@ -608,10 +721,10 @@ pmemblk_close(PMEMblkpool *pbp)
 	LOG(3, "pbp %p", pbp);
 
 	btt_fini(pbp->bttp);
-	if (pbp->locks) {
+	if (pbp->lanes) {
 		for (unsigned i = 0; i < pbp->nlane; i++)
-			util_mutex_destroy(&pbp->locks[i]);
-		Free((void *)pbp->locks);
+			util_mutex_destroy(&pbp->lanes[i].lock);
+		Free(pbp->lanes_buf);
 	}
 
 #ifdef DEBUG
@@ -700,6 +813,105 @@ pmemblk_write(PMEMblkpool *pbp, const void *buf, long long blockno)
 	return err;
 }
 
+/*
+ * pmemblk_readv -- read a range of blocks in a block memory pool
+ */
+int
+pmemblk_readv(PMEMblkpool *pbp, const struct iovec *iov, int iovcnt,
+		long long blockno)
+{
+	LOG(3, "pbp %p iov %p iovcnt %d blockno %lld",
+			pbp, iov, iovcnt, blockno);
+
+	if (blockno < 0) {
+		ERR("negative block number");
+		errno = EINVAL;
+		return -1;
+	}
+
+	unsigned lane;
+
+	lane_enter(pbp, &lane);
+
+	int err = btt_readv(pbp->bttp, lane, (uint64_t)blockno, iov, iovcnt);
+
+	lane_exit(pbp, lane);
+
+	return err;
+}
+
+/*
+ * pmemblk_writev -- write a range of blocks in a block memory pool
+ */
+int
+pmemblk_writev(PMEMblkpool *pbp, const struct iovec *iov, int iovcnt,
+		long long blockno)
+{
+	LOG(3, "pbp %p iov %p iovcnt %d blockno %lld",
+			pbp, iov, iovcnt, blockno);
+
+	if (pbp->rdonly) {
+		ERR("EROFS (pool is read-only)");
+		errno = EROFS;
+		return -1;
+	}
+
+	if (blockno < 0) {
+		ERR("negative block number");
+		errno = EINVAL;
+		return -1;
+	}
+
+	unsigned lane;
+
+	lane_enter(pbp, &lane);
+
+	int err = btt_writev(pbp->bttp, lane, (uint64_t)blockno, iov, iovcnt);
+
+	lane_exit(pbp, lane);
+
+	return err;
+}
+
+/*
+ * pmemblk_read_direct -- get read-only access to a block in a block pool
+ */
+int
+pmemblk_read_direct(PMEMblkpool *pbp, const void **addrp, unsigned *refp,
+		long long blockno)
+{
+	LOG(3, "pbp %p addrp %p refp %p blockno %lld",
+			pbp, addrp, refp, blockno);
+
+	if (blockno < 0) {
+		ERR("negative block number");
+		errno = EINVAL;
+		return -1;
+	}
+
+	unsigned lane;
+
+	lane_enter(pbp, &lane);
+
+	int err = btt_read_direct(pbp->bttp, lane, (uint64_t)blockno,
+			addrp, refp);
+
+	lane_exit(pbp, lane);
+
+	return err;
+}
+
+/*
+ * pmemblk_read_direct_release -- drop access obtained by pmemblk_read_direct
+ */
+void
+pmemblk_read_direct_release(PMEMblkpool *pbp, unsigned ref)
+{
+	LOG(3, "pbp %p ref %u", pbp, ref);
+
+	btt_read_direct_release(pbp->bttp, ref);
+}
+
 /*
  * pmemblk_set_zero -- zero a block in a block memory pool
  */
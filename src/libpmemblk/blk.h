@@ -1,5 +1,5 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
-/* Copyright 2014-2020, Intel Corporation */
+/* Copyright 2014-2021, Intel Corporation */
 
 /*
  * blk.h -- internal definitions for libpmem blk module
@@ -14,6 +14,7 @@
 #include "os_thread.h"
 #include "pool_hdr.h"
 #include "page_size.h"
+#include "util.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -38,6 +39,13 @@ extern "C" {
 
 static const features_t blk_format_feat_default = BLK_FORMAT_FEAT_DEFAULT;
 
+/* run-time lane state, padded so that lanes don't share cache lines */
+struct blk_lane {
+	os_mutex_t lock;	/* held while the lane is in use */
+
+	uint8_t padding[CACHELINE_SIZE - sizeof(os_mutex_t)];
+};
+
 struct pmemblk {
 	struct pool_hdr hdr;	/* memory pool header */
 
@@ -58,7 +66,9 @@ struct pmemblk {
 	struct btt *bttp;	/* btt handle */
 	unsigned nlane;		/* number of lanes */
 	unsigned next_lane;	/* used to rotate through lanes */
-	os_mutex_t *locks;	/* one per lane */
+	unsigned ncpus;		/* number of cpus lanes are spread over */
+	struct blk_lane *lanes;	/* one per lane, cache line aligned */
+	void *lanes_buf;	/* unaligned allocation of lanes */
 	int is_dev_dax;		/* true if mapped on device dax */
 	struct ctl *ctl;	/* top level node of the ctl tree structure */
 
@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2014-2019, Intel Corporation */
+/* Copyright 2014-2021, Intel Corporation */
 
 /*
  * btt.c -- block translation table providing atomic block updates
@@ -23,6 +23,10 @@
  * (made durable) when the call returns.  Data written directly via
  * the nsmap callback must be flushed explicitly using nssync.
  *
+ * Optionally, the caller may also provide nswrite_nodrain and nsdrain,
+ * which allow the write path to make several independent stores durable
+ * with a single drain.
+ *
  * The caller passes these callbacks, along with information such as
  * namespace size and UUID to btt_init() and gets back an opaque handle
  * which is then used with the rest of the entry points.
@@ -37,6 +41,16 @@
  *
  *	btt_write	Writes a single block (atomically) at a given LBA
  *
+ *	btt_readv	Reads a range of blocks starting at a given LBA
+ *
+ *	btt_writev	Writes a range of blocks (each one atomically)
+ *			starting at a given LBA
+ *
+ *	btt_read_direct	Returns direct access to the data of a block
+ *
+ *	btt_read_direct_release
+ *			Ends the direct access started by btt_read_direct
+ *
  *	btt_set_zero	Sets a block to read back as zeros
  *
  *	btt_set_error	Sets a block to return error on read
@@ -95,6 +109,7 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include <sys/param.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
@@ -108,6 +123,7 @@
 #include "sys_util.h"
 #include "util.h"
 #include "alloc.h"
+#include "os.h"
 
 /*
  * The opaque btt handle containing state tracked by this module
@@ -146,6 +162,7 @@ struct btt {
 	uint32_t nfree;			/* available flog entries */
 	uint64_t nlba;			/* total number of external LBAs */
 	unsigned narena;		/* number of arenas */
+	uint32_t nmap_locks;		/* map locks per arena, power of 2 */
 
 	/* run-time state kept for each arena */
 	struct arena {
@@ -176,12 +193,20 @@ struct btt {
 		 * active block for an external LBA.
 		 *
 		 * The read path doesn't use the flog at all.
+		 *
+		 * Each entry takes a whole cache line, so that writes
+		 * in different lanes don't falsely share it.
 		 */
 		struct flog_runtime {
 			struct btt_flog flog;	/* current info */
 			uint64_t entries[2];	/* offsets for flog pair */
 			int next;		/* next write (0 or 1) */
+
+			uint8_t padding[CACHELINE_SIZE -
+				sizeof(struct btt_flog) -
+				2 * sizeof(uint64_t) - sizeof(int)];
 		} *flogs;
+		void *flogs_buf;	/* unaligned allocation of flogs */
 
 		/*
 		 * Read tracking table.  Indexed by lane.
@@ -192,13 +217,29 @@ struct btt {
 		 * a concurrent write).  Unused slots in the rtt are indicated
 		 * by setting the error bit, BTT_MAP_ENTRY_ERROR, so that the
 		 * entry won't match any post-map LBA when checked.
+		 *
+		 * The first nfree entries are used by lanes, the following
+		 * ndirect entries by reads started with btt_read_direct().
+		 * Like the flog entries, each one takes a whole cache line.
 		 */
-		uint32_t volatile *rtt;
+		struct rtt_entry {
+			uint32_t volatile entry;
+
+			uint8_t padding[CACHELINE_SIZE - sizeof(uint32_t)];
+		} *rtt;
+		void *rtt_buf;		/* unaligned allocation of rtt */
 
 		/*
-		 * Map locking.  Indexed by pre-map LBA modulo nlane.
+		 * Map locking.  Indexed by the map cache line of a pre-map
+		 * LBA modulo nmap_locks, see get_map_lock_num().  Each lock
+		 * takes a whole cache line.
 		 */
-		os_mutex_t *map_locks;
+		struct map_lock_entry {
+			os_mutex_t lock;
+
+			uint8_t padding[CACHELINE_SIZE - sizeof(os_mutex_t)];
+		} *map_locks;
+		void *map_locks_buf;	/* unaligned allocation of map_locks */
 
 		/*
 		 * Arena info block locking.
@@ -217,6 +258,24 @@ struct btt {
 	 */
 	void *ns;
 	const struct ns_callback *ns_cbp;
+
+	/*
+	 * Direct read slots.  A direct read keeps the rtt entry of its slot
+	 * set until it is released, so unlike the other reads it can't
+	 * use the entry of a lane.  Slots are claimed by setting the
+	 * corresponding direct_busy flag and since they are claimed lowest
+	 * first, writers only have to check the slots below direct_hwm.
+	 * A writer whose free block is held by a direct read waits on
+	 * direct_cond, which is signaled when a slot is released while
+	 * there are any waiters.
+	 */
+	unsigned ndirect;		/* number of direct read slots */
+	unsigned direct_hwm;		/* slots above were never used */
+	uint32_t *direct_busy;		/* one flag per slot */
+	void *zero_blockp;		/* block of zeros for direct reads */
+	unsigned direct_waiters;	/* writers waiting on direct_cond */
+	os_mutex_t direct_lock;
+	os_cond_t direct_cond;
 };
 
 /*
@@ -241,24 +300,65 @@ static const struct btt_flog Zflog;
 static const unsigned Nseq[] = { 0, 2, 3, 1 };
 #define NSEQ(seq) (Nseq[(seq) & 3])
 
+/*
+ * Number of map locks per cpu.  The map locks are taken by all the writes,
+ * so there has to be enough of them for writes to random LBAs from all
+ * the cpus to rarely collide on the same lock, but not so many that they
+ * waste memory and cache.
+ */
+#define BTT_MAP_LOCKS_PER_CPU 16
+
+/*
+ * How long a write waits for the direct reads of its free block to be
+ * released before it fails with EBUSY.
+ */
+#define BTT_DIRECT_WAIT_SEC 1
+
 /*
  * get_map_lock_num -- (internal) Calculate offset into map_locks[]
  *
- * map_locks[] contains nfree locks which are used to protect the map
+ * map_locks[] contains nmap_locks locks which are used to protect the map
  * from concurrent access to the same cache line.  The index into
  * map_locks[] is calculated by looking at the byte offset into the map
  * (premap_lba * BTT_MAP_ENTRY_SIZE), figuring out how many cache lines
  * that is into the map that is (dividing by BTT_MAP_LOCK_ALIGN), and
- * then selecting one of nfree locks (the modulo at the end).
+ * then selecting one of nmap_locks locks (the mask at the end, since
+ * nmap_locks is a power of 2).
  *
  * The extra cast is to keep gcc from generating a false positive
  * 64-32 bit conversion error when -fsanitize is set.
  */
 static inline uint32_t
-get_map_lock_num(uint32_t premap_lba, uint32_t nfree)
+get_map_lock_num(uint32_t premap_lba, uint32_t nmap_locks)
 {
 	return (uint32_t)(premap_lba * BTT_MAP_ENTRY_SIZE / BTT_MAP_LOCK_ALIGN)
-		% nfree;
+		& (nmap_locks - 1);
+}
+
+/*
+ * map_locks_count -- (internal) calculate the number of map locks
+ *
+ * The number of map locks used to be equal to nfree, which ties it to
+ * the on-media layout instead of the number of threads writing to it.
+ * It is now BTT_MAP_LOCKS_PER_CPU per cpu, but never less than the
+ * default nfree, rounded up to a power of 2.
+ */
+static uint32_t
+map_locks_count(void)
+{
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpus < 1)
+		ncpus = 1;
+
+	uint64_t nlocks = (uint64_t)ncpus * BTT_MAP_LOCKS_PER_CPU;
+	if (nlocks < BTT_DEFAULT_NFREE)
+		nlocks = BTT_DEFAULT_NFREE;
+
+	uint32_t count = 1;
+	while (count < nlocks && count < (1U << 20))
+		count <<= 1;
+
+	return count;
 }
 
 /*
@@ -284,6 +384,50 @@ invalid_lba(struct btt *bttp, uint64_t lba)
 	return 0;
 }
 
+/*
+ * ns_write_nodrain -- (internal) write to the namespace without draining
+ *
+ * The data is guaranteed to be durable only after a subsequent call
+ * to ns_drain() or to the nswrite callback.
+ */
+static int
+ns_write_nodrain(struct btt *bttp, unsigned lane, const void *buf,
+		size_t count, uint64_t off)
+{
+	if (bttp->ns_cbp->nswrite_nodrain == NULL)
+		return (*bttp->ns_cbp->nswrite)(bttp->ns, lane, buf, count,
+				off);
+
+	return (*bttp->ns_cbp->nswrite_nodrain)(bttp->ns, lane, buf, count,
+			off);
+}
+
+/*
+ * zalloc_cacheline -- (internal) allocate zeroed, cache line aligned memory
+ *
+ * The returned pointer is aligned up from the actual allocation, which
+ * is stored in *bufp and has to be passed to Free().
+ */
+static void *
+zalloc_cacheline(size_t size, void **bufp)
+{
+	*bufp = Zalloc(size + CACHELINE_SIZE - 1);
+	if (*bufp == NULL)
+		return NULL;
+
+	return (void *)ALIGN_UP((uintptr_t)*bufp, CACHELINE_SIZE);
+}
+
+/*
+ * ns_drain -- (internal) wait for writes done by ns_write_nodrain()
+ */
+static void
+ns_drain(struct btt *bttp, unsigned lane)
+{
+	if (bttp->ns_cbp->nsdrain != NULL)
+		(*bttp->ns_cbp->nsdrain)(bttp->ns, lane);
+}
+
 /*
  * read_info -- (internal) convert btt_info to host byte order & validate
  *
@@ -546,6 +690,10 @@ read_flog_pair(struct btt *bttp, unsigned lane, struct arena *arenap,
  * and, only after those fields are known to be written durably, the
  * second write for the seq field is done.
  *
+ * The first write is not drained separately, it becomes durable together
+ * with any other pending ns_write_nodrain() stores of the caller (like
+ * the data block of btt_write()) just before the seq field is written.
+ *
  * Returns 0 on success, otherwise -1/errno.
  */
 static int
@@ -567,11 +715,14 @@ flog_update(struct btt *bttp, unsigned lane, struct arena *arenap,
 		arenap->flogs[lane].entries[arenap->flogs[lane].next];
 
 	/* write out first two fields first */
-	if ((*bttp->ns_cbp->nswrite)(bttp->ns, lane, &new_flog,
+	if (ns_write_nodrain(bttp, lane, &new_flog,
 				sizeof(uint32_t) * 2, new_flog_off) < 0)
 		return -1;
 	new_flog_off += sizeof(uint32_t) * 2;
 
+	/* make them (and all the caller's pending writes) durable */
+	ns_drain(bttp, lane);
+
 	/* write out new_map and seq field to make it active */
 	if ((*bttp->ns_cbp->nswrite)(bttp->ns, lane, &new_flog.new_map,
 				sizeof(uint32_t) * 2, new_flog_off) < 0)
@@ -674,8 +825,9 @@ set_arena_error(struct btt *bttp, struct arena *arenap, unsigned lane)
 static int
 read_flogs(struct btt *bttp, unsigned lane, struct arena *arenap)
 {
-	if ((arenap->flogs = Zalloc(bttp->nfree *
-			sizeof(struct flog_runtime))) == NULL) {
+	if ((arenap->flogs = zalloc_cacheline(bttp->nfree *
+			sizeof(struct flog_runtime), &arenap->flogs_buf))
+							== NULL) {
 		ERR("!Malloc for %u flog entries", bttp->nfree);
 		return -1;
 	}
@@ -711,18 +863,19 @@ read_flogs(struct btt *bttp, unsigned lane, struct arena *arenap)
  *
  * The rtt is big enough to hold an entry for each free block (nfree)
  * since nlane can't be bigger than nfree.  nlane may end up smaller,
- * in which case some of the high rtt entries will be unused.
+ * in which case some of the high rtt entries will be unused.  The same
+ * number of entries follows for the direct read slots.
  */
 static int
 build_rtt(struct btt *bttp, struct arena *arenap)
 {
-	if ((arenap->rtt = Malloc(bttp->nfree * sizeof(uint32_t)))
-							== NULL) {
-		ERR("!Malloc for %d rtt entries", bttp->nfree);
+	if ((arenap->rtt = zalloc_cacheline(2 * bttp->nfree *
+			sizeof(struct rtt_entry), &arenap->rtt_buf)) == NULL) {
+		ERR("!Malloc for %d rtt entries", 2 * bttp->nfree);
 		return -1;
 	}
-	for (uint32_t lane = 0; lane < bttp->nfree; lane++)
-		arenap->rtt[lane] = BTT_MAP_ENTRY_ERROR;
+	for (uint32_t lane = 0; lane < 2 * bttp->nfree; lane++)
+		arenap->rtt[lane].entry = BTT_MAP_ENTRY_ERROR;
 	util_synchronize();
 
 	return 0;
@@ -736,14 +889,14 @@ build_rtt(struct btt *bttp, struct arena *arenap)
 static int
 build_map_locks(struct btt *bttp, struct arena *arenap)
 {
-	if ((arenap->map_locks =
-			Malloc(bttp->nfree * sizeof(*arenap->map_locks)))
+	if ((arenap->map_locks = zalloc_cacheline(bttp->nmap_locks *
+			sizeof(*arenap->map_locks), &arenap->map_locks_buf))
 							== NULL) {
-		ERR("!Malloc for %d map_lock entries", bttp->nfree);
+		ERR("!Malloc for %u map_lock entries", bttp->nmap_locks);
 		return -1;
 	}
-	for (uint32_t lane = 0; lane < bttp->nfree; lane++)
-		util_mutex_init(&arenap->map_locks[lane]);
+	for (uint32_t i = 0; i < bttp->nmap_locks; i++)
+		util_mutex_init(&arenap->map_locks[i].lock);
 
 	return 0;
 }
@@ -897,11 +1050,11 @@ err:
 	if (bttp->arenas) {
 		for (unsigned i = 0; i < bttp->narena; i++) {
 			if (bttp->arenas[i].flogs)
-				Free(bttp->arenas[i].flogs);
+				Free(bttp->arenas[i].flogs_buf);
 			if (bttp->arenas[i].rtt)
-				Free((void *)bttp->arenas[i].rtt);
+				Free(bttp->arenas[i].rtt_buf);
 			if (bttp->arenas[i].map_locks)
-				Free((void *)bttp->arenas[i].map_locks);
+				Free(bttp->arenas[i].map_locks_buf);
 		}
 		Free(bttp->arenas);
 		bttp->arenas = NULL;
@@ -1421,7 +1574,10 @@ btt_init(uint64_t rawsize, uint32_t lbasize, uint8_t parent_uuid[],
 	}
 
 	util_mutex_init(&bttp->layout_write_mutex);
+	util_mutex_init(&bttp->direct_lock);
+	util_cond_init(&bttp->direct_cond);
 	memcpy(bttp->parent_uuid, parent_uuid, BTTINFO_UUID_LEN);
+	bttp->nmap_locks = map_locks_count();
 	bttp->rawsize = rawsize;
 	bttp->lbasize = lbasize;
 	bttp->ns = ns;
@@ -1448,6 +1604,15 @@ btt_init(uint64_t rawsize, uint32_t lbasize, uint8_t parent_uuid[],
 	if (maxlane && bttp->nlane > maxlane)
 		bttp->nlane = maxlane;
 
+	bttp->ndirect = bttp->nfree;
+	bttp->direct_busy = Zalloc(bttp->ndirect * sizeof(uint32_t));
+	bttp->zero_blockp = Zalloc(lbasize);
+	if (bttp->direct_busy == NULL || bttp->zero_blockp == NULL) {
+		ERR("!Malloc for direct read slots");
+		btt_fini(bttp);
+		return NULL;
+	}
+
 	LOG(3, "success, bttp %p nlane %u", bttp, bttp->nlane);
 	return bttp;
 }
@@ -1482,28 +1647,68 @@ btt_nlba(struct btt *bttp)
 }
 
 /*
- * btt_read -- read a block from a btt namespace
+ * iov_nlba -- (internal) count the blocks described by an I/O vector
+ *
+ * Each element of the vector has to cover a whole number of blocks and
+ * all of them, starting at the given LBA, have to fit in the namespace.
  *
  * Returns 0 on success, otherwise -1/errno.
  */
-int
-btt_read(struct btt *bttp, unsigned lane, uint64_t lba, void *buf)
+static int
+iov_nlba(struct btt *bttp, uint64_t lba, const struct iovec *iov, int iovcnt,
+		uint64_t *nlbap)
 {
-	LOG(3, "bttp %p lane %u lba %" PRIu64, bttp, lane, lba);
+	LOG(3, "bttp %p lba %" PRIu64 " iov %p iovcnt %d",
+			bttp, lba, iov, iovcnt);
+
+	if (iovcnt < 0) {
+		ERR("iovcnt is less than zero: %d", iovcnt);
+		errno = EINVAL;
+		return -1;
+	}
+
+	uint64_t nlba = 0;
+	for (int i = 0; i < iovcnt; i++) {
+		if (iov[i].iov_len % bttp->lbasize) {
+			ERR("iov[%d] length %zu not a multiple of lbasize %u",
+					i, iov[i].iov_len, bttp->lbasize);
+			errno = EINVAL;
+			return -1;
+		}
+
+		nlba += iov[i].iov_len / bttp->lbasize;
+	}
 
 	if (invalid_lba(bttp, lba))
 		return -1;
 
-	/* if there's no layout written yet, all reads come back as zeros */
-	if (!bttp->laidout)
-		return zero_block(bttp, buf);
+	if (nlba > bttp->nlba - lba) {
+		ERR("lba range out of range (lba %" PRIu64 " count %" PRIu64
+				" nlba %" PRIu64 ")", lba, nlba, bttp->nlba);
+		errno = EINVAL;
+		return -1;
+	}
 
-	/* find which arena LBA lives in, and the offset to the map entry */
-	struct arena *arenap;
-	uint32_t premap_lba;
+	*nlbap = nlba;
+	return 0;
+}
+
+/*
+ * rtt_protect -- (internal) find the data block of an LBA and protect it
+ *
+ * On success the post-map LBA of the data block is stored in *rttp, which
+ * keeps writes from reallocating the block until *rttp is reset to
+ * BTT_MAP_ENTRY_ERROR, and the offset of the data block is returned
+ * in *data_block_offp.
+ *
+ * Returns 0 on success, 1 if the block reads as zeros (*rttp untouched),
+ * otherwise -1/errno.
+ */
+static int
+rtt_protect(struct btt *bttp, unsigned lane, struct arena *arenap,
+	uint32_t premap_lba, uint32_t volatile *rttp, uint64_t *data_block_offp)
+{
 	uint64_t map_entry_off;
-	if (lba_to_arena_lba(bttp, lba, &arenap, &premap_lba) < 0)
-		return -1;
 
 	/* convert pre-map LBA into an offset into the map */
 	map_entry_off = arenap->mapoff + BTT_MAP_ENTRY_SIZE * premap_lba;
@@ -1532,7 +1737,7 @@ btt_read(struct btt *bttp, unsigned lane, uint64_t lba, void *buf)
 		}
 
 		if (map_entry_is_zero_or_initial(entry))
-			return zero_block(bttp, buf);
+			return 1;
 
 		/*
 		 * Record the post-map LBA in the read tracking table during
@@ -1547,7 +1752,7 @@ btt_read(struct btt *bttp, unsigned lane, uint64_t lba, void *buf)
 		 * btt_write() will check for it the same way, with the bits
 		 * both set.
 		 */
-		arenap->rtt[lane] = entry;
+		*rttp = entry;
 		util_synchronize();
 
 		/*
@@ -1561,7 +1766,7 @@ btt_read(struct btt *bttp, unsigned lane, uint64_t lba, void *buf)
 		uint32_t latest_entry;
 		if ((*bttp->ns_cbp->nsread)(bttp->ns, lane, &latest_entry,
 				sizeof(latest_entry), map_entry_off) < 0) {
-			arenap->rtt[lane] = BTT_MAP_ENTRY_ERROR;
+			*rttp = BTT_MAP_ENTRY_ERROR;
 			return -1;
 		}
 
@@ -1573,44 +1778,386 @@ btt_read(struct btt *bttp, unsigned lane, uint64_t lba, void *buf)
 			entry = latest_entry;	/* try again */
 	}
 
+	*data_block_offp =
+		arenap->dataoff + (uint64_t)(entry & BTT_MAP_ENTRY_LBA_MASK) *
+		arenap->internal_lbasize;
+
+	return 0;
+}
+
+/*
+ * read_block -- (internal) read a single, already validated, block
+ *
+ * Returns 0 on success, otherwise -1/errno.
+ */
+static int
+read_block(struct btt *bttp, unsigned lane, uint64_t lba, void *buf)
+{
+	/* if there's no layout written yet, all reads come back as zeros */
+	if (!bttp->laidout)
+		return zero_block(bttp, buf);
+
+	/* find which arena LBA lives in, and the offset to the map entry */
+	struct arena *arenap;
+	uint32_t premap_lba;
+	if (lba_to_arena_lba(bttp, lba, &arenap, &premap_lba) < 0)
+		return -1;
+
+	uint64_t data_block_off;
+	int ret = rtt_protect(bttp, lane, arenap, premap_lba,
+			&arenap->rtt[lane].entry, &data_block_off);
+	if (ret < 0)
+		return -1;
+	if (ret > 0)
+		return zero_block(bttp, buf);
+
 	/*
 	 * It is safe to read the block now, since the rtt protects the
 	 * block from getting re-allocated to something else by a write.
 	 */
-	uint64_t data_block_off =
-		arenap->dataoff + (uint64_t)(entry & BTT_MAP_ENTRY_LBA_MASK) *
-		arenap->internal_lbasize;
 	int readret = (*bttp->ns_cbp->nsread)(bttp->ns, lane, buf,
 					bttp->lbasize, data_block_off);
 
 	/* done with read, so clear out rtt entry */
-	arenap->rtt[lane] = BTT_MAP_ENTRY_ERROR;
+	arenap->rtt[lane].entry = BTT_MAP_ENTRY_ERROR;
 
 	return readret;
 }
 
 /*
- * map_lock -- (internal) grab the map_lock and read a map entry
+ * btt_read -- read a block from a btt namespace
+ *
+ * Returns 0 on success, otherwise -1/errno.
+ */
+int
+btt_read(struct btt *bttp, unsigned lane, uint64_t lba, void *buf)
+{
+	LOG(3, "bttp %p lane %u lba %" PRIu64, bttp, lane, lba);
+
+	if (invalid_lba(bttp, lba))
+		return -1;
+
+	return read_block(bttp, lane, lba, buf);
+}
+
+/*
+ * btt_readv -- read a range of blocks from a btt namespace
+ *
+ * The blocks starting at lba are scattered into the buffers described
+ * by iov, each of which has to be a multiple of the block size.
+ *
+ * Returns 0 on success, otherwise -1/errno.
+ */
+int
+btt_readv(struct btt *bttp, unsigned lane, uint64_t lba,
+		const struct iovec *iov, int iovcnt)
+{
+	LOG(3, "bttp %p lane %u lba %" PRIu64 " iov %p iovcnt %d",
+			bttp, lane, lba, iov, iovcnt);
+
+	uint64_t nlba;
+	if (iov_nlba(bttp, lba, iov, iovcnt, &nlba) < 0)
+		return -1;
+
+	for (int i = 0; i < iovcnt; i++) {
+		char *buf = iov[i].iov_base;
+		char *end = buf + iov[i].iov_len;
+
+		for (; buf < end; buf += bttp->lbasize)
+			if (read_block(bttp, lane, lba++, buf) < 0)
+				return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * map_hold -- (internal) state of a map_lock kept across blocks of a write
+ *
+ * The map entry written last under the held lock may not be durable yet.
+ * It is made durable by the next drain, which always happens before the
+ * lock is handed over to another thread, so no other writer can build
+ * its flog entry on a map entry which could still be lost.
+ */
+struct map_hold {
+	struct arena *arenap;	/* arena of the held lock, NULL if none */
+	uint32_t lock_num;	/* index of the held lock in map_locks[] */
+};
+
+/*
+ * map_hold_release -- (internal) make the map durable and drop the lock
+ */
+static void
+map_hold_release(struct btt *bttp, unsigned lane, struct map_hold *holdp)
+{
+	if (holdp->arenap == NULL)
+		return;
+
+	ns_drain(bttp, lane);
+	util_mutex_unlock(&holdp->arenap->map_locks[holdp->lock_num].lock);
+	holdp->arenap = NULL;
+}
+
+/*
+ * map_hold_acquire -- (internal) make sure the map_lock of an entry is held
+ *
+ * Consecutive pre-map LBAs share a cache line of the map and thus also
+ * the map_lock, in which case the lock taken for the previous block is
+ * simply kept.  At most one map_lock is held at a time.
+ *
+ * The data block doesn't have to be durable before the lock is taken,
+ * it is drained by flog_update() together with the previous map update.
+ */
+static void
+map_hold_acquire(struct btt *bttp, unsigned lane, struct map_hold *holdp,
+		struct arena *arenap, uint32_t premap_lba)
+{
+	uint32_t lock_num = get_map_lock_num(premap_lba, bttp->nmap_locks);
+
+	if (holdp->arenap == arenap && holdp->lock_num == lock_num)
+		return;
+
+	map_hold_release(bttp, lane, holdp);
+
+	util_mutex_lock(&arenap->map_locks[lock_num].lock);
+	holdp->arenap = arenap;
+	holdp->lock_num = lock_num;
+}
+
+/*
+ * direct_slot_claim -- (internal) claim a free direct read slot
+ *
+ * Returns 0 on success, otherwise -1/errno.
  */
 static int
-map_lock(struct btt *bttp, unsigned lane, struct arena *arenap,
-		uint32_t *entryp, uint32_t premap_lba)
+direct_slot_claim(struct btt *bttp, unsigned *slotp)
 {
-	LOG(3, "bttp %p lane %u arenap %p premap_lba %u",
-			bttp, lane, arenap, premap_lba);
+	unsigned slot;
+	for (slot = 0; slot < bttp->ndirect; slot++) {
+		if (bttp->direct_busy[slot] == 0 &&
+		    util_bool_compare_and_swap32(&bttp->direct_busy[slot],
+				0, 1))
+			break;
+	}
+
+	if (slot == bttp->ndirect) {
+		ERR("all %u direct read slots in use", bttp->ndirect);
+		errno = EAGAIN;
+		return -1;
+	}
+
+	/* make sure writers will look at this slot */
+	unsigned hwm;
+	do {
+		util_atomic_load_explicit32(&bttp->direct_hwm, &hwm,
+				memory_order_acquire);
+	} while (hwm <= slot &&
+		!util_bool_compare_and_swap32(&bttp->direct_hwm, hwm,
+				slot + 1));
+
+	*slotp = slot;
+	return 0;
+}
+
+/*
+ * direct_slot_release -- (internal) clear and release a direct read slot
+ */
+static void
+direct_slot_release(struct btt *bttp, unsigned slot)
+{
+	if (bttp->laidout) {
+		for (unsigned i = 0; i < bttp->narena; i++)
+			bttp->arenas[i].rtt[bttp->nfree + slot].entry =
+				BTT_MAP_ENTRY_ERROR;
+	}
+
+	util_atomic_store_explicit32(&bttp->direct_busy[slot], 0,
+			memory_order_release);
+
+	/*
+	 * A writer registers itself before it checks the rtt, so either it
+	 * sees the cleared entries or it is seen here.
+	 */
+	util_synchronize();
+
+	unsigned waiters;
+	util_atomic_load_explicit32(&bttp->direct_waiters, &waiters,
+			memory_order_relaxed);
+	if (waiters == 0)
+		return;
+
+	/* wake up the writers waiting for their free blocks */
+	util_mutex_lock(&bttp->direct_lock);
+	os_cond_broadcast(&bttp->direct_cond);
+	util_mutex_unlock(&bttp->direct_lock);
+}
+
+/*
+ * direct_wait -- (internal) wait for the direct reads of a free block
+ *
+ * A direct read may keep the block for arbitrarily long, so instead of
+ * spinning the writer sleeps until a slot is released, but no longer than
+ * BTT_DIRECT_WAIT_SEC in total.  This also keeps a thread which writes
+ * while holding a direct read of its own from deadlocking.  The map_lock
+ * held by the writer, if any, is released before it goes to sleep, so that
+ * the writes of the other blocks under that lock can proceed.
+ *
+ * Returns 0 on success, otherwise -1/errno.
+ */
+static int
+direct_wait(struct btt *bttp, unsigned lane, struct arena *arenap,
+		uint32_t free_entry, struct map_hold *holdp)
+{
+	unsigned direct_hwm;
+	util_atomic_load_explicit32(&bttp->direct_hwm, &direct_hwm,
+			memory_order_acquire);
+
+	struct timespec deadline = { 0, 0 };
+	int ret = 0;
+	unsigned i = 0;
+	while (i < direct_hwm) {
+		if (arenap->rtt[bttp->nfree + i].entry != free_entry) {
+			i++;
+			continue;
+		}
+
+		if (deadline.tv_sec == 0) {
+			map_hold_release(bttp, lane, holdp);
+			os_clock_gettime(CLOCK_REALTIME, &deadline);
+			deadline.tv_sec += BTT_DIRECT_WAIT_SEC;
+		}
+
+		ret = 0;
+		util_mutex_lock(&bttp->direct_lock);
+		util_fetch_and_add32(&bttp->direct_waiters, 1);
+		/* the slot might have been released in the meantime */
+		if (arenap->rtt[bttp->nfree + i].entry == free_entry)
+			ret = os_cond_timedwait(&bttp->direct_cond,
+					&bttp->direct_lock, &deadline);
+		util_fetch_and_sub32(&bttp->direct_waiters, 1);
+		util_mutex_unlock(&bttp->direct_lock);
+
+		if (ret != 0 &&
+		    arenap->rtt[bttp->nfree + i].entry == free_entry) {
+			ERR("free block %u held by a direct read",
+				free_entry & BTT_MAP_ENTRY_LBA_MASK);
+			errno = EBUSY;
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * btt_read_direct -- get direct read-only access to a block
+ *
+ * On success *addrp points to the data of the block and *slotp identifies
+ * the direct read slot which protects the block from being reused by
+ * writes, until it is passed to btt_read_direct_release().
+ *
+ * The lane is used only for the duration of this call.
+ *
+ * Returns 0 on success, otherwise -1/errno.
+ */
+int
+btt_read_direct(struct btt *bttp, unsigned lane, uint64_t lba,
+		const void **addrp, unsigned *slotp)
+{
+	LOG(3, "bttp %p lane %u lba %" PRIu64, bttp, lane, lba);
+
+	if (invalid_lba(bttp, lba))
+		return -1;
+
+	unsigned slot;
+	if (direct_slot_claim(bttp, &slot) < 0)
+		return -1;
+
+	/* if there's no layout written yet, all reads come back as zeros */
+	if (!bttp->laidout) {
+		*addrp = bttp->zero_blockp;
+		*slotp = slot;
+		return 0;
+	}
+
+	struct arena *arenap;
+	uint32_t premap_lba;
+	if (lba_to_arena_lba(bttp, lba, &arenap, &premap_lba) < 0)
+		goto err;
+
+	uint64_t data_block_off;
+	int ret = rtt_protect(bttp, lane, arenap, premap_lba,
+			&arenap->rtt[bttp->nfree + slot].entry,
+			&data_block_off);
+	if (ret < 0)
+		goto err;
+
+	if (ret > 0) {
+		*addrp = bttp->zero_blockp;
+	} else {
+		void *addr;
+		ssize_t len = (*bttp->ns_cbp->nsmap)(bttp->ns, lane, &addr,
+				bttp->lbasize, data_block_off);
+		if (len < 0)
+			goto err;
+
+		if ((size_t)len < bttp->lbasize) {
+			ERR("direct access to a block not possible");
+			errno = ENOTSUP;
+			goto err;
+		}
+
+		*addrp = addr;
+	}
+
+	*slotp = slot;
+	return 0;
+
+err:
+	direct_slot_release(bttp, slot);
+	return -1;
+}
+
+/*
+ * btt_read_direct_release -- end the direct access to a block
+ */
+void
+btt_read_direct_release(struct btt *bttp, unsigned slot)
+{
+	LOG(3, "bttp %p slot %u", bttp, slot);
 
+	if (slot >= bttp->ndirect) {
+		ERR("invalid direct read reference %u", slot);
+		errno = EINVAL;
+		return;
+	}
+
+	uint32_t busy;
+	util_atomic_load_explicit32(&bttp->direct_busy[slot], &busy,
+			memory_order_acquire);
+	if (busy == 0) {
+		ERR("direct read reference %u is not in use", slot);
+		errno = EINVAL;
+		return;
+	}
+
+	direct_slot_release(bttp, slot);
+}
+
+/*
+ * map_read -- (internal) read a map entry, the map_lock must be held
+ */
+static int
+map_read(struct btt *bttp, unsigned lane, struct arena *arenap,
+		uint32_t *entryp, uint32_t premap_lba)
+{
 	uint64_t map_entry_off =
 			arenap->mapoff + BTT_MAP_ENTRY_SIZE * premap_lba;
-	uint32_t map_lock_num = get_map_lock_num(premap_lba, bttp->nfree);
-
-	util_mutex_lock(&arenap->map_locks[map_lock_num]);
 
 	/* read the old map entry */
 	if ((*bttp->ns_cbp->nsread)(bttp->ns, lane, entryp,
-				sizeof(uint32_t), map_entry_off) < 0) {
-		util_mutex_unlock(&arenap->map_locks[map_lock_num]);
+				sizeof(uint32_t), map_entry_off) < 0)
 		return -1;
-	}
 
 	/* if map entry is in its initial state return premap_lba */
 	if (map_entry_is_initial(*entryp))
@@ -1624,6 +2171,29 @@ map_lock(struct btt *bttp, unsigned lane, struct arena *arenap,
 	return 0;
 }
 
+/*
+ * map_lock -- (internal) grab the map_lock and read a map entry
+ */
+static int
+map_lock(struct btt *bttp, unsigned lane, struct arena *arenap,
+		uint32_t *entryp, uint32_t premap_lba)
+{
+	LOG(3, "bttp %p lane %u arenap %p premap_lba %u",
+			bttp, lane, arenap, premap_lba);
+
+	uint32_t map_lock_num = get_map_lock_num(premap_lba,
+			bttp->nmap_locks);
+
+	util_mutex_lock(&arenap->map_locks[map_lock_num].lock);
+
+	if (map_read(bttp, lane, arenap, entryp, premap_lba) < 0) {
+		util_mutex_unlock(&arenap->map_locks[map_lock_num].lock);
+		return -1;
+	}
+
+	return 0;
+}
+
 /*
  * map_abort -- (internal) drop the map_lock without updating the entry
  */
@@ -1635,7 +2205,7 @@ map_abort(struct btt *bttp, unsigned lane, struct arena *arenap,
 			bttp, lane, arenap, premap_lba);
 
 	util_mutex_unlock(&arenap->map_locks[get_map_lock_num(premap_lba,
-				bttp->nfree)]);
+				bttp->nmap_locks)].lock);
 }
 
 /*
@@ -1656,7 +2226,7 @@ map_unlock(struct btt *bttp, unsigned lane, struct arena *arenap,
 				sizeof(uint32_t), map_entry_off);
 
 	util_mutex_unlock(&arenap->map_locks[get_map_lock_num(premap_lba,
-				bttp->nfree)]);
+				bttp->nmap_locks)].lock);
 
 	LOG(9, "unlocked map[%d]: %u%s%s", premap_lba,
 			entry & BTT_MAP_ENTRY_LBA_MASK,
@@ -1667,33 +2237,17 @@ map_unlock(struct btt *bttp, unsigned lane, struct arena *arenap,
 }
 
 /*
- * btt_write -- write a block to a btt namespace
+ * write_block -- (internal) write a single, already validated, block
+ *
+ * The new map entry is stored, but not drained, under the map_lock
+ * described by holdp, which remains held on return.
  *
  * Returns 0 on success, otherwise -1/errno.
  */
-int
-btt_write(struct btt *bttp, unsigned lane, uint64_t lba, const void *buf)
+static int
+write_block(struct btt *bttp, unsigned lane, uint64_t lba, const void *buf,
+		struct map_hold *holdp)
 {
-	LOG(3, "bttp %p lane %u lba %" PRIu64, bttp, lane, lba);
-
-	if (invalid_lba(bttp, lba))
-		return -1;
-
-	/* first write through here will initialize the metadata layout */
-	if (!bttp->laidout) {
-		int err = 0;
-
-		util_mutex_lock(&bttp->layout_write_mutex);
-
-		if (!bttp->laidout)
-			err = write_layout(bttp, lane, 1);
-
-		util_mutex_unlock(&bttp->layout_write_mutex);
-
-		if (err < 0)
-			return err;
-	}
-
 	/* find which arena LBA lives in, and the offset to the map entry */
 	struct arena *arenap;
 	uint32_t premap_lba;
@@ -1725,48 +2279,162 @@ btt_write(struct btt *bttp, unsigned lane, uint64_t lba, const void *buf)
 
 	/* wait for other threads to finish any reads on free block */
 	for (unsigned i = 0; i < bttp->nlane; i++)
-		while (arenap->rtt[i] == free_entry)
+		while (arenap->rtt[i].entry == free_entry)
 			;
 
-	/* it is now safe to perform write to the free block */
+	/* ... including the direct ones, which may take a while */
+	if (direct_wait(bttp, lane, arenap, free_entry, holdp) < 0)
+		return -1;
+
+	/*
+	 * It is now safe to perform write to the free block.  The write
+	 * doesn't have to be durable right away, it is drained by
+	 * flog_update() before the new flog entry becomes active.
+	 */
 	uint64_t data_block_off = arenap->dataoff +
 		(uint64_t)(free_entry & BTT_MAP_ENTRY_LBA_MASK) *
 		arenap->internal_lbasize;
-	if ((*bttp->ns_cbp->nswrite)(bttp->ns, lane, buf,
-				bttp->lbasize, data_block_off) < 0)
+	if (ns_write_nodrain(bttp, lane, buf, bttp->lbasize,
+				data_block_off) < 0)
 		return -1;
 
 	/*
 	 * Make the new block active atomically by updating the on-media flog
 	 * and then updating the map.
 	 */
+	map_hold_acquire(bttp, lane, holdp, arenap, premap_lba);
+
 	uint32_t old_entry;
-	if (map_lock(bttp, lane, arenap, &old_entry, premap_lba) < 0)
+	if (map_read(bttp, lane, arenap, &old_entry, premap_lba) < 0)
 		return -1;
 
 	old_entry = le32toh(old_entry);
 
-	/* update the flog */
+	/* update the flog, this also drains the previous map update */
 	if (flog_update(bttp, lane, arenap, premap_lba,
-					old_entry, free_entry) < 0) {
-		map_abort(bttp, lane, arenap, premap_lba);
+					old_entry, free_entry) < 0)
 		return -1;
-	}
 
-	if (map_unlock(bttp, lane, arenap, htole32(free_entry),
-					premap_lba) < 0) {
+	uint64_t map_entry_off =
+			arenap->mapoff + BTT_MAP_ENTRY_SIZE * premap_lba;
+	uint32_t entry = htole32(free_entry);
+
+	if (ns_write_nodrain(bttp, lane, &entry, sizeof(entry),
+				map_entry_off) < 0) {
 		/*
 		 * A critical write error occurred, set the arena's
 		 * info block error bit.
 		 */
+		map_hold_release(bttp, lane, holdp);
 		set_arena_error(bttp, arenap, lane);
 		errno = EIO;
 		return -1;
 	}
 
+	LOG(9, "updated map[%d]: %u", premap_lba,
+			free_entry & BTT_MAP_ENTRY_LBA_MASK);
+
+	return 0;
+}
+
+/*
+ * write_layout_once -- (internal) write the layout if not done already
+ *
+ * Returns 0 on success, otherwise -1/errno.
+ */
+static int
+write_layout_once(struct btt *bttp, unsigned lane)
+{
+	/* first write through here will initialize the metadata layout */
+	if (!bttp->laidout) {
+		int err = 0;
+
+		util_mutex_lock(&bttp->layout_write_mutex);
+
+		if (!bttp->laidout)
+			err = write_layout(bttp, lane, 1);
+
+		util_mutex_unlock(&bttp->layout_write_mutex);
+
+		if (err < 0)
+			return err;
+	}
+
 	return 0;
 }
 
+/*
+ * btt_write -- write a block to a btt namespace
+ *
+ * Returns 0 on success, otherwise -1/errno.
+ */
+int
+btt_write(struct btt *bttp, unsigned lane, uint64_t lba, const void *buf)
+{
+	LOG(3, "bttp %p lane %u lba %" PRIu64, bttp, lane, lba);
+
+	if (invalid_lba(bttp, lba))
+		return -1;
+
+	if (write_layout_once(bttp, lane) < 0)
+		return -1;
+
+	struct map_hold hold = { NULL, 0 };
+
+	int ret = write_block(bttp, lane, lba, buf, &hold);
+
+	map_hold_release(bttp, lane, &hold);
+
+	return ret;
+}
+
+/*
+ * btt_writev -- write a range of blocks to a btt namespace
+ *
+ * The buffers described by iov, each of which has to be a multiple of
+ * the block size, are gathered into the blocks starting at lba.  Every
+ * block is written atomically, but the range as a whole is not, i.e.
+ * on failure the blocks preceding the failing one remain written.
+ *
+ * While the blocks go to consecutive entries of the same map cache line,
+ * its map_lock is kept and the map update of each block is drained
+ * together with the data and flog writes of the next one.
+ *
+ * Returns 0 on success, otherwise -1/errno.
+ */
+int
+btt_writev(struct btt *bttp, unsigned lane, uint64_t lba,
+		const struct iovec *iov, int iovcnt)
+{
+	LOG(3, "bttp %p lane %u lba %" PRIu64 " iov %p iovcnt %d",
+			bttp, lane, lba, iov, iovcnt);
+
+	uint64_t nlba;
+	if (iov_nlba(bttp, lba, iov, iovcnt, &nlba) < 0)
+		return -1;
+
+	if (nlba == 0)
+		return 0;
+
+	if (write_layout_once(bttp, lane) < 0)
+		return -1;
+
+	struct map_hold hold = { NULL, 0 };
+	int ret = 0;
+
+	for (int i = 0; i < iovcnt && ret == 0; i++) {
+		const char *buf = iov[i].iov_base;
+		const char *end = buf + iov[i].iov_len;
+
+		for (; buf < end && ret == 0; buf += bttp->lbasize)
+			ret = write_block(bttp, lane, lba++, buf, &hold);
+	}
+
+	map_hold_release(bttp, lane, &hold);
+
+	return ret;
+}
+
 /*
  * map_entry_setf -- (internal) set a given flag on a map entry
  *
@@ -2039,13 +2707,17 @@ btt_fini(struct btt *bttp)
 	if (bttp->arenas) {
 		for (unsigned i = 0; i < bttp->narena; i++) {
 			if (bttp->arenas[i].flogs)
-				Free(bttp->arenas[i].flogs);
-			if (bttp->arenas[i].rtt)
-				Free((void *)bttp->arenas[i].rtt);
+				Free(bttp->arenas[i].flogs_buf);
 			if (bttp->arenas[i].rtt)
-				Free((void *)bttp->arenas[i].map_locks);
+				Free(bttp->arenas[i].rtt_buf);
+			if (bttp->arenas[i].map_locks)
+				Free(bttp->arenas[i].map_locks_buf);
 		}
 		Free(bttp->arenas);
 	}
+	Free(bttp->direct_busy);
+	Free(bttp->zero_blockp);
+	util_cond_destroy(&bttp->direct_cond);
+	util_mutex_destroy(&bttp->direct_lock);
 	Free(bttp);
 }
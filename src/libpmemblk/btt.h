@@ -1,5 +1,5 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
-/* Copyright 2014-2020, Intel Corporation */
+/* Copyright 2014-2021, Intel Corporation */
 
 /*
  * btt.h -- btt module definitions
@@ -23,10 +23,21 @@ struct ns_callback {
 			size_t len, uint64_t off);
 	void (*nssync)(void *ns, unsigned lane, void *addr, size_t len);
 
+	/*
+	 * Optional pair used to amortize flushes, nswrite_nodrain() stores
+	 * the data without waiting for it to become durable and nsdrain()
+	 * waits for all such stores issued so far.  If not provided, each
+	 * write is made durable by nswrite().
+	 */
+	int (*nswrite_nodrain)(void *ns, unsigned lane,
+		const void *buf, size_t count, uint64_t off);
+	void (*nsdrain)(void *ns, unsigned lane);
+
 	int ns_is_zeroed;
 };
 
 struct btt_info;
+struct iovec;
 
 struct btt *btt_init(uint64_t rawsize, uint32_t lbasize, uint8_t parent_uuid[],
 		unsigned maxlane, void *ns, const struct ns_callback *ns_cbp);
@@ -34,6 +45,13 @@ unsigned btt_nlane(struct btt *bttp);
 size_t btt_nlba(struct btt *bttp);
 int btt_read(struct btt *bttp, unsigned lane, uint64_t lba, void *buf);
 int btt_write(struct btt *bttp, unsigned lane, uint64_t lba, const void *buf);
+int btt_readv(struct btt *bttp, unsigned lane, uint64_t lba,
+		const struct iovec *iov, int iovcnt);
+int btt_writev(struct btt *bttp, unsigned lane, uint64_t lba,
+		const struct iovec *iov, int iovcnt);
+int btt_read_direct(struct btt *bttp, unsigned lane, uint64_t lba,
+		const void **addrp, unsigned *slotp);
+void btt_read_direct_release(struct btt *bttp, unsigned slot);
 int btt_set_zero(struct btt *bttp, unsigned lane, uint64_t lba);
 int btt_set_error(struct btt *bttp, unsigned lane, uint64_t lba);
 int btt_check(struct btt *bttp);
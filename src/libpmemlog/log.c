@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2014-2020, Intel Corporation */
+/* Copyright 2014-2021, Intel Corporation */
 
 /*
  * log.c -- log memory pool entry points for libpmem
@@ -53,6 +53,13 @@ log_descr_create(PMEMlogpool *plp, size_t poolsize)
 
 	ASSERTeq(poolsize % Pagesize, 0);
 
+	/*
+	 * The run-time part of the descriptor must not push the beginning of
+	 * the log data past the offset used by the existing pools.
+	 */
+	COMPILE_ERROR_ON(roundup(sizeof(*plp), LOG_FORMAT_DATA_ALIGN) !=
+		roundup(sizeof(struct pool_hdr) + 1, LOG_FORMAT_DATA_ALIGN));
+
 	/* create required metadata */
 	plp->start_offset = htole64(roundup(sizeof(*plp),
 					LOG_FORMAT_DATA_ALIGN));
@@ -122,13 +129,26 @@ log_runtime_init(PMEMlogpool *plp, int rdonly)
 	 */
 	plp->rdonly = rdonly;
 
+	if ((plp->appendp = Malloc(sizeof(*plp->appendp))) == NULL) {
+		ERR("!Malloc for an appenders state");
+		return -1;
+	}
+
 	if ((plp->rwlockp = Malloc(sizeof(*plp->rwlockp))) == NULL) {
 		ERR("!Malloc for a RW lock");
+		Free(plp->appendp);
 		return -1;
 	}
 
 	util_rwlock_init(plp->rwlockp);
 
+	struct log_append *ap = plp->appendp;
+	ap->reserved = le64toh(plp->write_offset);
+	ap->completed = ap->reserved;
+	util_mutex_init(&ap->lock);
+	util_cond_init(&ap->cond);
+	util_mutex_init(&ap->commit_lock);
+
 	/*
 	 * If possible, turn off all permissions on the pool header page.
 	 *
@@ -361,6 +381,11 @@ pmemlog_close(PMEMlogpool *plp)
 	util_rwlock_destroy(plp->rwlockp);
 	Free((void *)plp->rwlockp);
 
+	util_mutex_destroy(&plp->appendp->commit_lock);
+	util_cond_destroy(&plp->appendp->cond);
+	util_mutex_destroy(&plp->appendp->lock);
+	Free(plp->appendp);
+
 	util_poolset_close(plp->set, DO_NOT_DELETE_PARTS);
 }
 
@@ -382,29 +407,57 @@ pmemlog_nbyte(PMEMlogpool *plp)
 	return size;
 }
 
+#ifdef DEBUG
 /*
- * log_persist -- (internal) persist data, then metadata
+ * log_protect -- (internal) protect the committed log space range
+ *	(debug version only)
  *
- * On entry, the write lock should be held.
+ * The last, partially filled page is protected only if there are no other
+ * appenders in flight. On entry, the appenders lock should be held, new
+ * appenders unprotect their ranges under the same lock.
  */
 static void
-log_persist(PMEMlogpool *plp, uint64_t new_write_offset)
+log_protect(PMEMlogpool *plp, uint64_t new_write_offset)
 {
 	uint64_t old_write_offset = le64toh(plp->write_offset);
-	size_t length = new_write_offset - old_write_offset;
+	uint64_t ro_end = new_write_offset;
+	uint64_t reserved;
 
-	/* unprotect the log space range (debug version only) */
-	RANGE_RW((char *)plp->addr + old_write_offset, length, plp->is_dev_dax);
+	util_atomic_load_explicit64(&plp->appendp->reserved, &reserved,
+		memory_order_acquire);
+	if (reserved != new_write_offset)
+		ro_end &= ~((uint64_t)Pagesize - 1);
 
-	/* persist the data */
-	if (plp->is_pmem)
-		pmem_drain(); /* data already flushed */
-	else
-		pmem_msync((char *)plp->addr + old_write_offset, length);
+	if (ro_end > old_write_offset)
+		RANGE_RO((char *)plp->addr + old_write_offset,
+			ro_end - old_write_offset, plp->is_dev_dax);
+}
 
-	/* protect the log space range (debug version only) */
-	RANGE_RO((char *)plp->addr + old_write_offset, length, plp->is_dev_dax);
+/*
+ * log_unprotect -- (internal) unprotect the log space range, where the new
+ *	data will be stored (debug version only)
+ */
+static void
+log_unprotect(PMEMlogpool *plp, uint64_t offset, size_t count)
+{
+	util_mutex_lock(&plp->appendp->lock);
+	RANGE_RW((char *)plp->addr + offset, count, plp->is_dev_dax);
+	util_mutex_unlock(&plp->appendp->lock);
+}
+#else
+#define log_protect(plp, new_write_offset) do {} while (0)
+#define log_unprotect(plp, offset, count) do {} while (0)
+#endif
 
+/*
+ * log_persist -- (internal) persist the write offset
+ *
+ * On entry, the commit lock should be held and all the data up to
+ * the new write offset should be already persistent.
+ */
+static void
+log_persist(PMEMlogpool *plp, uint64_t new_write_offset)
+{
 	/* unprotect the pool descriptor (debug version only) */
 	RANGE_RW((char *)plp->addr + sizeof(struct pool_hdr),
 			LOG_FORMAT_DATA_ALIGN, plp->is_dev_dax);
@@ -423,6 +476,102 @@ log_persist(PMEMlogpool *plp, uint64_t new_write_offset)
 			LOG_FORMAT_DATA_ALIGN, plp->is_dev_dax);
 }
 
+/*
+ * log_reserve -- (internal) reserve a range of the log space
+ *
+ * Concurrent writers get disjoint ranges, the reservation never goes past
+ * the end of the log. On entry, the read lock should be held.
+ */
+static int
+log_reserve(PMEMlogpool *plp, uint64_t count, uint64_t *offset)
+{
+	struct log_append *ap = plp->appendp;
+	uint64_t end_offset = le64toh(plp->end_offset);
+	uint64_t reserved;
+
+	do {
+		util_atomic_load_explicit64(&ap->reserved, &reserved,
+			memory_order_acquire);
+
+		if (reserved >= end_offset || count > end_offset - reserved) {
+			/* no space left */
+			errno = ENOSPC;
+			return -1;
+		}
+	} while (!util_bool_compare_and_swap64(&ap->reserved, reserved,
+			reserved + count));
+
+	*offset = reserved;
+
+	return 0;
+}
+
+/*
+ * log_copy -- (internal) copy the data to the reserved log space range
+ */
+static void
+log_copy(PMEMlogpool *plp, uint64_t offset, const void *buf, size_t count)
+{
+	char *data = plp->addr;
+
+	/* it's protected again once committed (debug version only) */
+	log_unprotect(plp, offset, count);
+
+	if (plp->is_pmem)
+		pmem_memcpy_nodrain(&data[offset], buf, count);
+	else
+		memcpy(&data[offset], buf, count);
+}
+
+/*
+ * log_commit -- (internal) persist the reserved range and publish it
+ *
+ * Returns once the write offset covers the whole range. On entry, the read
+ * lock should be held.
+ */
+static void
+log_commit(PMEMlogpool *plp, uint64_t offset, uint64_t end)
+{
+	struct log_append *ap = plp->appendp;
+	char *data = plp->addr;
+
+	/*
+	 * Persist the data. Every writer has to do it on its own, a drain
+	 * issued by other thread doesn't cover the stores of this one.
+	 */
+	if (plp->is_pmem)
+		pmem_drain(); /* data already flushed */
+	else
+		pmem_msync(&data[offset], end - offset);
+
+	/* ranges are completed in the order of their reservations */
+	util_mutex_lock(&ap->lock);
+	while (ap->completed != offset)
+		os_cond_wait(&ap->cond, &ap->lock);
+
+	ap->completed = end;
+	os_cond_broadcast(&ap->cond);
+	util_mutex_unlock(&ap->lock);
+
+	/*
+	 * Group commit -- while one writer persists the write offset, others
+	 * complete their ranges and wait here. The first one of them to get
+	 * the lock publishes all the completed ranges at once.
+	 */
+	util_mutex_lock(&ap->commit_lock);
+
+	if (le64toh(plp->write_offset) < end) {
+		util_mutex_lock(&ap->lock);
+		uint64_t completed = ap->completed;
+		log_protect(plp, completed);
+		util_mutex_unlock(&ap->lock);
+
+		log_persist(plp, completed);
+	}
+
+	util_mutex_unlock(&ap->commit_lock);
+}
+
 /*
  * pmemlog_append -- add data to a log memory pool
  */
@@ -439,48 +588,22 @@ pmemlog_append(PMEMlogpool *plp, const void *buf, size_t count)
 		return -1;
 	}
 
-	util_rwlock_wrlock(plp->rwlockp);
-
-	/* get the current values */
-	uint64_t end_offset = le64toh(plp->end_offset);
-	uint64_t write_offset = le64toh(plp->write_offset);
-
-	if (write_offset >= end_offset) {
-		/* no space left */
-		errno = ENOSPC;
-		ERR("!pmemlog_append");
-		ret = -1;
-		goto end;
-	}
+	/*
+	 * Appenders share the lock, they only exclude rewinding the log.
+	 */
+	util_rwlock_rdlock(plp->rwlockp);
 
-	/* make sure we don't write past the available space */
-	if (count > (end_offset - write_offset)) {
-		errno = ENOSPC;
+	uint64_t write_offset;
+	if (log_reserve(plp, count, &write_offset) != 0) {
 		ERR("!pmemlog_append");
 		ret = -1;
 		goto end;
 	}
 
-	char *data = plp->addr;
-
-	/*
-	 * unprotect the log space range, where the new data will be stored
-	 * (debug version only)
-	 */
-	RANGE_RW(&data[write_offset], count, plp->is_dev_dax);
-
-	if (plp->is_pmem)
-		pmem_memcpy_nodrain(&data[write_offset], buf, count);
-	else
-		memcpy(&data[write_offset], buf, count);
-
-	/* protect the log space range (debug version only) */
-	RANGE_RO(&data[write_offset], count, plp->is_dev_dax);
-
-	write_offset += count;
+	log_copy(plp, write_offset, buf, count);
 
 	/* persist the data and the metadata */
-	log_persist(plp, write_offset);
+	log_commit(plp, write_offset, write_offset + count);
 
 end:
 	util_rwlock_unlock(plp->rwlockp);
@@ -511,61 +634,31 @@ pmemlog_appendv(PMEMlogpool *plp, const struct iovec *iov, int iovcnt)
 		return -1;
 	}
 
-	util_rwlock_wrlock(plp->rwlockp);
-
-	/* get the current values */
-	uint64_t end_offset = le64toh(plp->end_offset);
-	uint64_t write_offset = le64toh(plp->write_offset);
-
-	if (write_offset >= end_offset) {
-		/* no space left */
-		errno = ENOSPC;
-		ERR("!pmemlog_appendv");
-		ret = -1;
-		goto end;
-	}
+	util_rwlock_rdlock(plp->rwlockp);
 
-	char *data = plp->addr;
 	uint64_t count = 0;
-	char *buf;
 
 	/* calculate required space */
 	for (i = 0; i < iovcnt; ++i)
 		count += iov[i].iov_len;
 
-	/* check if there is enough free space */
-	if (count > (end_offset - write_offset)) {
-		errno = ENOSPC;
+	uint64_t write_offset;
+	if (log_reserve(plp, count, &write_offset) != 0) {
+		ERR("!pmemlog_appendv");
 		ret = -1;
 		goto end;
 	}
 
+	uint64_t offset = write_offset;
+
 	/* append the data */
 	for (i = 0; i < iovcnt; ++i) {
-		buf = iov[i].iov_base;
-		count = iov[i].iov_len;
-
-		/*
-		 * unprotect the log space range, where the new data will be
-		 * stored (debug version only)
-		 */
-		RANGE_RW(&data[write_offset], count, plp->is_dev_dax);
-
-		if (plp->is_pmem)
-			pmem_memcpy_nodrain(&data[write_offset], buf, count);
-		else
-			memcpy(&data[write_offset], buf, count);
-
-		/*
-		 * protect the log space range (debug version only)
-		 */
-		RANGE_RO(&data[write_offset], count, plp->is_dev_dax);
-
-		write_offset += count;
+		log_copy(plp, offset, iov[i].iov_base, iov[i].iov_len);
+		offset += iov[i].iov_len;
 	}
 
 	/* persist the data and the metadata */
-	log_persist(plp, write_offset);
+	log_commit(plp, write_offset, offset);
 
 end:
 	util_rwlock_unlock(plp->rwlockp);
@@ -615,6 +708,9 @@ pmemlog_rewind(PMEMlogpool *plp)
 			LOG_FORMAT_DATA_ALIGN, plp->is_dev_dax);
 
 	plp->write_offset = plp->start_offset;
+	plp->appendp->reserved = le64toh(plp->start_offset);
+	plp->appendp->completed = plp->appendp->reserved;
+
 	if (plp->is_pmem)
 		pmem_persist(&plp->write_offset, sizeof(uint64_t));
 	else
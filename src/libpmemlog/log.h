@@ -1,5 +1,5 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
-/* Copyright 2014-2020, Intel Corporation */
+/* Copyright 2014-2021, Intel Corporation */
 
 /*
  * log.h -- internal definitions for libpmem log module
@@ -41,6 +41,22 @@ extern "C" {
 
 static const features_t log_format_feat_default = LOG_FORMAT_FEAT_DEFAULT;
 
+/*
+ * run-time state shared by the concurrent appenders
+ *
+ * Writers reserve disjoint ranges of the log by advancing 'reserved', copy
+ * their data in parallel and then, in the order of their reservations, move
+ * 'completed' past their ranges. The persistent write offset is updated in
+ * a group commit: one persist covers all the ranges completed so far.
+ */
+struct log_append {
+	uint64_t reserved;	/* end of the last reserved range */
+	uint64_t completed;	/* end of the contiguous copied data */
+	os_mutex_t lock;	/* protects 'completed' */
+	os_cond_t cond;		/* signaled when 'completed' is advanced */
+	os_mutex_t commit_lock;	/* serializes write offset updates */
+};
+
 struct pmemlog {
 	struct pool_hdr hdr;	/* memory pool header */
 
@@ -57,6 +73,7 @@ struct pmemlog {
 	os_rwlock_t *rwlockp;	/* pointer to RW lock */
 	int is_dev_dax;		/* true if mapped on device dax */
 	struct ctl *ctl;	/* top level node of the ctl tree structure */
+	struct log_append *appendp; /* concurrent appenders state */
 
 	struct pool_set *set;	/* pool set info */
 };
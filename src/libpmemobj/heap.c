@@ -22,10 +22,12 @@
 #include "container_seglists.h"
 #include "alloc_class.h"
 #include "os_thread.h"
+#include "recovery.h"
 #include "set.h"
 
-#define MAX_RUN_LOCKS MAX_CHUNK
+#define MAX_RUN_LOCKS (1 << 16)
 #define MAX_RUN_LOCKS_VG 1024 /* avoid perf issues /w drd */
+#define RUN_LOCKS_PER_CPU 64
 
 /*
  * This is the value by which the heap might grow once we hit an OOM.
@@ -33,9 +35,13 @@
 #define HEAP_DEFAULT_GROW_SIZE (1 << 27) /* 128 megabytes */
 #define MAX_DEFAULT_ARENAS (1 << 10) /* 1024 arenas */
 
+#define THREAD_CACHE_DEFAULT_MAX_SIZE 1024 /* bytes */
+
 enum pobj_arenas_assignment_type Default_arenas_assignment_type =
 	POBJ_ARENAS_ASSIGNMENT_THREAD_KEY;
 
+int Default_populate_at_open = 0;
+
 struct arenas_thread_assignment {
 	enum pobj_arenas_assignment_type type;
 	union {
@@ -76,6 +82,74 @@ struct arena {
 	struct arenas *arenas;
 };
 
+/*
+ * The populator is a background thread which creates the volatile state of
+ * the zones before the allocation path needs it, so that the allocating
+ * threads do not have to traverse the chunk headers of a fresh zone while
+ * holding the default bucket lock.
+ */
+struct heap_populator {
+	os_thread_t thread;
+	os_mutex_t lock;
+	os_cond_t cond;
+
+	/* serializes starting and stopping of the thread */
+	os_mutex_t control_lock;
+	int running; /* protected by the control lock */
+	int pending; /* protected by the lock */
+	unsigned stop;
+
+	/* protected by the default bucket lock */
+	unsigned ahead;
+
+	int numa_node; /* protected by the control lock */
+	int thread_numa_node; /* the node of the running thread */
+};
+
+/*
+ * A block reserved from a run bucket, along with the reservation it holds on
+ * the run it came from.
+ */
+struct thread_cache_entry {
+	struct memory_block m;
+	struct memory_block_reserved *mresv;
+};
+
+/*
+ * Blocks of a single allocation class, handed out in the order in which they
+ * were taken from the bucket. All the blocks have the same size index.
+ */
+struct thread_cache_bin {
+	uint32_t size_idx;
+	unsigned first; /* the next block to hand out */
+	unsigned nentries;
+	struct thread_cache_entry entries[];
+};
+
+/*
+ * Per-thread magazines of blocks reserved in batches from the arena buckets,
+ * so that most small allocations do not have to take the bucket lock. Frees
+ * are not cached, so a bin is only ever refilled once it is empty.
+ */
+struct thread_cache {
+	struct palloc_heap *heap;
+	unsigned batch; /* blocks per bin */
+	PMDK_LIST_ENTRY(thread_cache) next;
+
+	struct thread_cache_bin *bins[MAX_ALLOCATION_CLASSES];
+};
+
+struct thread_caches {
+	os_mutex_t lock; /* protects the list and the key creation */
+	PMDK_LIST_HEAD(thread_caches_list, thread_cache) list;
+
+	os_tls_key_t key;
+	unsigned key_created;
+
+	unsigned batch; /* 0 disables the caches */
+	uint64_t max_size;
+};
+
 struct heap_rt {
 	struct alloc_class_collection *alloc_classes;
 
@@ -86,11 +160,18 @@ struct heap_rt {
 
 	struct recycler *recyclers[MAX_ALLOCATION_CLASSES];
 
-	os_mutex_t run_locks[MAX_RUN_LOCKS];
-	unsigned nlocks;
+	os_mutex_t *run_locks;
+	unsigned nlocks; /* power of two */
 
 	unsigned nzones;
 	unsigned zones_exhausted;
+
+	/* one past the highest zone the default bucket took memory from */
+	unsigned zones_frontier;
+
+	struct heap_populator populator;
+
+	struct thread_caches tcaches;
 };
 
 /*
@@ -470,9 +551,35 @@ heap_bucket_release(struct palloc_heap *heap, struct bucket *b)
  * heap_get_run_lock -- returns the lock associated with memory block
  */
 os_mutex_t *
-heap_get_run_lock(struct palloc_heap *heap, uint32_t chunk_id)
+heap_get_run_lock(struct palloc_heap *heap, uint32_t zone_id,
+	uint32_t chunk_id)
+{
+	/* chunks of consecutive zones map onto consecutive locks */
+	uint64_t idx = (uint64_t)zone_id * MAX_CHUNK + chunk_id;
+
+	return &heap->rt->run_locks[idx & (heap->rt->nlocks - 1)];
+}
+
+/*
+ * heap_get_run_locks_count -- (internal) returns the number of run locks for
+ *	a heap of the given size, ideally a lock per chunk, but no fewer than
+ *	the number that keeps the threads of all cpus from colliding on the
+ *	same locks
+ */
+static unsigned
+heap_get_run_locks_count(uint64_t heap_size, unsigned ncpus)
 {
-	return &heap->rt->run_locks[chunk_id % heap->rt->nlocks];
+	unsigned max = On_valgrind ? MAX_RUN_LOCKS_VG : MAX_RUN_LOCKS;
+	uint64_t nlocks = MAX(heap_size / CHUNKSIZE,
+		(uint64_t)ncpus * RUN_LOCKS_PER_CPU);
+
+	unsigned n = 1;
+	while (n < nlocks && n < max)
+		n <<= 1;
+
+	LOG(4, "creating %u run locks", n);
+
+	return n;
 }
 
 /*
@@ -771,6 +878,307 @@ heap_populate_bucket(struct palloc_heap *heap, struct bucket *bucket)
 	return 0;
 }
 
+/*
+ * heap_populate_needed -- (internal) checks whether the populator is behind
+ *	the demand, must be called with the default bucket locked
+ */
+static int
+heap_populate_needed(struct palloc_heap *heap)
+{
+	struct heap_rt *h = heap->rt;
+
+	if (h->populator.ahead == 0)
+		return 0;
+
+	uint64_t target = (uint64_t)h->zones_frontier + h->populator.ahead;
+
+	return h->zones_exhausted < MIN(target, h->nzones);
+}
+
+/*
+ * heap_populate_wake -- (internal) wakes up the populator thread
+ */
+static void
+heap_populate_wake(struct heap_populator *p)
+{
+	util_mutex_lock(&p->lock);
+	p->pending = 1;
+	os_cond_signal(&p->cond);
+	util_mutex_unlock(&p->lock);
+}
+
+/*
+ * heap_populate_advance -- (internal) moves the frontier of the heap and
+ *	wakes up the populator if it fell behind, must be called with the
+ *	default bucket locked
+ */
+static void
+heap_populate_advance(struct palloc_heap *heap, uint32_t zone_id)
+{
+	struct heap_rt *h = heap->rt;
+
+	if (zone_id < h->zones_frontier)
+		return;
+
+	h->zones_frontier = zone_id + 1;
+
+	if (heap_populate_needed(heap))
+		heap_populate_wake(&h->populator);
+}
+
+/*
+ * heap_populate_ahead -- (internal) populates the zones until the populator
+ *	is the configured number of zones ahead of the frontier
+ *
+ * The default bucket is released after every zone so that the allocating
+ * threads are never blocked for longer than a single zone traversal.
+ */
+static void
+heap_populate_ahead(struct palloc_heap *heap)
+{
+	struct heap_populator *p = &heap->rt->populator;
+
+	for (;;) {
+		unsigned stop;
+		util_atomic_load_explicit32(&p->stop, &stop,
+			memory_order_acquire);
+		if (stop)
+			return;
+
+		struct bucket *defb = heap_bucket_acquire(heap,
+			DEFAULT_ALLOC_CLASS_ID, HEAP_ARENA_PER_THREAD);
+
+		int needed = heap_populate_needed(heap);
+		if (needed)
+			heap_populate_bucket(heap, defb);
+
+		heap_bucket_release(heap, defb);
+
+		if (!needed)
+			return;
+	}
+}
+
+/*
+ * heap_populate_pin -- (internal) binds the calling thread to the CPUs of
+ *	the NUMA node
+ */
+static void
+heap_populate_pin(int numa_node)
+{
+	os_cpu_set_t cpus;
+	if (os_numa_node_cpus(numa_node, &cpus) == 0) {
+		LOG(2, "cannot determine the CPUs of NUMA node %d", numa_node);
+		return;
+	}
+
+	os_thread_t self;
+	os_thread_self(&self);
+	if (os_thread_setaffinity_np(&self, sizeof(cpus), &cpus) != 0)
+		LOG(2, "cannot bind the populator to NUMA node %d", numa_node);
+}
+
+/*
+ * heap_populate_worker -- (internal) the populator thread
+ */
+static void *
+heap_populate_worker(void *arg)
+{
+	struct palloc_heap *heap = arg;
+	struct heap_populator *p = &heap->rt->populator;
+
+	if (p->thread_numa_node >= 0)
+		heap_populate_pin(p->thread_numa_node);
+
+	util_mutex_lock(&p->lock);
+	while (!p->stop) {
+		if (!p->pending) {
+			os_cond_wait(&p->cond, &p->lock);
+			continue;
+		}
+
+		p->pending = 0;
+		util_mutex_unlock(&p->lock);
+
+		heap_populate_ahead(heap);
+
+		util_mutex_lock(&p->lock);
+	}
+	util_mutex_unlock(&p->lock);
+
+	return NULL;
+}
+
+/*
+ * heap_populate_start -- (internal) starts the populator thread, must be
+ *	called with the control lock held
+ */
+static int
+heap_populate_start(struct palloc_heap *heap)
+{
+	struct heap_populator *p = &heap->rt->populator;
+
+	ASSERTeq(p->running, 0);
+
+	p->stop = 0;
+	p->pending = 1;
+	p->thread_numa_node = p->numa_node;
+
+	int ret = os_thread_create(&p->thread, NULL, heap_populate_worker,
+		heap);
+	if (ret != 0) {
+		errno = ret;
+		ERR("!cannot create the populator thread");
+		return -1;
+	}
+
+	p->running = 1;
+
+	return 0;
+}
+
+/*
+ * heap_populate_stop_locked -- (internal) stops the populator thread, if it's
+ *	running, must be called with the control lock held
+ */
+static void
+heap_populate_stop_locked(struct palloc_heap *heap)
+{
+	struct heap_populator *p = &heap->rt->populator;
+
+	if (!p->running)
+		return;
+
+	util_mutex_lock(&p->lock);
+	util_atomic_store_explicit32(&p->stop, 1, memory_order_release);
+	os_cond_signal(&p->cond);
+	util_mutex_unlock(&p->lock);
+
+	os_thread_join(&p->thread, NULL);
+	p->running = 0;
+}
+
+/*
+ * heap_populate_stop -- stops the populator thread, if it's running
+ */
+void
+heap_populate_stop(struct palloc_heap *heap)
+{
+	struct heap_populator *p = &heap->rt->populator;
+
+	util_mutex_lock(&p->control_lock);
+	heap_populate_stop_locked(heap);
+	util_mutex_unlock(&p->control_lock);
+}
+
+/*
+ * heap_populate_all -- creates the volatile state of all the zones
+ */
+void
+heap_populate_all(struct palloc_heap *heap)
+{
+	struct bucket *defb = heap_bucket_acquire(heap,
+		DEFAULT_ALLOC_CLASS_ID, HEAP_ARENA_PER_THREAD);
+
+	while (heap_populate_bucket(heap, defb) == 0)
+		;
+
+	heap_bucket_release(heap, defb);
+}
+
+/*
+ * heap_get_populate_ahead -- returns the number of zones the populator
+ *	keeps ready ahead of the allocations
+ */
+unsigned
+heap_get_populate_ahead(struct palloc_heap *heap)
+{
+	struct bucket *defb = heap_bucket_acquire(heap,
+		DEFAULT_ALLOC_CLASS_ID, HEAP_ARENA_PER_THREAD);
+	unsigned ahead = heap->rt->populator.ahead;
+	heap_bucket_release(heap, defb);
+
+	return ahead;
+}
+
+/*
+ * heap_set_populate_ahead -- changes the number of zones the populator
+ *	keeps ready ahead of the allocations, 0 stops the populator
+ */
+int
+heap_set_populate_ahead(struct palloc_heap *heap, unsigned ahead)
+{
+	struct heap_populator *p = &heap->rt->populator;
+	int ret = 0;
+
+	/*
+	 * The whole change is done under the control lock, so that concurrent
+	 * writers can neither both start nor both stop the thread, and the
+	 * last written value decides whether it's running.
+	 */
+	util_mutex_lock(&p->control_lock);
+
+	struct bucket *defb = heap_bucket_acquire(heap,
+		DEFAULT_ALLOC_CLASS_ID, HEAP_ARENA_PER_THREAD);
+	p->ahead = ahead;
+	heap_bucket_release(heap, defb);
+
+	if (ahead == 0)
+		heap_populate_stop_locked(heap);
+	else if (!p->running)
+		ret = heap_populate_start(heap);
+	else
+		heap_populate_wake(p);
+
+	util_mutex_unlock(&p->control_lock);
+
+	return ret;
+}
+
+/*
+ * heap_get_populate_numa_node -- returns the NUMA node the populator is
+ *	bound to, -1 if it's not bound
+ */
+int
+heap_get_populate_numa_node(struct palloc_heap *heap)
+{
+	struct heap_populator *p = &heap->rt->populator;
+
+	util_mutex_lock(&p->control_lock);
+	int numa_node = p->numa_node;
+	util_mutex_unlock(&p->control_lock);
+
+	return numa_node;
+}
+
+/*
+ * heap_set_populate_numa_node -- binds the populator to the NUMA node,
+ *	takes effect the next time the populator is started
+ */
+void
+heap_set_populate_numa_node(struct palloc_heap *heap, int numa_node)
+{
+	struct heap_populator *p = &heap->rt->populator;
+
+	util_mutex_lock(&p->control_lock);
+	p->numa_node = numa_node;
+	util_mutex_unlock(&p->control_lock);
+}
+
+/*
+ * heap_get_populated_zones -- returns the number of zones with volatile state
+ */
+unsigned
+heap_get_populated_zones(struct palloc_heap *heap)
+{
+	struct bucket *defb = heap_bucket_acquire(heap,
+		DEFAULT_ALLOC_CLASS_ID, HEAP_ARENA_PER_THREAD);
+	unsigned zones = heap->rt->zones_exhausted;
+	heap_bucket_release(heap, defb);
+
+	return zones;
+}
+
 /*
  * heap_recycle_unused -- recalculate scores in the recycler and turn any
  *	empty runs into free chunks
@@ -891,6 +1299,8 @@ heap_bucket_deref_active(struct palloc_heap *heap, struct bucket *b)
 void
 heap_force_recycle(struct palloc_heap *heap)
 {
+	heap_thread_cache_flush(heap);
+
 	util_mutex_lock(&heap->rt->arenas.lock);
 	struct arena *arenap;
 	VEC_FOREACH(arenap, &heap->rt->arenas.vec) {
@@ -951,6 +1361,51 @@ heap_discard_run(struct palloc_heap *heap, struct memory_block *m)
 	}
 }
 
+/*
+ * heap_reservation_clear -- drops a reservation of the block, puts the block
+ *	back into its bucket if requested and possible, and discards the run if
+ *	this was the last reservation
+ */
+void
+heap_reservation_clear(struct palloc_heap *heap, const struct memory_block *m,
+	struct memory_block_reserved *mresv, int reinsert)
+{
+	struct bucket *b = mresv->bucket;
+
+	if (reinsert) {
+		util_mutex_lock(&b->lock);
+		struct memory_block *am = &b->active_memory_block->m;
+
+		/*
+		 * If a memory block used for the action is the currently active
+		 * memory block of the bucket it can be inserted back to the
+		 * bucket. This way it will be available for future allocation
+		 * requests, improving performance.
+		 */
+		if (b->is_active &&
+		    am->chunk_id == m->chunk_id &&
+		    am->zone_id == m->zone_id) {
+			ASSERTeq(b->active_memory_block, mresv);
+			bucket_insert_block(b, m);
+		}
+
+		util_mutex_unlock(&b->lock);
+	}
+
+	if (util_fetch_and_sub64(&mresv->nresv, 1) == 1) {
+		VALGRIND_ANNOTATE_HAPPENS_AFTER(&mresv->nresv);
+		/*
+		 * If the memory block used for the action is not currently used
+		 * in any bucket nor action it can be discarded (given back to
+		 * the heap).
+		 */
+		heap_discard_run(heap, &mresv->m);
+		Free(mresv);
+	} else {
+		VALGRIND_ANNOTATE_HAPPENS_BEFORE(&mresv->nresv);
+	}
+}
+
 /*
  * heap_ensure_run_bucket_filled -- (internal) refills the bucket if needed
  */
@@ -1094,6 +1549,9 @@ heap_get_bestfit_block(struct palloc_heap *heap, struct bucket *b,
 
 	ASSERT(m->size_idx >= units);
 
+	if (b == heap->rt->default_bucket)
+		heap_populate_advance(heap, m->zone_id);
+
 	if (units != m->size_idx)
 		heap_split_block(heap, b, m, units);
 
@@ -1103,6 +1561,335 @@ heap_get_bestfit_block(struct palloc_heap *heap, struct bucket *b,
 	return 0;
 }
 
+/*
+ * thread_cache_bin_flush -- (internal) gives the cached blocks back to their
+ *	buckets
+ */
+static void
+thread_cache_bin_flush(struct palloc_heap *heap, struct thread_cache_bin *bin)
+{
+	for (unsigned i = bin->first; i < bin->nentries; ++i) {
+		struct thread_cache_entry *e = &bin->entries[i];
+		if (e->mresv != NULL)
+			heap_reservation_clear(heap, &e->m, e->mresv, 1);
+	}
+
+	bin->first = 0;
+	bin->nentries = 0;
+}
+
+/*
+ * thread_cache_new -- (internal) creates an empty cache of the calling thread
+ */
+static struct thread_cache *
+thread_cache_new(struct palloc_heap *heap, unsigned batch)
+{
+	struct thread_caches *tcs = &heap->rt->tcaches;
+
+	struct thread_cache *tc = Zalloc(sizeof(*tc));
+	if (tc == NULL)
+		return NULL;
+
+	tc->heap = heap;
+	tc->batch = batch;
+
+	util_mutex_lock(&tcs->lock);
+	PMDK_LIST_INSERT_HEAD(&tcs->list, tc, next);
+	util_mutex_unlock(&tcs->lock);
+
+	return tc;
+}
+
+/*
+ * thread_cache_delete -- (internal) flushes and deletes the cache, the cache
+ *	must be already removed from the list
+ */
+static void
+thread_cache_delete(struct thread_cache *tc)
+{
+	for (int i = 0; i < MAX_ALLOCATION_CLASSES; ++i) {
+		if (tc->bins[i] == NULL)
+			continue;
+
+		thread_cache_bin_flush(tc->heap, tc->bins[i]);
+		Free(tc->bins[i]);
+	}
+
+	Free(tc);
+}
+
+/*
+ * thread_cache_detach -- (internal) removes the cache from the list and
+ *	deletes it
+ */
+static void
+thread_cache_detach(struct thread_cache *tc)
+{
+	struct thread_caches *tcs = &tc->heap->rt->tcaches;
+
+	util_mutex_lock(&tcs->lock);
+	PMDK_LIST_REMOVE(tc, next);
+	util_mutex_unlock(&tcs->lock);
+
+	thread_cache_delete(tc);
+}
+
+/*
+ * heap_thread_cache_destructor -- (internal) flushes the cache of an exiting
+ *	thread
+ */
+static void
+heap_thread_cache_destructor(void *arg)
+{
+	thread_cache_detach(arg);
+}
+
+/*
+ * thread_cache_bin_refill -- (internal) reserves a batch of blocks from the
+ *	bucket of the calling thread's arena
+ */
+static void
+thread_cache_bin_refill(struct palloc_heap *heap, struct thread_cache_bin *bin,
+	struct alloc_class *c, uint32_t size_idx, unsigned n)
+{
+	ASSERTeq(bin->first, bin->nentries);
+
+	bin->first = 0;
+	bin->nentries = 0;
+	bin->size_idx = size_idx;
+
+	struct bucket *b = heap_bucket_acquire(heap, c->id,
+		HEAP_ARENA_PER_THREAD);
+
+	while (bin->nentries < n) {
+		struct thread_cache_entry *e = &bin->entries[bin->nentries];
+		e->m = MEMORY_BLOCK_NONE;
+		e->m.size_idx = size_idx;
+
+		if (heap_get_bestfit_block(heap, b, &e->m) != 0)
+			break;
+
+		/* the reservation is handed over to the allocation later */
+		if ((e->mresv = b->active_memory_block) != NULL)
+			util_fetch_and_add64(&e->mresv->nresv, 1);
+
+		bin->nentries++;
+	}
+
+	heap_bucket_release(heap, b);
+}
+
+/*
+ * heap_thread_cache_get -- takes a block for the allocation from the cache
+ *	of the calling thread
+ *
+ * Returns 0 if the block was found in the cache, in which case the caller
+ * takes over the reservation of the block.
+ */
+int
+heap_thread_cache_get(struct palloc_heap *heap, struct alloc_class *c,
+	struct memory_block *m, struct memory_block_reserved **mresv)
+{
+	struct thread_caches *tcs = &heap->rt->tcaches;
+
+	unsigned key_created;
+	util_atomic_load_explicit32(&tcs->key_created, &key_created,
+		memory_order_acquire);
+	if (!key_created)
+		return ENOENT;
+
+	unsigned batch;
+	util_atomic_load_explicit32(&tcs->batch, &batch, memory_order_relaxed);
+
+	struct thread_cache *tc = os_tls_get(tcs->key);
+	if (tc != NULL && tc->batch != batch) {
+		/* the cache has been resized or disabled */
+		thread_cache_detach(tc);
+		os_tls_set(tcs->key, NULL);
+		tc = NULL;
+	}
+
+	uint64_t max_size;
+	util_atomic_load_explicit64(&tcs->max_size, &max_size,
+		memory_order_relaxed);
+
+	if (batch == 0 || c->type != CLASS_RUN ||
+	    c->unit_size * m->size_idx > max_size)
+		return ENOENT;
+
+	if (tc == NULL) {
+		if ((tc = thread_cache_new(heap, batch)) == NULL)
+			return ENOENT;
+
+		os_tls_set(tcs->key, tc);
+	}
+
+	struct thread_cache_bin *bin = tc->bins[c->id];
+	if (bin == NULL) {
+		bin = Zalloc(sizeof(*bin) +
+			sizeof(struct thread_cache_entry) * tc->batch);
+		if (bin == NULL)
+			return ENOENT;
+
+		tc->bins[c->id] = bin;
+	}
+
+	if (bin->first == bin->nentries) {
+		thread_cache_bin_refill(heap, bin, c, m->size_idx, tc->batch);
+	} else if (bin->size_idx != m->size_idx) {
+		/* blocks of other sizes are taken directly from the bucket */
+		return ENOENT;
+	}
+
+	if (bin->first == bin->nentries)
+		return ENOENT;
+
+	struct thread_cache_entry *e = &bin->entries[bin->first++];
+	*m = e->m;
+	*mresv = e->mresv;
+
+	return 0;
+}
+
+/*
+ * heap_thread_cache_put -- returns the block which was just taken from the
+ *	cache of the calling thread but could not be used for the allocation
+ */
+void
+heap_thread_cache_put(struct palloc_heap *heap, struct alloc_class *c,
+	const struct memory_block *m, struct memory_block_reserved *mresv)
+{
+	struct thread_cache *tc = os_tls_get(heap->rt->tcaches.key);
+	ASSERTne(tc, NULL);
+
+	struct thread_cache_bin *bin = tc->bins[c->id];
+	ASSERTne(bin, NULL);
+	ASSERT(bin->first > 0);
+
+	struct thread_cache_entry *e = &bin->entries[--bin->first];
+	e->m = *m;
+	e->mresv = mresv;
+}
+
+/*
+ * heap_thread_cache_flush -- gives all the blocks cached by the calling thread
+ *	back to the buckets
+ */
+void
+heap_thread_cache_flush(struct palloc_heap *heap)
+{
+	struct thread_caches *tcs = &heap->rt->tcaches;
+
+	unsigned key_created;
+	util_atomic_load_explicit32(&tcs->key_created, &key_created,
+		memory_order_acquire);
+	if (!key_created)
+		return;
+
+	struct thread_cache *tc = os_tls_get(tcs->key);
+	if (tc == NULL)
+		return;
+
+	for (int i = 0; i < MAX_ALLOCATION_CLASSES; ++i) {
+		if (tc->bins[i] != NULL)
+			thread_cache_bin_flush(heap, tc->bins[i]);
+	}
+}
+
+/*
+ * heap_thread_caches_fini -- flushes and deletes the caches of all the
+ *	threads, the pool must not be used concurrently
+ */
+void
+heap_thread_caches_fini(struct palloc_heap *heap)
+{
+	struct thread_caches *tcs = &heap->rt->tcaches;
+
+	if (tcs->key_created) {
+		os_tls_key_delete(tcs->key);
+		tcs->key_created = 0;
+	}
+
+	struct thread_cache *tc;
+	while ((tc = PMDK_LIST_FIRST(&tcs->list)) != NULL) {
+		PMDK_LIST_REMOVE(tc, next);
+		thread_cache_delete(tc);
+	}
+}
+
+/*
+ * heap_get_thread_cache_batch -- returns the number of blocks of each class
+ *	that a thread reserves at once and keeps in its cache
+ */
+unsigned
+heap_get_thread_cache_batch(struct palloc_heap *heap)
+{
+	unsigned batch;
+	util_atomic_load_explicit32(&heap->rt->tcaches.batch, &batch,
+		memory_order_relaxed);
+
+	return batch;
+}
+
+/*
+ * heap_set_thread_cache_batch -- changes the number of blocks of each class
+ *	that a thread reserves at once and keeps in its cache, 0 disables
+ *	the caches
+ *
+ * The threads give the blocks cached with the previous batch back on their
+ * next allocation.
+ */
+int
+heap_set_thread_cache_batch(struct palloc_heap *heap, unsigned batch)
+{
+	struct thread_caches *tcs = &heap->rt->tcaches;
+
+	util_mutex_lock(&tcs->lock);
+	if (batch != 0 && !tcs->key_created) {
+		int ret = os_tls_key_create(&tcs->key,
+			heap_thread_cache_destructor);
+		if (ret != 0) {
+			util_mutex_unlock(&tcs->lock);
+			errno = ret;
+			ERR("!os_tls_key_create");
+			return -1;
+		}
+
+		util_atomic_store_explicit32(&tcs->key_created, 1,
+			memory_order_release);
+	}
+
+	util_atomic_store_explicit32(&tcs->batch, batch, memory_order_relaxed);
+	util_mutex_unlock(&tcs->lock);
+
+	return 0;
+}
+
+/*
+ * heap_get_thread_cache_max_size -- returns the size of the largest
+ *	allocation served from the thread caches
+ */
+size_t
+heap_get_thread_cache_max_size(struct palloc_heap *heap)
+{
+	uint64_t max_size;
+	util_atomic_load_explicit64(&heap->rt->tcaches.max_size, &max_size,
+		memory_order_relaxed);
+
+	return max_size;
+}
+
+/*
+ * heap_set_thread_cache_max_size -- changes the size of the largest
+ *	allocation served from the thread caches
+ */
+void
+heap_set_thread_cache_max_size(struct palloc_heap *heap, size_t max_size)
+{
+	util_atomic_store_explicit64(&heap->rt->tcaches.max_size, max_size,
+		memory_order_relaxed);
+}
+
 /*
  * heap_get_adjacent_free_block -- locates adjacent free memory block in heap
  */
@@ -1522,27 +2309,39 @@ heap_extend(struct palloc_heap *heap, struct bucket *b, size_t size)
 }
 
 /*
- * heap_zone_update_if_needed -- updates the zone metadata if the pool has been
- *	extended.
+ * heap_zone_update -- (internal) updates the metadata of a single zone if
+ *	the pool has been extended
  */
 static void
-heap_zone_update_if_needed(struct palloc_heap *heap)
+heap_zone_update(void *arg, uint64_t idx)
 {
-	struct zone *z;
+	struct palloc_heap *heap = arg;
+	uint32_t zone_id = (uint32_t)idx;
 
-	for (uint32_t i = 0; i < heap->rt->nzones; ++i) {
-		z = ZID_TO_ZONE(heap->layout, i);
-		if (z->header.magic != ZONE_HEADER_MAGIC)
-			continue;
+	struct zone *z = ZID_TO_ZONE(heap->layout, zone_id);
+	if (z->header.magic != ZONE_HEADER_MAGIC)
+		return;
 
-		size_t size_idx = zone_calc_size_idx(i, heap->rt->nzones,
-			*heap->sizep);
+	size_t size_idx = zone_calc_size_idx(zone_id, heap->rt->nzones,
+		*heap->sizep);
 
-		if (size_idx == z->header.size_idx)
-			continue;
+	if (size_idx == z->header.size_idx)
+		return;
 
-		heap_zone_init(heap, i, z->header.size_idx);
-	}
+	heap_zone_init(heap, zone_id, z->header.size_idx);
+}
+
+/*
+ * heap_zone_update_if_needed -- updates the zone metadata if the pool has been
+ *	extended.
+ *
+ * The zones are independent from each other and are checked in parallel by
+ * the recovery threads.
+ */
+static void
+heap_zone_update_if_needed(struct palloc_heap *heap)
+{
+	recovery_parallel(heap->rt->nzones, heap_zone_update, heap);
 }
 
 /*
@@ -1597,8 +2396,30 @@ heap_boot(struct palloc_heap *heap, void *heap_start, uint64_t heap_size,
 	h->nzones = heap_max_zone(heap_size);
 
 	h->zones_exhausted = 0;
-
-	h->nlocks = On_valgrind ? MAX_RUN_LOCKS_VG : MAX_RUN_LOCKS;
+	h->zones_frontier = 0;
+
+	h->populator.running = 0;
+	h->populator.pending = 0;
+	h->populator.stop = 0;
+	h->populator.ahead = 0;
+	h->populator.numa_node = -1;
+	h->populator.thread_numa_node = -1;
+	util_mutex_init(&h->populator.lock);
+	util_cond_init(&h->populator.cond);
+	util_mutex_init(&h->populator.control_lock);
+
+	util_mutex_init(&h->tcaches.lock);
+	PMDK_LIST_INIT(&h->tcaches.list);
+	h->tcaches.key_created = 0;
+	h->tcaches.batch = 0;
+	h->tcaches.max_size = THREAD_CACHE_DEFAULT_MAX_SIZE;
+
+	h->nlocks = heap_get_run_locks_count(heap_size, narenas_default);
+	h->run_locks = Malloc(h->nlocks * sizeof(*h->run_locks));
+	if (h->run_locks == NULL) {
+		err = ENOMEM;
+		goto error_run_locks_malloc;
+	}
 	for (unsigned i = 0; i < h->nlocks; ++i)
 		util_mutex_init(&h->run_locks[i]);
 
@@ -1628,6 +2449,14 @@ heap_boot(struct palloc_heap *heap, void *heap_start, uint64_t heap_size,
 	return 0;
 
 error_vec_reserve:
+	for (unsigned i = 0; i < h->nlocks; ++i)
+		util_mutex_destroy(&h->run_locks[i]);
+	Free(h->run_locks);
+error_run_locks_malloc:
+	util_mutex_destroy(&h->tcaches.lock);
+	util_mutex_destroy(&h->populator.control_lock);
+	util_cond_destroy(&h->populator.cond);
+	util_mutex_destroy(&h->populator.lock);
 	heap_arenas_fini(&h->arenas);
 error_arenas_malloc:
 	alloc_class_collection_delete(h->alloc_classes);
@@ -1706,6 +2535,14 @@ heap_cleanup(struct palloc_heap *heap)
 {
 	struct heap_rt *rt = heap->rt;
 
+	heap_populate_stop(heap);
+	util_mutex_destroy(&rt->populator.control_lock);
+	util_cond_destroy(&rt->populator.cond);
+	util_mutex_destroy(&rt->populator.lock);
+
+	heap_thread_caches_fini(heap);
+	util_mutex_destroy(&rt->tcaches.lock);
+
 	alloc_class_collection_delete(rt->alloc_classes);
 
 	arena_thread_assignment_fini(&rt->arenas.assignment);
@@ -1717,6 +2554,7 @@ heap_cleanup(struct palloc_heap *heap)
 
 	for (unsigned i = 0; i < rt->nlocks; ++i)
 		util_mutex_destroy(&rt->run_locks[i]);
+	Free(rt->run_locks);
 
 	heap_arenas_fini(&rt->arenas);
 
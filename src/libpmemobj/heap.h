@@ -22,6 +22,7 @@ extern "C" {
 #endif
 
 extern enum pobj_arenas_assignment_type Default_arenas_assignment_type;
+extern int Default_populate_at_open;
 
 #define HEAP_OFF_TO_PTR(heap, off) ((void *)((char *)((heap)->base) + (off)))
 #define HEAP_PTR_TO_OFF(heap, ptr)\
@@ -62,7 +63,7 @@ struct memory_block
 heap_coalesce_huge(struct palloc_heap *heap, struct bucket *b,
 	const struct memory_block *m);
 os_mutex_t *heap_get_run_lock(struct palloc_heap *heap,
-		uint32_t chunk_id);
+		uint32_t zone_id, uint32_t chunk_id);
 
 void
 heap_force_recycle(struct palloc_heap *heap);
@@ -70,6 +71,10 @@ heap_force_recycle(struct palloc_heap *heap);
 void
 heap_discard_run(struct palloc_heap *heap, struct memory_block *m);
 
+void
+heap_reservation_clear(struct palloc_heap *heap, const struct memory_block *m,
+	struct memory_block_reserved *mresv, int reinsert);
+
 void
 heap_memblock_on_free(struct palloc_heap *heap, const struct memory_block *m);
 
@@ -106,6 +111,26 @@ int heap_set_arena_auto(struct palloc_heap *heap, unsigned arena_id,
 
 void heap_set_arena_thread(struct palloc_heap *heap, unsigned arena_id);
 
+void heap_populate_all(struct palloc_heap *heap);
+void heap_populate_stop(struct palloc_heap *heap);
+unsigned heap_get_populate_ahead(struct palloc_heap *heap);
+int heap_set_populate_ahead(struct palloc_heap *heap, unsigned ahead);
+int heap_get_populate_numa_node(struct palloc_heap *heap);
+void heap_set_populate_numa_node(struct palloc_heap *heap, int numa_node);
+unsigned heap_get_populated_zones(struct palloc_heap *heap);
+
+int heap_thread_cache_get(struct palloc_heap *heap, struct alloc_class *c,
+	struct memory_block *m, struct memory_block_reserved **mresv);
+void heap_thread_cache_put(struct palloc_heap *heap, struct alloc_class *c,
+	const struct memory_block *m, struct memory_block_reserved *mresv);
+void heap_thread_cache_flush(struct palloc_heap *heap);
+void heap_thread_caches_fini(struct palloc_heap *heap);
+unsigned heap_get_thread_cache_batch(struct palloc_heap *heap);
+int heap_set_thread_cache_batch(struct palloc_heap *heap, unsigned batch);
+size_t heap_get_thread_cache_max_size(struct palloc_heap *heap);
+void heap_set_thread_cache_max_size(struct palloc_heap *heap,
+	size_t max_size);
+
 void heap_vg_open(struct palloc_heap *heap, object_callback cb,
 		void *arg, int objects);
 
@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2015-2019, Intel Corporation */
+/* Copyright 2015-2021, Intel Corporation */
 
 /*
  * lane.c -- lane implementation
@@ -12,18 +12,22 @@
 #include <inttypes.h>
 #include <errno.h>
 #include <limits.h>
-#include <sched.h>
+#include <unistd.h>
 
 #include "libpmemobj.h"
 #include "critnib.h"
+#include "ctl.h"
 #include "lane.h"
 #include "out.h"
 #include "util.h"
 #include "obj.h"
+#include "os.h"
 #include "os_thread.h"
+#include "sys_util.h"
 #include "valgrind_internal.h"
 #include "memops.h"
 #include "palloc.h"
+#include "recovery.h"
 #include "tx.h"
 
 static os_tls_key_t Lane_info_key;
@@ -32,6 +36,13 @@ static __thread struct critnib *Lane_info_ht;
 static __thread struct lane_info *Lane_info_records;
 static __thread struct lane_info *Lane_info_cache;
 
+/*
+ * Capacities of the external redo log and of the undo log of the lanes of
+ * the pools created from now on.
+ */
+static uint64_t Lane_redo_size_at_create = LANE_REDO_EXTERNAL_SIZE;
+static uint64_t Lane_undo_size_at_create = LANE_UNDO_SIZE;
+
 /*
  * lane_info_create -- (internal) constructor for thread shared data
  */
@@ -147,7 +158,79 @@ static struct lane_layout *
 lane_get_layout(PMEMobjpool *pop, uint64_t lane_idx)
 {
 	return (void *)((char *)pop + pop->lanes_offset +
-		sizeof(struct lane_layout) * lane_idx);
+		OBJ_LANE_SIZE(pop) * lane_idx);
+}
+
+/*
+ * lane_get_undo -- (internal) calculates the real pointer of the undo log
+ *	of the lane
+ */
+static struct ulog *
+lane_get_undo(PMEMobjpool *pop, struct lane_layout *layout)
+{
+	return (void *)((char *)layout + OBJ_LANE_UNDO_OFFSET(pop));
+}
+
+/*
+ * lane_size_valid -- (internal) checks if the given capacity can be used for
+ *	a log of a lane
+ */
+static int
+lane_size_valid(uint64_t size, uint64_t min_size)
+{
+	return size >= min_size && size <= LANE_LOG_MAX_SIZE &&
+		size % CACHELINE_SIZE == 0;
+}
+
+/*
+ * lane_sizes_at_create -- returns the capacities of the external redo log and
+ *	of the undo log with which the lanes of a new pool are created
+ */
+void
+lane_sizes_at_create(size_t *redo_size, size_t *undo_size)
+{
+	uint64_t redo;
+	uint64_t undo;
+	util_atomic_load_explicit64(&Lane_redo_size_at_create, &redo,
+		memory_order_relaxed);
+	util_atomic_load_explicit64(&Lane_undo_size_at_create, &undo,
+		memory_order_relaxed);
+
+	*redo_size = (size_t)redo;
+	*undo_size = (size_t)undo;
+}
+
+/*
+ * lane_sizes_check -- validates the capacities of the logs recorded in the
+ *	pool descriptor
+ */
+int
+lane_sizes_check(PMEMobjpool *pop)
+{
+	if (!lane_size_valid(OBJ_LANE_REDO_SIZE(pop),
+			LANE_REDO_EXTERNAL_SIZE)) {
+		ERR("invalid capacity of the lane redo log: %u",
+			pop->lane_redo_size);
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!lane_size_valid(OBJ_LANE_UNDO_SIZE(pop), LANE_UNDO_SIZE)) {
+		ERR("invalid capacity of the lane undo log: %u",
+			pop->lane_undo_size);
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (pop->heap_offset < pop->lanes_offset +
+			pop->nlanes * OBJ_LANE_SIZE(pop)) {
+		ERR("lanes overlap with the heap: heap off %" PRIu64,
+			pop->heap_offset);
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
 }
 
 /*
@@ -179,6 +262,8 @@ lane_undo_extend(void *base, uint64_t *redo, uint64_t gen_num)
 	struct tx_parameters *params = pop->tx_params;
 	size_t s = SIZEOF_ALIGNED_ULOG(params->cache_size);
 
+	STATS_LANE_INC(pop->stats, tx_log_extend, 1);
+
 	return pmalloc_construct(base, redo, s, lane_ulog_constructor, &gen_num,
 		0, OBJ_INTERNAL_OBJECT_MASK, 0);
 }
@@ -189,8 +274,11 @@ lane_undo_extend(void *base, uint64_t *redo, uint64_t gen_num)
 static int
 lane_redo_extend(void *base, uint64_t *redo, uint64_t gen_num)
 {
+	PMEMobjpool *pop = base;
 	size_t s = SIZEOF_ALIGNED_ULOG(LANE_REDO_EXTERNAL_SIZE);
 
+	STATS_LANE_INC(pop->stats, tx_log_extend, 1);
+
 	return pmalloc_construct(base, redo, s, lane_ulog_constructor, &gen_num,
 		0, OBJ_INTERNAL_OBJECT_MASK, 0);
 }
@@ -204,6 +292,7 @@ lane_init(PMEMobjpool *pop, struct lane *lane, struct lane_layout *layout)
 	ASSERTne(lane, NULL);
 
 	lane->layout = layout;
+	lane->undo_log = lane_get_undo(pop, layout);
 
 	lane->internal = operation_new((struct ulog *)&layout->internal,
 		LANE_REDO_INTERNAL_SIZE,
@@ -213,21 +302,27 @@ lane_init(PMEMobjpool *pop, struct lane *lane, struct lane_layout *layout)
 		goto error_internal_new;
 
 	lane->external = operation_new((struct ulog *)&layout->external,
-		LANE_REDO_EXTERNAL_SIZE,
+		OBJ_LANE_REDO_SIZE(pop),
 		lane_redo_extend, (ulog_free_fn)pfree, &pop->p_ops,
 		LOG_TYPE_REDO);
 	if (lane->external == NULL)
 		goto error_external_new;
 
-	lane->undo = operation_new((struct ulog *)&layout->undo,
-		LANE_UNDO_SIZE,
+	lane->undo = operation_new(lane->undo_log,
+		OBJ_LANE_UNDO_SIZE(pop),
 		lane_undo_extend, (ulog_free_fn)pfree, &pop->p_ops,
 		LOG_TYPE_UNDO);
 	if (lane->undo == NULL)
 		goto error_undo_new;
 
+	lane->tx_arena = tx_arena_new();
+	if (lane->tx_arena == NULL)
+		goto error_tx_arena_new;
+
 	return 0;
 
+error_tx_arena_new:
+	operation_delete(lane->undo);
 error_undo_new:
 	operation_delete(lane->external);
 error_external_new:
@@ -242,11 +337,25 @@ error_internal_new:
 static void
 lane_destroy(PMEMobjpool *pop, struct lane *lane)
 {
+	tx_arena_delete(lane->tx_arena);
 	operation_delete(lane->undo);
 	operation_delete(lane->internal);
 	operation_delete(lane->external);
 }
 
+/*
+ * lane_get_ncpus -- (internal) returns the number of the per-cpu lane shards
+ */
+static unsigned
+lane_get_ncpus(void)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus < 1)
+		cpus = 1;
+
+	return (unsigned)cpus;
+}
+
 /*
  * lane_boot -- initializes all lanes
  */
@@ -271,9 +380,18 @@ lane_boot(PMEMobjpool *pop)
 		goto error_locks_malloc;
 	}
 
+	pop->lanes_desc.ncpus = lane_get_ncpus();
+	pop->lanes_desc.nwaiters = 0;
+	util_mutex_init(&pop->lanes_desc.waiters_lock);
+	if ((err = os_cond_init(&pop->lanes_desc.waiters_cond)) != 0) {
+		errno = err;
+		ERR("!os_cond_init");
+		goto error_cond_init;
+	}
+
 	/* add lanes to pmemcheck ignored list */
 	VALGRIND_ADD_TO_GLOBAL_TX_IGNORE((char *)pop + pop->lanes_offset,
-		(sizeof(struct lane_layout) * pop->nlanes));
+		OBJ_LANE_SIZE(pop) * pop->nlanes);
 
 	uint64_t i;
 	for (i = 0; i < pop->nlanes; ++i) {
@@ -290,6 +408,9 @@ lane_boot(PMEMobjpool *pop)
 error_lane_init:
 	for (; i >= 1; --i)
 		lane_destroy(pop, &pop->lanes_desc.lane[i - 1]);
+	os_cond_destroy(&pop->lanes_desc.waiters_cond);
+error_cond_init:
+	util_mutex_destroy(&pop->lanes_desc.waiters_lock);
 	Free(pop->lanes_desc.lane_locks);
 	pop->lanes_desc.lane_locks = NULL;
 error_locks_malloc:
@@ -312,13 +433,13 @@ lane_init_data(PMEMobjpool *pop)
 		ulog_construct(OBJ_PTR_TO_OFF(pop, &layout->internal),
 			LANE_REDO_INTERNAL_SIZE, 0, 0, 0, &pop->p_ops);
 		ulog_construct(OBJ_PTR_TO_OFF(pop, &layout->external),
-			LANE_REDO_EXTERNAL_SIZE, 0, 0, 0, &pop->p_ops);
-		ulog_construct(OBJ_PTR_TO_OFF(pop, &layout->undo),
-			LANE_UNDO_SIZE, 0, 0, 0, &pop->p_ops);
+			OBJ_LANE_REDO_SIZE(pop), 0, 0, 0, &pop->p_ops);
+		ulog_construct(OBJ_PTR_TO_OFF(pop, lane_get_undo(pop, layout)),
+			OBJ_LANE_UNDO_SIZE(pop), 0, 0, 0, &pop->p_ops);
 	}
 	layout = lane_get_layout(pop, 0);
 	pmemops_xpersist(&pop->p_ops, layout,
-		pop->nlanes * sizeof(struct lane_layout),
+		pop->nlanes * OBJ_LANE_SIZE(pop),
 		PMEMOBJ_F_RELAXED);
 }
 
@@ -336,12 +457,182 @@ lane_cleanup(PMEMobjpool *pop)
 	Free(pop->lanes_desc.lane_locks);
 	pop->lanes_desc.lane_locks = NULL;
 
+	os_cond_destroy(&pop->lanes_desc.waiters_cond);
+	util_mutex_destroy(&pop->lanes_desc.waiters_lock);
+
 	lane_info_cleanup(pop);
 }
 
+/*
+ * lane_any_free -- (internal) checks whether any of the lanes is free
+ */
+static int
+lane_any_free(struct lane_descriptor *desc)
+{
+	for (unsigned i = 0; i < desc->runtime_nlanes; ++i) {
+		uint64_t locked;
+		util_atomic_load_explicit64(&desc->lane_locks[i], &locked,
+			memory_order_relaxed);
+		if (!locked)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * lane_wait -- (internal) sleeps until any lane is released or the wait
+ *	times out, returns 1 if the thread was woken up by a released lane
+ *
+ * The number of waiters is published before the lanes are checked for the
+ * last time, and lane_release checks it after the lane is unlocked, which
+ * means that either the waiter finds the released lane or the releasing
+ * thread finds the waiter. The timeout only bounds the wait in case another
+ * thread takes the released lane first.
+ */
+static int
+lane_wait(struct lane_descriptor *desc)
+{
+	int woken = 0;
+
+	util_mutex_lock(&desc->waiters_lock);
+	util_fetch_and_add32(&desc->nwaiters, 1);
+
+	if (!lane_any_free(desc)) {
+		struct timespec deadline;
+		os_clock_gettime(CLOCK_REALTIME, &deadline);
+		uint64_t nsec = (uint64_t)deadline.tv_nsec +
+			(uint64_t)LANE_WAIT_TIMEOUT_US * 1000;
+		deadline.tv_sec += (time_t)(nsec / 1000000000);
+		deadline.tv_nsec = (long)(nsec % 1000000000);
+
+		woken = os_cond_timedwait(&desc->waiters_cond,
+			&desc->waiters_lock, &deadline) == 0;
+	}
+
+	util_fetch_and_sub32(&desc->nwaiters, 1);
+	util_mutex_unlock(&desc->waiters_lock);
+
+	return woken;
+}
+
+/*
+ * lane_wake -- (internal) wakes up one of the threads waiting for a lane
+ */
+static void
+lane_wake(struct lane_descriptor *desc)
+{
+	unsigned nwaiters;
+	util_atomic_load32(&desc->nwaiters, &nwaiters);
+	if (likely(nwaiters == 0))
+		return;
+
+	util_mutex_lock(&desc->waiters_lock);
+	os_cond_signal(&desc->waiters_cond);
+	util_mutex_unlock(&desc->waiters_lock);
+}
+
+/*
+ * get_lane_info_record -- (internal) get lane record attached to memory pool
+ *	or first free
+ */
+static inline struct lane_info *
+get_lane_info_record(PMEMobjpool *pop)
+{
+	if (likely(Lane_info_cache != NULL &&
+			Lane_info_cache->pop_uuid_lo == pop->uuid_lo)) {
+		return Lane_info_cache;
+	}
+
+	if (unlikely(Lane_info_ht == NULL)) {
+		lane_info_ht_boot();
+	}
+
+	struct lane_info *info = critnib_get(Lane_info_ht, pop->uuid_lo);
+
+	if (unlikely(info == NULL)) {
+		info = Malloc(sizeof(struct lane_info));
+		if (unlikely(info == NULL)) {
+			FATAL("Malloc");
+		}
+		info->pop_uuid_lo = pop->uuid_lo;
+		info->lane_idx = UINT64_MAX;
+		info->nest_count = 0;
+		info->next = Lane_info_records;
+		info->prev = NULL;
+		info->primary = UINT64_MAX;
+		info->primary_attempts = LANE_PRIMARY_ATTEMPTS;
+		info->cpu = -1;
+		if (Lane_info_records) {
+			Lane_info_records->prev = info;
+		}
+		Lane_info_records = info;
+
+		if (unlikely(critnib_insert(
+				Lane_info_ht, pop->uuid_lo, info) != 0)) {
+			FATAL("critnib_insert");
+		}
+	}
+
+	Lane_info_cache = info;
+	return info;
+}
+
+/*
+ * lane_redo_recover -- (internal) recovers the internal and external redo logs
+ *	of a single lane
+ */
+static void
+lane_redo_recover(void *arg, uint64_t idx)
+{
+	PMEMobjpool *pop = arg;
+	struct lane_layout *layout = lane_get_layout(pop, idx);
+
+	ulog_recover((struct ulog *)&layout->internal,
+		OBJ_OFF_IS_VALID_FROM_CTX, &pop->p_ops);
+	ulog_recover((struct ulog *)&layout->external,
+		OBJ_OFF_IS_VALID_FROM_CTX, &pop->p_ops);
+}
+
+/*
+ * lane_undo_recover -- (internal) processes the undo log of a single lane
+ *
+ * Freeing the undo log extensions requires a lane for the allocator
+ * operation. The recovered lane is held by the recovering thread for that
+ * purpose, just like in a transaction. Otherwise, the thread could wait for
+ * a lane held by itself, or by another thread recovering a lane, and it
+ * could reinitialize a lane which is in the middle of its recovery.
+ */
+static void
+lane_undo_recover(void *arg, uint64_t idx)
+{
+	PMEMobjpool *pop = arg;
+	struct lane_descriptor *desc = &pop->lanes_desc;
+
+	while (!util_bool_compare_and_swap64(&desc->lane_locks[idx], 0, 1))
+		lane_wait(desc);
+
+	/* the recovered lanes can be beyond the ones used at runtime */
+	struct lane_info *info = get_lane_info_record(pop);
+	ASSERTeq(info->nest_count, 0);
+	info->lane_idx = idx;
+	info->nest_count = 1;
+
+	struct operation_context *ctx = desc->lane[idx].undo;
+	operation_resume(ctx);
+	operation_process(ctx);
+	operation_finish(ctx, ULOG_INC_FIRST_GEN_NUM |
+			ULOG_FREE_AFTER_FIRST);
+
+	lane_release(pop);
+}
+
 /*
  * lane_recover_and_section_boot -- performs initialization and recovery of all
  * lanes
+ *
+ * The lanes are independent from each other and are recovered by the number
+ * of threads configured with the recovery.nthreads global ctl entry.
  */
 int
 lane_recover_and_section_boot(PMEMobjpool *pop)
@@ -351,36 +642,29 @@ lane_recover_and_section_boot(PMEMobjpool *pop)
 		SIZEOF_ULOG(LANE_REDO_INTERNAL_SIZE) != LANE_TOTAL_SIZE);
 
 	int err = 0;
-	uint64_t i; /* lane index */
-	struct lane_layout *layout;
+	uint64_t start;
 
 	/*
 	 * First we need to recover the internal/external redo logs so that the
 	 * allocator state is consistent before we boot it.
 	 */
-	for (i = 0; i < pop->nlanes; ++i) {
-		layout = lane_get_layout(pop, i);
-
-		ulog_recover((struct ulog *)&layout->internal,
-			OBJ_OFF_IS_VALID_FROM_CTX, &pop->p_ops);
-		ulog_recover((struct ulog *)&layout->external,
-			OBJ_OFF_IS_VALID_FROM_CTX, &pop->p_ops);
-	}
-
-	if ((err = pmalloc_boot(pop)) != 0)
+	start = stats_recovery_start();
+	recovery_parallel(pop->nlanes, lane_redo_recover, pop);
+	stats_recovery_end(pop->stats, STATS_RECOVERY_REDO, start);
+
+	start = stats_recovery_start();
+	err = pmalloc_boot(pop);
+	stats_recovery_end(pop->stats, STATS_RECOVERY_HEAP_BOOT, start);
+	if (err != 0)
 		return err;
 
 	/*
 	 * Undo logs must be processed after the heap is initialized since
 	 * a undo recovery might require deallocation of the next ulogs.
 	 */
-	for (i = 0; i < pop->nlanes; ++i) {
-		struct operation_context *ctx = pop->lanes_desc.lane[i].undo;
-		operation_resume(ctx);
-		operation_process(ctx);
-		operation_finish(ctx, ULOG_INC_FIRST_GEN_NUM |
-				ULOG_FREE_AFTER_FIRST);
-	}
+	start = stats_recovery_start();
+	recovery_parallel(pop->nlanes, lane_undo_recover, pop);
+	stats_recovery_end(pop->stats, STATS_RECOVERY_UNDO, start);
 
 	return 0;
 }
@@ -418,15 +702,74 @@ lane_check(PMEMobjpool *pop)
 }
 
 /*
- * get_lane -- (internal) get free lane index
+ * lane_cpu_primary -- (internal) selects the primary lane from the shard of
+ *	the given cpu
+ *
+ * Threads running on the same cpu cannot use their lanes at the same time,
+ * so the lanes of a shard are adjacent and only the shards are far enough
+ * from each other to not falsely share the lane locks.
+ */
+static uint64_t
+lane_cpu_primary(struct lane_descriptor *desc, unsigned cpu)
+{
+	unsigned nlanes = desc->runtime_nlanes;
+	unsigned shard_size = nlanes / desc->ncpus;
+	if (shard_size == 0)
+		shard_size = 1;
+
+	unsigned nshards = nlanes / shard_size;
+	unsigned offset = util_fetch_and_add32(&desc->next_lane_idx, 1);
+
+	return (uint64_t)(cpu % nshards) * shard_size + offset % shard_size;
+}
+
+/*
+ * lane_select_primary -- (internal) selects the primary lane for the thread
+ *	based on the cpu it is currently running on
+ *
+ * If the cpu cannot be determined, the primary lanes are assigned to
+ * the threads in a round-robin fashion.
  */
 static inline void
-get_lane(uint64_t *locks, struct lane_info *info, uint64_t nlocks)
+lane_select_primary(struct lane_descriptor *desc, struct lane_info *info)
 {
-	info->lane_idx = info->primary;
+	int cpu = os_thread_getcpu();
+	if (likely(cpu == info->cpu && info->primary != UINT64_MAX))
+		return;
+
+	if (cpu < 0) {
+		/* initial wrap to next CL */
+		info->primary = util_fetch_and_add32(&desc->next_lane_idx,
+			LANE_JUMP) % desc->runtime_nlanes;
+	} else {
+		info->primary = lane_cpu_primary(desc, (unsigned)cpu);
+	}
+
+	info->cpu = cpu;
+	info->primary_attempts = LANE_PRIMARY_ATTEMPTS;
+}
+
+/*
+ * get_lane -- (internal) get free lane index, returns the number of failed
+ *	attempts to lock a lane
+ *
+ * The lanes are checked starting from the primary one. If all of them are
+ * taken, the thread sleeps until any lane is released.
+ */
+static inline uint64_t
+get_lane(struct lane_descriptor *desc, struct lane_info *info,
+	uint64_t *waits, uint64_t *handoffs)
+{
+	uint64_t *locks = desc->lane_locks;
+	uint64_t nlocks = desc->runtime_nlanes;
+	uint64_t retries = 0;
+
 	while (1) {
-		do {
-			info->lane_idx %= nlocks;
+		info->lane_idx = info->primary;
+		for (uint64_t i = 0; i < nlocks; ++i) {
+			if (info->lane_idx >= nlocks)
+				info->lane_idx = 0;
+
 			if (likely(util_bool_compare_and_swap64(
 					&locks[info->lane_idx], 0, 1))) {
 				if (info->lane_idx == info->primary) {
@@ -437,68 +780,28 @@ get_lane(uint64_t *locks, struct lane_info *info, uint64_t nlocks)
 					info->primary_attempts =
 						LANE_PRIMARY_ATTEMPTS;
 				}
-				return;
+				return retries;
 			}
 
+			retries++;
+
 			if (info->lane_idx == info->primary &&
 					info->primary_attempts > 0) {
 				info->primary_attempts--;
 			}
 
 			++info->lane_idx;
-		} while (info->lane_idx < nlocks);
-
-		sched_yield();
-	}
-}
-
-/*
- * get_lane_info_record -- (internal) get lane record attached to memory pool
- *	or first free
- */
-static inline struct lane_info *
-get_lane_info_record(PMEMobjpool *pop)
-{
-	if (likely(Lane_info_cache != NULL &&
-			Lane_info_cache->pop_uuid_lo == pop->uuid_lo)) {
-		return Lane_info_cache;
-	}
-
-	if (unlikely(Lane_info_ht == NULL)) {
-		lane_info_ht_boot();
-	}
-
-	struct lane_info *info = critnib_get(Lane_info_ht, pop->uuid_lo);
-
-	if (unlikely(info == NULL)) {
-		info = Malloc(sizeof(struct lane_info));
-		if (unlikely(info == NULL)) {
-			FATAL("Malloc");
 		}
-		info->pop_uuid_lo = pop->uuid_lo;
-		info->lane_idx = UINT64_MAX;
-		info->nest_count = 0;
-		info->next = Lane_info_records;
-		info->prev = NULL;
-		info->primary = 0;
-		info->primary_attempts = LANE_PRIMARY_ATTEMPTS;
-		if (Lane_info_records) {
-			Lane_info_records->prev = info;
-		}
-		Lane_info_records = info;
 
-		if (unlikely(critnib_insert(
-				Lane_info_ht, pop->uuid_lo, info) != 0)) {
-			FATAL("critnib_insert");
-		}
+		(*waits)++;
+		if (lane_wait(desc))
+			(*handoffs)++;
 	}
-
-	Lane_info_cache = info;
-	return info;
 }
 
 /*
- * lane_hold -- grabs a per-thread lane in a round-robin fashion
+ * lane_hold -- grabs a per-thread lane, preferably from the shard of the cpu
+ *	the thread is running on
  */
 unsigned
 lane_hold(PMEMobjpool *pop, struct lane **lanep)
@@ -515,16 +818,24 @@ lane_hold(PMEMobjpool *pop, struct lane **lanep)
 	}
 
 	struct lane_info *lane = get_lane_info_record(pop);
-	while (unlikely(lane->lane_idx == UINT64_MAX)) {
-		/* initial wrap to next CL */
-		lane->primary = lane->lane_idx = util_fetch_and_add32(
-			&pop->lanes_desc.next_lane_idx, LANE_JUMP);
-	} /* handles wraparound */
 
-	uint64_t *llocks = pop->lanes_desc.lane_locks;
 	/* grab next free lane from lanes available at runtime */
 	if (!lane->nest_count++) {
-		get_lane(llocks, lane, pop->lanes_desc.runtime_nlanes);
+		uint64_t waits = 0;
+		uint64_t handoffs = 0;
+
+		lane_select_primary(&pop->lanes_desc, lane);
+		uint64_t retries = get_lane(&pop->lanes_desc, lane,
+			&waits, &handoffs);
+		if (unlikely(retries != 0)) {
+			struct stats_lane *sl = stats_lane_at(pop->stats,
+				(unsigned)lane->lane_idx);
+			if (sl != NULL) {
+				sl->lane_retries += retries;
+				sl->lane_waits += waits;
+				sl->lane_handoffs += handoffs;
+			}
+		}
 	}
 
 	struct lane *l = &pop->lanes_desc.lane[lane->lane_idx];
@@ -532,7 +843,7 @@ lane_hold(PMEMobjpool *pop, struct lane **lanep)
 	/* reinitialize lane's content only if in outermost hold */
 	if (lanep && lane->nest_count == 1) {
 		VALGRIND_ANNOTATE_NEW_MEMORY(l, sizeof(*l));
-		VALGRIND_ANNOTATE_NEW_MEMORY(l->layout, sizeof(*l->layout));
+		VALGRIND_ANNOTATE_NEW_MEMORY(l->layout, OBJ_LANE_SIZE(pop));
 		operation_init(l->external);
 		operation_init(l->internal);
 		operation_init(l->undo);
@@ -544,6 +855,23 @@ lane_hold(PMEMobjpool *pop, struct lane **lanep)
 	return (unsigned)lane->lane_idx;
 }
 
+/*
+ * lane_current -- returns the index of the lane held by the calling thread,
+ *	or UINT_MAX if the thread doesn't hold any
+ */
+unsigned
+lane_current(PMEMobjpool *pop)
+{
+	if (unlikely(!pop->lanes_desc.runtime_nlanes))
+		return UINT_MAX;
+
+	struct lane_info *lane = get_lane_info_record(pop);
+	if (lane->nest_count == 0)
+		return UINT_MAX;
+
+	return (unsigned)lane->lane_idx;
+}
+
 /*
  * lane_release -- drops the per-thread lane
  */
@@ -568,5 +896,201 @@ lane_release(PMEMobjpool *pop)
 				1, 0))) {
 			FATAL("util_bool_compare_and_swap64");
 		}
+
+		lane_wake(&pop->lanes_desc);
+	}
+}
+
+/*
+ * lane_detach -- hands over the lane held by the calling thread without
+ *	releasing it, the lane can be then taken over by a different thread
+ *	with lane_attach
+ *
+ * Only the outermost hold can be detached. Returns the lane index or -1 if the
+ * lane is held more than once.
+ */
+int
+lane_detach(PMEMobjpool *pop)
+{
+	if (unlikely(!pop->lanes_desc.runtime_nlanes))
+		return -1;
+
+	struct lane_info *lane = get_lane_info_record(pop);
+
+	ASSERTne(lane->lane_idx, UINT64_MAX);
+
+	if (lane->nest_count != 1)
+		return -1;
+
+	lane->nest_count = 0;
+
+	return (int)lane->lane_idx;
+}
+
+/*
+ * lane_attach -- takes over the ownership of a lane detached by a different
+ *	thread, the lane must be dropped with lane_release afterwards
+ */
+void
+lane_attach(PMEMobjpool *pop, unsigned lane_idx, struct lane **lanep)
+{
+	ASSERT(lane_idx < pop->lanes_desc.runtime_nlanes);
+	ASSERTeq(pop->lanes_desc.lane_locks[lane_idx], 1);
+
+	struct lane_info *lane = get_lane_info_record(pop);
+	if (unlikely(lane->nest_count != 0))
+		FATAL("lane_attach");
+
+	if (lane->lane_idx == UINT64_MAX)
+		lane->primary = lane_idx;
+
+	lane->lane_idx = lane_idx;
+	lane->nest_count = 1;
+
+	if (lanep)
+		*lanep = &pop->lanes_desc.lane[lane_idx];
+}
+
+/*
+ * lane_hold_all -- grabs all the lanes of the pool without waiting, which
+ *	guarantees that no other thread is in the middle of a transaction or
+ *	any other operation that requires a lane
+ *
+ * Returns -1 and sets errno to EBUSY if any of the lanes is in use.
+ */
+int
+lane_hold_all(PMEMobjpool *pop)
+{
+	struct lane_descriptor *desc = &pop->lanes_desc;
+
+	for (unsigned i = 0; i < desc->runtime_nlanes; ++i) {
+		if (util_bool_compare_and_swap64(&desc->lane_locks[i], 0, 1))
+			continue;
+
+		while (i-- != 0) {
+			util_atomic_store_explicit64(&desc->lane_locks[i], 0,
+				memory_order_release);
+			lane_wake(desc);
+		}
+
+		errno = EBUSY;
+		return -1;
 	}
+
+	return 0;
+}
+
+/*
+ * lane_release_all -- drops all the lanes grabbed by lane_hold_all
+ */
+void
+lane_release_all(PMEMobjpool *pop)
+{
+	struct lane_descriptor *desc = &pop->lanes_desc;
+
+	for (unsigned i = 0; i < desc->runtime_nlanes; ++i) {
+		util_atomic_store_explicit64(&desc->lane_locks[i], 0,
+			memory_order_release);
+		lane_wake(desc);
+	}
+}
+
+/*
+ * lane_size_ctl_set -- (internal) sets the capacity of a log of the lanes of
+ *	the pools created from now on
+ */
+static int
+lane_size_ctl_set(uint64_t *size, long long arg_in, uint64_t min_size)
+{
+	if (arg_in < 0 || !lane_size_valid((uint64_t)arg_in, min_size)) {
+		ERR("invalid capacity of a lane log %lld, must be a multiple "
+			"of %d between %" PRIu64 " and %d", arg_in,
+			(int)CACHELINE_SIZE, min_size, LANE_LOG_MAX_SIZE);
+		errno = EINVAL;
+		return -1;
+	}
+
+	util_atomic_store_explicit64(size, (uint64_t)arg_in,
+		memory_order_relaxed);
+
+	return 0;
+}
+
+/*
+ * CTL_READ_HANDLER(redo_size) -- returns the capacity of the external redo
+ *	log of the lanes of newly created pools
+ */
+static int
+CTL_READ_HANDLER(redo_size)(void *ctx, enum ctl_query_source source,
+	void *arg, struct ctl_indexes *indexes)
+{
+	long long *arg_out = arg;
+
+	uint64_t size;
+	util_atomic_load_explicit64(&Lane_redo_size_at_create, &size,
+		memory_order_relaxed);
+	*arg_out = (long long)size;
+
+	return 0;
+}
+
+/*
+ * CTL_WRITE_HANDLER(redo_size) -- sets the capacity of the external redo
+ *	log of the lanes of newly created pools
+ */
+static int
+CTL_WRITE_HANDLER(redo_size)(void *ctx, enum ctl_query_source source,
+	void *arg, struct ctl_indexes *indexes)
+{
+	return lane_size_ctl_set(&Lane_redo_size_at_create,
+		*(long long *)arg, LANE_REDO_EXTERNAL_SIZE);
+}
+
+/*
+ * CTL_READ_HANDLER(undo_size) -- returns the capacity of the undo log of
+ *	the lanes of newly created pools
+ */
+static int
+CTL_READ_HANDLER(undo_size)(void *ctx, enum ctl_query_source source,
+	void *arg, struct ctl_indexes *indexes)
+{
+	long long *arg_out = arg;
+
+	uint64_t size;
+	util_atomic_load_explicit64(&Lane_undo_size_at_create, &size,
+		memory_order_relaxed);
+	*arg_out = (long long)size;
+
+	return 0;
+}
+
+/*
+ * CTL_WRITE_HANDLER(undo_size) -- sets the capacity of the undo log of
+ *	the lanes of newly created pools
+ */
+static int
+CTL_WRITE_HANDLER(undo_size)(void *ctx, enum ctl_query_source source,
+	void *arg, struct ctl_indexes *indexes)
+{
+	return lane_size_ctl_set(&Lane_undo_size_at_create,
+		*(long long *)arg, LANE_UNDO_SIZE);
+}
+
+static const struct ctl_argument CTL_ARG(redo_size) = CTL_ARG_LONG_LONG;
+static const struct ctl_argument CTL_ARG(undo_size) = CTL_ARG_LONG_LONG;
+
+static const struct ctl_node CTL_NODE(lane)[] = {
+	CTL_LEAF_RW(redo_size),
+	CTL_LEAF_RW(undo_size),
+
+	CTL_NODE_END
+};
+
+/*
+ * lane_global_ctl_register -- registers the global ctl entries of the lanes
+ */
+void
+lane_global_ctl_register(void)
+{
+	CTL_REGISTER_MODULE(NULL, lane);
 }
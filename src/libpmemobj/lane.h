@@ -1,5 +1,5 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
-/* Copyright 2015-2020, Intel Corporation */
+/* Copyright 2015-2021, Intel Corporation */
 
 /*
  * lane.h -- internal definitions for lanes
@@ -11,6 +11,7 @@
 #include <stdint.h>
 #include "ulog.h"
 #include "libpmemobj.h"
+#include "os_thread.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -30,6 +31,12 @@ extern "C" {
  */
 #define LANE_PRIMARY_ATTEMPTS 128
 
+/*
+ * Maximum time a thread sleeps waiting for a lane to be released before it
+ * looks for a free lane again.
+ */
+#define LANE_WAIT_TIMEOUT_US 1000
+
 #define RLANE_DEFAULT 0
 
 #define LANE_TOTAL_SIZE 3072 /* 3 * 1024 (sum of 3 old lane sections) */
@@ -62,6 +69,19 @@ extern "C" {
 #define LANE_REDO_INTERNAL_SIZE ALIGN_UP(256 - sizeof(struct ulog), \
 					CACHELINE_SIZE) /* 192 for 64B ulog */
 
+/*
+ * The capacities of the external redo log and of the undo log can be
+ * enlarged for a pool at creation time, so that bigger transactions can be
+ * performed without extending the logs. The values above are the defaults and
+ * the lower bounds, the capacity of a single log is limited to 1 megabyte.
+ */
+#define LANE_LOG_MAX_SIZE (1 << 20)
+
+/*
+ * Layout of a lane with the default capacities of the logs. In a pool with
+ * non-default capacities only the internal and the external redo logs reside
+ * at these offsets, see OBJ_LANE_UNDO_OFFSET.
+ */
 struct lane_layout {
 	/*
 	 * Redo log for self-contained and 'one-shot' allocator operations.
@@ -82,9 +102,11 @@ struct lane_layout {
 
 struct lane {
 	struct lane_layout *layout; /* pointer to persistent layout */
+	struct ulog *undo_log; /* pointer to persistent undo log */
 	struct operation_context *internal; /* context for internal ulog */
 	struct operation_context *external; /* context for external ulog */
 	struct operation_context *undo; /* context for undo ulog */
+	struct tx_arena *tx_arena; /* runtime scratch memory of transactions */
 };
 
 struct lane_descriptor {
@@ -97,6 +119,17 @@ struct lane_descriptor {
 	unsigned next_lane_idx;
 	uint64_t *lane_locks;
 	struct lane *lane;
+
+	/*
+	 * The lanes are split into per-cpu shards, a thread picks its primary
+	 * lane from the shard of the cpu it is running on.
+	 */
+	unsigned ncpus;
+
+	/* threads sleeping until any lane is released */
+	unsigned nwaiters;
+	os_mutex_t waiters_lock;
+	os_cond_t waiters_cond;
 };
 
 typedef int (*section_layout_op)(PMEMobjpool *pop, void *data, unsigned length);
@@ -125,6 +158,7 @@ struct lane_info {
 	 */
 	uint64_t primary;
 	int primary_attempts;
+	int cpu; /* cpu for which the primary lane was selected */
 
 	struct lane_info *prev, *next;
 };
@@ -132,6 +166,10 @@ struct lane_info {
 void lane_info_boot(void);
 void lane_info_destroy(void);
 
+void lane_global_ctl_register(void);
+void lane_sizes_at_create(size_t *redo_size, size_t *undo_size);
+int lane_sizes_check(PMEMobjpool *pop);
+
 void lane_init_data(PMEMobjpool *pop);
 int lane_boot(PMEMobjpool *pop);
 void lane_cleanup(PMEMobjpool *pop);
@@ -140,8 +178,15 @@ int lane_section_cleanup(PMEMobjpool *pop);
 int lane_check(PMEMobjpool *pop);
 
 unsigned lane_hold(PMEMobjpool *pop, struct lane **lane);
+unsigned lane_current(PMEMobjpool *pop);
 void lane_release(PMEMobjpool *pop);
 
+int lane_detach(PMEMobjpool *pop);
+void lane_attach(PMEMobjpool *pop, unsigned lane_idx, struct lane **lane);
+
+int lane_hold_all(PMEMobjpool *pop);
+void lane_release_all(PMEMobjpool *pop);
+
 #ifdef __cplusplus
 }
 #endif
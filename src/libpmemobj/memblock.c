@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2016-2020, Intel Corporation */
+/* Copyright 2016-2021, Intel Corporation */
 
 /*
  * memblock.c -- implementation of memory block
@@ -725,7 +725,7 @@ huge_get_lock(const struct memory_block *m)
 static os_mutex_t *
 run_get_lock(const struct memory_block *m)
 {
-	return heap_get_run_lock(m->heap, m->chunk_id);
+	return heap_get_run_lock(m->heap, m->zone_id, m->chunk_id);
 }
 
 /*
@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2016-2020, Intel Corporation */
+/* Copyright 2016-2021, Intel Corporation */
 
 /*
  * memops.c -- aggregated memory operations helper implementation
@@ -16,6 +16,8 @@
 
 #include "memops.h"
 #include "obj.h"
+#include "os.h"
+#include "os_thread.h"
 #include "out.h"
 #include "ravl.h"
 #include "valgrind_internal.h"
@@ -71,6 +73,34 @@ struct operation_context {
 
 	/* collection used to look for potential merge candidates */
 	VECQ(, struct ulog_entry_val *) merge_entries;
+
+	struct operation_group *group; /* NULL if not grouped */
+	struct operation_context *group_next; /* in the pending batch */
+};
+
+/*
+ * Group of operation contexts whose persistent redo logs are processed
+ * together. The first thread that finds no batch in progress becomes the
+ * leader: it optionally waits for other threads to join, and then stores,
+ * applies and clobbers the redo logs of the whole batch, draining once per
+ * phase instead of once per phase and context. The other threads of the batch
+ * wait until it is done, so each of them returns only after its own
+ * modifications are persistent, exactly like with the ungrouped processing.
+ */
+struct operation_group {
+	os_mutex_t lock;
+	os_cond_t cond;
+
+	int enabled;
+	unsigned window_us; /* how long the leader waits for more contexts */
+	unsigned max_batch; /* the leader stops waiting at this batch size */
+
+	struct operation_context *pending; /* the batch being collected */
+	struct operation_context *pending_tail;
+	unsigned npending;
+	uint64_t pending_id; /* the id of the batch being collected */
+	uint64_t done_id; /* the id of the last processed batch */
+	int busy; /* set if the leader is collecting or processing a batch */
 };
 
 /*
@@ -638,6 +668,17 @@ operation_get_any_user_buffer(struct operation_context *ctx)
 	return ctx->ulog_any_user_buffer;
 }
 
+/*
+ * operation_get_logged -- returns the number of bytes stored in the
+ *	persistent log by the current operation
+ */
+size_t
+operation_get_logged(struct operation_context *ctx)
+{
+	return ctx->type == LOG_TYPE_UNDO ?
+		ctx->total_logged : ctx->pshadow_ops.offset;
+}
+
 /*
  * operation_process_persistent_redo -- (internal) process using ulog
  */
@@ -657,6 +698,211 @@ operation_process_persistent_redo(struct operation_context *ctx)
 	ulog_clobber(ctx->ulog, &ctx->next, ctx->p_ops);
 }
 
+/*
+ * operation_group_new -- creates a new, disabled, operation group
+ */
+struct operation_group *
+operation_group_new(void)
+{
+	struct operation_group *group = Zalloc(sizeof(*group));
+	if (group == NULL) {
+		ERR("!Zalloc");
+		return NULL;
+	}
+
+	util_mutex_init(&group->lock);
+	if (os_cond_init(&group->cond) != 0) {
+		ERR("!os_cond_init");
+		util_mutex_destroy(&group->lock);
+		Free(group);
+		return NULL;
+	}
+
+	group->window_us = OPERATION_GROUP_DEFAULT_WINDOW_US;
+	group->max_batch = OPERATION_GROUP_DEFAULT_MAX_BATCH;
+
+	return group;
+}
+
+/*
+ * operation_group_delete -- deletes the operation group, there must be no
+ *	contexts being processed in the group
+ */
+void
+operation_group_delete(struct operation_group *group)
+{
+	ASSERTeq(group->pending, NULL);
+
+	os_cond_destroy(&group->cond);
+	util_mutex_destroy(&group->lock);
+	Free(group);
+}
+
+/*
+ * operation_group_get_params -- returns the parameters of the group
+ */
+void
+operation_group_get_params(struct operation_group *group, int *enabled,
+	unsigned *window_us, unsigned *max_batch)
+{
+	util_mutex_lock(&group->lock);
+	if (enabled)
+		*enabled = group->enabled;
+	if (window_us)
+		*window_us = group->window_us;
+	if (max_batch)
+		*max_batch = group->max_batch;
+	util_mutex_unlock(&group->lock);
+}
+
+/*
+ * operation_group_set_params -- sets the parameters of the group, NULL
+ *	arguments are left unchanged
+ */
+void
+operation_group_set_params(struct operation_group *group, const int *enabled,
+	const unsigned *window_us, const unsigned *max_batch)
+{
+	util_mutex_lock(&group->lock);
+	if (enabled)
+		group->enabled = *enabled;
+	if (window_us)
+		group->window_us = *window_us;
+	if (max_batch)
+		group->max_batch = *max_batch;
+	util_mutex_unlock(&group->lock);
+}
+
+/*
+ * operation_set_group -- sets the group in which the persistent redo log of
+ *	the context is processed, NULL means that it is processed alone
+ */
+void
+operation_set_group(struct operation_context *ctx,
+	struct operation_group *group)
+{
+	ctx->group = group;
+}
+
+/*
+ * operation_group_process_batch -- (internal) processes the persistent redo
+ *	logs of all the contexts in the batch
+ *
+ * The phases are the same as in operation_process_persistent_redo, but
+ * the stores of all the contexts are drained at once.
+ */
+static void
+operation_group_process_batch(struct operation_context *batch)
+{
+	const struct pmem_ops *p_ops = batch->p_ops;
+	struct operation_context *ctx;
+
+	for (ctx = batch; ctx != NULL; ctx = ctx->group_next) {
+		ASSERTeq(ctx->pshadow_ops.capacity % CACHELINE_SIZE, 0);
+
+		ulog_store_nodrain(ctx->ulog, ctx->pshadow_ops.ulog,
+			ctx->pshadow_ops.offset, ctx->ulog_base_nbytes,
+			ctx->ulog_capacity,
+			&ctx->next, ctx->p_ops);
+	}
+	pmemops_drain(p_ops);
+
+	for (ctx = batch; ctx != NULL; ctx = ctx->group_next)
+		ulog_process_nodrain(ctx->pshadow_ops.ulog,
+			OBJ_OFF_IS_VALID_FROM_CTX, ctx->p_ops);
+	pmemops_drain(p_ops);
+
+	for (ctx = batch; ctx != NULL; ctx = ctx->group_next)
+		ulog_clobber_nodrain(ctx->ulog, &ctx->next, ctx->p_ops);
+	pmemops_drain(p_ops);
+}
+
+/*
+ * operation_group_collect -- (internal) waits, up to the group window,
+ *	for other contexts to join the batch, must be called with the group
+ *	lock held
+ */
+static void
+operation_group_collect(struct operation_group *group)
+{
+	if (group->window_us == 0)
+		return;
+
+	struct timespec deadline;
+	os_clock_gettime(CLOCK_REALTIME, &deadline);
+	uint64_t nsec = (uint64_t)deadline.tv_nsec +
+		(uint64_t)group->window_us * 1000;
+	deadline.tv_sec += (time_t)(nsec / 1000000000);
+	deadline.tv_nsec = (long)(nsec % 1000000000);
+
+	while (group->npending < group->max_batch) {
+		if (os_cond_timedwait(&group->cond, &group->lock,
+				&deadline) != 0)
+			break;
+	}
+}
+
+/*
+ * operation_group_process -- (internal) processes the persistent redo log of
+ *	the context as a part of a batch, returns only after the batch with the
+ *	context is processed
+ */
+static void
+operation_group_process(struct operation_group *group,
+	struct operation_context *ctx)
+{
+	util_mutex_lock(&group->lock);
+
+	if (!group->enabled) {
+		util_mutex_unlock(&group->lock);
+		operation_process_persistent_redo(ctx);
+		return;
+	}
+
+	ctx->group_next = NULL;
+	if (group->pending_tail)
+		group->pending_tail->group_next = ctx;
+	else
+		group->pending = ctx;
+	group->pending_tail = ctx;
+	group->npending++;
+
+	uint64_t id = group->pending_id;
+
+	/* a waiting leader might want to stop collecting */
+	if (group->busy && group->npending >= group->max_batch)
+		os_cond_broadcast(&group->cond);
+
+	while (group->done_id < id + 1) {
+		if (group->busy) {
+			os_cond_wait(&group->cond, &group->lock);
+			continue;
+		}
+
+		/* become the leader of the pending batch */
+		group->busy = 1;
+		operation_group_collect(group);
+
+		struct operation_context *batch = group->pending;
+		uint64_t batch_id = group->pending_id;
+		group->pending = NULL;
+		group->pending_tail = NULL;
+		group->npending = 0;
+		group->pending_id++;
+
+		util_mutex_unlock(&group->lock);
+
+		operation_group_process_batch(batch);
+
+		util_mutex_lock(&group->lock);
+		group->done_id = batch_id + 1;
+		group->busy = 0;
+		os_cond_broadcast(&group->cond);
+	}
+
+	util_mutex_unlock(&group->lock);
+}
+
 /*
  * operation_process_persistent_undo -- (internal) process using ulog
  */
@@ -779,7 +1025,10 @@ operation_process(struct operation_context *ctx)
 	}
 
 	if (redo_process) {
-		operation_process_persistent_redo(ctx);
+		if (ctx->group != NULL)
+			operation_group_process(ctx->group, ctx);
+		else
+			operation_process_persistent_redo(ctx);
 		ctx->state = OPERATION_CLEANUP;
 	} else if (ctx->type == LOG_TYPE_UNDO && ctx->total_logged != 0) {
 		operation_process_persistent_undo(ctx);
@@ -1,5 +1,5 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
-/* Copyright 2016-2020, Intel Corporation */
+/* Copyright 2016-2021, Intel Corporation */
 
 /*
  * memops.h -- aggregated memory operations helper definitions
@@ -40,6 +40,10 @@ struct user_buffer_def {
 };
 
 struct operation_context;
+struct operation_group;
+
+#define OPERATION_GROUP_DEFAULT_WINDOW_US 0
+#define OPERATION_GROUP_DEFAULT_MAX_BATCH 64
 
 struct operation_context *
 operation_new(struct ulog *redo, size_t ulog_base_nbytes,
@@ -70,6 +74,7 @@ void operation_set_auto_reserve(struct operation_context *ctx,
 void operation_set_any_user_buffer(struct operation_context *ctx,
 	int any_user_buffer);
 int operation_get_any_user_buffer(struct operation_context *ctx);
+size_t operation_get_logged(struct operation_context *ctx);
 int operation_user_buffer_range_cmp(const void *lhs, const void *rhs);
 
 int operation_reserve(struct operation_context *ctx, size_t new_capacity);
@@ -77,6 +82,16 @@ void operation_process(struct operation_context *ctx);
 void operation_finish(struct operation_context *ctx, unsigned flags);
 void operation_cancel(struct operation_context *ctx);
 
+struct operation_group *operation_group_new(void);
+void operation_group_delete(struct operation_group *group);
+void operation_group_get_params(struct operation_group *group, int *enabled,
+	unsigned *window_us, unsigned *max_batch);
+void operation_group_set_params(struct operation_group *group,
+	const int *enabled, const unsigned *window_us,
+	const unsigned *max_batch);
+void operation_set_group(struct operation_context *ctx,
+	struct operation_group *group);
+
 #ifdef __cplusplus
 }
 #endif
@@ -23,6 +23,8 @@
 #include "os.h"
 #include "os_thread.h"
 #include "pmemops.h"
+#include "recovery.h"
+#include "rep_fanout.h"
 #include "set.h"
 #include "sync.h"
 #include "tx.h"
@@ -165,6 +167,7 @@ obj_ctl_init_and_load(PMEMobjpool *pop)
 		pmalloc_ctl_register(pop);
 		stats_ctl_register(pop);
 		debug_ctl_register(pop);
+		rep_fanout_ctl_register(pop);
 	}
 
 	char *env_config = os_getenv(OBJ_CONFIG_ENV_VARIABLE);
@@ -280,6 +283,8 @@ obj_init(void)
 	 */
 	ctl_global_register();
 	pmalloc_global_ctl_register();
+	recovery_global_ctl_register();
+	lane_global_ctl_register();
 
 	if (obj_ctl_init_and_load(NULL))
 		FATAL("error: %s", pmemobj_errormsg());
@@ -515,6 +520,82 @@ obj_handle_remote_persist_error(PMEMobjpool *pop)
 	FATAL("Fatal error of remote persist. Aborting...");
 }
 
+/*
+ * obj_rep_drain_local -- (internal) drain the stores to all local replicas
+ *
+ * A drain waits for all the stores issued by the calling thread, so for every
+ * distinct drain function it is enough to call it just once.
+ */
+static void
+obj_rep_drain_local(PMEMobjpool *pop)
+{
+	pop->drain_local();
+
+	PMEMobjpool *rep = pop->replica;
+	while (rep) {
+		if (rep->rpp == NULL && rep->drain_local != pop->drain_local) {
+			rep->drain_local();
+			break;
+		}
+		rep = rep->replica;
+	}
+}
+
+/*
+ * obj_rep_local_begin -- (internal) start applying the write to the local
+ *	replicas, in parallel with the master replica if possible
+ *
+ * Returns 1 if the write was handed off to the replica workers.
+ */
+static int
+obj_rep_local_begin(PMEMobjpool *pop, const struct rep_op *op)
+{
+	if (pop->rep_fanout == NULL)
+		return 0;
+
+	return rep_fanout_begin(pop->rep_fanout, op);
+}
+
+/*
+ * obj_rep_local_end -- (internal) finish applying the write to the local
+ *	replicas and drain all of them at once
+ */
+static void
+obj_rep_local_end(PMEMobjpool *pop, const struct rep_op *op, int fanout)
+{
+	if (fanout) {
+		rep_fanout_end(pop->rep_fanout);
+	} else {
+		PMEMobjpool *rep = pop->replica;
+		while (rep) {
+			if (rep->rpp == NULL)
+				rep_op_apply(rep, op);
+			rep = rep->replica;
+		}
+	}
+
+	if (!(op->flags & PMEM_F_MEM_NODRAIN))
+		obj_rep_drain_local(pop);
+}
+
+/*
+ * obj_rep_remote -- (internal) persist the range in all remote replicas
+ */
+static void
+obj_rep_remote(PMEMobjpool *pop, const void *addr, size_t len, unsigned lane,
+		unsigned flags)
+{
+	PMEMobjpool *rep = pop->replica;
+	while (rep) {
+		void *raddr = (char *)rep + (uintptr_t)addr - (uintptr_t)pop;
+		if (rep->rpp != NULL) {
+			if (rep->persist_remote(rep, raddr, len, lane, flags))
+				obj_handle_remote_persist_error(pop);
+		}
+		rep = rep->replica;
+	}
+}
+
 /*
  * obj_rep_memcpy -- (internal) memcpy with replication
  */
@@ -531,23 +612,24 @@ obj_rep_memcpy(void *ctx, void *dest, const void *src, size_t len,
 	if (pop->has_remote_replicas)
 		lane = lane_hold(pop, NULL);
 
-	void *ret = pop->memcpy_local(dest, src, len, flags);
+	struct rep_op op = {
+		.type = REP_OP_MEMCPY,
+		.off = (uintptr_t)dest - (uintptr_t)pop,
+		.src = src,
+		.len = len,
+		.flags = flags & PMEM_F_MEM_VALID_FLAGS,
+	};
+	int fanout = obj_rep_local_begin(pop, &op);
 
-	PMEMobjpool *rep = pop->replica;
-	while (rep) {
-		void *rdest = (char *)rep + (uintptr_t)dest - (uintptr_t)pop;
-		if (rep->rpp == NULL) {
-			rep->memcpy_local(rdest, src, len,
-						flags & PMEM_F_MEM_VALID_FLAGS);
-		} else {
-			if (rep->persist_remote(rep, rdest, len, lane, flags))
-				obj_handle_remote_persist_error(pop);
-		}
-		rep = rep->replica;
-	}
+	void *ret = pop->memcpy_local(dest, src, len,
+					flags | PMEM_F_MEM_NODRAIN);
 
-	if (pop->has_remote_replicas)
+	obj_rep_local_end(pop, &op, fanout);
+
+	if (pop->has_remote_replicas) {
+		obj_rep_remote(pop, dest, len, lane, flags);
 		lane_release(pop);
+	}
 
 	return ret;
 }
@@ -568,23 +650,31 @@ obj_rep_memmove(void *ctx, void *dest, const void *src, size_t len,
 	if (pop->has_remote_replicas)
 		lane = lane_hold(pop, NULL);
 
-	void *ret = pop->memmove_local(dest, src, len, flags);
+	/*
+	 * The source may overlap with the destination, so the replicas are
+	 * always updated one by one, after the master replica.
+	 */
+	void *ret = pop->memmove_local(dest, src, len,
+					flags | PMEM_F_MEM_NODRAIN);
 
 	PMEMobjpool *rep = pop->replica;
 	while (rep) {
 		void *rdest = (char *)rep + (uintptr_t)dest - (uintptr_t)pop;
 		if (rep->rpp == NULL) {
 			rep->memmove_local(rdest, src, len,
-						flags & PMEM_F_MEM_VALID_FLAGS);
-		} else {
-			if (rep->persist_remote(rep, rdest, len, lane, flags))
-				obj_handle_remote_persist_error(pop);
+				(flags & PMEM_F_MEM_VALID_FLAGS) |
+				PMEM_F_MEM_NODRAIN);
 		}
 		rep = rep->replica;
 	}
 
-	if (pop->has_remote_replicas)
+	if (!(flags & PMEM_F_MEM_NODRAIN))
+		obj_rep_drain_local(pop);
+
+	if (pop->has_remote_replicas) {
+		obj_rep_remote(pop, dest, len, lane, flags);
 		lane_release(pop);
+	}
 
 	return ret;
 }
@@ -604,23 +694,24 @@ obj_rep_memset(void *ctx, void *dest, int c, size_t len, unsigned flags)
 	if (pop->has_remote_replicas)
 		lane = lane_hold(pop, NULL);
 
-	void *ret = pop->memset_local(dest, c, len, flags);
+	struct rep_op op = {
+		.type = REP_OP_MEMSET,
+		.off = (uintptr_t)dest - (uintptr_t)pop,
+		.c = c,
+		.len = len,
+		.flags = flags & PMEM_F_MEM_VALID_FLAGS,
+	};
+	int fanout = obj_rep_local_begin(pop, &op);
 
-	PMEMobjpool *rep = pop->replica;
-	while (rep) {
-		void *rdest = (char *)rep + (uintptr_t)dest - (uintptr_t)pop;
-		if (rep->rpp == NULL) {
-			rep->memset_local(rdest, c, len,
-						flags & PMEM_F_MEM_VALID_FLAGS);
-		} else {
-			if (rep->persist_remote(rep, rdest, len, lane, flags))
-				obj_handle_remote_persist_error(pop);
-		}
-		rep = rep->replica;
-	}
+	void *ret = pop->memset_local(dest, c, len,
+					flags | PMEM_F_MEM_NODRAIN);
 
-	if (pop->has_remote_replicas)
+	obj_rep_local_end(pop, &op, fanout);
+
+	if (pop->has_remote_replicas) {
+		obj_rep_remote(pop, dest, len, lane, flags);
 		lane_release(pop);
+	}
 
 	return ret;
 }
@@ -639,22 +730,23 @@ obj_rep_persist(void *ctx, const void *addr, size_t len, unsigned flags)
 	if (pop->has_remote_replicas)
 		lane = lane_hold(pop, NULL);
 
-	pop->persist_local(addr, len);
+	struct rep_op op = {
+		.type = REP_OP_MEMCPY,
+		.off = (uintptr_t)addr - (uintptr_t)pop,
+		.src = addr,
+		.len = len,
+		.flags = 0,
+	};
+	int fanout = obj_rep_local_begin(pop, &op);
 
-	PMEMobjpool *rep = pop->replica;
-	while (rep) {
-		void *raddr = (char *)rep + (uintptr_t)addr - (uintptr_t)pop;
-		if (rep->rpp == NULL) {
-			rep->memcpy_local(raddr, addr, len, 0);
-		} else {
-			if (rep->persist_remote(rep, raddr, len, lane, flags))
-				obj_handle_remote_persist_error(pop);
-		}
-		rep = rep->replica;
-	}
+	pop->flush_local(addr, len);
 
-	if (pop->has_remote_replicas)
+	obj_rep_local_end(pop, &op, fanout);
+
+	if (pop->has_remote_replicas) {
+		obj_rep_remote(pop, addr, len, lane, flags);
 		lane_release(pop);
+	}
 
 	return 0;
 }
@@ -673,23 +765,23 @@ obj_rep_flush(void *ctx, const void *addr, size_t len, unsigned flags)
 	if (pop->has_remote_replicas)
 		lane = lane_hold(pop, NULL);
 
+	struct rep_op op = {
+		.type = REP_OP_MEMCPY,
+		.off = (uintptr_t)addr - (uintptr_t)pop,
+		.src = addr,
+		.len = len,
+		.flags = PMEM_F_MEM_NODRAIN,
+	};
+	int fanout = obj_rep_local_begin(pop, &op);
+
 	pop->flush_local(addr, len);
 
-	PMEMobjpool *rep = pop->replica;
-	while (rep) {
-		void *raddr = (char *)rep + (uintptr_t)addr - (uintptr_t)pop;
-		if (rep->rpp == NULL) {
-			rep->memcpy_local(raddr, addr, len,
-				PMEM_F_MEM_NODRAIN);
-		} else {
-			if (rep->persist_remote(rep, raddr, len, lane, flags))
-				obj_handle_remote_persist_error(pop);
-		}
-		rep = rep->replica;
-	}
+	obj_rep_local_end(pop, &op, fanout);
 
-	if (pop->has_remote_replicas)
+	if (pop->has_remote_replicas) {
+		obj_rep_remote(pop, addr, len, lane, flags);
 		lane_release(pop);
+	}
 
 	return 0;
 }
@@ -703,14 +795,7 @@ obj_rep_drain(void *ctx)
 	PMEMobjpool *pop = ctx;
 	LOG(15, "pop %p", pop);
 
-	pop->drain_local();
-
-	PMEMobjpool *rep = pop->replica;
-	while (rep) {
-		if (rep->rpp == NULL)
-			rep->drain_local();
-		rep = rep->replica;
-	}
+	obj_rep_drain_local(pop);
 }
 
 #if VG_MEMCHECK_ENABLED
@@ -871,9 +956,12 @@ obj_runtime_cleanup_common(PMEMobjpool *pop)
  * obj_descr_create -- (internal) create obj pool descriptor
  */
 static int
-obj_descr_create(PMEMobjpool *pop, const char *layout, size_t poolsize)
+obj_descr_create(PMEMobjpool *pop, const char *layout, size_t poolsize,
+	size_t lane_redo_size, size_t lane_undo_size)
 {
-	LOG(3, "pop %p layout %s poolsize %zu", pop, layout, poolsize);
+	LOG(3, "pop %p layout %s poolsize %zu lane_redo_size %zu "
+		"lane_undo_size %zu", pop, layout, poolsize,
+		lane_redo_size, lane_undo_size);
 
 	ASSERTeq(poolsize % Pagesize, 0);
 
@@ -889,13 +977,26 @@ obj_descr_create(PMEMobjpool *pop, const char *layout, size_t poolsize)
 	pop->lanes_offset = OBJ_LANES_OFFSET;
 	pop->nlanes = OBJ_NLANES;
 
-	/* zero all lanes */
-	lane_init_data(pop);
+	/* the default capacities are recorded as zeros */
+	if (lane_redo_size != LANE_REDO_EXTERNAL_SIZE)
+		pop->lane_redo_size = (uint32_t)lane_redo_size;
+	if (lane_undo_size != LANE_UNDO_SIZE)
+		pop->lane_undo_size = (uint32_t)lane_undo_size;
 
 	pop->heap_offset = pop->lanes_offset +
-		pop->nlanes * sizeof(struct lane_layout);
+		pop->nlanes * OBJ_LANE_SIZE(pop);
 	pop->heap_offset = (pop->heap_offset + Pagesize - 1) & ~(Pagesize - 1);
 
+	if (pop->heap_offset >= pop->set->poolsize) {
+		ERR("pool too small for the lanes, lanes end at %" PRIu64,
+			pop->heap_offset);
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* zero all lanes */
+	lane_init_data(pop);
+
 	size_t heap_size = pop->set->poolsize - pop->heap_offset;
 
 	/* initialize heap prior to storing the checksum */
@@ -979,6 +1080,11 @@ obj_descr_check(PMEMobjpool *pop, const char *layout, size_t poolsize)
 		return -1;
 	}
 
+	if (lane_sizes_check(pop) != 0) {
+		LOG(2, "invalid lane sizes");
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -1192,6 +1298,9 @@ obj_runtime_init(PMEMobjpool *pop, int rdonly, int boot, unsigned nlanes)
 	if (pop->tx_params == NULL)
 		goto err_tx_params;
 
+	pop->tx_postcommit = NULL;
+	pop->rep_fanout = NULL;
+
 	pop->stats = stats_new(pop);
 	if (pop->stats == NULL)
 		goto err_stat;
@@ -1262,7 +1371,9 @@ obj_runtime_init(PMEMobjpool *pop, int rdonly, int boot, unsigned nlanes)
 err_user_buffers_map:
 	util_mutex_destroy(&pop->ulog_user_buffers.lock);
 	ctl_delete(pop->ctl);
-err_ctl:;
+err_ctl:
+	rep_fanout_cleanup(pop);
+	tx_post_commit_cleanup(pop);
 	void *n = critnib_remove(pools_tree, (uint64_t)pop);
 	ASSERTne(n, NULL);
 err_tree_insert:
@@ -1348,6 +1459,17 @@ pmemobj_createU(const char *path, const char *layout,
 	else
 		adj_pool_attr.features.incompat &= ~POOL_FEAT_SDS;
 
+	/*
+	 * Pools with non-default lanes cannot be opened by the older versions
+	 * of the library, which know only the fixed size of the lanes.
+	 */
+	size_t lane_redo_size;
+	size_t lane_undo_size;
+	lane_sizes_at_create(&lane_redo_size, &lane_undo_size);
+	if (lane_redo_size != LANE_REDO_EXTERNAL_SIZE ||
+	    lane_undo_size != LANE_UNDO_SIZE)
+		adj_pool_attr.features.incompat |= POOL_FEAT_LANE_SIZE;
+
 	if (util_pool_create(&set, path, poolsize, PMEMOBJ_MIN_POOL,
 			PMEMOBJ_MIN_PART, &adj_pool_attr, &runtime_nlanes,
 			REPLICAS_ENABLED) != 0) {
@@ -1388,7 +1510,8 @@ pmemobj_createU(const char *path, const char *layout,
 	pop->set = set;
 
 	/* create pool descriptor */
-	if (obj_descr_create(pop, layout, set->poolsize) != 0) {
+	if (obj_descr_create(pop, layout, set->poolsize, lane_redo_size,
+			lane_undo_size) != 0) {
 		LOG(2, "creation of pool descriptor failed");
 		goto err;
 	}
@@ -1687,7 +1810,7 @@ obj_replicas_check_basic(PMEMobjpool *pop)
 
 	/* copy lanes */
 	void *src = (void *)((uintptr_t)pop + pop->lanes_offset);
-	size_t len = pop->nlanes * sizeof(struct lane_layout);
+	size_t len = pop->nlanes * OBJ_LANE_SIZE(pop);
 
 	for (unsigned r = 1; r < pop->set->nreplicas; r++) {
 		rep = pop->set->replica[r]->part[0].addr;
@@ -1932,6 +2055,12 @@ obj_pool_cleanup(PMEMobjpool *pop)
 {
 	LOG(3, "pop %p", pop);
 
+	/* the background work and the thread caches update the statistics */
+	palloc_heap_quiesce(&pop->heap);
+
+	rep_fanout_cleanup(pop);
+	tx_post_commit_cleanup(pop);
+
 	ravl_delete(pop->ulog_user_buffers.map);
 	util_mutex_destroy(&pop->ulog_user_buffers.lock);
 
@@ -2288,6 +2417,111 @@ pmemobj_xalloc(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
 	return ret;
 }
 
+/*
+ * pmemobj_xalloc_batch -- allocates oidcnt objects of the same size and type,
+ *	either all of them are allocated or none
+ *
+ * All of the objects are reserved under a single acquisition of the bucket
+ * and published together with the destination oids in one redo log.
+ */
+int
+pmemobj_xalloc_batch(PMEMobjpool *pop, PMEMoid *oidv, size_t oidcnt,
+	size_t size, uint64_t type_num, uint64_t flags)
+{
+	LOG(3, "pop %p oidv %p oidcnt %zu size %zu type_num %llx flags %llx",
+		pop, oidv, oidcnt, size, (unsigned long long)type_num,
+		(unsigned long long)flags);
+
+	/* log notice message if used inside a transaction */
+	_POBJ_DEBUG_NOTICE_IN_TX();
+
+	if (size == 0) {
+		ERR("allocation with size 0");
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (oidcnt == 0 || oidv == NULL) {
+		ERR("empty array of objects");
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (flags & ~POBJ_XALLOC_BATCH_VALID_FLAGS) {
+		ERR("unknown flags 0x%" PRIx64,
+				flags & ~POBJ_XALLOC_BATCH_VALID_FLAGS);
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (size > PMEMOBJ_MAX_ALLOC_SIZE) {
+		ERR("requested size too large");
+		errno = ENOMEM;
+		return -1;
+	}
+
+	/* uuid, offset and heap metadata of each object */
+	size_t entries_size = 3 * sizeof(struct ulog_entry_val);
+	if (oidcnt > SIZE_MAX / entries_size) {
+		ERR("too many objects in a batch");
+		errno = ENOMEM;
+		return -1;
+	}
+	entries_size *= oidcnt;
+
+	PMEMOBJ_API_START();
+
+	int ret = -1;
+	struct pobj_action *actv = Malloc(oidcnt * sizeof(*actv));
+	if (actv == NULL) {
+		ERR("!Malloc");
+		goto out;
+	}
+
+	struct constr_args carg;
+
+	carg.zero_init = flags & POBJ_FLAG_ZERO;
+	carg.constructor = NULL;
+	carg.arg = NULL;
+
+	if (palloc_reserve_batch(&pop->heap, size, constructor_alloc, &carg,
+		type_num, 0, CLASS_ID_FROM_FLAG(flags),
+		ARENA_ID_FROM_FLAG(flags), actv, oidcnt) != 0)
+		goto out_free;
+
+	struct operation_context *ctx = pmalloc_operation_hold(pop);
+
+	uint64_t start = stats_latency_start(pop->stats);
+
+	if (operation_reserve(ctx, entries_size) != 0) {
+		pmalloc_operation_release(pop);
+		palloc_cancel(&pop->heap, actv, oidcnt);
+		goto out_free;
+	}
+
+	for (size_t i = 0; i < oidcnt; ++i) {
+		operation_add_entry(ctx, &oidv[i].pool_uuid_lo, pop->uuid_lo,
+			ULOG_OPERATION_SET);
+		operation_add_entry(ctx, &oidv[i].off, actv[i].heap.offset,
+			ULOG_OPERATION_SET);
+	}
+
+	palloc_publish(&pop->heap, actv, oidcnt, ctx);
+
+	stats_latency_end(stats_lane_detail_get(pop->stats),
+		STATS_LATENCY_HEAP_OPERATION, start);
+
+	pmalloc_operation_release(pop);
+
+	ret = 0;
+
+out_free:
+	Free(actv);
+out:
+	PMEMOBJ_API_END();
+	return ret;
+}
+
 /* arguments for constructor_realloc and constructor_zrealloc */
 struct carg_realloc {
 	void *ptr;
@@ -3086,6 +3320,8 @@ pmemobj_publish(PMEMobjpool *pop, struct pobj_action *actv, size_t actvcnt)
 	PMEMOBJ_API_START();
 	struct operation_context *ctx = pmalloc_operation_hold(pop);
 
+	uint64_t start = stats_latency_start(pop->stats);
+
 	size_t entries_size = actvcnt * sizeof(struct ulog_entry_val);
 
 	if (operation_reserve(ctx, entries_size) != 0) {
@@ -3095,6 +3331,9 @@ pmemobj_publish(PMEMobjpool *pop, struct pobj_action *actv, size_t actvcnt)
 
 	palloc_publish(&pop->heap, actv, actvcnt, ctx);
 
+	stats_latency_end(stats_lane_detail_get(pop->stats),
+		STATS_LATENCY_HEAP_PUBLISH, start);
+
 	pmalloc_operation_release(pop);
 
 	PMEMOBJ_API_END();
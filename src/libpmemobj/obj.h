@@ -1,5 +1,5 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
-/* Copyright 2014-2020, Intel Corporation */
+/* Copyright 2014-2021, Intel Corporation */
 
 /*
  * obj.h -- internal definitions for obj module
@@ -61,7 +61,24 @@ static const features_t obj_format_feat_default = OBJ_FORMAT_FEAT_CHECK;
 #define OBJ_OFF_FROM_LANES(pop, off)\
 	((off) >= (pop)->lanes_offset &&\
 	(off) < (pop)->lanes_offset +\
-	(pop)->nlanes * sizeof(struct lane_layout))
+	(pop)->nlanes * OBJ_LANE_SIZE(pop))
+
+/*
+ * Capacities of the logs of every lane, as recorded in the pool descriptor.
+ * The internal and external redo logs are always placed at the beginning of
+ * the lane, the undo log follows the external redo log.
+ */
+#define OBJ_LANE_REDO_SIZE(pop)\
+	((pop)->lane_redo_size == 0 ? (size_t)LANE_REDO_EXTERNAL_SIZE :\
+	(size_t)(pop)->lane_redo_size)
+#define OBJ_LANE_UNDO_SIZE(pop)\
+	((pop)->lane_undo_size == 0 ? (size_t)LANE_UNDO_SIZE :\
+	(size_t)(pop)->lane_undo_size)
+#define OBJ_LANE_UNDO_OFFSET(pop)\
+	(offsetof(struct lane_layout, external) +\
+	SIZEOF_ULOG(OBJ_LANE_REDO_SIZE(pop)))
+#define OBJ_LANE_SIZE(pop)\
+	(OBJ_LANE_UNDO_OFFSET(pop) + SIZEOF_ULOG(OBJ_LANE_UNDO_SIZE(pop)))
 
 #define OBJ_PTR_FROM_POOL(pop, ptr)\
 	((uintptr_t)(ptr) >= (uintptr_t)(pop) &&\
@@ -95,7 +112,7 @@ typedef uint64_t type_num_t;
 #define CONVERSION_FLAG_OLD_SET_CACHE ((1ULL) << 0)
 
 /* PMEM_OBJ_POOL_HEAD_SIZE Without the unused and unused2 arrays */
-#define PMEM_OBJ_POOL_HEAD_SIZE 2196
+#define PMEM_OBJ_POOL_HEAD_SIZE 2316
 #define PMEM_OBJ_POOL_UNUSED2_SIZE (PMEM_PAGESIZE \
 					- OBJ_DSC_P_UNUSED\
 					- PMEM_OBJ_POOL_HEAD_SIZE)
@@ -108,7 +125,8 @@ struct pmemobjpool {
 	uint64_t lanes_offset;
 	uint64_t nlanes;
 	uint64_t heap_offset;
-	uint64_t unused3;
+	uint32_t lane_redo_size; /* capacity of external redo, 0 if default */
+	uint32_t lane_undo_size; /* capacity of undo log, 0 if default */
 	unsigned char unused[OBJ_DSC_P_UNUSED]; /* must be zero */
 	uint64_t checksum;	/* checksum of above fields */
 
@@ -173,6 +191,8 @@ struct pmemobjpool {
 	int tx_debug_skip_expensive_checks;
 
 	struct tx_parameters *tx_params;
+	struct tx_post_commit *tx_postcommit; /* NULL if not configured */
+	struct rep_fanout *rep_fanout; /* NULL if not configured */
 
 	/*
 	 * Locks are dynamically allocated on FreeBSD. Keep track so
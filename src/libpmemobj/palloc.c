@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2015-2020, Intel Corporation */
+/* Copyright 2015-2021, Intel Corporation */
 
 /*
  * palloc.c -- implementation of pmalloc POSIX-like API
@@ -47,8 +47,8 @@ struct pobj_action_internal {
 	/* type of operation (alloc/free vs set) */
 	enum pobj_action_type type;
 
-	/* not used */
-	uint32_t padding;
+	/* allocation class of a reserved block, used only for statistics */
+	uint32_t class_id;
 
 	/*
 	 * Action-specific lock that needs to be taken for the duration of
@@ -154,9 +154,12 @@ alloc_prep_block(struct palloc_heap *heap, const struct memory_block *m,
 	return 0;
 }
 
+static void palloc_heap_action_on_cancel(struct palloc_heap *heap,
+	struct pobj_action_internal *act);
+
 /*
- * palloc_reservation_create -- creates a volatile reservation of a
- *	memory block.
+ * palloc_reservation_create -- creates volatile reservations of memory
+ *	blocks, all of the same size.
  *
  * The first step in the allocation of a new block is reserving it in
  * the transient heap - which is represented by the bucket abstraction.
@@ -169,19 +172,21 @@ alloc_prep_block(struct palloc_heap *heap, const struct memory_block *m,
  * Once the bucket is selected, just enough memory is reserved for the
  * requested size. The underlying block allocation algorithm
  * (best-fit, next-fit, ...) varies depending on the bucket container.
+ *
+ * All of the 'cnt' blocks are reserved under a single acquisition of the
+ * bucket. If any of them cannot be reserved, the ones that already were
+ * are cancelled.
  */
 static int
 palloc_reservation_create(struct palloc_heap *heap, size_t size,
 	palloc_constr constructor, void *arg,
 	uint64_t extra_field, uint16_t object_flags,
 	uint16_t class_id, uint16_t arena_id,
-	struct pobj_action_internal *out)
+	struct pobj_action_internal *out, size_t cnt)
 {
 	int err = 0;
 
-	struct memory_block *new_block = &out->m;
-	out->type = POBJ_ACTION_TYPE_HEAP;
-
+	ASSERTne(cnt, 0);
 	ASSERT(class_id < UINT8_MAX);
 	struct alloc_class *c = class_id == 0 ?
 		heap_get_best_class(heap, size) :
@@ -210,46 +215,76 @@ palloc_reservation_create(struct palloc_heap *heap, size_t size,
 		return -1;
 	}
 	ASSERT(size_idx <= UINT32_MAX);
-	*new_block = MEMORY_BLOCK_NONE;
-	new_block->size_idx = (uint32_t)size_idx;
+	out->m = MEMORY_BLOCK_NONE;
+	out->m.size_idx = (uint32_t)size_idx;
 
-	struct bucket *b = heap_bucket_acquire(heap, c->id, arena_id);
+	/*
+	 * Small blocks are preferably taken from the cache of the thread,
+	 * which already holds the reservations of the blocks and doesn't
+	 * require the bucket lock.
+	 */
+	struct bucket *b = NULL;
+	int cached = cnt == 1 && arena_id == HEAP_ARENA_PER_THREAD &&
+		heap_thread_cache_get(heap, c, &out->m, &out->mresv) == 0;
 
-	err = heap_get_bestfit_block(heap, b, new_block);
-	if (err != 0)
-		goto out;
+	if (!cached)
+		b = heap_bucket_acquire(heap, c->id, arena_id);
 
-	if (alloc_prep_block(heap, new_block, constructor, arg,
-		extra_field, object_flags, out) != 0) {
-		/*
-		 * Constructor returned non-zero value which means
-		 * the memory block reservation has to be rolled back.
-		 */
-		if (new_block->type == MEMORY_BLOCK_HUGE) {
-			bucket_insert_block(b, new_block);
+	size_t i;
+	for (i = 0; i < cnt; ++i) {
+		struct pobj_action_internal *act = &out[i];
+		struct memory_block *new_block = &act->m;
+		act->type = POBJ_ACTION_TYPE_HEAP;
+
+		if (!cached) {
+			*new_block = MEMORY_BLOCK_NONE;
+			new_block->size_idx = (uint32_t)size_idx;
+
+			err = heap_get_bestfit_block(heap, b, new_block);
+			if (err != 0)
+				break;
 		}
-		err = ECANCELED;
-		goto out;
-	}
 
-	/*
-	 * Each as of yet unfulfilled reservation needs to be tracked in the
-	 * runtime state.
-	 * The memory block cannot be put back into the global state unless
-	 * there are no active reservations.
-	 */
-	if ((out->mresv = b->active_memory_block) != NULL)
-		util_fetch_and_add64(&out->mresv->nresv, 1);
+		if (alloc_prep_block(heap, new_block, constructor, arg,
+			extra_field, object_flags, act) != 0) {
+			/*
+			 * Constructor returned non-zero value which means
+			 * the memory block reservation has to be rolled back.
+			 */
+			if (cached) {
+				heap_thread_cache_put(heap, c, new_block,
+					act->mresv);
+			} else if (new_block->type == MEMORY_BLOCK_HUGE) {
+				bucket_insert_block(b, new_block);
+			}
+			err = ECANCELED;
+			break;
+		}
 
-	out->lock = new_block->m_ops->get_lock(new_block);
-	out->new_state = MEMBLOCK_ALLOCATED;
+		/*
+		 * Each as of yet unfulfilled reservation needs to be tracked
+		 * in the runtime state.
+		 * The memory block cannot be put back into the global state
+		 * unless there are no active reservations.
+		 */
+		if (!cached && (act->mresv = b->active_memory_block) != NULL)
+			util_fetch_and_add64(&act->mresv->nresv, 1);
+
+		act->lock = new_block->m_ops->get_lock(new_block);
+		act->new_state = MEMBLOCK_ALLOCATED;
+		act->class_id = c->id;
+	}
 
-out:
-	heap_bucket_release(heap, b);
+	if (b != NULL)
+		heap_bucket_release(heap, b);
 
 	if (err == 0)
 		return 0;
 
+	/* the bucket is no longer held, the cancel might need to acquire it */
+	for (size_t j = 0; j < i; ++j)
+		palloc_heap_action_on_cancel(heap, &out[j]);
+
 	errno = err;
 	return -1;
 }
@@ -324,41 +359,7 @@ palloc_reservation_clear(struct palloc_heap *heap,
 	if (act->mresv == NULL)
 		return;
 
-	struct memory_block_reserved *mresv = act->mresv;
-	struct bucket *b = mresv->bucket;
-
-	if (!publish) {
-		util_mutex_lock(&b->lock);
-		struct memory_block *am = &b->active_memory_block->m;
-
-		/*
-		 * If a memory block used for the action is the currently active
-		 * memory block of the bucket it can be inserted back to the
-		 * bucket. This way it will be available for future allocation
-		 * requests, improving performance.
-		 */
-		if (b->is_active &&
-		    am->chunk_id == act->m.chunk_id &&
-		    am->zone_id == act->m.zone_id) {
-			ASSERTeq(b->active_memory_block, mresv);
-			bucket_insert_block(b, &act->m);
-		}
-
-		util_mutex_unlock(&b->lock);
-	}
-
-	if (util_fetch_and_sub64(&mresv->nresv, 1) == 1) {
-		VALGRIND_ANNOTATE_HAPPENS_AFTER(&mresv->nresv);
-		/*
-		 * If the memory block used for the action is not currently used
-		 * in any bucket nor action it can be discarded (given back to
-		 * the heap).
-		 */
-		heap_discard_run(heap, &mresv->m);
-		Free(mresv);
-	} else {
-		VALGRIND_ANNOTATE_HAPPENS_BEFORE(&mresv->nresv);
-	}
+	heap_reservation_clear(heap, &act->m, act->mresv, !publish);
 }
 
 /*
@@ -516,13 +517,17 @@ palloc_action_compare(const void *lhs, const void *rhs)
 }
 
 /*
- * palloc_exec_actions -- perform the provided free/alloc operations
+ * palloc_exec_actions_process -- persistently performs the provided free/alloc
+ *	operations, the runtime finalization of the actions is left to
+ *	palloc_exec_actions_finish
+ *
+ * The allocations are counted in the given detailed lane statistics, if any.
  */
 static void
-palloc_exec_actions(struct palloc_heap *heap,
+palloc_exec_actions_process(struct palloc_heap *heap,
 	struct operation_context *ctx,
 	struct pobj_action_internal *actv,
-	size_t actvcnt)
+	size_t actvcnt, struct stats_lane_detail *sd)
 {
 	/*
 	 * The operations array is sorted so that proper lock ordering is
@@ -566,14 +571,30 @@ palloc_exec_actions(struct palloc_heap *heap,
 
 		action_funcs[act->type].on_process(heap, act);
 
+		if (sd != NULL && act->type == POBJ_ACTION_TYPE_HEAP &&
+				act->new_state == MEMBLOCK_ALLOCATED)
+			sd->heap_class_alloc[act->class_id]++;
+
 		if (i == actvcnt - 1 || act->lock != actv[i + 1].lock) {
 			if (act->lock)
 				util_mutex_unlock(act->lock);
 		}
 	}
+}
 
+/*
+ * palloc_exec_actions_finish -- performs the final steps of the already
+ *	processed actions, these do not modify the persistent state and can be
+ *	done outside of the critical path of the operation
+ */
+static void
+palloc_exec_actions_finish(struct palloc_heap *heap,
+	struct operation_context *ctx,
+	struct pobj_action_internal *actv,
+	size_t actvcnt)
+{
 	for (size_t i = 0; i < actvcnt; ++i) {
-		act = &actv[i];
+		struct pobj_action_internal *act = &actv[i];
 
 		action_funcs[act->type].on_unlock(heap, act);
 	}
@@ -581,6 +602,19 @@ palloc_exec_actions(struct palloc_heap *heap,
 	operation_finish(ctx, 0);
 }
 
+/*
+ * palloc_exec_actions -- perform the provided free/alloc operations
+ */
+static void
+palloc_exec_actions(struct palloc_heap *heap,
+	struct operation_context *ctx,
+	struct pobj_action_internal *actv,
+	size_t actvcnt, struct stats_lane_detail *sd)
+{
+	palloc_exec_actions_process(heap, ctx, actv, actvcnt, sd);
+	palloc_exec_actions_finish(heap, ctx, actv, actvcnt);
+}
+
 /*
  * palloc_reserve -- creates a single reservation
  */
@@ -596,7 +630,26 @@ palloc_reserve(struct palloc_heap *heap, size_t size,
 
 	return palloc_reservation_create(heap, size, constructor, arg,
 		extra_field, object_flags, class_id, arena_id,
-		(struct pobj_action_internal *)act);
+		(struct pobj_action_internal *)act, 1);
+}
+
+/*
+ * palloc_reserve_batch -- creates 'actvcnt' reservations of the same size,
+ *	either all of them are created or none
+ */
+int
+palloc_reserve_batch(struct palloc_heap *heap, size_t size,
+	palloc_constr constructor, void *arg,
+	uint64_t extra_field, uint16_t object_flags,
+	uint16_t class_id, uint16_t arena_id,
+	struct pobj_action *actv, size_t actvcnt)
+{
+	COMPILE_ERROR_ON(sizeof(struct pobj_action) !=
+		sizeof(struct pobj_action_internal));
+
+	return palloc_reservation_create(heap, size, constructor, arg,
+		extra_field, object_flags, class_id, arena_id,
+		(struct pobj_action_internal *)actv, actvcnt);
 }
 
 /*
@@ -658,6 +711,37 @@ palloc_publish(struct palloc_heap *heap,
 	struct operation_context *ctx)
 {
 	palloc_exec_actions(heap, ctx,
+		(struct pobj_action_internal *)actv, actvcnt,
+		stats_lane_detail_get(heap->stats));
+}
+
+/*
+ * palloc_publish_process -- publishes all reservations in the array, but
+ *	leaves the runtime finalization to a later call to palloc_publish_finish
+ *
+ * The persistent state is fully updated once this function returns. The
+ * operation context must not be reused until palloc_publish_finish is called.
+ */
+void
+palloc_publish_process(struct palloc_heap *heap,
+	struct pobj_action *actv, size_t actvcnt,
+	struct operation_context *ctx)
+{
+	palloc_exec_actions_process(heap, ctx,
+		(struct pobj_action_internal *)actv, actvcnt,
+		stats_lane_detail_get(heap->stats));
+}
+
+/*
+ * palloc_publish_finish -- finalizes the runtime state of actions published
+ *	with palloc_publish_process
+ */
+void
+palloc_publish_finish(struct palloc_heap *heap,
+	struct pobj_action *actv, size_t actvcnt,
+	struct operation_context *ctx)
+{
+	palloc_exec_actions_finish(heap, ctx,
 		(struct pobj_action_internal *)actv, actvcnt);
 }
 
@@ -703,6 +787,9 @@ palloc_operation(struct palloc_heap *heap,
 	uint16_t class_id, uint16_t arena_id,
 	struct operation_context *ctx)
 {
+	uint64_t start = stats_latency_start(heap->stats);
+	struct stats_lane_detail *sd = stats_lane_detail_get(heap->stats);
+
 	size_t user_size = 0;
 
 	size_t nops = 0;
@@ -731,7 +818,7 @@ palloc_operation(struct palloc_heap *heap,
 		alloc = &ops[nops++];
 		if (palloc_reservation_create(heap, size, constructor, arg,
 			extra_field, object_flags,
-			class_id, arena_id, alloc) != 0) {
+			class_id, arena_id, alloc, 1) != 0) {
 			operation_cancel(ctx);
 			return -1;
 		}
@@ -766,7 +853,9 @@ palloc_operation(struct palloc_heap *heap,
 	}
 
 	/* and now actually perform the requested operation! */
-	palloc_exec_actions(heap, ctx, ops, nops);
+	palloc_exec_actions(heap, ctx, ops, nops, sd);
+
+	stats_latency_end(sd, STATS_LATENCY_HEAP_OPERATION, start);
 
 	return 0;
 }
@@ -1041,7 +1130,7 @@ palloc_defrag(struct palloc_heap *heap, uint64_t **objv, size_t objcnt,
 		    NULL, NULL,
 		    m.m_ops->get_extra(&m), m.m_ops->get_flags(&m),
 		    0, HEAP_ARENA_PER_THREAD,
-		    (struct pobj_action_internal *)reserve) != 0) {
+		    (struct pobj_action_internal *)reserve, 1) != 0) {
 			VEC_POP_BACK(&actv);
 			continue;
 		}
@@ -1305,6 +1394,17 @@ palloc_heap_cleanup(struct palloc_heap *heap)
 	heap_cleanup(heap);
 }
 
+/*
+ * palloc_heap_quiesce -- stops the background population of the heap and
+ *	gives back the blocks from the thread caches
+ */
+void
+palloc_heap_quiesce(struct palloc_heap *heap)
+{
+	heap_populate_stop(heap);
+	heap_thread_caches_fini(heap);
+}
+
 #if VG_MEMCHECK_ENABLED
 /*
  * palloc_vg_register_alloc -- (internal) registers allocation header
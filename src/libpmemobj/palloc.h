@@ -1,5 +1,5 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
-/* Copyright 2015-2020, Intel Corporation */
+/* Copyright 2015-2021, Intel Corporation */
 
 /*
  * palloc.h -- internal definitions for persistent allocator
@@ -56,6 +56,13 @@ palloc_reserve(struct palloc_heap *heap, size_t size,
 	uint16_t class_id, uint16_t arena_id,
 	struct pobj_action *act);
 
+int
+palloc_reserve_batch(struct palloc_heap *heap, size_t size,
+	palloc_constr constructor, void *arg,
+	uint64_t extra_field, uint16_t object_flags,
+	uint16_t class_id, uint16_t arena_id,
+	struct pobj_action *actv, size_t actvcnt);
+
 void
 palloc_defer_free(struct palloc_heap *heap, uint64_t off,
 	struct pobj_action *act);
@@ -69,6 +76,16 @@ palloc_publish(struct palloc_heap *heap,
 	struct pobj_action *actv, size_t actvcnt,
 	struct operation_context *ctx);
 
+void
+palloc_publish_process(struct palloc_heap *heap,
+	struct pobj_action *actv, size_t actvcnt,
+	struct operation_context *ctx);
+
+void
+palloc_publish_finish(struct palloc_heap *heap,
+	struct pobj_action *actv, size_t actvcnt,
+	struct operation_context *ctx);
+
 void
 palloc_set_value(struct palloc_heap *heap, struct pobj_action *act,
 	uint64_t *ptr, uint64_t value);
@@ -94,6 +111,7 @@ int palloc_heap_check(void *heap_start, uint64_t heap_size);
 int palloc_heap_check_remote(void *heap_start, uint64_t heap_size,
 	struct remote_ops *ops);
 void palloc_heap_cleanup(struct palloc_heap *heap);
+void palloc_heap_quiesce(struct palloc_heap *heap);
 size_t palloc_heap(void *heap_start);
 
 int palloc_defrag(struct palloc_heap *heap, uint64_t **objv, size_t objcnt,
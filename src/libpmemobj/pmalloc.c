@@ -191,10 +191,15 @@ pmalloc_boot(PMEMobjpool *pop)
 #endif
 
 	ret = palloc_buckets_init(&pop->heap);
-	if (ret)
+	if (ret) {
 		palloc_heap_cleanup(&pop->heap);
+		return ret;
+	}
 
-	return ret;
+	if (Default_populate_at_open)
+		heap_populate_all(&pop->heap);
+
+	return 0;
 }
 
 /*
@@ -779,12 +784,220 @@ static const struct ctl_node CTL_NODE(thread)[] = {
 	CTL_NODE_END
 };
 
+/*
+ * CTL_READ_HANDLER(ahead) -- reads the number of zones the populator keeps
+ *	ready ahead of the allocations
+ */
+static int
+CTL_READ_HANDLER(ahead)(void *ctx,
+	enum ctl_query_source source, void *arg, struct ctl_indexes *indexes)
+{
+	PMEMobjpool *pop = ctx;
+
+	ssize_t *arg_out = arg;
+
+	*arg_out = (ssize_t)heap_get_populate_ahead(&pop->heap);
+
+	return 0;
+}
+
+/*
+ * CTL_WRITE_HANDLER(ahead) -- changes the number of zones the populator keeps
+ *	ready ahead of the allocations, starts or stops the populator thread
+ */
+static int
+CTL_WRITE_HANDLER(ahead)(void *ctx,
+	enum ctl_query_source source, void *arg, struct ctl_indexes *indexes)
+{
+	PMEMobjpool *pop = ctx;
+
+	ssize_t arg_in = *(ssize_t *)arg;
+	if (arg_in < 0 || arg_in > UINT32_MAX) {
+		ERR("incorrect number of zones to populate ahead");
+		errno = EINVAL;
+		return -1;
+	}
+
+	return heap_set_populate_ahead(&pop->heap, (unsigned)arg_in);
+}
+
+static const struct ctl_argument CTL_ARG(ahead) = CTL_ARG_LONG_LONG;
+
+/*
+ * CTL_READ_HANDLER(numa_node) -- reads the NUMA node of the populator thread
+ */
+static int
+CTL_READ_HANDLER(numa_node)(void *ctx,
+	enum ctl_query_source source, void *arg, struct ctl_indexes *indexes)
+{
+	PMEMobjpool *pop = ctx;
+
+	ssize_t *arg_out = arg;
+
+	*arg_out = heap_get_populate_numa_node(&pop->heap);
+
+	return 0;
+}
+
+/*
+ * CTL_WRITE_HANDLER(numa_node) -- binds the populator thread to the NUMA node
+ */
+static int
+CTL_WRITE_HANDLER(numa_node)(void *ctx,
+	enum ctl_query_source source, void *arg, struct ctl_indexes *indexes)
+{
+	PMEMobjpool *pop = ctx;
+
+	ssize_t arg_in = *(ssize_t *)arg;
+	if (arg_in < -1 || arg_in > INT_MAX) {
+		ERR("incorrect NUMA node of the populator");
+		errno = EINVAL;
+		return -1;
+	}
+
+	heap_set_populate_numa_node(&pop->heap, (int)arg_in);
+
+	return 0;
+}
+
+static const struct ctl_argument CTL_ARG(numa_node) = CTL_ARG_LONG_LONG;
+
+/*
+ * CTL_READ_HANDLER(zones) -- reads the number of the populated zones
+ */
+static int
+CTL_READ_HANDLER(zones)(void *ctx,
+	enum ctl_query_source source, void *arg, struct ctl_indexes *indexes)
+{
+	PMEMobjpool *pop = ctx;
+
+	ssize_t *arg_out = arg;
+
+	*arg_out = (ssize_t)heap_get_populated_zones(&pop->heap);
+
+	return 0;
+}
+
+static const struct ctl_node CTL_NODE(populate)[] = {
+	CTL_LEAF_RW(ahead),
+	CTL_LEAF_RW(numa_node),
+	CTL_LEAF_RO(zones),
+
+	CTL_NODE_END
+};
+
+/*
+ * CTL_READ_HANDLER(batch) -- reads the number of blocks of each allocation
+ *	class that a thread reserves at once and keeps in its cache
+ */
+static int
+CTL_READ_HANDLER(batch)(void *ctx,
+	enum ctl_query_source source, void *arg, struct ctl_indexes *indexes)
+{
+	PMEMobjpool *pop = ctx;
+
+	ssize_t *arg_out = arg;
+
+	*arg_out = (ssize_t)heap_get_thread_cache_batch(&pop->heap);
+
+	return 0;
+}
+
+/*
+ * CTL_WRITE_HANDLER(batch) -- changes the number of blocks of each
+ *	allocation class that a thread reserves at once and keeps in its cache
+ */
+static int
+CTL_WRITE_HANDLER(batch)(void *ctx,
+	enum ctl_query_source source, void *arg, struct ctl_indexes *indexes)
+{
+	PMEMobjpool *pop = ctx;
+
+	ssize_t arg_in = *(ssize_t *)arg;
+	if (arg_in < 0 || arg_in > UINT16_MAX) {
+		ERR("incorrect thread cache batch, must be between 0 and %u",
+			UINT16_MAX);
+		errno = EINVAL;
+		return -1;
+	}
+
+	return heap_set_thread_cache_batch(&pop->heap, (unsigned)arg_in);
+}
+
+static const struct ctl_argument CTL_ARG(batch) = CTL_ARG_LONG_LONG;
+
+/*
+ * CTL_READ_HANDLER(max_size) -- reads the size of the largest allocation
+ *	served from the thread caches
+ */
+static int
+CTL_READ_HANDLER(max_size)(void *ctx,
+	enum ctl_query_source source, void *arg, struct ctl_indexes *indexes)
+{
+	PMEMobjpool *pop = ctx;
+
+	ssize_t *arg_out = arg;
+
+	*arg_out = (ssize_t)heap_get_thread_cache_max_size(&pop->heap);
+
+	return 0;
+}
+
+/*
+ * CTL_WRITE_HANDLER(max_size) -- changes the size of the largest allocation
+ *	served from the thread caches
+ */
+static int
+CTL_WRITE_HANDLER(max_size)(void *ctx,
+	enum ctl_query_source source, void *arg, struct ctl_indexes *indexes)
+{
+	PMEMobjpool *pop = ctx;
+
+	ssize_t arg_in = *(ssize_t *)arg;
+	if (arg_in < 0) {
+		ERR("incorrect thread cache max size");
+		errno = EINVAL;
+		return -1;
+	}
+
+	heap_set_thread_cache_max_size(&pop->heap, (size_t)arg_in);
+
+	return 0;
+}
+
+static const struct ctl_argument CTL_ARG(max_size) = CTL_ARG_LONG_LONG;
+
+/*
+ * CTL_RUNNABLE_HANDLER(flush) -- gives the blocks cached by the calling
+ *	thread back to the arenas
+ */
+static int
+CTL_RUNNABLE_HANDLER(flush)(void *ctx,
+	enum ctl_query_source source, void *arg, struct ctl_indexes *indexes)
+{
+	PMEMobjpool *pop = ctx;
+
+	heap_thread_cache_flush(&pop->heap);
+
+	return 0;
+}
+
+static const struct ctl_node CTL_NODE(thread_cache)[] = {
+	CTL_LEAF_RW(batch),
+	CTL_LEAF_RW(max_size),
+	CTL_LEAF_RUNNABLE(flush),
+
+	CTL_NODE_END
+};
+
 static const struct ctl_node CTL_NODE(heap)[] = {
 	CTL_CHILD(alloc_class),
 	CTL_CHILD(arena),
 	CTL_CHILD(size),
 	CTL_CHILD(thread),
 	CTL_CHILD(narenas),
+	CTL_CHILD(populate),
+	CTL_CHILD(thread_cache),
 
 	CTL_NODE_END
 };
@@ -860,8 +1073,47 @@ static const struct ctl_argument CTL_ARG(arenas_assignment_type) = {
 	}
 };
 
+/*
+ * CTL_WRITE_HANDLER(at_open) -- enables population of the entire heap
+ *	when the pool is opened
+ */
+static int
+CTL_WRITE_HANDLER(at_open)(void *ctx,
+	enum ctl_query_source source, void *arg, struct ctl_indexes *indexes)
+{
+	int arg_in = *(int *)arg;
+
+	Default_populate_at_open = arg_in;
+
+	return 0;
+}
+
+/*
+ * CTL_READ_HANDLER(at_open) -- returns whether the entire heap is populated
+ *	when the pool is opened
+ */
+static int
+CTL_READ_HANDLER(at_open)(void *ctx,
+	enum ctl_query_source source, void *arg, struct ctl_indexes *indexes)
+{
+	int *arg_out = arg;
+
+	*arg_out = Default_populate_at_open;
+
+	return 0;
+}
+
+static const struct ctl_argument CTL_ARG(at_open) = CTL_ARG_BOOLEAN;
+
+static const struct ctl_node CTL_NODE(populate, global)[] = {
+	CTL_LEAF_RW(at_open),
+
+	CTL_NODE_END
+};
+
 static const struct ctl_node CTL_NODE(heap_global)[] = {
 	CTL_LEAF_RW(arenas_assignment_type),
+	CTL_CHILD(populate, global),
 
 	CTL_NODE_END
 };
@@ -0,0 +1,152 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * recovery.c -- parallel recovery of the pool
+ *
+ * The recovery of the lanes and the update of the zone metadata performed
+ * while opening the pool consist of many independent parts. The parts are
+ * claimed one by one by the opening thread and the recovery workers, whose
+ * number is configured globally, before the pool is opened.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+
+#include "alloc.h"
+#include "ctl.h"
+#include "out.h"
+#include "os_thread.h"
+#include "recovery.h"
+#include "util.h"
+
+/* number of threads, including the opening one, recovering the pool */
+static unsigned Recovery_nthreads = 1;
+
+struct recovery_job {
+	recovery_fn fn;
+	void *arg;
+	uint64_t n;
+	uint64_t next; /* index of the next part to be claimed */
+};
+
+/*
+ * recovery_worker -- (internal) processes the parts of the job until there
+ *	are none left
+ */
+static void *
+recovery_worker(void *arg)
+{
+	struct recovery_job *job = arg;
+
+	uint64_t idx;
+	while ((idx = util_fetch_and_add64(&job->next, 1)) < job->n)
+		job->fn(job->arg, idx);
+
+	return NULL;
+}
+
+/*
+ * recovery_parallel -- calls fn for all the indexes in range [0, n),
+ *	using up to the configured number of threads
+ *
+ * If the workers cannot be created, the remaining parts are processed by
+ * the calling thread.
+ */
+void
+recovery_parallel(uint64_t n, recovery_fn fn, void *arg)
+{
+	struct recovery_job job = {fn, arg, n, 0};
+
+	unsigned nthreads;
+	util_atomic_load_explicit32(&Recovery_nthreads, &nthreads,
+		memory_order_relaxed);
+	if (nthreads > n)
+		nthreads = (unsigned)n;
+
+	os_thread_t *workers = NULL;
+	unsigned nworkers = 0;
+	if (nthreads > 1) {
+		workers = Malloc(sizeof(*workers) * (nthreads - 1));
+		if (workers == NULL)
+			LOG(2, "!Malloc, recovering sequentially");
+	}
+
+	for (; workers != NULL && nworkers < nthreads - 1; ++nworkers) {
+		int ret = os_thread_create(&workers[nworkers], NULL,
+			recovery_worker, &job);
+		if (ret != 0) {
+			errno = ret;
+			LOG(2, "!os_thread_create, using %u recovery threads",
+				nworkers + 1);
+			break;
+		}
+	}
+
+	LOG(4, "%" PRIu64 " parts, %u workers", n, nworkers);
+
+	recovery_worker(&job);
+
+	for (unsigned i = 0; i < nworkers; ++i)
+		os_thread_join(&workers[i], NULL);
+
+	Free(workers);
+}
+
+/*
+ * CTL_READ_HANDLER(nthreads) -- returns the number of recovery threads
+ */
+static int
+CTL_READ_HANDLER(nthreads)(void *ctx, enum ctl_query_source source,
+	void *arg, struct ctl_indexes *indexes)
+{
+	int *arg_out = arg;
+
+	unsigned nthreads;
+	util_atomic_load_explicit32(&Recovery_nthreads, &nthreads,
+		memory_order_relaxed);
+	*arg_out = (int)nthreads;
+
+	return 0;
+}
+
+/*
+ * CTL_WRITE_HANDLER(nthreads) -- sets the number of recovery threads
+ */
+static int
+CTL_WRITE_HANDLER(nthreads)(void *ctx, enum ctl_query_source source,
+	void *arg, struct ctl_indexes *indexes)
+{
+	int arg_in = *(int *)arg;
+
+	if (arg_in < 1 || arg_in > RECOVERY_MAX_THREADS) {
+		ERR("invalid number of recovery threads %d, "
+			"must be between 1 and %d",
+			arg_in, RECOVERY_MAX_THREADS);
+		errno = EINVAL;
+		return -1;
+	}
+
+	util_atomic_store_explicit32(&Recovery_nthreads, (unsigned)arg_in,
+		memory_order_relaxed);
+
+	return 0;
+}
+
+static const struct ctl_argument CTL_ARG(nthreads) = CTL_ARG_INT;
+
+static const struct ctl_node CTL_NODE(recovery)[] = {
+	CTL_LEAF_RW(nthreads),
+
+	CTL_NODE_END
+};
+
+/*
+ * recovery_global_ctl_register -- registers the global ctl entries of
+ *	the recovery
+ */
+void
+recovery_global_ctl_register(void)
+{
+	CTL_REGISTER_MODULE(NULL, recovery);
+}
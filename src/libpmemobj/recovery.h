@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * recovery.h -- internal definitions for the parallel recovery of the pool
+ */
+
+#ifndef LIBPMEMOBJ_RECOVERY_H
+#define LIBPMEMOBJ_RECOVERY_H 1
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RECOVERY_MAX_THREADS 256
+
+/* processes a single, independent part of the pool */
+typedef void (*recovery_fn)(void *arg, uint64_t idx);
+
+void recovery_parallel(uint64_t n, recovery_fn fn, void *arg);
+
+void recovery_global_ctl_register(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
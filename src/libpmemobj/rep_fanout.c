@@ -0,0 +1,317 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * rep_fanout.c -- concurrent writes to local replicas
+ *
+ * Every local replica, other than the master one, gets its own worker thread.
+ * A large enough write is posted to all the workers, which apply it to their
+ * replicas while the calling thread writes the master replica. Only one
+ * write at a time is fanned out, the writers that find the workers busy
+ * update the replicas on their own, just like when the fan-out is disabled.
+ */
+
+#include <errno.h>
+
+#include "alloc.h"
+#include "ctl.h"
+#include "libpmem.h"
+#include "obj.h"
+#include "os_thread.h"
+#include "out.h"
+#include "rep_fanout.h"
+#include "sys_util.h"
+#include "valgrind_internal.h"
+
+struct rep_fanout_worker {
+	os_thread_t thread;
+	PMEMobjpool *rep;		/* the replica updated by the worker */
+	struct rep_fanout *fanout;
+};
+
+struct rep_fanout {
+	size_t threshold;	/* minimal length of a fanned out write */
+
+	os_mutex_t busy;	/* held while a write is being fanned out */
+
+	os_mutex_t lock;	/* protects the fields below */
+	os_cond_t posted;	/* signaled when a new write is posted */
+	os_cond_t done;		/* signaled when all the workers are done */
+	uint64_t generation;	/* incremented for every posted write */
+	unsigned pending;	/* number of workers still applying the write */
+	int stop;
+	struct rep_op op;	/* the write being fanned out */
+
+	unsigned nworkers;
+	struct rep_fanout_worker workers[];
+};
+
+/*
+ * rep_op_apply -- applies the write to the local replica, without draining
+ */
+void
+rep_op_apply(PMEMobjpool *rep, const struct rep_op *op)
+{
+	void *rdest = (char *)rep + op->off;
+	unsigned flags = op->flags | PMEM_F_MEM_NODRAIN;
+
+	switch (op->type) {
+		case REP_OP_MEMCPY:
+			rep->memcpy_local(rdest, op->src, op->len, flags);
+			break;
+		case REP_OP_MEMSET:
+			rep->memset_local(rdest, op->c, op->len, flags);
+			break;
+		default:
+			ASSERT(0);
+	}
+}
+
+/*
+ * rep_fanout_worker_func -- (internal) applies the posted writes to a single
+ *	replica
+ */
+static void *
+rep_fanout_worker_func(void *arg)
+{
+	struct rep_fanout_worker *w = arg;
+	struct rep_fanout *f = w->fanout;
+	uint64_t generation = 0;
+
+	util_mutex_lock(&f->lock);
+	for (;;) {
+		while (!f->stop && f->generation == generation)
+			os_cond_wait(&f->posted, &f->lock);
+
+		if (f->stop)
+			break;
+
+		generation = f->generation;
+		struct rep_op op = f->op;
+		util_mutex_unlock(&f->lock);
+
+		rep_op_apply(w->rep, &op);
+
+		/* a drain issued by the writer wouldn't cover these stores */
+		w->rep->drain_local();
+
+		util_mutex_lock(&f->lock);
+		if (--f->pending == 0)
+			os_cond_signal(&f->done);
+	}
+	util_mutex_unlock(&f->lock);
+
+	return NULL;
+}
+
+/*
+ * rep_fanout_begin -- posts the write to the workers, returns 1 if they
+ *	have taken it and 0 if the caller has to update the replicas itself
+ */
+int
+rep_fanout_begin(struct rep_fanout *f, const struct rep_op *op)
+{
+	if (f->nworkers == 0 || op->len < f->threshold)
+		return 0;
+
+	if (os_mutex_trylock(&f->busy) != 0)
+		return 0;
+
+	util_mutex_lock(&f->lock);
+	f->op = *op;
+	f->pending = f->nworkers;
+	f->generation++;
+	os_cond_broadcast(&f->posted);
+	util_mutex_unlock(&f->lock);
+
+	return 1;
+}
+
+/*
+ * rep_fanout_end -- waits until all the workers apply the posted write
+ */
+void
+rep_fanout_end(struct rep_fanout *f)
+{
+	util_mutex_lock(&f->lock);
+	while (f->pending != 0)
+		os_cond_wait(&f->done, &f->lock);
+	util_mutex_unlock(&f->lock);
+
+	util_mutex_unlock(&f->busy);
+}
+
+/*
+ * rep_fanout_stop -- (internal) stops and joins the first n workers
+ */
+static void
+rep_fanout_stop(struct rep_fanout *f, unsigned n)
+{
+	util_mutex_lock(&f->lock);
+	f->stop = 1;
+	os_cond_broadcast(&f->posted);
+	util_mutex_unlock(&f->lock);
+
+	for (unsigned i = 0; i < n; ++i)
+		os_thread_join(&f->workers[i].thread, NULL);
+}
+
+/*
+ * rep_fanout_delete -- (internal) stops the workers and frees the fan-out
+ */
+static void
+rep_fanout_delete(struct rep_fanout *f)
+{
+	rep_fanout_stop(f, f->nworkers);
+
+	util_cond_destroy(&f->done);
+	util_cond_destroy(&f->posted);
+	util_mutex_destroy(&f->lock);
+	util_mutex_destroy(&f->busy);
+
+	Free(f);
+}
+
+/*
+ * rep_fanout_new -- (internal) creates a new fan-out with a worker for every
+ *	local replica of the pool
+ */
+static struct rep_fanout *
+rep_fanout_new(PMEMobjpool *pop, size_t threshold)
+{
+	unsigned nworkers = 0;
+	for (PMEMobjpool *rep = pop->replica; rep; rep = rep->replica) {
+		if (rep->rpp == NULL)
+			nworkers++;
+	}
+
+	struct rep_fanout *f = Zalloc(sizeof(*f) +
+		nworkers * sizeof(struct rep_fanout_worker));
+	if (f == NULL)
+		return NULL;
+
+	f->threshold = threshold;
+	util_mutex_init(&f->busy);
+	util_mutex_init(&f->lock);
+	util_cond_init(&f->posted);
+	util_cond_init(&f->done);
+
+	unsigned n = 0;
+	for (PMEMobjpool *rep = pop->replica; rep; rep = rep->replica) {
+		if (rep->rpp != NULL)
+			continue;
+
+		struct rep_fanout_worker *w = &f->workers[n];
+		w->rep = rep;
+		w->fanout = f;
+
+		errno = os_thread_create(&w->thread, NULL,
+			rep_fanout_worker_func, w);
+		if (errno) {
+			ERR("!cannot create a replica worker thread");
+			goto err;
+		}
+		n++;
+	}
+	f->nworkers = n;
+
+	return f;
+
+err:
+	rep_fanout_stop(f, n);
+	f->nworkers = 0;
+	util_cond_destroy(&f->done);
+	util_cond_destroy(&f->posted);
+	util_mutex_destroy(&f->lock);
+	util_mutex_destroy(&f->busy);
+	Free(f);
+
+	return NULL;
+}
+
+/*
+ * rep_fanout_cleanup -- stops the replica workers of the pool, if any
+ */
+void
+rep_fanout_cleanup(PMEMobjpool *pop)
+{
+	if (pop->rep_fanout == NULL)
+		return;
+
+	rep_fanout_delete(pop->rep_fanout);
+	pop->rep_fanout = NULL;
+}
+
+/*
+ * CTL_READ_HANDLER(threshold) -- returns the minimal length of a write
+ *	applied to the replicas concurrently
+ */
+static int
+CTL_READ_HANDLER(threshold)(void *ctx, enum ctl_query_source source,
+	void *arg, struct ctl_indexes *indexes)
+{
+	PMEMobjpool *pop = ctx;
+
+	ssize_t *arg_out = arg;
+
+	struct rep_fanout *f = pop->rep_fanout;
+	*arg_out = f == NULL ? 0 : (ssize_t)f->threshold;
+
+	return 0;
+}
+
+/*
+ * CTL_WRITE_HANDLER(threshold) -- sets the minimal length of a write applied
+ *	to the replicas concurrently, 0 disables the fan-out
+ */
+static int
+CTL_WRITE_HANDLER(threshold)(void *ctx, enum ctl_query_source source,
+	void *arg, struct ctl_indexes *indexes)
+{
+	PMEMobjpool *pop = ctx;
+
+	ssize_t arg_in = *(ssize_t *)arg;
+
+	if (arg_in < 0) {
+		ERR("invalid replica fan-out threshold %zd", arg_in);
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (arg_in == 0) {
+		rep_fanout_cleanup(pop);
+		return 0;
+	}
+
+	if (pop->rep_fanout != NULL) {
+		pop->rep_fanout->threshold = (size_t)arg_in;
+		return 0;
+	}
+
+	pop->rep_fanout = rep_fanout_new(pop, (size_t)arg_in);
+
+	return pop->rep_fanout == NULL ? -1 : 0;
+}
+
+static const struct ctl_argument CTL_ARG(threshold) = CTL_ARG_LONG_LONG;
+
+static const struct ctl_node CTL_NODE(fanout)[] = {
+	CTL_LEAF_RW(threshold),
+
+	CTL_NODE_END
+};
+
+static const struct ctl_node CTL_NODE(replica)[] = {
+	CTL_CHILD(fanout),
+
+	CTL_NODE_END
+};
+
+/*
+ * rep_fanout_ctl_register -- registers ctl nodes for "replica" module
+ */
+void
+rep_fanout_ctl_register(PMEMobjpool *pop)
+{
+	CTL_REGISTER_MODULE(pop->ctl, replica);
+}
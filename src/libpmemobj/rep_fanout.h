@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * rep_fanout.h -- internal definitions for concurrent local replica writes
+ */
+
+#ifndef LIBPMEMOBJ_REP_FANOUT_H
+#define LIBPMEMOBJ_REP_FANOUT_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "obj.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum rep_op_type {
+	REP_OP_MEMCPY,
+	REP_OP_MEMSET,
+};
+
+/* a write to be applied to the local replicas */
+struct rep_op {
+	enum rep_op_type type;
+	uintptr_t off;		/* offset of the destination in the pool */
+	const void *src;	/* REP_OP_MEMCPY only */
+	int c;			/* REP_OP_MEMSET only */
+	size_t len;
+	unsigned flags;
+};
+
+void rep_op_apply(PMEMobjpool *rep, const struct rep_op *op);
+
+int rep_fanout_begin(struct rep_fanout *fanout, const struct rep_op *op);
+void rep_fanout_end(struct rep_fanout *fanout);
+
+void rep_fanout_cleanup(PMEMobjpool *pop);
+void rep_fanout_ctl_register(PMEMobjpool *pop);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,22 +1,335 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2017-2019, Intel Corporation */
+/* Copyright 2017-2021, Intel Corporation */
 
 /*
  * stats.c -- implementation of statistics
  */
 
+#include <inttypes.h>
+
+#include "alloc_class.h"
+#include "lane.h"
 #include "obj.h"
+#include "os.h"
 #include "stats.h"
+#include "sys_util.h"
+
+/*
+ * stats_lanes_base -- (internal) returns the array of per-lane statistics,
+ *	or NULL if it wasn't allocated yet
+ */
+static char *
+stats_lanes_base(struct stats_lanes *l)
+{
+	uint64_t base;
+	util_atomic_load_explicit64((uint64_t *)&l->base, &base,
+		memory_order_acquire);
+
+	return (char *)base;
+}
+
+/*
+ * stats_lanes_reserve -- (internal) allocates the array of per-lane
+ *	statistics of the given size on the first update of any of them, returns
+ *	NULL if the allocation fails
+ *
+ * The failure is not reported to the user, the update is just skipped.
+ */
+static char *
+stats_lanes_reserve(struct stats *s, struct stats_lanes *l, size_t size)
+{
+	char *base = stats_lanes_base(l);
+	if (likely(base != NULL))
+		return base;
+
+	util_mutex_lock(&s->lanes_lock);
+	if (l->base != NULL)
+		goto out;
+
+	/*
+	 * The lane statistics are padded to whole cachelines, so that threads
+	 * using neighbouring lanes don't share them.
+	 */
+	int oerrno = errno;
+	l->stride = ALIGN_UP(size, CACHELINE_SIZE);
+	l->alloc = Zalloc(s->nlanes * l->stride + CACHELINE_SIZE);
+	if (l->alloc == NULL) {
+		LOG(2, "!cannot allocate the lane statistics");
+		errno = oerrno;
+		goto out;
+	}
+
+	util_atomic_store_explicit64((uint64_t *)&l->base,
+		(uint64_t)ALIGN_UP((uintptr_t)l->alloc, CACHELINE_SIZE),
+		memory_order_release);
+
+out:
+	base = l->base;
+	util_mutex_unlock(&s->lanes_lock);
+	return base;
+}
+
+/*
+ * stats_lane_at -- returns the statistics of the given lane, or NULL if the
+ *	transient statistics are disabled
+ */
+struct stats_lane *
+stats_lane_at(struct stats *s, unsigned lane_idx)
+{
+	if (!STATS_ENABLED_TRANSIENT(s))
+		return NULL;
+
+	if (lane_idx >= s->nlanes)
+		return NULL;
+
+	char *base = stats_lanes_reserve(s, &s->lanes,
+		sizeof(struct stats_lane));
+	if (base == NULL)
+		return NULL;
+
+	return (struct stats_lane *)(base + lane_idx * s->lanes.stride);
+}
+
+/*
+ * stats_lane_get -- returns the statistics of the lane held by the calling
+ *	thread, or NULL if the transient statistics are disabled or the thread
+ *	doesn't hold any lane
+ */
+struct stats_lane *
+stats_lane_get(struct stats *s)
+{
+	if (!STATS_ENABLED_TRANSIENT(s))
+		return NULL;
+
+	return stats_lane_at(s, lane_current(s->pop));
+}
+
+/*
+ * stats_lane_detail_get -- returns the detailed statistics of the lane held
+ *	by the calling thread, or NULL if they are disabled or the thread
+ *	doesn't hold any lane
+ *
+ * The lane is looked up in the thread-local state, so the result should be
+ * reused for all the updates made within one operation.
+ */
+struct stats_lane_detail *
+stats_lane_detail_get(struct stats *s)
+{
+	if (!s->detailed_enabled || !STATS_ENABLED_TRANSIENT(s))
+		return NULL;
+
+	unsigned lane_idx = lane_current(s->pop);
+	if (lane_idx >= s->nlanes)
+		return NULL;
+
+	char *base = stats_lanes_reserve(s, &s->details,
+		sizeof(struct stats_lane_detail));
+	if (base == NULL)
+		return NULL;
+
+	return (struct stats_lane_detail *)(base +
+		lane_idx * s->details.stride);
+}
+
+/*
+ * stats_lanes_sum -- (internal) sums up the counter at the given offset
+ *	across all the lanes
+ */
+static uint64_t
+stats_lanes_sum(struct stats *s, struct stats_lanes *l, size_t offset)
+{
+	char *base = stats_lanes_base(l);
+	if (base == NULL)
+		return 0;
+
+	uint64_t sum = 0;
+	for (unsigned i = 0; i < s->nlanes; ++i) {
+		uint64_t value;
+		util_atomic_load_explicit64((uint64_t *)(base + i * l->stride +
+			offset), &value, memory_order_relaxed);
+		sum += value;
+	}
+
+	return sum;
+}
+
+/*
+ * stats_now -- (internal) returns the current value of the monotonic clock
+ *	in nanoseconds
+ */
+static uint64_t
+stats_now(void)
+{
+	struct timespec ts;
+	os_clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * stats_latency_start -- returns the start timestamp of a measured operation,
+ *	0 if the latency statistics are disabled
+ */
+uint64_t
+stats_latency_start(struct stats *s)
+{
+	if (!s->detailed_enabled || !STATS_ENABLED_TRANSIENT(s))
+		return 0;
+
+	return stats_now();
+}
+
+/*
+ * stats_latency_end -- records the latency of an operation started at the
+ *	given timestamp in the given detailed lane statistics
+ */
+void
+stats_latency_end(struct stats_lane_detail *sd, enum stats_latency_type type,
+	uint64_t start)
+{
+	if (start == 0 || sd == NULL)
+		return;
+
+	uint64_t ns = stats_now() - start;
+	unsigned bucket = ns == 0 ? 0 : util_mssb_index64(ns);
+	if (bucket >= POBJ_STATS_LATENCY_BUCKETS)
+		bucket = POBJ_STATS_LATENCY_BUCKETS - 1;
+
+	sd->latency[type].buckets[bucket]++;
+}
+
+/*
+ * stats_recovery_start -- returns the start timestamp of a recovery phase
+ */
+uint64_t
+stats_recovery_start(void)
+{
+	return stats_now();
+}
+
+/*
+ * stats_recovery_end -- records the duration of a recovery phase started at
+ *	the given timestamp
+ */
+void
+stats_recovery_end(struct stats *s, enum stats_recovery_phase phase,
+	uint64_t start)
+{
+	uint64_t ns = stats_now() - start;
+
+	LOG(3, "recovery phase %d took %" PRIu64 " ns", phase, ns);
+
+	s->recovery_ns[phase] = ns;
+}
+
+#define STATS_LANE_CTL_HANDLER(name, varname)\
+static int CTL_READ_HANDLER(lane_##name)(void *ctx,\
+	enum ctl_query_source source, void *arg, struct ctl_indexes *indexes)\
+{\
+	PMEMobjpool *pop = ctx;\
+	uint64_t *argv = arg;\
+	*argv = stats_lanes_sum(pop->stats, &pop->stats->lanes,\
+		offsetof(struct stats_lane, varname));\
+	return 0;\
+}
+
+#define STATS_LATENCY_CTL_HANDLER(name, type)\
+static int CTL_READ_HANDLER(latency_##name)(void *ctx,\
+	enum ctl_query_source source, void *arg, struct ctl_indexes *indexes)\
+{\
+	PMEMobjpool *pop = ctx;\
+	struct pobj_stats_latency *argv = arg;\
+	for (unsigned b = 0; b < POBJ_STATS_LATENCY_BUCKETS; ++b) {\
+		argv->buckets[b] = stats_lanes_sum(pop->stats,\
+			&pop->stats->details,\
+			offsetof(struct stats_lane_detail, latency) +\
+			(type) * sizeof(struct pobj_stats_latency) +\
+			b * sizeof(uint64_t));\
+	}\
+	return 0;\
+}
 
 STATS_CTL_HANDLER(persistent, curr_allocated, heap_curr_allocated);
 
 STATS_CTL_HANDLER(transient, run_allocated, heap_run_allocated);
 STATS_CTL_HANDLER(transient, run_active, heap_run_active);
 
+STATS_LATENCY_CTL_HANDLER(operation_latency, STATS_LATENCY_HEAP_OPERATION);
+STATS_LATENCY_CTL_HANDLER(publish_latency, STATS_LATENCY_HEAP_PUBLISH);
+
+/*
+ * CTL_READ_HANDLER(allocs) -- returns the number of allocations made from
+ *	the allocation class
+ */
+static int
+CTL_READ_HANDLER(allocs)(void *ctx,
+	enum ctl_query_source source, void *arg, struct ctl_indexes *indexes)
+{
+	PMEMobjpool *pop = ctx;
+
+	struct ctl_index *idx = PMDK_SLIST_FIRST(indexes);
+	ASSERTeq(strcmp(idx->name, "class_id"), 0);
+
+	if (idx->value < 0 || idx->value >= STATS_ALLOC_CLASSES) {
+		ERR("class id outside of the allowed range");
+		errno = ERANGE;
+		return -1;
+	}
+
+	uint64_t *argv = arg;
+	*argv = stats_lanes_sum(pop->stats, &pop->stats->details,
+		offsetof(struct stats_lane_detail, heap_class_alloc) +
+		(size_t)idx->value * sizeof(uint64_t));
+
+	return 0;
+}
+
+static const struct ctl_node CTL_NODE(class_id)[] = {
+	CTL_LEAF_RO(allocs),
+
+	CTL_NODE_END
+};
+
+static const struct ctl_node CTL_NODE(alloc_class)[] = {
+	CTL_INDEXED(class_id),
+
+	CTL_NODE_END
+};
+
 static const struct ctl_node CTL_NODE(heap)[] = {
 	STATS_CTL_LEAF(persistent, curr_allocated),
 	STATS_CTL_LEAF(transient, run_allocated),
 	STATS_CTL_LEAF(transient, run_active),
+	STATS_CTL_LEAF(latency, operation_latency),
+	STATS_CTL_LEAF(latency, publish_latency),
+	CTL_CHILD(alloc_class),
+
+	CTL_NODE_END
+};
+
+STATS_LANE_CTL_HANDLER(begin, tx_begin);
+STATS_LANE_CTL_HANDLER(commit, tx_commit);
+STATS_LANE_CTL_HANDLER(abort, tx_abort);
+STATS_LANE_CTL_HANDLER(undo_bytes, tx_undo_bytes);
+STATS_LANE_CTL_HANDLER(redo_bytes, tx_redo_bytes);
+STATS_LANE_CTL_HANDLER(log_extend, tx_log_extend);
+STATS_LANE_CTL_HANDLER(lane_retries, lane_retries);
+STATS_LANE_CTL_HANDLER(lane_waits, lane_waits);
+STATS_LANE_CTL_HANDLER(lane_handoffs, lane_handoffs);
+
+STATS_LATENCY_CTL_HANDLER(commit_latency, STATS_LATENCY_TX_COMMIT);
+
+static const struct ctl_node CTL_NODE(tx)[] = {
+	STATS_CTL_LEAF(lane, begin),
+	STATS_CTL_LEAF(lane, commit),
+	STATS_CTL_LEAF(lane, abort),
+	STATS_CTL_LEAF(lane, undo_bytes),
+	STATS_CTL_LEAF(lane, redo_bytes),
+	STATS_CTL_LEAF(lane, log_extend),
+	STATS_CTL_LEAF(lane, lane_retries),
+	STATS_CTL_LEAF(lane, lane_waits),
+	STATS_CTL_LEAF(lane, lane_handoffs),
+	STATS_CTL_LEAF(latency, commit_latency),
 
 	CTL_NODE_END
 };
@@ -81,8 +394,10 @@ CTL_WRITE_HANDLER(enabled)(void *ctx,
 	struct ctl_indexes *indexes)
 {
 	PMEMobjpool *pop = ctx;
+	struct stats *s = pop->stats;
+	enum pobj_stats_enabled enabled = *(enum pobj_stats_enabled *)arg;
 
-	pop->stats->enabled = *(enum pobj_stats_enabled *)arg;
+	s->enabled = enabled;
 
 	return 0;
 }
@@ -96,9 +411,72 @@ static const struct ctl_argument CTL_ARG(enabled) = {
 	}
 };
 
+/*
+ * CTL_READ_HANDLER(detailed_enabled) -- returns whether or not the detailed
+ *	statistics are enabled
+ */
+static int
+CTL_READ_HANDLER(detailed_enabled)(void *ctx,
+	enum ctl_query_source source, void *arg,
+	struct ctl_indexes *indexes)
+{
+	PMEMobjpool *pop = ctx;
+
+	int *arg_out = arg;
+
+	*arg_out = pop->stats->detailed_enabled;
+
+	return 0;
+}
+
+/*
+ * CTL_WRITE_HANDLER(detailed_enabled) -- enables or disables the allocation
+ *	class counters and the latency histograms
+ */
+static int
+CTL_WRITE_HANDLER(detailed_enabled)(void *ctx,
+	enum ctl_query_source source, void *arg,
+	struct ctl_indexes *indexes)
+{
+	PMEMobjpool *pop = ctx;
+	struct stats *s = pop->stats;
+	int enabled = *(int *)arg;
+
+	s->detailed_enabled = enabled;
+
+	return 0;
+}
+
+static const struct ctl_argument CTL_ARG(detailed_enabled) = CTL_ARG_BOOLEAN;
+
+#define STATS_RECOVERY_CTL_HANDLER(name, phase)\
+static int CTL_READ_HANDLER(recovery_##name)(void *ctx,\
+	enum ctl_query_source source, void *arg, struct ctl_indexes *indexes)\
+{\
+	PMEMobjpool *pop = ctx;\
+	uint64_t *argv = arg;\
+	*argv = pop->stats->recovery_ns[phase];\
+	return 0;\
+}
+
+STATS_RECOVERY_CTL_HANDLER(redo_ns, STATS_RECOVERY_REDO);
+STATS_RECOVERY_CTL_HANDLER(heap_boot_ns, STATS_RECOVERY_HEAP_BOOT);
+STATS_RECOVERY_CTL_HANDLER(undo_ns, STATS_RECOVERY_UNDO);
+
+static const struct ctl_node CTL_NODE(recovery)[] = {
+	STATS_CTL_LEAF(recovery, redo_ns),
+	STATS_CTL_LEAF(recovery, heap_boot_ns),
+	STATS_CTL_LEAF(recovery, undo_ns),
+
+	CTL_NODE_END
+};
+
 static const struct ctl_node CTL_NODE(stats)[] = {
 	CTL_CHILD(heap),
+	CTL_CHILD(tx),
+	CTL_CHILD(recovery),
 	CTL_LEAF_RW(enabled),
+	CTL_LEAF_RW(detailed_enabled),
 
 	CTL_NODE_END
 };
@@ -116,12 +494,23 @@ stats_new(PMEMobjpool *pop)
 	}
 
 	s->enabled = POBJ_STATS_ENABLED_TRANSIENT;
+	s->detailed_enabled = 0;
+	for (int i = 0; i < MAX_STATS_RECOVERY_PHASE; ++i)
+		s->recovery_ns[i] = 0;
 	s->persistent = &pop->stats_persistent;
 	VALGRIND_ADD_TO_GLOBAL_TX_IGNORE(s->persistent, sizeof(*s->persistent));
 	s->transient = Zalloc(sizeof(struct stats_transient));
 	if (s->transient == NULL)
 		goto error_transient_alloc;
 
+	COMPILE_ERROR_ON(STATS_ALLOC_CLASSES != MAX_ALLOCATION_CLASSES);
+
+	s->pop = pop;
+	s->nlanes = pop->lanes_desc.runtime_nlanes;
+	util_mutex_init(&s->lanes_lock);
+	memset(&s->lanes, 0, sizeof(s->lanes));
+	memset(&s->details, 0, sizeof(s->details));
+
 	return s;
 
 error_transient_alloc:
@@ -137,6 +526,9 @@ stats_delete(PMEMobjpool *pop, struct stats *s)
 {
 	pmemops_persist(&pop->p_ops, s->persistent,
 	sizeof(struct stats_persistent));
+	Free(s->details.alloc);
+	Free(s->lanes.alloc);
+	util_mutex_destroy(&s->lanes_lock);
 	Free(s->transient);
 	Free(s);
 }
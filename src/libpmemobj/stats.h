@@ -1,5 +1,5 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
-/* Copyright 2017-2020, Intel Corporation */
+/* Copyright 2017-2021, Intel Corporation */
 
 /*
  * stats.h -- definitions of statistics
@@ -9,6 +9,7 @@
 #define LIBPMEMOBJ_STATS_H 1
 
 #include "ctl.h"
+#include "os_thread.h"
 #include "libpmemobj/ctl.h"
 
 #ifdef __cplusplus
@@ -24,12 +25,82 @@ struct stats_persistent {
 	uint64_t heap_curr_allocated;
 };
 
+/* equal to MAX_ALLOCATION_CLASSES, which cannot be included here */
+#define STATS_ALLOC_CLASSES 255
+
+enum stats_latency_type {
+	STATS_LATENCY_TX_COMMIT,
+	STATS_LATENCY_HEAP_OPERATION,
+	STATS_LATENCY_HEAP_PUBLISH,
+
+	MAX_STATS_LATENCY_TYPE
+};
+
+/* phases of the recovery performed while opening the pool */
+enum stats_recovery_phase {
+	STATS_RECOVERY_REDO,
+	STATS_RECOVERY_HEAP_BOOT,
+	STATS_RECOVERY_UNDO,
+
+	MAX_STATS_RECOVERY_PHASE
+};
+
+/*
+ * Transient statistics updated only by the thread holding the lane, so that
+ * counting doesn't require any atomic operations on shared cachelines. The
+ * values are summed up across all the lanes when read.
+ */
+struct stats_lane {
+	uint64_t tx_begin;
+	uint64_t tx_commit;
+	uint64_t tx_abort;
+	uint64_t tx_undo_bytes;
+	uint64_t tx_redo_bytes;
+	uint64_t tx_log_extend;
+	uint64_t lane_retries;
+	uint64_t lane_waits;
+	uint64_t lane_handoffs;
+};
+
+/*
+ * Per-lane statistics which are large or expensive to gather, kept only if
+ * stats.detailed_enabled is set.
+ */
+struct stats_lane_detail {
+	uint64_t heap_class_alloc[STATS_ALLOC_CLASSES];
+	struct pobj_stats_latency latency[MAX_STATS_LATENCY_TYPE];
+};
+
+/*
+ * Cacheline aligned array of per-lane statistics, allocated on the first
+ * update of any of the statistics it holds.
+ */
+struct stats_lanes {
+	char *base; /* NULL until allocated */
+	void *alloc; /* unaligned allocation of the array */
+	size_t stride;
+};
+
 struct stats {
 	enum pobj_stats_enabled enabled;
+	int detailed_enabled;
 	struct stats_transient *transient;
 	struct stats_persistent *persistent;
+
+	PMEMobjpool *pop;
+	unsigned nlanes;
+	os_mutex_t lanes_lock; /* serializes the allocation of the lanes */
+	struct stats_lanes lanes; /* of struct stats_lane */
+	struct stats_lanes details; /* of struct stats_lane_detail */
+
+	/* durations of the recovery phases in nanoseconds, always measured */
+	uint64_t recovery_ns[MAX_STATS_RECOVERY_PHASE];
 };
 
+#define STATS_ENABLED_TRANSIENT(stats)\
+((stats)->enabled == POBJ_STATS_ENABLED_TRANSIENT ||\
+(stats)->enabled == POBJ_STATS_ENABLED_BOTH)
+
 #define STATS_INC(stats, type, name, value) do {\
 	STATS_INC_##type(stats, name, value);\
 } while (0)
@@ -80,6 +151,18 @@ struct stats {
 		(value), memory_order_release);\
 } while (0)
 
+#define STATS_LANE_INC(stats, name, value) do {\
+	struct stats_lane *_sl = stats_lane_get(stats);\
+	if (_sl != NULL)\
+		_sl->name += (value);\
+} while (0)
+
+#define STATS_LANE_IDX_INC(stats, lane_idx, name, value) do {\
+	struct stats_lane *_sl = stats_lane_at(stats, lane_idx);\
+	if (_sl != NULL)\
+		_sl->name += (value);\
+} while (0)
+
 #define STATS_CTL_LEAF(type, name)\
 {CTL_STR(name), CTL_NODE_LEAF,\
 {CTL_READ_HANDLER(type##_##name), NULL, NULL},\
@@ -98,6 +181,19 @@ static int CTL_READ_HANDLER(type##_##name)(void *ctx,\
 
 void stats_ctl_register(PMEMobjpool *pop);
 
+struct stats_lane *stats_lane_get(struct stats *stats);
+struct stats_lane *stats_lane_at(struct stats *stats, unsigned lane_idx);
+
+struct stats_lane_detail *stats_lane_detail_get(struct stats *stats);
+
+uint64_t stats_latency_start(struct stats *stats);
+void stats_latency_end(struct stats_lane_detail *sd,
+	enum stats_latency_type type, uint64_t start);
+
+uint64_t stats_recovery_start(void);
+void stats_recovery_end(struct stats *stats, enum stats_recovery_phase phase,
+	uint64_t start);
+
 struct stats *stats_new(PMEMobjpool *pop);
 void stats_delete(PMEMobjpool *pop, struct stats *stats);
 
@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2015-2020, Intel Corporation */
+/* Copyright 2015-2021, Intel Corporation */
 
 /*
  * tx.c -- transactions implementation
@@ -10,6 +10,8 @@
 
 #include "queue.h"
 #include "ravl.h"
+#include "ringbuf.h"
+#include "sys_util.h"
 #include "obj.h"
 #include "out.h"
 #include "pmalloc.h"
@@ -17,6 +19,26 @@
 #include "valgrind_internal.h"
 #include "memops.h"
 
+struct tx_range_def {
+	uint64_t offset;
+	uint64_t size;
+	uint64_t flags;
+};
+
+VEC(tx_actions, struct pobj_action);
+
+/*
+ * tx_deferred_range -- range added with POBJ_XADD_DEFERRED, its cache lines
+ *	are snapshotted only once they are touched
+ */
+struct tx_deferred_range {
+	struct tx_deferred_range *next;
+	uint64_t offset;
+	uint64_t size;
+	uint64_t flags;
+	uint64_t lines[]; /* bitmap of the already snapshotted cache lines */
+};
+
 struct tx_data {
 	PMDK_SLIST_ENTRY(tx_data) tx_entry;
 	jmp_buf env;
@@ -31,9 +53,18 @@ struct tx {
 	PMDK_SLIST_HEAD(txl, tx_lock_data) tx_locks;
 	PMDK_SLIST_HEAD(txd, tx_data) tx_entries;
 
+	/*
+	 * Snapshot ranges, kept sorted in the inline array until it overflows
+	 * and in a tree allocated from the lane arena afterwards.
+	 */
+	struct tx_range_def ranges_inline[TX_RANGES_INLINE];
+	size_t nranges_inline;
 	struct ravl *ranges;
 
-	VEC(, struct pobj_action) actions;
+	/* the most recently added deferred range first */
+	struct tx_deferred_range *deferred;
+
+	struct tx_actions actions;
 	VEC(, struct user_buffer_def) redo_userbufs;
 	size_t redo_userbufs_capacity;
 
@@ -78,12 +109,6 @@ struct tx_alloc_args {
 #define ALLOC_ARGS(flags)\
 (struct tx_alloc_args){flags, NULL, 0}
 
-struct tx_range_def {
-	uint64_t offset;
-	uint64_t size;
-	uint64_t flags;
-};
-
 /*
  * tx_range_def_cmp -- compares two snapshot ranges
  */
@@ -114,6 +139,15 @@ tx_params_new(void)
 
 	tx_params->cache_size = TX_DEFAULT_RANGE_CACHE_SIZE;
 
+	tx_params->group_commit = operation_group_new();
+	if (tx_params->group_commit == NULL) {
+		Free(tx_params);
+		return NULL;
+	}
+
+	util_mutex_init(&tx_params->post_commit_lock);
+	util_cond_init(&tx_params->post_commit_cond);
+
 	return tx_params;
 }
 
@@ -123,9 +157,190 @@ tx_params_new(void)
 void
 tx_params_delete(struct tx_parameters *tx_params)
 {
+	operation_group_delete(tx_params->group_commit);
+	util_cond_destroy(&tx_params->post_commit_cond);
+	util_mutex_destroy(&tx_params->post_commit_lock);
 	Free(tx_params);
 }
 
+/*
+ * tx_arena -- runtime scratch memory of the transactions running on a lane,
+ *	reclaimed as a whole once the transaction is finished and reused by the
+ *	next one
+ */
+struct tx_arena_block {
+	struct tx_arena_block *next;
+	size_t size;
+	size_t used;
+	char data[];
+};
+
+struct tx_arena {
+	struct tx_arena_block *blocks; /* the most recent block first */
+	struct tx_actions actions; /* spare buffer of the actions vector */
+};
+
+/*
+ * tx_arena_new -- creates a new, empty, transaction arena
+ */
+struct tx_arena *
+tx_arena_new(void)
+{
+	struct tx_arena *arena = Malloc(sizeof(*arena));
+	if (arena == NULL) {
+		ERR("!Malloc");
+		return NULL;
+	}
+
+	arena->blocks = NULL;
+	VEC_INIT(&arena->actions);
+
+	return arena;
+}
+
+/*
+ * tx_arena_delete -- deletes the transaction arena along with its memory
+ */
+void
+tx_arena_delete(struct tx_arena *arena)
+{
+	struct tx_arena_block *b;
+	while ((b = arena->blocks) != NULL) {
+		arena->blocks = b->next;
+		Free(b);
+	}
+
+	VEC_DELETE(&arena->actions);
+	Free(arena);
+}
+
+/*
+ * tx_arena_alloc -- (internal) bump allocates memory from the arena
+ */
+static void *
+tx_arena_alloc(size_t size, void *arg)
+{
+	struct tx_arena *arena = arg;
+	size = ALIGN_UP(size, sizeof(uint64_t));
+
+	struct tx_arena_block *b = arena->blocks;
+	if (b == NULL || b->size - b->used < size) {
+		size_t bsize = MAX(size, TX_ARENA_BLOCK_SIZE);
+		b = Malloc(sizeof(*b) + bsize);
+		if (b == NULL) {
+			ERR("!Malloc");
+			return NULL;
+		}
+		b->size = bsize;
+		b->used = 0;
+		b->next = arena->blocks;
+		arena->blocks = b;
+	}
+
+	void *ptr = b->data + b->used;
+	b->used += size;
+
+	/* the memory might have been used by a different thread before */
+	VALGRIND_ANNOTATE_NEW_MEMORY(ptr, size);
+
+	return ptr;
+}
+
+/*
+ * tx_arena_free -- (internal) the memory of individual allocations is only
+ *	reclaimed when the arena is reset
+ */
+static void
+tx_arena_free(void *ptr, void *arg)
+{
+	/* nothing to do */
+}
+
+/*
+ * tx_arena_reset -- (internal) reclaims the scratch memory of a finished
+ *	transaction and takes over its actions buffer, must be called before
+ *	the lane of the transaction is released
+ */
+static void
+tx_arena_reset(struct tx_arena *arena, struct tx_actions *actions)
+{
+	struct tx_arena_block *b = arena->blocks;
+	if (b != NULL) {
+		/* only the most recent block is retained */
+		struct tx_arena_block *next;
+		while ((next = b->next) != NULL) {
+			b->next = next->next;
+			Free(next);
+		}
+		b->used = 0;
+	}
+
+	if (actions->capacity <= TX_ARENA_ACTIONS_MAX_CAPACITY) {
+		VEC_CLEAR(actions);
+		VEC_MOVE(&arena->actions, actions);
+	} else {
+		VEC_DELETE(actions);
+	}
+}
+
+/*
+ * tx_post_commit_task -- the deferred part of a commit, there's one task per
+ *	lane because the lane stays held until its task is processed
+ */
+struct tx_post_commit_task {
+	unsigned lane_idx;
+	struct tx_actions actions;
+};
+
+struct tx_post_commit {
+	struct ringbuf *queue;
+	unsigned nworkers; /* protected by the post_commit_lock */
+	struct tx_post_commit_task tasks[];
+};
+
+/*
+ * tx_post_commit_get -- (internal) returns the post commit queue of the pool
+ *
+ * The queue is replaced only while all the lanes are held, so it stays valid
+ * for as long as the calling thread holds a lane.
+ */
+static struct tx_post_commit *
+tx_post_commit_get(PMEMobjpool *pop)
+{
+	struct tx_post_commit *pc;
+	util_atomic_load_explicit64(&pop->tx_postcommit, &pc,
+		memory_order_acquire);
+
+	return pc;
+}
+
+/*
+ * tx_post_commit_new -- (internal) creates a new post commit queue
+ */
+static struct tx_post_commit *
+tx_post_commit_new(PMEMobjpool *pop, unsigned depth)
+{
+	unsigned nlanes = pop->lanes_desc.runtime_nlanes;
+
+	struct tx_post_commit *pc = Zalloc(sizeof(*pc) +
+		sizeof(struct tx_post_commit_task) * nlanes);
+	if (pc == NULL)
+		return NULL;
+
+	pc->queue = ringbuf_new(depth);
+	if (pc->queue == NULL) {
+		Free(pc);
+		return NULL;
+	}
+
+	for (unsigned i = 0; i < nlanes; ++i) {
+		pc->tasks[i].lane_idx = i;
+		VEC_INIT(&pc->tasks[i].actions);
+	}
+
+	return pc;
+}
+
 static void
 obj_tx_abort(int errnum, int user);
 
@@ -386,12 +601,150 @@ tx_abort_set(PMEMobjpool *pop, struct lane *lane)
 {
 	LOG(7, NULL);
 
-	ulog_foreach_entry((struct ulog *)&lane->layout->undo,
+	ulog_foreach_entry(lane->undo_log,
 		tx_undo_entry_apply, NULL, &pop->p_ops);
 	pmemops_drain(&pop->p_ops);
 	operation_finish(lane->undo, ULOG_INC_FIRST_GEN_NUM);
 }
 
+/*
+ * tx_ranges_spill -- (internal) moves the ranges from the full inline array
+ *	to a tree allocated from the lane arena
+ */
+static int
+tx_ranges_spill(struct tx *tx)
+{
+	struct ravl *ranges = ravl_new_sized_alloc(tx_range_def_cmp,
+		sizeof(struct tx_range_def), tx_arena_alloc, tx_arena_free,
+		tx->lane->tx_arena);
+	if (ranges == NULL)
+		return -1;
+
+	for (size_t i = 0; i < tx->nranges_inline; ++i) {
+		if (ravl_emplace_copy(ranges, &tx->ranges_inline[i]) != 0) {
+			ravl_delete(ranges);
+			return -1;
+		}
+	}
+
+	tx->ranges = ranges;
+	tx->nranges_inline = 0;
+
+	return 0;
+}
+
+/*
+ * tx_lane_ranges_insert_def -- (internal) allocates and inserts a new range
+ *	definition into the ranges of the transaction
+ */
+static int
+tx_lane_ranges_insert_def(PMEMobjpool *pop, struct tx *tx,
+	const struct tx_range_def *rdef)
+{
+	LOG(3, "rdef->offset %"PRIu64" rdef->size %"PRIu64,
+		rdef->offset, rdef->size);
+
+	if (tx->ranges == NULL && tx->nranges_inline == TX_RANGES_INLINE) {
+		if (tx_ranges_spill(tx) != 0)
+			return -1;
+	}
+
+	if (tx->ranges != NULL) {
+		int ret = ravl_emplace_copy(tx->ranges, rdef);
+		if (ret && errno == EEXIST)
+			FATAL("invalid state of ranges tree");
+		return ret;
+	}
+
+	struct tx_range_def *ranges = tx->ranges_inline;
+	size_t i = tx->nranges_inline;
+	for (; i > 0; --i) {
+		int cmp = tx_range_def_cmp(&ranges[i - 1], rdef);
+		if (cmp == 0)
+			FATAL("invalid state of ranges array");
+		if (cmp < 0)
+			break;
+	}
+
+	memmove(&ranges[i + 1], &ranges[i],
+		(tx->nranges_inline - i) * sizeof(*ranges));
+	ranges[i] = *rdef;
+	tx->nranges_inline++;
+
+	return 0;
+}
+
+/*
+ * tx_ranges_find -- (internal) finds the range that satisfies the predicate
+ *	with respect to the search range, only the EQUAL and LESS predicates
+ *	are supported
+ */
+static struct tx_range_def *
+tx_ranges_find(struct tx *tx, const struct tx_range_def *search,
+	enum ravl_predicate predicate)
+{
+	ASSERTeq(predicate & RAVL_PREDICATE_GREATER, 0);
+
+	if (tx->ranges != NULL) {
+		struct ravl_node *n = ravl_find(tx->ranges, search, predicate);
+		return n ? ravl_data(n) : NULL;
+	}
+
+	/* the inline array is small enough to be searched linearly */
+	for (size_t i = tx->nranges_inline; i > 0; --i) {
+		struct tx_range_def *r = &tx->ranges_inline[i - 1];
+		int cmp = tx_range_def_cmp(r, search);
+		if (cmp == 0 && (predicate & RAVL_PREDICATE_EQUAL))
+			return r;
+		if (cmp < 0)
+			return (predicate & RAVL_PREDICATE_LESS) ? r : NULL;
+	}
+
+	return NULL;
+}
+
+/*
+ * tx_ranges_remove -- (internal) removes the range previously returned by
+ *	tx_ranges_find, invalidates pointers to all the ranges that follow it
+ */
+static void
+tx_ranges_remove(struct tx *tx, struct tx_range_def *r)
+{
+	if (tx->ranges != NULL) {
+		struct ravl_node *n = ravl_find(tx->ranges, r,
+			RAVL_PREDICATE_EQUAL);
+		ASSERTne(n, NULL);
+		ravl_remove(tx->ranges, n);
+		return;
+	}
+
+	size_t i = (size_t)(r - tx->ranges_inline);
+	ASSERT(i < tx->nranges_inline);
+
+	memmove(r, r + 1, (tx->nranges_inline - i - 1) * sizeof(*r));
+	tx->nranges_inline--;
+}
+
+/*
+ * tx_ranges_delete_cb -- (internal) calls the callback for every range, in
+ *	the order of offsets, and drops all the ranges of the transaction
+ */
+static void
+tx_ranges_delete_cb(struct tx *tx, ravl_cb cb, void *arg)
+{
+	if (tx->ranges != NULL) {
+		ravl_delete_cb(tx->ranges, cb, arg);
+		tx->ranges = NULL;
+	}
+
+	for (size_t i = 0; i < tx->nranges_inline; ++i)
+		cb(&tx->ranges_inline[i], arg);
+	tx->nranges_inline = 0;
+
+	/* the deferred ranges live in the arena, which is reset separately */
+	tx->deferred = NULL;
+}
+
 /*
  * tx_flush_range -- (internal) flush one range
  */
@@ -429,9 +782,41 @@ tx_pre_commit(struct tx *tx)
 {
 	LOG(5, NULL);
 
-	/* Flush all regions and destroy the whole tree. */
-	ravl_delete_cb(tx->ranges, tx_flush_range, tx->pop);
-	tx->ranges = NULL;
+	/* Flush all regions and drop all the ranges. */
+	tx_ranges_delete_cb(tx, tx_flush_range, tx->pop);
+}
+
+/*
+ * tx_lane_idx -- (internal) returns the index of the lane held by the
+ *	transaction
+ */
+static inline unsigned
+tx_lane_idx(PMEMobjpool *pop, struct tx *tx)
+{
+	return (unsigned)(tx->lane - pop->lanes_desc.lane);
+}
+
+/*
+ * tx_stats_finish -- (internal) updates the statistics of the lane with the
+ *	outcome of the outermost transaction, must be called before the lane is
+ *	released
+ */
+static void
+tx_stats_finish(struct tx *tx, int committed)
+{
+	struct stats_lane *sl = stats_lane_at(tx->pop->stats,
+		tx_lane_idx(tx->pop, tx));
+	if (sl == NULL)
+		return;
+
+	if (committed) {
+		sl->tx_commit++;
+		sl->tx_redo_bytes += operation_get_logged(tx->lane->external);
+	} else {
+		sl->tx_abort++;
+	}
+
+	sl->tx_undo_bytes += operation_get_logged(tx->lane->undo);
 }
 
 /*
@@ -446,10 +831,9 @@ tx_abort(PMEMobjpool *pop, struct lane *lane)
 
 	tx_abort_set(pop, lane);
 
-	ravl_delete_cb(tx->ranges, tx_clean_range, pop);
+	tx_ranges_delete_cb(tx, tx_clean_range, pop);
 	palloc_cancel(&pop->heap,
 		VEC_ARR(&tx->actions), VEC_SIZE(&tx->actions));
-	tx->ranges = NULL;
 }
 
 /*
@@ -548,23 +932,6 @@ release_and_free_tx_locks(struct tx *tx)
 	}
 }
 
-/*
- * tx_lane_ranges_insert_def -- (internal) allocates and inserts a new range
- *	definition into the ranges tree
- */
-static int
-tx_lane_ranges_insert_def(PMEMobjpool *pop, struct tx *tx,
-	const struct tx_range_def *rdef)
-{
-	LOG(3, "rdef->offset %"PRIu64" rdef->size %"PRIu64,
-		rdef->offset, rdef->size);
-
-	int ret = ravl_emplace_copy(tx->ranges, rdef);
-	if (ret && errno == EEXIST)
-		FATAL("invalid state of ranges tree");
-	return ret;
-}
-
 /*
  * tx_alloc_common -- (internal) common function for alloc and zalloc
  */
@@ -741,14 +1108,19 @@ pmemobj_tx_begin(PMEMobjpool *pop, jmp_buf env, ...)
 		lane_hold(pop, &tx->lane);
 		operation_start(tx->lane->undo);
 
-		VEC_INIT(&tx->actions);
+		STATS_LANE_IDX_INC(pop->stats, tx_lane_idx(pop, tx),
+			tx_begin, 1);
+
+		/* reuse the actions buffer of the previous transaction */
+		VEC_MOVE(&tx->actions, &tx->lane->tx_arena->actions);
 		VEC_INIT(&tx->redo_userbufs);
 		tx->redo_userbufs_capacity = 0;
 		PMDK_SLIST_INIT(&tx->tx_entries);
 		PMDK_SLIST_INIT(&tx->tx_locks);
 
-		tx->ranges = ravl_new_sized(tx_range_def_cmp,
-			sizeof(struct tx_range_def));
+		tx->nranges_inline = 0;
+		tx->ranges = NULL;
+		tx->deferred = NULL;
 
 		tx->pop = pop;
 
@@ -921,9 +1293,12 @@ obj_tx_abort(int errnum, int user)
 	if (PMDK_SLIST_NEXT(txd, tx_entry) == NULL) {
 		/* this is the outermost transaction */
 
+		tx_stats_finish(tx, 0);
+
 		/* process the undo log */
 		tx_abort(tx->pop, tx->lane);
 
+		tx_arena_reset(tx->lane->tx_arena, &tx->actions);
 		lane_release(tx->pop);
 		tx->lane = NULL;
 	}
@@ -964,12 +1339,122 @@ pmemobj_tx_errno(void)
 	return get_tx()->last_errnum;
 }
 
+/*
+ * tx_post_commit -- (internal) performs all the post-commit operations
+ */
 static void
 tx_post_commit(struct tx *tx)
 {
 	operation_finish(tx->lane->undo, 0);
 }
 
+/*
+ * tx_post_commit_process -- (internal) performs the post-commit operations of
+ *	a transaction committed on a detached lane and releases that lane
+ */
+static void
+tx_post_commit_process(PMEMobjpool *pop, struct tx_post_commit_task *task)
+{
+	struct lane *lane;
+	lane_attach(pop, task->lane_idx, &lane);
+
+	palloc_publish_finish(&pop->heap, VEC_ARR(&task->actions),
+		VEC_SIZE(&task->actions), lane->external);
+
+	operation_finish(lane->undo, 0);
+
+	tx_arena_reset(lane->tx_arena, &task->actions);
+
+	lane_release(pop);
+}
+
+/*
+ * tx_post_commit_drain -- (internal) processes all the queued tasks on the
+ *	calling thread
+ */
+static void
+tx_post_commit_drain(PMEMobjpool *pop, struct tx_post_commit *pc)
+{
+	struct tx_post_commit_task *task;
+	while ((task = ringbuf_trydequeue(pc->queue)) != NULL)
+		tx_post_commit_process(pop, task);
+}
+
+/*
+ * tx_post_commit_delete -- (internal) stops the post commit queue, waits for
+ *	its workers to exit, drains and deletes the queue, must be called with
+ *	the post_commit_lock held
+ */
+static void
+tx_post_commit_delete(PMEMobjpool *pop, struct tx_post_commit *pc)
+{
+	struct tx_parameters *params = pop->tx_params;
+
+	ringbuf_stop(pc->queue);
+	while (pc->nworkers != 0)
+		os_cond_wait(&params->post_commit_cond,
+			&params->post_commit_lock);
+
+	tx_post_commit_drain(pop, pc);
+	ringbuf_delete(pc->queue);
+
+	Free(pc);
+}
+
+/*
+ * tx_post_commit_cleanup -- finishes all pending post-commit operations and
+ *	deletes the post commit queue of the pool
+ */
+void
+tx_post_commit_cleanup(PMEMobjpool *pop)
+{
+	struct tx_parameters *params = pop->tx_params;
+
+	util_mutex_lock(&params->post_commit_lock);
+
+	struct tx_post_commit *pc = pop->tx_postcommit;
+	if (pc != NULL) {
+		util_atomic_store_explicit64(&pop->tx_postcommit, NULL,
+			memory_order_release);
+		tx_post_commit_delete(pop, pc);
+	}
+
+	util_mutex_unlock(&params->post_commit_lock);
+}
+
+/*
+ * tx_post_commit_enqueue -- (internal) hands over the post-commit operations
+ *	of the transaction, along with its lane, to the post commit workers
+ *
+ * The operations are performed synchronously if the queue is full, stopped
+ * or if the lane cannot be detached from the current thread.
+ */
+static void
+tx_post_commit_enqueue(PMEMobjpool *pop, struct tx_post_commit *pc,
+	struct tx *tx)
+{
+	int lane_idx = lane_detach(pop);
+	if (lane_idx >= 0) {
+		struct tx_post_commit_task *task = &pc->tasks[lane_idx];
+		ASSERTeq(VEC_SIZE(&task->actions), 0);
+
+		/* the task takes the ownership of the actions */
+		VEC_MOVE(&task->actions, &tx->actions);
+
+		if (ringbuf_tryenqueue(pc->queue, task) == 0)
+			return;
+
+		VEC_MOVE(&tx->actions, &task->actions);
+		lane_attach(pop, (unsigned)lane_idx, NULL);
+	}
+
+	palloc_publish_finish(&pop->heap, VEC_ARR(&tx->actions),
+		VEC_SIZE(&tx->actions), tx->lane->external);
+	tx_post_commit(tx);
+	tx_arena_reset(tx->lane->tx_arena, &tx->actions);
+	lane_release(pop);
+}
+
 /*
  * pmemobj_tx_commit -- commits current transaction
  */
@@ -996,6 +1481,8 @@ pmemobj_tx_commit(void)
 
 		PMEMobjpool *pop = tx->pop;
 
+		uint64_t start = stats_latency_start(pop->stats);
+
 		/* pre-commit phase */
 		tx_pre_commit(tx);
 
@@ -1007,12 +1494,40 @@ pmemobj_tx_commit(void)
 		VEC_FOREACH_BY_PTR(userbuf, &tx->redo_userbufs)
 			operation_add_user_buffer(tx->lane->external, userbuf);
 
-		palloc_publish(&pop->heap, VEC_ARR(&tx->actions),
-			VEC_SIZE(&tx->actions), tx->lane->external);
+		/* the redo log might be processed along with other commits */
+		operation_set_group(tx->lane->external,
+			pop->tx_params->group_commit);
+
+		struct tx_post_commit *pc = tx_post_commit_get(pop);
+		if (pc == NULL) {
+			palloc_publish(&pop->heap, VEC_ARR(&tx->actions),
+				VEC_SIZE(&tx->actions), tx->lane->external);
+			operation_set_group(tx->lane->external, NULL);
+
+			tx_stats_finish(tx, 1);
+			stats_latency_end(stats_lane_detail_get(pop->stats),
+				STATS_LATENCY_TX_COMMIT, start);
+
+			tx_post_commit(tx);
 
-		tx_post_commit(tx);
+			tx_arena_reset(tx->lane->tx_arena, &tx->actions);
+			lane_release(pop);
+		} else {
+			/*
+			 * Once the actions are processed, the transaction is
+			 * durable and the rest can be done in the background.
+			 */
+			palloc_publish_process(&pop->heap,
+				VEC_ARR(&tx->actions), VEC_SIZE(&tx->actions),
+				tx->lane->external);
+			operation_set_group(tx->lane->external, NULL);
+
+			tx_stats_finish(tx, 1);
+			stats_latency_end(stats_lane_detail_get(pop->stats),
+				STATS_LATENCY_TX_COMMIT, start);
 
-		lane_release(pop);
+			tx_post_commit_enqueue(pop, pc, tx);
+		}
 
 		tx->lane = NULL;
 	}
@@ -1178,7 +1693,7 @@ pmemobj_tx_add_snapshot(struct tx *tx, struct tx_range_def *snapshot)
 		if (action == NULL)
 			return -1;
 
-		uint64_t *n = &tx->lane->layout->undo.gen_num;
+		uint64_t *n = &tx->lane->undo_log->gen_num;
 		palloc_set_value(&tx->pop->heap, action,
 			n, *n + 1);
 
@@ -1206,6 +1721,40 @@ pmemobj_tx_merge_flags(struct tx_range_def *dest, struct tx_range_def *merged)
 	}
 }
 
+/*
+ * tx_add_deferred -- (internal) registers a range whose cache lines are
+ *	snapshotted on first touch
+ */
+static int
+tx_add_deferred(struct tx *tx, struct tx_range_def *args)
+{
+	if (args->size == 0)
+		return 0;
+
+	uint64_t first = ALIGN_DOWN(args->offset, CACHELINE_SIZE);
+	uint64_t end = ALIGN_UP(args->offset + args->size, CACHELINE_SIZE);
+	size_t nlines = (end - first) / CACHELINE_SIZE;
+	size_t bitmap_size = (nlines + 63) / 64 * sizeof(uint64_t);
+
+	struct tx_deferred_range *d = tx_arena_alloc(sizeof(*d) + bitmap_size,
+		tx->lane->tx_arena);
+	if (d == NULL) {
+		ERR("out of memory");
+		return obj_tx_fail_err(ENOMEM, args->flags);
+	}
+
+	d->offset = args->offset;
+	d->size = args->size;
+	/* the failure behavior is determined when the range is touched */
+	d->flags = args->flags & ~(POBJ_XADD_DEFERRED | POBJ_XADD_NO_ABORT);
+	memset(d->lines, 0, bitmap_size);
+
+	d->next = tx->deferred;
+	tx->deferred = d;
+
+	return 0;
+}
+
 /*
  * pmemobj_tx_add_common -- (internal) common code for adding persistent memory
  * into the transaction
@@ -1227,6 +1776,9 @@ pmemobj_tx_add_common(struct tx *tx, struct tx_range_def *args)
 		return obj_tx_fail_err(EINVAL, args->flags);
 	}
 
+	if (args->flags & POBJ_XADD_DEFERRED)
+		return tx_add_deferred(tx, args);
+
 	int ret = 0;
 
 	/*
@@ -1240,10 +1792,10 @@ pmemobj_tx_add_common(struct tx *tx, struct tx_range_def *args)
 	 * they can be merged, so search for less or equal elements.
 	 */
 	enum ravl_predicate p = RAVL_PREDICATE_LESS_EQUAL;
-	struct ravl_node *nprev = NULL;
+	struct tx_range_def *fprev = NULL;
 	while (r.size != 0) {
 		search.offset = r.offset + r.size;
-		struct ravl_node *n = ravl_find(tx->ranges, &search, p);
+		struct tx_range_def *f = tx_ranges_find(tx, &search, p);
 		/*
 		 * We have to skip searching for LESS_EQUAL because
 		 * the snapshot we would find is the one that was just
@@ -1251,8 +1803,6 @@ pmemobj_tx_add_common(struct tx *tx, struct tx_range_def *args)
 		 */
 		p = RAVL_PREDICATE_LESS;
 
-		struct tx_range_def *f = n ? ravl_data(n) : NULL;
-
 		size_t fend = f == NULL ? 0: f->offset + f->size;
 		size_t rend = r.offset + r.size;
 		if (fend == 0 || fend < r.offset) {
@@ -1268,20 +1818,19 @@ pmemobj_tx_add_common(struct tx *tx, struct tx_range_def *args)
 			 * or	+--- (no overlap)
 			 * or	---+ (adjacent on on right side)
 			 */
-			if (nprev != NULL) {
+			if (fprev != NULL) {
 				/*
 				 * But, if we have an existing adjacent snapshot
 				 * on the right side, we can just extend it to
 				 * include the desired range.
 				 */
-				struct tx_range_def *fprev = ravl_data(nprev);
 				ASSERTeq(rend, fprev->offset);
 				fprev->offset -= r.size;
 				fprev->size += r.size;
 			} else {
 				/*
 				 * If we don't have anything adjacent, create
-				 * a new range in the tree.
+				 * a new range.
 				 */
 				ret = tx_lane_ranges_insert_def(tx->pop,
 					tx, &r);
@@ -1326,12 +1875,12 @@ pmemobj_tx_add_common(struct tx *tx, struct tx_range_def *args)
 			 * If there's a snapshot adjacent on right side, merge
 			 * the two ranges together.
 			 */
-			if (nprev != NULL) {
-				struct tx_range_def *fprev = ravl_data(nprev);
+			if (fprev != NULL) {
 				ASSERTeq(rend, fprev->offset);
 				f->size += fprev->size;
 				pmemobj_tx_merge_flags(f, fprev);
-				ravl_remove(tx->ranges, nprev);
+				/* f precedes fprev, so it remains valid */
+				tx_ranges_remove(tx, fprev);
 			}
 		} else if (fend >= r.offset) {
 			/*
@@ -1350,7 +1899,7 @@ pmemobj_tx_add_common(struct tx *tx, struct tx_range_def *args)
 			 * on this information without risking overwriting an
 			 * existing one. We have to continue iterating, but we
 			 * keep the information about adjacent snapshots in the
-			 * nprev variable.
+			 * fprev variable.
 			 */
 			size_t overlap = rend - MAX(f->offset, r.offset);
 			r.size -= overlap;
@@ -1359,7 +1908,7 @@ pmemobj_tx_add_common(struct tx *tx, struct tx_range_def *args)
 			ASSERT(0);
 		}
 
-		nprev = n;
+		fprev = f;
 	}
 
 	if (ret != 0) {
@@ -1370,6 +1919,65 @@ pmemobj_tx_add_common(struct tx *tx, struct tx_range_def *args)
 	return 0;
 }
 
+/*
+ * tx_touch_common -- (internal) snapshots the not yet touched cache lines
+ *	of a deferred range, falls back to a regular snapshot of the whole
+ *	block if it does not belong to a single deferred range
+ */
+static int
+tx_touch_common(struct tx *tx, struct tx_range_def *args)
+{
+	LOG(15, NULL);
+
+	if (args->size == 0)
+		return 0;
+
+	uint64_t end = args->offset + args->size;
+
+	struct tx_deferred_range *d;
+	for (d = tx->deferred; d != NULL; d = d->next) {
+		if (args->offset >= d->offset &&
+		    args->offset - d->offset < d->size)
+			break;
+	}
+
+	if (d == NULL || end > d->offset + d->size || end < args->offset)
+		return pmemobj_tx_add_common(tx, args);
+
+	uint64_t base = ALIGN_DOWN(d->offset, CACHELINE_SIZE);
+	uint64_t line = (args->offset - base) / CACHELINE_SIZE;
+	uint64_t last = (end - 1 - base) / CACHELINE_SIZE;
+
+	while (line <= last) {
+		if (d->lines[line / 64] & (1ULL << (line % 64))) {
+			line++;
+			continue;
+		}
+
+		/* consecutive untouched lines are snapshotted together */
+		uint64_t next = line + 1;
+		while (next <= last &&
+		    !(d->lines[next / 64] & (1ULL << (next % 64))))
+			next++;
+
+		/* the lines at the edges are clamped to the deferred range */
+		struct tx_range_def r;
+		r.offset = MAX(base + line * CACHELINE_SIZE, d->offset);
+		r.size = MIN(base + next * CACHELINE_SIZE,
+			d->offset + d->size) - r.offset;
+		r.flags = d->flags | (args->flags & POBJ_XADD_NO_ABORT);
+
+		int ret = pmemobj_tx_add_common(tx, &r);
+		if (ret != 0)
+			return ret;
+
+		for (; line < next; ++line)
+			d->lines[line / 64] |= 1ULL << (line % 64);
+	}
+
+	return 0;
+}
+
 /*
  * pmemobj_tx_add_range_direct -- adds persistent memory range into the
  *					transaction
@@ -1538,6 +2146,83 @@ pmemobj_tx_xadd_range(PMEMoid oid, uint64_t hoff, size_t size, uint64_t flags)
 	return ret;
 }
 
+/*
+ * pmemobj_tx_touch_range_direct -- snapshots the untouched cache lines of
+ *	a deferred range
+ */
+int
+pmemobj_tx_touch_range_direct(const void *ptr, size_t size)
+{
+	LOG(3, NULL);
+
+	PMEMOBJ_API_START();
+	struct tx *tx = get_tx();
+
+	ASSERT_IN_TX(tx);
+	ASSERT_TX_STAGE_WORK(tx);
+
+	int ret;
+
+	uint64_t flags = tx_abort_on_failure_flag(tx);
+
+	if (!OBJ_PTR_FROM_POOL(tx->pop, ptr)) {
+		ERR("object outside of pool");
+		ret = obj_tx_fail_err(EINVAL, flags);
+		PMEMOBJ_API_END();
+		return ret;
+	}
+
+	struct tx_range_def args = {
+		.offset = (uint64_t)((char *)ptr - (char *)tx->pop),
+		.size = size,
+		.flags = flags,
+	};
+
+	ret = tx_touch_common(tx, &args);
+
+	PMEMOBJ_API_END();
+	return ret;
+}
+
+/*
+ * pmemobj_tx_touch_range -- snapshots the untouched cache lines of a deferred
+ *	range
+ */
+int
+pmemobj_tx_touch_range(PMEMoid oid, uint64_t hoff, size_t size)
+{
+	LOG(3, NULL);
+
+	PMEMOBJ_API_START();
+	struct tx *tx = get_tx();
+
+	ASSERT_IN_TX(tx);
+	ASSERT_TX_STAGE_WORK(tx);
+
+	int ret;
+
+	uint64_t flags = tx_abort_on_failure_flag(tx);
+
+	if (oid.pool_uuid_lo != tx->pop->uuid_lo) {
+		ERR("invalid pool uuid");
+		ret = obj_tx_fail_err(EINVAL, flags);
+		PMEMOBJ_API_END();
+		return ret;
+	}
+	ASSERT(OBJ_OID_IS_VALID(tx->pop, oid));
+
+	struct tx_range_def args = {
+		.offset = oid.off + hoff,
+		.size = size,
+		.flags = flags,
+	};
+
+	ret = tx_touch_common(tx, &args);
+
+	PMEMOBJ_API_END();
+	return ret;
+}
+
 /*
  * pmemobj_tx_alloc -- allocates a new object
  */
@@ -1833,22 +2518,21 @@ pmemobj_tx_xfree(PMEMoid oid, uint64_t flags)
 	struct pobj_action *action;
 
 	struct tx_range_def range = {oid.off, 0, 0};
-	struct ravl_node *n = ravl_find(tx->ranges, &range,
+	struct tx_range_def *r = tx_ranges_find(tx, &range,
 		RAVL_PREDICATE_EQUAL);
 
 	/*
 	 * If attempting to free an object allocated within the same
 	 * transaction, simply cancel the alloc and remove it from the actions.
 	 */
-	if (n != NULL) {
+	if (r != NULL) {
 		VEC_FOREACH_BY_PTR(action, &tx->actions) {
 			if (action->type == POBJ_ACTION_TYPE_HEAP &&
 				action->heap.offset == oid.off) {
-				struct tx_range_def *r = ravl_data(n);
 				void *ptr = OBJ_OFF_TO_PTR(pop, r->offset);
 				VALGRIND_SET_CLEAN(ptr, r->size);
 				VALGRIND_REMOVE_FROM_TX(ptr, r->size);
-				ravl_remove(tx->ranges, n);
+				tx_ranges_remove(tx, r);
 				palloc_cancel(&pop->heap, action, 1);
 				VEC_ERASE_BY_PTR(&tx->actions, action);
 				PMEMOBJ_API_END();
@@ -2314,17 +2998,93 @@ static int
 CTL_READ_HANDLER(queue_depth)(void *ctx, enum ctl_query_source source,
 	void *arg, struct ctl_indexes *indexes)
 {
+	PMEMobjpool *pop = ctx;
+	struct tx_parameters *params = pop->tx_params;
+
+	int *arg_out = arg;
+
+	util_mutex_lock(&params->post_commit_lock);
+	struct tx_post_commit *pc = pop->tx_postcommit;
+	*arg_out = pc == NULL ? 0 : (int)ringbuf_length(pc->queue);
+	util_mutex_unlock(&params->post_commit_lock);
+
 	return 0;
 }
 
 /*
  * CTL_WRITE_HANDLER(queue_depth) -- sets the depth of the post commit queue
+ *
+ * The queue can be replaced only when there are no running post commit
+ * workers and no other thread holds a lane. Stopped workers are waited for.
  */
 static int
 CTL_WRITE_HANDLER(queue_depth)(void *ctx, enum ctl_query_source source,
 	void *arg, struct ctl_indexes *indexes)
 {
+	PMEMobjpool *pop = ctx;
+	struct tx_parameters *params = pop->tx_params;
+
+	int arg_in = *(int *)arg;
+
+	if (arg_in < 0) {
+		ERR("invalid post commit queue depth %d", arg_in);
+		errno = EINVAL;
+		return -1;
+	}
+
+	struct tx_post_commit *npc = NULL;
+	if (arg_in != 0) {
+		npc = tx_post_commit_new(pop, (unsigned)arg_in);
+		if (npc == NULL)
+			return -1;
+	}
+
+	util_mutex_lock(&params->post_commit_lock);
+
+	struct tx_post_commit *pc = pop->tx_postcommit;
+	if (pc != NULL) {
+		if (pc->nworkers != 0 && ringbuf_running(pc->queue)) {
+			ERR("post commit workers are running");
+			goto err_busy;
+		}
+
+		while (pc->nworkers != 0)
+			os_cond_wait(&params->post_commit_cond,
+				&params->post_commit_lock);
+
+		/* queued tasks hold their lanes until they are processed */
+		tx_post_commit_drain(pop, pc);
+	}
+
+	/*
+	 * Holding all the lanes guarantees that no thread is between fetching
+	 * the queue and enqueueing its task.
+	 */
+	if (lane_hold_all(pop) != 0) {
+		ERR("transactions are in progress");
+		goto err_busy;
+	}
+
+	util_atomic_store_explicit64(&pop->tx_postcommit, npc,
+		memory_order_release);
+
+	lane_release_all(pop);
+
+	if (pc != NULL)
+		tx_post_commit_delete(pop, pc);
+
+	util_mutex_unlock(&params->post_commit_lock);
+
 	return 0;
+
+err_busy:
+	util_mutex_unlock(&params->post_commit_lock);
+	if (npc != NULL) {
+		ringbuf_delete(npc->queue);
+		Free(npc);
+	}
+	errno = EBUSY;
+	return -1;
 }
 
 static const struct ctl_argument CTL_ARG(queue_depth) = CTL_ARG_INT;
@@ -2336,6 +3096,29 @@ static int
 CTL_READ_HANDLER(worker)(void *ctx, enum ctl_query_source source,
 	void *arg, struct ctl_indexes *indexes)
 {
+	PMEMobjpool *pop = ctx;
+	struct tx_parameters *params = pop->tx_params;
+
+	util_mutex_lock(&params->post_commit_lock);
+	struct tx_post_commit *pc = pop->tx_postcommit;
+	if (pc == NULL) {
+		util_mutex_unlock(&params->post_commit_lock);
+		ERR("post commit queue not configured");
+		errno = EINVAL;
+		return -1;
+	}
+	pc->nworkers++;
+	util_mutex_unlock(&params->post_commit_lock);
+
+	struct tx_post_commit_task *task;
+	while ((task = ringbuf_dequeue(pc->queue)) != NULL)
+		tx_post_commit_process(pop, task);
+
+	util_mutex_lock(&params->post_commit_lock);
+	if (--pc->nworkers == 0)
+		os_cond_broadcast(&params->post_commit_cond);
+	util_mutex_unlock(&params->post_commit_lock);
+
 	return 0;
 }
 
@@ -2346,6 +3129,21 @@ static int
 CTL_READ_HANDLER(stop)(void *ctx, enum ctl_query_source source,
 	void *arg, struct ctl_indexes *indexes)
 {
+	PMEMobjpool *pop = ctx;
+	struct tx_parameters *params = pop->tx_params;
+
+	util_mutex_lock(&params->post_commit_lock);
+	struct tx_post_commit *pc = pop->tx_postcommit;
+	if (pc == NULL) {
+		util_mutex_unlock(&params->post_commit_lock);
+		ERR("post commit queue not configured");
+		errno = EINVAL;
+		return -1;
+	}
+
+	ringbuf_stop(pc->queue);
+	util_mutex_unlock(&params->post_commit_lock);
+
 	return 0;
 }
 
@@ -2357,10 +3155,151 @@ static const struct ctl_node CTL_NODE(post_commit)[] = {
 	CTL_NODE_END
 };
 
+/*
+ * CTL_READ_HANDLER(enabled) -- returns whether the group commit is enabled
+ */
+static int
+CTL_READ_HANDLER(enabled)(void *ctx, enum ctl_query_source source,
+	void *arg, struct ctl_indexes *indexes)
+{
+	PMEMobjpool *pop = ctx;
+
+	int *arg_out = arg;
+
+	operation_group_get_params(pop->tx_params->group_commit, arg_out,
+		NULL, NULL);
+
+	return 0;
+}
+
+/*
+ * CTL_WRITE_HANDLER(enabled) -- enables or disables the group commit
+ */
+static int
+CTL_WRITE_HANDLER(enabled)(void *ctx, enum ctl_query_source source,
+	void *arg, struct ctl_indexes *indexes)
+{
+	PMEMobjpool *pop = ctx;
+
+	int arg_in = *(int *)arg;
+
+	operation_group_set_params(pop->tx_params->group_commit, &arg_in,
+		NULL, NULL);
+
+	return 0;
+}
+
+static const struct ctl_argument CTL_ARG(enabled) = CTL_ARG_BOOLEAN;
+
+/*
+ * CTL_READ_HANDLER(window_us) -- returns the time for which the group commit
+ *	leader waits for other transactions
+ */
+static int
+CTL_READ_HANDLER(window_us)(void *ctx, enum ctl_query_source source,
+	void *arg, struct ctl_indexes *indexes)
+{
+	PMEMobjpool *pop = ctx;
+
+	int *arg_out = arg;
+
+	unsigned window_us;
+	operation_group_get_params(pop->tx_params->group_commit, NULL,
+		&window_us, NULL);
+	*arg_out = (int)window_us;
+
+	return 0;
+}
+
+/*
+ * CTL_WRITE_HANDLER(window_us) -- sets the time for which the group commit
+ *	leader waits for other transactions
+ */
+static int
+CTL_WRITE_HANDLER(window_us)(void *ctx, enum ctl_query_source source,
+	void *arg, struct ctl_indexes *indexes)
+{
+	PMEMobjpool *pop = ctx;
+
+	int arg_in = *(int *)arg;
+
+	if (arg_in < 0 || arg_in > TX_GROUP_COMMIT_MAX_WINDOW_US) {
+		ERR("invalid group commit window %d, must be between 0 and %d",
+			arg_in, TX_GROUP_COMMIT_MAX_WINDOW_US);
+		errno = EINVAL;
+		return -1;
+	}
+
+	unsigned window_us = (unsigned)arg_in;
+	operation_group_set_params(pop->tx_params->group_commit, NULL,
+		&window_us, NULL);
+
+	return 0;
+}
+
+static const struct ctl_argument CTL_ARG(window_us) = CTL_ARG_INT;
+
+/*
+ * CTL_READ_HANDLER(max_batch) -- returns the number of transactions which
+ *	makes the group commit leader stop waiting
+ */
+static int
+CTL_READ_HANDLER(max_batch)(void *ctx, enum ctl_query_source source,
+	void *arg, struct ctl_indexes *indexes)
+{
+	PMEMobjpool *pop = ctx;
+
+	int *arg_out = arg;
+
+	unsigned max_batch;
+	operation_group_get_params(pop->tx_params->group_commit, NULL,
+		NULL, &max_batch);
+	*arg_out = (int)max_batch;
+
+	return 0;
+}
+
+/*
+ * CTL_WRITE_HANDLER(max_batch) -- sets the number of transactions which
+ *	makes the group commit leader stop waiting
+ */
+static int
+CTL_WRITE_HANDLER(max_batch)(void *ctx, enum ctl_query_source source,
+	void *arg, struct ctl_indexes *indexes)
+{
+	PMEMobjpool *pop = ctx;
+
+	int arg_in = *(int *)arg;
+
+	if (arg_in < 1) {
+		ERR("invalid group commit max batch %d, must be positive",
+			arg_in);
+		errno = EINVAL;
+		return -1;
+	}
+
+	unsigned max_batch = (unsigned)arg_in;
+	operation_group_set_params(pop->tx_params->group_commit, NULL,
+		NULL, &max_batch);
+
+	return 0;
+}
+
+static const struct ctl_argument CTL_ARG(max_batch) = CTL_ARG_INT;
+
+static const struct ctl_node CTL_NODE(group_commit)[] = {
+	CTL_LEAF_RW(enabled),
+	CTL_LEAF_RW(window_us),
+	CTL_LEAF_RW(max_batch),
+
+	CTL_NODE_END
+};
+
 static const struct ctl_node CTL_NODE(tx)[] = {
 	CTL_CHILD(debug),
 	CTL_CHILD(cache),
 	CTL_CHILD(post_commit),
+	CTL_CHILD(group_commit),
 
 	CTL_NODE_END
 };
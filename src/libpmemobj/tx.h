@@ -1,5 +1,5 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
-/* Copyright 2016-2020, Intel Corporation */
+/* Copyright 2016-2021, Intel Corporation */
 
 /*
  * tx.h -- internal definitions for transactions
@@ -19,6 +19,12 @@ extern "C" {
 #define TX_DEFAULT_RANGE_CACHE_SIZE (1 << 15)
 #define TX_DEFAULT_RANGE_CACHE_THRESHOLD (1 << 12)
 
+#define TX_GROUP_COMMIT_MAX_WINDOW_US 1000000
+
+#define TX_RANGES_INLINE 8
+#define TX_ARENA_BLOCK_SIZE (1 << 12)
+#define TX_ARENA_ACTIONS_MAX_CAPACITY 256
+
 #define TX_RANGE_MASK (8ULL - 1)
 #define TX_RANGE_MASK_LEGACY (32ULL - 1)
 
@@ -34,6 +40,11 @@ extern "C" {
 
 struct tx_parameters {
 	size_t cache_size;
+	struct operation_group *group_commit; /* redo logs processing group */
+
+	/* serializes the changes of the post commit queue with its workers */
+	os_mutex_t post_commit_lock;
+	os_cond_t post_commit_cond; /* signaled when the last worker exits */
 };
 
 /*
@@ -47,6 +58,11 @@ void tx_ctl_register(PMEMobjpool *pop);
 struct tx_parameters *tx_params_new(void);
 void tx_params_delete(struct tx_parameters *tx_params);
 
+void tx_post_commit_cleanup(PMEMobjpool *pop);
+
+struct tx_arena *tx_arena_new(void);
+void tx_arena_delete(struct tx_arena *arena);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2015-2020, Intel Corporation */
+/* Copyright 2015-2021, Intel Corporation */
 
 /*
  * ulog.c -- unified log implementation
@@ -279,13 +279,14 @@ ulog_checksum(struct ulog *ulog, size_t ulog_base_bytes, int insert)
 }
 
 /*
- * ulog_store -- stores the transient src ulog in the
- *	persistent dest ulog
+ * ulog_store_nodrain -- stores the transient src ulog in the
+ *	persistent dest ulog, without waiting for the first part of the ulog
+ *	to become persistent
  *
  * The source and destination ulogs must be cacheline aligned.
  */
 void
-ulog_store(struct ulog *dest, struct ulog *src, size_t nbytes,
+ulog_store_nodrain(struct ulog *dest, struct ulog *src, size_t nbytes,
 	size_t ulog_base_nbytes, size_t ulog_total_capacity,
 	struct ulog_next *next, const struct pmem_ops *p_ops)
 {
@@ -357,11 +358,27 @@ ulog_store(struct ulog *dest, struct ulog *src, size_t nbytes,
 
 	pmemops_memcpy(p_ops, dest, src,
 		SIZEOF_ULOG(base_nbytes),
-		PMEMOBJ_F_MEM_WC);
+		PMEMOBJ_F_MEM_WC | PMEMOBJ_F_MEM_NODRAIN);
 
 	src->capacity = old_capacity;
 }
 
+/*
+ * ulog_store -- stores the transient src ulog in the
+ *	persistent dest ulog
+ *
+ * The source and destination ulogs must be cacheline aligned.
+ */
+void
+ulog_store(struct ulog *dest, struct ulog *src, size_t nbytes,
+	size_t ulog_base_nbytes, size_t ulog_total_capacity,
+	struct ulog_next *next, const struct pmem_ops *p_ops)
+{
+	ulog_store_nodrain(dest, src, nbytes, ulog_base_nbytes,
+		ulog_total_capacity, next, p_ops);
+	pmemops_drain(p_ops);
+}
+
 /*
  * ulog_entry_val_create -- creates a new log value entry in the ulog
  *
@@ -685,10 +702,11 @@ out:
 }
 
 /*
- * ulog_clobber -- zeroes the metadata of the ulog
+ * ulog_clobber_nodrain -- zeroes the metadata of the ulog, without waiting
+ *	for the change to become persistent
  */
 void
-ulog_clobber(struct ulog *dest, struct ulog_next *next,
+ulog_clobber_nodrain(struct ulog *dest, struct ulog_next *next,
 	const struct pmem_ops *p_ops)
 {
 	struct ulog empty;
@@ -700,7 +718,18 @@ ulog_clobber(struct ulog *dest, struct ulog_next *next,
 		empty.next = dest->next;
 
 	pmemops_memcpy(p_ops, dest, &empty, sizeof(empty),
-		PMEMOBJ_F_MEM_WC);
+		PMEMOBJ_F_MEM_WC | PMEMOBJ_F_MEM_NODRAIN);
+}
+
+/*
+ * ulog_clobber -- zeroes the metadata of the ulog
+ */
+void
+ulog_clobber(struct ulog *dest, struct ulog_next *next,
+	const struct pmem_ops *p_ops)
+{
+	ulog_clobber_nodrain(dest, next, p_ops);
+	pmemops_drain(p_ops);
 }
 
 /*
@@ -778,10 +807,11 @@ ulog_clobber_data(struct ulog *ulog_first,
 }
 
 /*
- * ulog_process -- process ulog entries
+ * ulog_process_nodrain -- process ulog entries, without waiting for
+ *	the modifications to become persistent
  */
 void
-ulog_process(struct ulog *ulog, ulog_check_offset_fn check,
+ulog_process_nodrain(struct ulog *ulog, ulog_check_offset_fn check,
 	const struct pmem_ops *p_ops)
 {
 	LOG(15, "ulog %p", ulog);
@@ -792,6 +822,16 @@ ulog_process(struct ulog *ulog, ulog_check_offset_fn check,
 #endif
 
 	ulog_foreach_entry(ulog, ulog_process_entry, NULL, p_ops);
+}
+
+/*
+ * ulog_process -- process ulog entries
+ */
+void
+ulog_process(struct ulog *ulog, ulog_check_offset_fn check,
+	const struct pmem_ops *p_ops)
+{
+	ulog_process_nodrain(ulog, check, p_ops);
 	pmemops_drain(p_ops);
 }
 
@@ -1,5 +1,5 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
-/* Copyright 2015-2020, Intel Corporation */
+/* Copyright 2015-2021, Intel Corporation */
 
 /*
  * ulog.h -- unified log public interface
@@ -118,12 +118,18 @@ void ulog_store(struct ulog *dest,
 	struct ulog *src, size_t nbytes, size_t ulog_base_nbytes,
 	size_t ulog_total_capacity,
 	struct ulog_next *next, const struct pmem_ops *p_ops);
+void ulog_store_nodrain(struct ulog *dest,
+	struct ulog *src, size_t nbytes, size_t ulog_base_nbytes,
+	size_t ulog_total_capacity,
+	struct ulog_next *next, const struct pmem_ops *p_ops);
 
 int ulog_free_next(struct ulog *u, const struct pmem_ops *p_ops,
 		ulog_free_fn ulog_free, ulog_rm_user_buffer_fn user_buff_remove,
 		uint64_t flags);
 void ulog_clobber(struct ulog *dest, struct ulog_next *next,
 	const struct pmem_ops *p_ops);
+void ulog_clobber_nodrain(struct ulog *dest, struct ulog_next *next,
+	const struct pmem_ops *p_ops);
 int ulog_clobber_data(struct ulog *dest,
 	size_t nbytes, size_t ulog_base_nbytes,
 	struct ulog_next *next, ulog_free_fn ulog_free,
@@ -134,6 +140,8 @@ void ulog_clobber_entry(const struct ulog_entry_base *e,
 
 void ulog_process(struct ulog *ulog, ulog_check_offset_fn check,
 	const struct pmem_ops *p_ops);
+void ulog_process_nodrain(struct ulog *ulog, ulog_check_offset_fn check,
+	const struct pmem_ops *p_ops);
 
 size_t ulog_base_nbytes(struct ulog *ulog);
 int ulog_recovery_needed(struct ulog *ulog, int verify_checksum);
@@ -0,0 +1,229 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * copy.c -- parallel copy engine used to rebuild replicas
+ *
+ * The data is split into large chunks, which are claimed one by one by
+ * a number of copying threads. Each chunk is copied with non-temporal
+ * stores and, if the destination is not persistent memory, flushed with
+ * msync. If the NUMA node of the destination is known, the helper threads
+ * are created bound to the CPUs local to that node.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libpmem.h"
+#include "libpmem2.h"
+#include "alloc.h"
+#include "copy.h"
+#include "os.h"
+#include "os_thread.h"
+#include "out.h"
+#include "util.h"
+
+/* the size of a chunk claimed at once by a copying thread */
+#define COPY_CHUNK_SIZE ((size_t)(16 << 20)) /* 16 MiB */
+
+/* the default maximum number of copying threads */
+#define COPY_THREADS_DEFAULT_MAX 8
+
+/* the number of progress reports for the whole copy */
+#define COPY_PROGRESS_STEPS 10
+
+struct copy_ctx {
+	char *dst;
+	const char *src;
+	size_t len;
+	int is_pmem;
+
+	uint64_t nchunks;
+	uint64_t next_chunk;	/* the next chunk to be claimed */
+	uint64_t copied;	/* the number of bytes copied so far */
+};
+
+/*
+ * copy_nthreads -- (internal) returns the number of threads to be used
+ */
+static unsigned
+copy_nthreads(void)
+{
+	char *env = os_getenv(COPY_THREADS_ENV_VARIABLE);
+	if (env != NULL) {
+		char *endptr;
+		errno = 0;
+		long nthreads = strtol(env, &endptr, 10);
+		if (errno == 0 && *endptr == '\0' && nthreads > 0 &&
+				nthreads <= UINT16_MAX)
+			return (unsigned)nthreads;
+
+		LOG(2, "invalid value of %s variable: %s, using the default",
+			COPY_THREADS_ENV_VARIABLE, env);
+	}
+
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpus <= 0)
+		return 1;
+
+	return (unsigned)MIN(ncpus, COPY_THREADS_DEFAULT_MAX);
+}
+
+/*
+ * copy_part_numa_node -- (internal) returns the NUMA node of the part or -1
+ *	if it cannot be determined
+ */
+static int
+copy_part_numa_node(const struct pool_set_part *part)
+{
+	LOG(3, "part %p", part);
+
+	int fd = os_open(part->path, O_RDONLY);
+	if (fd < 0) {
+		LOG(2, "!cannot open %s", part->path);
+		return -1;
+	}
+
+	int numa_node = -1;
+	struct pmem2_source *src;
+	if (pmem2_source_from_fd(&src, fd) == 0) {
+		if (pmem2_source_numa_node(src, &numa_node) != 0)
+			numa_node = -1;
+		pmem2_source_delete(&src);
+	}
+
+	(void) os_close(fd);
+
+	LOG(4, "part %s numa node %d", part->path, numa_node);
+
+	return numa_node;
+}
+
+/*
+ * copy_worker -- (internal) copies chunks until there are none left
+ */
+static void *
+copy_worker(void *arg)
+{
+	struct copy_ctx *ctx = arg;
+	uint64_t idx;
+
+	while ((idx = util_fetch_and_add64(&ctx->next_chunk, 1)) <
+			ctx->nchunks) {
+		size_t off = idx * COPY_CHUNK_SIZE;
+		size_t len = MIN(COPY_CHUNK_SIZE, ctx->len - off);
+
+		pmem_memcpy(ctx->dst + off, ctx->src + off, len,
+			PMEM_F_MEM_NONTEMPORAL | PMEM_F_MEM_NODRAIN);
+		if (!ctx->is_pmem)
+			pmem_msync(ctx->dst + off, len);
+
+		uint64_t copied = util_fetch_and_add64(&ctx->copied, len);
+		if (copied * COPY_PROGRESS_STEPS / ctx->len !=
+				(copied + len) * COPY_PROGRESS_STEPS / ctx->len)
+			LOG(2, "copied %zu of %zu bytes (%zu%%)",
+				copied + len, ctx->len,
+				(copied + len) * 100 / ctx->len);
+	}
+
+	/* the stores of every thread have to be drained by the thread */
+	if (ctx->is_pmem)
+		pmem_drain();
+
+	return NULL;
+}
+
+/*
+ * copy_data -- copies and persists the data using multiple threads
+ *
+ * If the destination part is given, the helper threads are placed on the CPUs
+ * of its NUMA node. The calling thread also takes part in the copy.
+ */
+void
+copy_data(void *dst, const void *src, size_t len, int is_pmem,
+	const struct pool_set_part *part)
+{
+	LOG(3, "dst %p src %p len %zu is_pmem %d part %p",
+		dst, src, len, is_pmem, part);
+
+	if (len == 0)
+		return;
+
+	struct copy_ctx ctx = {
+		.dst = dst,
+		.src = src,
+		.len = len,
+		.is_pmem = is_pmem,
+		.nchunks = (len + COPY_CHUNK_SIZE - 1) / COPY_CHUNK_SIZE,
+		.next_chunk = 0,
+		.copied = 0,
+	};
+
+	unsigned nthreads = copy_nthreads();
+	if (nthreads > ctx.nchunks)
+		nthreads = (unsigned)ctx.nchunks;
+
+	os_thread_t *threads = NULL;
+	unsigned nhelpers = 0;
+
+	if (nthreads > 1)
+		threads = Malloc((nthreads - 1) * sizeof(*threads));
+	if (threads == NULL)
+		nthreads = 1;
+
+	/* the helper threads are created already bound to the NUMA node */
+	os_thread_attr_t attr;
+	os_thread_attr_t *attrp = NULL;
+	if (nthreads > 1 && part != NULL) {
+		int numa_node = copy_part_numa_node(part);
+		os_cpu_set_t cpus;
+		if (numa_node >= 0 &&
+				os_numa_node_cpus(numa_node, &cpus) != 0 &&
+				os_thread_attr_init(&attr) == 0) {
+			attrp = &attr;
+			if (os_thread_attr_setaffinity_np(attrp, sizeof(cpus),
+					&cpus) != 0)
+				LOG(2, "cannot bind the copying threads to "
+					"NUMA node %d", numa_node);
+		}
+	}
+
+	LOG(4, "copying %zu bytes using %u threads", len, nthreads);
+
+	for (unsigned i = 0; i < nthreads - 1; ++i) {
+		int ret = os_thread_create(&threads[i], attrp, copy_worker,
+			&ctx);
+		if (ret != 0 && attrp != NULL) {
+			/* the CPUs of the node may be unavailable to us */
+			LOG(2, "cannot create a bound copying thread");
+			os_thread_attr_destroy(attrp);
+			attrp = NULL;
+			ret = os_thread_create(&threads[i], NULL, copy_worker,
+				&ctx);
+		}
+
+		/* the copy is never stopped, the caller just does more work */
+		if (ret != 0) {
+			errno = ret;
+			LOG(2, "!cannot create a copying thread");
+			break;
+		}
+		nhelpers++;
+	}
+
+	copy_worker(&ctx);
+
+	for (unsigned i = 0; i < nhelpers; ++i)
+		os_thread_join(&threads[i], NULL);
+
+	if (attrp != NULL)
+		os_thread_attr_destroy(attrp);
+
+	Free(threads);
+
+	ASSERTeq(ctx.copied, len);
+}
@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * copy.h -- internal definitions for the parallel replica copy engine
+ */
+
+#ifndef COPY_H
+#define COPY_H
+
+#include <stddef.h>
+
+#include "set.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the environment variable overriding the number of copying threads */
+#define COPY_THREADS_ENV_VARIABLE "PMEMPOOL_COPY_THREADS"
+
+void copy_data(void *dst, const void *src, size_t len, int is_pmem,
+	const struct pool_set_part *part);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
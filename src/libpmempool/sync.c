@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2016-2020, Intel Corporation */
+/* Copyright 2016-2021, Intel Corporation */
 
 /*
  * sync.c -- a module for poolset synchronizing
@@ -14,6 +14,7 @@
 #include <limits.h>
 
 #include "libpmem.h"
+#include "copy.h"
 #include "replica.h"
 #include "out.h"
 #include "os.h"
@@ -117,8 +118,7 @@ sync_copy_data(void *src_addr, void *dst_addr, size_t off, size_t len,
 			off, len, rep_h->part[0].path);
 
 		/* copy all data */
-		memcpy(dst_addr, src_addr, len);
-		util_persist(part->is_dev_dax, dst_addr, len);
+		copy_data(dst_addr, src_addr, len, part->is_dev_dax, part);
 	}
 
 	return 0;
@@ -0,0 +1,273 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * blk_read_direct.c -- unit test for pmemblk_read_direct
+ *
+ * usage: blk_read_direct bsize file
+ */
+
+#include "unittest.h"
+
+#define TEST_LBA 5
+
+static size_t Bsize;
+
+/*
+ * check_block -- verify that the whole block holds the given value
+ */
+static void
+check_block(const void *addr, unsigned char val)
+{
+	const unsigned char *buf = addr;
+
+	for (size_t i = 0; i < Bsize; i++)
+		UT_ASSERTeq(buf[i], val);
+}
+
+/*
+ * write_block -- fill a block with the given value
+ */
+static void
+write_block(PMEMblkpool *pbp, long long lba, unsigned char val)
+{
+	unsigned char *buf = MALLOC(Bsize);
+	memset(buf, val, Bsize);
+
+	UT_ASSERTeq(pmemblk_write(pbp, buf, lba), 0);
+
+	FREE(buf);
+}
+
+/*
+ * test_basic -- direct read of unwritten, written and rewritten blocks
+ */
+static void
+test_basic(PMEMblkpool *pbp)
+{
+	const void *addr;
+	unsigned ref;
+
+	/* no layout yet */
+	UT_ASSERTeq(pmemblk_read_direct(pbp, &addr, &ref, TEST_LBA), 0);
+	check_block(addr, 0);
+	pmemblk_read_direct_release(pbp, ref);
+
+	write_block(pbp, TEST_LBA, 1);
+
+	UT_ASSERTeq(pmemblk_read_direct(pbp, &addr, &ref, TEST_LBA), 0);
+	check_block(addr, 1);
+
+	/* the block being read is not overwritten in place */
+	write_block(pbp, TEST_LBA, 2);
+	check_block(addr, 1);
+	pmemblk_read_direct_release(pbp, ref);
+
+	UT_ASSERTeq(pmemblk_read_direct(pbp, &addr, &ref, TEST_LBA), 0);
+	check_block(addr, 2);
+	pmemblk_read_direct_release(pbp, ref);
+
+	/* zeroed block */
+	UT_ASSERTeq(pmemblk_set_zero(pbp, TEST_LBA), 0);
+	UT_ASSERTeq(pmemblk_read_direct(pbp, &addr, &ref, TEST_LBA), 0);
+	check_block(addr, 0);
+	pmemblk_read_direct_release(pbp, ref);
+
+	UT_OUT("basic");
+}
+
+struct writer_args {
+	PMEMblkpool *pbp;
+	unsigned nwrites;
+};
+
+/*
+ * writer -- keep rewriting the test block
+ */
+static void *
+writer(void *arg)
+{
+	struct writer_args *args = arg;
+
+	for (unsigned i = 0; i < args->nwrites; i++)
+		write_block(args->pbp, TEST_LBA, (unsigned char)(i % 250 + 10));
+
+	return NULL;
+}
+
+/*
+ * test_concurrent -- the block must stay intact while being read directly
+ *
+ * The writer goes through all the lanes several times, so at some point
+ * the free block of its lane is the one being read and it has to wait
+ * until it is released.
+ */
+static void
+test_concurrent(PMEMblkpool *pbp)
+{
+	const void *addr;
+	unsigned ref;
+
+	write_block(pbp, TEST_LBA, 3);
+	UT_ASSERTeq(pmemblk_read_direct(pbp, &addr, &ref, TEST_LBA), 0);
+
+	struct writer_args args = { pbp, 1000 };
+	os_thread_t thread;
+	THREAD_CREATE(&thread, NULL, writer, &args);
+
+	for (int i = 0; i < 10; i++) {
+		check_block(addr, 3);
+		usleep(10000);
+	}
+
+	pmemblk_read_direct_release(pbp, ref);
+	THREAD_JOIN(&thread, NULL);
+
+	UT_ASSERTeq(pmemblk_read_direct(pbp, &addr, &ref, TEST_LBA), 0);
+	check_block(addr, (unsigned char)((args.nwrites - 1) % 250 + 10));
+	pmemblk_read_direct_release(pbp, ref);
+
+	UT_OUT("concurrent");
+}
+
+/*
+ * test_write_held -- write from the thread which holds a direct read
+ *
+ * The first write makes the block being read the free block of the lane
+ * of this thread, so the following writes, of any block, can't reuse it and
+ * have to give up instead of waiting for the thread itself.
+ */
+static void
+test_write_held(PMEMblkpool *pbp)
+{
+	const void *addr;
+	unsigned ref;
+
+	write_block(pbp, TEST_LBA, 4);
+	UT_ASSERTeq(pmemblk_read_direct(pbp, &addr, &ref, TEST_LBA), 0);
+
+	write_block(pbp, TEST_LBA, 5);
+
+	unsigned char *buf = MALLOC(Bsize);
+	memset(buf, 6, Bsize);
+
+	errno = 0;
+	UT_ASSERTeq(pmemblk_write(pbp, buf, TEST_LBA), -1);
+	UT_ASSERTeq(errno, EBUSY);
+	check_block(addr, 4);
+
+	errno = 0;
+	UT_ASSERTeq(pmemblk_write(pbp, buf, TEST_LBA + 1), -1);
+	UT_ASSERTeq(errno, EBUSY);
+	check_block(addr, 4);
+
+	pmemblk_read_direct_release(pbp, ref);
+
+	UT_ASSERTeq(pmemblk_write(pbp, buf, TEST_LBA), 0);
+
+	UT_ASSERTeq(pmemblk_read_direct(pbp, &addr, &ref, TEST_LBA), 0);
+	check_block(addr, 6);
+	pmemblk_read_direct_release(pbp, ref);
+
+	FREE(buf);
+
+	UT_OUT("write while held");
+}
+
+/*
+ * test_slots -- claim all the direct read slots
+ */
+static void
+test_slots(PMEMblkpool *pbp)
+{
+	unsigned max = 4096;
+	unsigned *refs = MALLOC(max * sizeof(*refs));
+	const void *addr;
+	unsigned n;
+
+	for (n = 0; n < max; n++) {
+		if (pmemblk_read_direct(pbp, &addr, &refs[n], n) < 0) {
+			UT_ASSERTeq(errno, EAGAIN);
+			break;
+		}
+	}
+	UT_ASSERT(n > 0 && n < max);
+
+	for (unsigned i = 0; i < n; i++)
+		pmemblk_read_direct_release(pbp, refs[i]);
+
+	/* slots are reusable */
+	UT_ASSERTeq(pmemblk_read_direct(pbp, &addr, &refs[0], 0), 0);
+	pmemblk_read_direct_release(pbp, refs[0]);
+
+	FREE(refs);
+
+	UT_OUT("slots");
+}
+
+/*
+ * test_invalid -- check invalid block numbers and references
+ */
+static void
+test_invalid(PMEMblkpool *pbp)
+{
+	const void *addr;
+	unsigned ref;
+
+	errno = 0;
+	UT_ASSERTeq(pmemblk_read_direct(pbp, &addr, &ref, -1), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	errno = 0;
+	UT_ASSERTeq(pmemblk_read_direct(pbp, &addr, &ref,
+			(long long)pmemblk_nblock(pbp)), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* a reference which is not held is ignored */
+	errno = 0;
+	pmemblk_read_direct_release(pbp, UINT_MAX);
+	UT_ASSERTeq(errno, EINVAL);
+
+	UT_ASSERTeq(pmemblk_read_direct(pbp, &addr, &ref, TEST_LBA), 0);
+	pmemblk_read_direct_release(pbp, ref);
+
+	errno = 0;
+	pmemblk_read_direct_release(pbp, ref);
+	UT_ASSERTeq(errno, EINVAL);
+
+	UT_OUT("invalid arguments");
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "blk_read_direct");
+
+	if (argc < 3)
+		UT_FATAL("usage: %s bsize file", argv[0]);
+
+	Bsize = strtoul(argv[1], NULL, 0);
+
+	const char *path = argv[2];
+
+	PMEMblkpool *pbp = pmemblk_create(path, Bsize, PMEMBLK_MIN_POOL,
+			S_IWUSR | S_IRUSR);
+	if (pbp == NULL)
+		UT_FATAL("!%s: pmemblk_create", path);
+
+	test_basic(pbp);
+	test_concurrent(pbp);
+	test_write_held(pbp);
+	test_slots(pbp);
+	test_invalid(pbp);
+
+	pmemblk_close(pbp);
+
+	int result = pmemblk_check(path, Bsize);
+	if (result < 0)
+		UT_OUT("!%s: pmemblk_check", path);
+	else if (result == 0)
+		UT_OUT("%s: pmemblk_check: not consistent", path);
+
+	DONE(NULL);
+}
@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2014-2020, Intel Corporation */
+/* Copyright 2014-2021, Intel Corporation */
 /*
  * Copyright (c) 2016, Microsoft Corporation. All rights reserved.
  *
@@ -35,8 +35,10 @@
 /*
  * blk_rw_mt.c -- unit test for multi-threaded random I/O
  *
- * usage: blk_rw_mt bsize file seed nthread nops
+ * usage: blk_rw_mt bsize file seed nthread nops [nblock]
  *
+ * Afterwards every thread writes the blocks it owns, which are then checked
+ * once all the threads are done.
  */
 
 #include "unittest.h"
@@ -44,7 +46,7 @@
 
 static size_t Bsize;
 /* all I/O below this LBA (increases collisions) */
-static const unsigned Nblock = 100;
+static unsigned Nblock = 100;
 static unsigned Seed;
 static unsigned Nthread;
 static unsigned Nops;
@@ -80,6 +82,15 @@ check(unsigned char *buf)
 		}
 }
 
+/*
+ * owned_val -- the value written at the end to a block by its owner
+ */
+static unsigned char
+owned_val(os_off_t lba)
+{
+	return (unsigned char)(lba % 255 + 1);
+}
+
 /*
  * worker -- the work each thread performs
  */
@@ -115,13 +126,53 @@ worker(void *arg)
 	return NULL;
 }
 
+/*
+ * owner -- write the blocks owned by the thread
+ */
+static void *
+owner(void *arg)
+{
+	uintptr_t mytid = (uintptr_t)arg;
+	unsigned char *buf = MALLOC(Bsize);
+
+	for (os_off_t lba = (os_off_t)mytid; lba < Nblock; lba += Nthread) {
+		memset(buf, owned_val(lba), Bsize);
+		if (pmemblk_write(Handle, buf, lba) < 0)
+			UT_FATAL("!write     lba %zu", lba);
+	}
+
+	FREE(buf);
+
+	return NULL;
+}
+
+/*
+ * run_threads -- run nthread threads doing the given work
+ */
+static void
+run_threads(void *(*work)(void *))
+{
+	os_thread_t *threads = MALLOC(Nthread * sizeof(os_thread_t));
+
+	/* kick off nthread threads */
+	for (unsigned i = 0; i < Nthread; i++)
+		THREAD_CREATE(&threads[i], NULL, work, (void *)(intptr_t)i);
+
+	/* wait for all the threads to complete */
+	for (unsigned i = 0; i < Nthread; i++)
+		THREAD_JOIN(&threads[i], NULL);
+
+	FREE(threads);
+}
+
 int
 main(int argc, char *argv[])
 {
 	START(argc, argv, "blk_rw_mt");
 
-	if (argc != 6)
-		UT_FATAL("usage: %s bsize file seed nthread nops", argv[0]);
+	if (argc != 6 && argc != 7)
+		UT_FATAL("usage: %s bsize file seed nthread nops [nblock]",
+			argv[0]);
 
 	Bsize = strtoul(argv[1], NULL, 0);
 
@@ -134,20 +185,27 @@ main(int argc, char *argv[])
 	Seed = strtoul(argv[3], NULL, 0);
 	Nthread = strtoul(argv[4], NULL, 0);
 	Nops = strtoul(argv[5], NULL, 0);
+	if (argc == 7)
+		Nblock = strtoul(argv[6], NULL, 0);
+
+	if (Nblock > pmemblk_nblock(Handle))
+		UT_FATAL("nblock %u > %zu", Nblock, pmemblk_nblock(Handle));
 
 	UT_OUT("%s block size %zu usable blocks %u", argv[1], Bsize, Nblock);
 
-	os_thread_t *threads = MALLOC(Nthread * sizeof(os_thread_t));
+	run_threads(worker);
+	run_threads(owner);
 
-	/* kick off nthread threads */
-	for (unsigned i = 0; i < Nthread; i++)
-		THREAD_CREATE(&threads[i], NULL, worker, (void *)(intptr_t)i);
+	unsigned char *buf = MALLOC(Bsize);
+	for (os_off_t lba = 0; lba < Nblock; lba++) {
+		if (pmemblk_read(Handle, buf, lba) < 0)
+			UT_FATAL("!read      lba %zu", lba);
 
-	/* wait for all the threads to complete */
-	for (unsigned i = 0; i < Nthread; i++)
-		THREAD_JOIN(&threads[i], NULL);
+		for (size_t i = 0; i < Bsize; i++)
+			UT_ASSERTeq(buf[i], owned_val(lba));
+	}
+	FREE(buf);
 
-	FREE(threads);
 	pmemblk_close(Handle);
 
 	/* XXX not ready to pass this part of the test yet */
@@ -0,0 +1,210 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * blk_rwv.c -- unit test for pmemblk_readv/writev
+ *
+ * usage: blk_rwv bsize file
+ */
+
+#include "unittest.h"
+
+#define WRITE_LBA 10
+#define WRITE_NBLOCK 40
+
+static size_t Bsize;
+
+/*
+ * fill -- fill a range of blocks with the pattern of the given lba
+ */
+static void
+fill(unsigned char *buf, long long lba, size_t nblock)
+{
+	for (size_t i = 0; i < nblock; i++)
+		memset(buf + i * Bsize, (int)((lba + (long long)i) % 250 + 1),
+				Bsize);
+}
+
+/*
+ * verify -- check a range of blocks read starting at lba
+ *
+ * Blocks in the written range have to hold their pattern, other blocks
+ * have to be zeroed.
+ */
+static void
+verify(const unsigned char *buf, long long lba, size_t nblock)
+{
+	for (size_t i = 0; i < nblock; i++, lba++) {
+		unsigned char val = 0;
+		if (lba >= WRITE_LBA && lba < WRITE_LBA + WRITE_NBLOCK)
+			val = (unsigned char)(lba % 250 + 1);
+
+		for (size_t b = 0; b < Bsize; b++)
+			UT_ASSERTeq(buf[i * Bsize + b], val);
+	}
+}
+
+/*
+ * test_readv -- read a range of blocks split between two iovecs
+ */
+static void
+test_readv(PMEMblkpool *pbp, long long lba, size_t nblock)
+{
+	unsigned char *buf = MALLOC(nblock * Bsize);
+	memset(buf, 0xff, nblock * Bsize);
+
+	struct iovec iov[2];
+	iov[0].iov_base = buf;
+	iov[0].iov_len = nblock / 2 * Bsize;
+	iov[1].iov_base = buf + iov[0].iov_len;
+	iov[1].iov_len = nblock * Bsize - iov[0].iov_len;
+
+	int ret = pmemblk_readv(pbp, iov, 2, lba);
+	UT_ASSERTeq(ret, 0);
+
+	verify(buf, lba, nblock);
+
+	UT_OUT("readv lba %lld nblock %zu", lba, nblock);
+
+	FREE(buf);
+}
+
+/*
+ * test_writev -- write the test range of blocks split between three iovecs
+ */
+static void
+test_writev(PMEMblkpool *pbp)
+{
+	unsigned char *buf = MALLOC(WRITE_NBLOCK * Bsize);
+	fill(buf, WRITE_LBA, WRITE_NBLOCK);
+
+	struct iovec iov[3];
+	iov[0].iov_base = buf;
+	iov[0].iov_len = 8 * Bsize;
+	iov[1].iov_base = buf + 8 * Bsize;
+	iov[1].iov_len = 1 * Bsize;
+	iov[2].iov_base = buf + 9 * Bsize;
+	iov[2].iov_len = (WRITE_NBLOCK - 9) * Bsize;
+
+	int ret = pmemblk_writev(pbp, iov, 3, WRITE_LBA);
+	UT_ASSERTeq(ret, 0);
+
+	UT_OUT("writev lba %d nblock %d", WRITE_LBA, WRITE_NBLOCK);
+
+	FREE(buf);
+}
+
+/*
+ * test_single -- cross-check the vectored writes with pmemblk_read
+ */
+static void
+test_single(PMEMblkpool *pbp)
+{
+	unsigned char *buf = MALLOC(Bsize);
+
+	for (long long lba = WRITE_LBA - 1;
+			lba <= WRITE_LBA + WRITE_NBLOCK; lba++) {
+		UT_ASSERTeq(pmemblk_read(pbp, buf, lba), 0);
+		verify(buf, lba, 1);
+	}
+
+	UT_OUT("read lba %d..%d", WRITE_LBA - 1, WRITE_LBA + WRITE_NBLOCK);
+
+	FREE(buf);
+}
+
+/*
+ * test_invalid -- check invalid arguments of pmemblk_readv/writev
+ */
+static void
+test_invalid(PMEMblkpool *pbp)
+{
+	unsigned char *buf = MALLOC(2 * Bsize);
+	memset(buf, 0, 2 * Bsize);
+
+	long long nblock = (long long)pmemblk_nblock(pbp);
+	struct iovec iov = { buf, 2 * Bsize };
+
+	/* nothing to do */
+	UT_ASSERTeq(pmemblk_writev(pbp, &iov, 0, 0), 0);
+	UT_ASSERTeq(pmemblk_readv(pbp, &iov, 0, 0), 0);
+
+	errno = 0;
+	UT_ASSERTeq(pmemblk_writev(pbp, &iov, -1, 0), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	errno = 0;
+	UT_ASSERTeq(pmemblk_readv(pbp, &iov, 1, -1), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* range crossing the end of the pool */
+	errno = 0;
+	UT_ASSERTeq(pmemblk_writev(pbp, &iov, 1, nblock - 1), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	errno = 0;
+	UT_ASSERTeq(pmemblk_readv(pbp, &iov, 1, nblock), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* partial block */
+	iov.iov_len = Bsize + 1;
+	errno = 0;
+	UT_ASSERTeq(pmemblk_writev(pbp, &iov, 1, 0), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	errno = 0;
+	UT_ASSERTeq(pmemblk_readv(pbp, &iov, 1, 0), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* the last two blocks are fine */
+	iov.iov_len = 2 * Bsize;
+	UT_ASSERTeq(pmemblk_writev(pbp, &iov, 1, nblock - 2), 0);
+
+	UT_OUT("invalid arguments");
+
+	FREE(buf);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "blk_rwv");
+
+	if (argc < 3)
+		UT_FATAL("usage: %s bsize file", argv[0]);
+
+	Bsize = strtoul(argv[1], NULL, 0);
+
+	const char *path = argv[2];
+
+	PMEMblkpool *pbp = pmemblk_create(path, Bsize, PMEMBLK_MIN_POOL,
+			S_IWUSR | S_IRUSR);
+	if (pbp == NULL)
+		UT_FATAL("!%s: pmemblk_create", path);
+
+	/* no layout yet, everything reads as zeros */
+	test_readv(pbp, 0, 4);
+
+	test_writev(pbp);
+	test_readv(pbp, WRITE_LBA - 1, WRITE_NBLOCK + 2);
+	test_single(pbp);
+	test_invalid(pbp);
+
+	pmemblk_close(pbp);
+
+	int result = pmemblk_check(path, Bsize);
+	if (result < 0)
+		UT_OUT("!%s: pmemblk_check", path);
+	else if (result == 0)
+		UT_OUT("%s: pmemblk_check: not consistent", path);
+
+	pbp = pmemblk_open(path, Bsize);
+	if (pbp == NULL)
+		UT_FATAL("!%s: pmemblk_open", path);
+
+	test_readv(pbp, WRITE_LBA - 1, WRITE_NBLOCK + 2);
+
+	pmemblk_close(pbp);
+
+	DONE(NULL);
+}
@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2014-2018, Intel Corporation */
+/* Copyright 2014-2021, Intel Corporation */
 
 /*
  * checksum.c -- unit test for library internal checksum routine
@@ -36,6 +36,86 @@ fletcher64(void *addr, size_t len)
 	return htole64((uint64_t)hi32 << 32 | lo32);
 }
 
+/*
+ * checksum_compute_ref -- the reference implementation of
+ * util_checksum_compute(), processes one word at a time
+ */
+static uint64_t
+checksum_compute_ref(void *addr, size_t len, uint64_t *csump,
+		size_t skip_off)
+{
+	uint32_t *p32 = addr;
+	uint32_t *p32end = (uint32_t *)((char *)addr + len);
+	uint32_t *skip;
+	uint32_t lo32 = 0;
+	uint32_t hi32 = 0;
+
+	if (skip_off)
+		skip = (uint32_t *)((char *)addr + skip_off);
+	else
+		skip = (uint32_t *)((char *)addr + len);
+
+	while (p32 < p32end)
+		if (p32 == (uint32_t *)csump || p32 >= skip) {
+			p32 += 2;
+			hi32 += 2 * lo32;
+		} else {
+			lo32 += le32toh(*p32);
+			++p32;
+			hi32 += lo32;
+		}
+
+	return (uint64_t)hi32 << 32 | lo32;
+}
+
+#define RANDOM_MAX_LEN 8192
+#define RANDOM_ITERATIONS 10000
+
+/*
+ * test_random -- compares the checksums of random buffers with
+ * the reference implementation, which covers the vectorized
+ * kernels and all the possible lengths of their tails
+ */
+static void
+test_random(void)
+{
+	uint32_t *buf = MALLOC(RANDOM_MAX_LEN + sizeof(uint64_t));
+	unsigned seed = 42;
+	for (size_t i = 0; i < RANDOM_MAX_LEN / 4 + 2; ++i)
+		buf[i] = (uint32_t)os_rand_r(&seed);
+
+	for (unsigned n = 0; n < RANDOM_ITERATIONS; ++n) {
+		/* unaligned buffers are checksummed as well */
+		uint32_t *addr = buf + os_rand_r(&seed) % 2;
+		size_t len = (size_t)os_rand_r(&seed) % (RANDOM_MAX_LEN / 4);
+		len *= 4;
+
+		uint64_t *csump = (uint64_t *)(addr +
+			(len ? (size_t)os_rand_r(&seed) % (len / 4) : 0));
+		size_t skip_off = len && os_rand_r(&seed) % 2 ?
+			(size_t)os_rand_r(&seed) % len : 0;
+
+		uint64_t csum = util_checksum_compute(addr, len, csump,
+			skip_off);
+		uint64_t ref = checksum_compute_ref(addr, len, csump,
+			skip_off);
+		UT_ASSERTeq(csum, ref);
+
+		/* the sequential checksum doesn't skip anything */
+		csum = util_checksum_seq(addr, len, n);
+		uint64_t refcsum = n;
+		uint32_t *p32 = addr;
+		for (size_t i = 0; i < len / 4; ++i) {
+			uint32_t lo32 = (uint32_t)refcsum + le32toh(p32[i]);
+			uint32_t hi32 = (uint32_t)(refcsum >> 32) + lo32;
+			refcsum = (uint64_t)hi32 << 32 | lo32;
+		}
+		UT_ASSERTeq(csum, refcsum);
+	}
+
+	FREE(buf);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -44,6 +124,11 @@ main(int argc, char *argv[])
 	if (argc < 2)
 		UT_FATAL("usage: %s files...", argv[0]);
 
+	/* selects the checksum kernel */
+	util_init();
+
+	test_random();
+
 	for (int arg = 1; arg < argc; arg++) {
 		int fd = OPEN(argv[arg], O_RDONLY);
 
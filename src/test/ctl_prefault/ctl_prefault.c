@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2018, Intel Corporation */
+/* Copyright 2018-2021, Intel Corporation */
 
 /*
  * ctl_prefault.c -- tests for the ctl entry points: prefault
@@ -17,6 +17,8 @@
 #define BSIZE 20
 #define LAYOUT "obj_ctl_prefault"
 
+#define NTHREADS 4
+
 #ifdef __FreeBSD__
 typedef char vec_t;
 #else
@@ -66,6 +68,29 @@ prefault_fun(int prefault, fun get_func, fun set_func)
 		ret = get_func(NULL, "prefault.at_create", &arg_read);
 		UT_ASSERTeq(ret, 0);
 		UT_ASSERTeq(arg_read, 1);
+	} else if (prefault == 3) { /* prefault at open, many threads */
+		arg = 1;
+		ret = set_func(NULL, "prefault.at_open", &arg);
+		UT_ASSERTeq(ret, 0);
+
+		arg_read = -1;
+		ret = get_func(NULL, "prefault.nthreads", &arg_read);
+		UT_ASSERTeq(ret, 0);
+		UT_ASSERTeq(arg_read, 1);
+
+		arg = 0;
+		ret = set_func(NULL, "prefault.nthreads", &arg);
+		UT_ASSERTeq(ret, -1);
+		UT_ASSERTeq(errno, EINVAL);
+
+		arg = NTHREADS;
+		ret = set_func(NULL, "prefault.nthreads", &arg);
+		UT_ASSERTeq(ret, 0);
+
+		arg_read = -1;
+		ret = get_func(NULL, "prefault.nthreads", &arg_read);
+		UT_ASSERTeq(ret, 0);
+		UT_ASSERTeq(arg_read, NTHREADS);
 	}
 }
 /*
@@ -94,18 +119,24 @@ count_resident_pages(void *pool, size_t length)
 static void
 test_obj(const char *path, int open)
 {
+	/*
+	 * The pool has to be bigger than a single slice of the prefault
+	 * to be split between the threads.
+	 */
+	size_t pool_size = 4 * PMEMOBJ_MIN_POOL;
+
 	PMEMobjpool *pop;
 	if (open) {
 		if ((pop = pmemobj_open(path, LAYOUT)) == NULL)
 			UT_FATAL("!pmemobj_open: %s", path);
 	} else {
 		if ((pop = pmemobj_create(path, LAYOUT,
-				PMEMOBJ_MIN_POOL,
+				pool_size,
 				S_IWUSR | S_IRUSR)) == NULL)
 			UT_FATAL("!pmemobj_create: %s", path);
 	}
 
-	size_t resident_pages = count_resident_pages(pop, PMEMOBJ_MIN_POOL);
+	size_t resident_pages = count_resident_pages(pop, pool_size);
 
 	pmemobj_close(pop);
 
@@ -164,7 +195,7 @@ test_log(const char *path, int open)
 }
 
 #define USAGE() do {\
-	UT_FATAL("usage: %s file-name type(obj/blk/log) prefault(0/1/2) "\
+	UT_FATAL("usage: %s file-name type(obj/blk/log) prefault(0/1/2/3) "\
 			"open(0/1)", argv[0]);\
 } while (0)
 
@@ -0,0 +1,215 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * log_append_mt.c -- unit test for concurrent appends to a log memory pool
+ *
+ * usage: log_append_mt file nthreads nops
+ *
+ * Every thread appends records tagged with its id and a sequence number,
+ * both with pmemlog_append and pmemlog_appendv. After that the log is filled
+ * up concurrently until all the threads get ENOSPC. The whole log is then
+ * verified, also after reopening the pool.
+ */
+
+#include "unittest.h"
+
+#define PAYLOAD_SIZE 100
+
+struct record {
+	unsigned thread;
+	unsigned seq;
+	char payload[PAYLOAD_SIZE];
+};
+
+static PMEMlogpool *plp;
+static unsigned Nthreads;
+static unsigned Nops;
+
+/*
+ * record_init -- fills the record, the payload depends on the thread and
+ *	the sequence number
+ */
+static void
+record_init(struct record *rec, unsigned thread, unsigned seq)
+{
+	rec->thread = thread;
+	rec->seq = seq;
+	memset(rec->payload, (int)(thread + seq), PAYLOAD_SIZE);
+}
+
+/*
+ * do_append -- appends records of a single thread
+ */
+static void *
+do_append(void *arg)
+{
+	unsigned thread = *(unsigned *)arg;
+	struct record rec;
+	unsigned seq = 0;
+
+	for (unsigned i = 0; i < Nops; ++i) {
+		record_init(&rec, thread, seq++);
+
+		if (i % 2) {
+			int ret = pmemlog_append(plp, &rec, sizeof(rec));
+			UT_ASSERTeq(ret, 0);
+		} else {
+			struct iovec iov[2];
+			iov[0].iov_base = &rec;
+			iov[0].iov_len = offsetof(struct record, payload);
+			iov[1].iov_base = rec.payload;
+			iov[1].iov_len = PAYLOAD_SIZE;
+
+			int ret = pmemlog_appendv(plp, iov, 2);
+			UT_ASSERTeq(ret, 0);
+		}
+	}
+
+	/* fill up the log */
+	for (;;) {
+		record_init(&rec, thread, seq);
+		if (pmemlog_append(plp, &rec, sizeof(rec)) != 0) {
+			UT_ASSERTeq(errno, ENOSPC);
+			break;
+		}
+		seq++;
+	}
+
+	return (void *)(uintptr_t)seq;
+}
+
+struct verify_arg {
+	unsigned *next_seq;
+	unsigned nrecords;
+};
+
+/*
+ * verify_chunk -- walker callback, verifies records of the whole log
+ */
+static int
+verify_chunk(const void *buf, size_t len, void *arg)
+{
+	struct verify_arg *va = arg;
+
+	UT_ASSERTeq(len % sizeof(struct record), 0);
+
+	const struct record *rec = buf;
+	const struct record *end = rec + len / sizeof(struct record);
+	struct record expected;
+
+	for (; rec < end; ++rec) {
+		UT_ASSERT(rec->thread < Nthreads);
+
+		/* records of a single thread are kept in order */
+		UT_ASSERTeq(rec->seq, va->next_seq[rec->thread]);
+		va->next_seq[rec->thread]++;
+
+		record_init(&expected, rec->thread, rec->seq);
+		UT_ASSERTeq(memcmp(rec, &expected, sizeof(*rec)), 0);
+
+		va->nrecords++;
+	}
+
+	return 0;
+}
+
+/*
+ * verify -- checks the log contains all the records appended by the threads
+ */
+static void
+verify(unsigned *nappended)
+{
+	struct verify_arg va;
+	va.next_seq = CALLOC(Nthreads, sizeof(unsigned));
+	va.nrecords = 0;
+
+	pmemlog_walk(plp, 0, verify_chunk, &va);
+
+	unsigned total = 0;
+	for (unsigned i = 0; i < Nthreads; ++i) {
+		UT_ASSERTeq(va.next_seq[i], nappended[i]);
+		total += nappended[i];
+	}
+
+	UT_ASSERTeq(va.nrecords, total);
+	UT_ASSERTeq((size_t)pmemlog_tell(plp), total * sizeof(struct record));
+
+	/* there's no room left even for a single record */
+	UT_ASSERT(pmemlog_nbyte(plp) - (size_t)pmemlog_tell(plp) <
+		sizeof(struct record));
+
+	FREE(va.next_seq);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "log_append_mt");
+
+	if (argc != 4)
+		UT_FATAL("usage: %s file nthreads nops", argv[0]);
+
+	const char *path = argv[1];
+	Nthreads = ATOU(argv[2]);
+	Nops = ATOU(argv[3]);
+
+	plp = pmemlog_create(path, PMEMLOG_MIN_POOL, S_IWUSR | S_IRUSR);
+	if (plp == NULL)
+		UT_FATAL("!pmemlog_create: %s", path);
+
+	UT_ASSERT(pmemlog_nbyte(plp) >=
+		(size_t)Nthreads * Nops * sizeof(struct record));
+
+	os_thread_t *threads = MALLOC(Nthreads * sizeof(os_thread_t));
+	unsigned *ids = MALLOC(Nthreads * sizeof(unsigned));
+	unsigned *nappended = MALLOC(Nthreads * sizeof(unsigned));
+
+	for (unsigned i = 0; i < Nthreads; ++i) {
+		ids[i] = i;
+		THREAD_CREATE(&threads[i], NULL, do_append, &ids[i]);
+	}
+
+	for (unsigned i = 0; i < Nthreads; ++i) {
+		void *ret;
+		THREAD_JOIN(&threads[i], &ret);
+		nappended[i] = (unsigned)(uintptr_t)ret;
+		UT_ASSERT(nappended[i] >= Nops);
+	}
+
+	verify(nappended);
+
+	pmemlog_close(plp);
+
+	plp = pmemlog_open(path);
+	if (plp == NULL)
+		UT_FATAL("!pmemlog_open: %s", path);
+
+	verify(nappended);
+
+	/* the log can be reused after rewinding */
+	pmemlog_rewind(plp);
+	UT_ASSERTeq(pmemlog_tell(plp), 0);
+
+	memset(nappended, 0, Nthreads * sizeof(unsigned));
+	Nops = 0;
+
+	for (unsigned i = 0; i < Nthreads; ++i)
+		THREAD_CREATE(&threads[i], NULL, do_append, &ids[i]);
+
+	for (unsigned i = 0; i < Nthreads; ++i) {
+		void *ret;
+		THREAD_JOIN(&threads[i], &ret);
+		nappended[i] = (unsigned)(uintptr_t)ret;
+	}
+
+	verify(nappended);
+
+	pmemlog_close(plp);
+
+	FREE(nappended);
+	FREE(ids);
+	FREE(threads);
+
+	DONE(NULL);
+}
@@ -0,0 +1,228 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * obj_alloc_batch.c -- unit test for pmemobj_xalloc_batch
+ */
+
+#include "unittest.h"
+
+#define LAYOUT "obj_alloc_batch"
+#define OBJ_SIZE 100
+#define TYPE_NUM 1
+#define TYPE_NUM_BIG 2
+#define NOBJS 1000
+#define NOBJS_ROOT 64
+#define BIG_SIZE ((size_t)1 << 18)
+
+struct root {
+	PMEMoid oids[NOBJS_ROOT];
+};
+
+/*
+ * count_objs -- returns the number of objects of the given type
+ */
+static size_t
+count_objs(PMEMobjpool *pop, uint64_t type_num)
+{
+	size_t n = 0;
+	PMEMoid oid;
+	POBJ_FOREACH(pop, oid) {
+		if (pmemobj_type_num(oid) == type_num)
+			n++;
+	}
+
+	return n;
+}
+
+/*
+ * check_objs -- verifies the allocated objects
+ */
+static void
+check_objs(PMEMobjpool *pop, PMEMoid *oidv, size_t oidcnt, int zeroed)
+{
+	for (size_t i = 0; i < oidcnt; ++i) {
+		UT_ASSERT(!OID_IS_NULL(oidv[i]));
+		UT_ASSERTeq(pmemobj_pool_by_oid(oidv[i]), pop);
+		UT_ASSERTeq(pmemobj_type_num(oidv[i]), TYPE_NUM);
+		UT_ASSERT(pmemobj_alloc_usable_size(oidv[i]) >= OBJ_SIZE);
+
+		char *buf = pmemobj_direct(oidv[i]);
+		if (zeroed) {
+			for (size_t j = 0; j < OBJ_SIZE; ++j)
+				UT_ASSERTeq(buf[j], 0);
+		}
+		memset(buf, 0xc, OBJ_SIZE);
+
+		if (i != 0)
+			UT_ASSERTne(oidv[i].off, oidv[i - 1].off);
+	}
+}
+
+/*
+ * test_invalid -- invalid arguments are rejected and oids are untouched
+ */
+static void
+test_invalid(PMEMobjpool *pop)
+{
+	PMEMoid oids[2] = {OID_NULL, OID_NULL};
+
+	errno = 0;
+	int ret = pmemobj_xalloc_batch(pop, oids, 2, 0, TYPE_NUM, 0);
+	UT_ASSERTeq(ret, -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	errno = 0;
+	ret = pmemobj_xalloc_batch(pop, oids, 0, OBJ_SIZE, TYPE_NUM, 0);
+	UT_ASSERTeq(ret, -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	errno = 0;
+	ret = pmemobj_xalloc_batch(pop, oids, 2, OBJ_SIZE, TYPE_NUM,
+		POBJ_XALLOC_NO_FLUSH);
+	UT_ASSERTeq(ret, -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	UT_ASSERT(OID_IS_NULL(oids[0]));
+	UT_ASSERT(OID_IS_NULL(oids[1]));
+}
+
+/*
+ * test_volatile -- batch allocation into an array outside of the pool
+ */
+static void
+test_volatile(PMEMobjpool *pop)
+{
+	PMEMoid *oids = MALLOC(NOBJS * sizeof(*oids));
+
+	int ret = pmemobj_xalloc_batch(pop, oids, NOBJS, OBJ_SIZE, TYPE_NUM,
+		POBJ_XALLOC_ZERO);
+	UT_ASSERTeq(ret, 0);
+	check_objs(pop, oids, NOBJS, 1);
+
+	size_t n = count_objs(pop, TYPE_NUM);
+	UT_ASSERTeq(n, NOBJS);
+
+	for (size_t i = 0; i < NOBJS; ++i)
+		pmemobj_free(&oids[i]);
+
+	n = count_objs(pop, TYPE_NUM);
+	UT_ASSERTeq(n, 0);
+
+	FREE(oids);
+}
+
+/*
+ * test_persistent -- batch allocation into an array inside of the pool
+ */
+static void
+test_persistent(PMEMobjpool *pop)
+{
+	PMEMoid root = pmemobj_root(pop, sizeof(struct root));
+	struct root *r = pmemobj_direct(root);
+
+	int ret = pmemobj_xalloc_batch(pop, r->oids, NOBJS_ROOT, OBJ_SIZE,
+		TYPE_NUM, POBJ_XALLOC_ZERO);
+	UT_ASSERTeq(ret, 0);
+	check_objs(pop, r->oids, NOBJS_ROOT, 1);
+
+	size_t n = count_objs(pop, TYPE_NUM);
+	UT_ASSERTeq(n, NOBJS_ROOT);
+}
+
+/*
+ * test_oom -- a batch that doesn't fit is rolled back as a whole
+ */
+static void
+test_oom(PMEMobjpool *pop)
+{
+	/* how many big objects fit into the pool */
+	size_t nbig = 0;
+	PMEMoid oid;
+	PMEMoid next;
+	while (pmemobj_alloc(pop, &oid, BIG_SIZE, TYPE_NUM_BIG,
+			NULL, NULL) == 0)
+		nbig++;
+	UT_ASSERTne(nbig, 0);
+	POBJ_FOREACH_SAFE(pop, oid, next) {
+		if (pmemobj_type_num(oid) == TYPE_NUM_BIG)
+			pmemobj_free(&oid);
+	}
+
+	size_t cnt = nbig + 1;
+	PMEMoid *oids = ZALLOC(cnt * sizeof(*oids));
+
+	errno = 0;
+	int ret = pmemobj_xalloc_batch(pop, oids, cnt, BIG_SIZE,
+		TYPE_NUM_BIG, 0);
+	UT_ASSERTeq(ret, -1);
+	UT_ASSERTeq(errno, ENOMEM);
+	for (size_t i = 0; i < cnt; ++i)
+		UT_ASSERT(OID_IS_NULL(oids[i]));
+
+	size_t n = count_objs(pop, TYPE_NUM_BIG);
+	UT_ASSERTeq(n, 0);
+
+	/* the cancelled reservations are available again */
+	ret = pmemobj_xalloc_batch(pop, oids, nbig, BIG_SIZE,
+		TYPE_NUM_BIG, 0);
+	UT_ASSERTeq(ret, 0);
+
+	n = count_objs(pop, TYPE_NUM_BIG);
+	UT_ASSERTeq(n, nbig);
+
+	for (size_t i = 0; i < nbig; ++i)
+		pmemobj_free(&oids[i]);
+
+	FREE(oids);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_alloc_batch");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	PMEMobjpool *pop = pmemobj_create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+		S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	test_oom(pop);
+
+	pmemobj_close(pop);
+
+	/* reopen to start the remaining tests with the runtime state rebuilt */
+	pop = pmemobj_open(path, LAYOUT);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", path);
+
+	test_invalid(pop);
+	test_volatile(pop);
+	test_persistent(pop);
+
+	pmemobj_close(pop);
+
+	/* the published objects and oids must survive reopening the pool */
+	pop = pmemobj_open(path, LAYOUT);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", path);
+
+	struct root *r = pmemobj_direct(pmemobj_root(pop, sizeof(*r)));
+	for (size_t i = 0; i < NOBJS_ROOT; ++i) {
+		UT_ASSERTeq(pmemobj_type_num(r->oids[i]), TYPE_NUM);
+		char *buf = pmemobj_direct(r->oids[i]);
+		UT_ASSERTeq(buf[0], 0xc);
+	}
+
+	size_t n = count_objs(pop, TYPE_NUM);
+	UT_ASSERTeq(n, NOBJS_ROOT);
+
+	pmemobj_close(pop);
+
+	DONE(NULL);
+}
@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2017-2020, Intel Corporation */
+/* Copyright 2017-2021, Intel Corporation */
 
 /*
  * obj_ctl_stats.c -- tests for the libpmemobj statistics module
@@ -7,6 +7,139 @@
 
 #include "unittest.h"
 
+#define SNAPSHOT_SIZE (16 * 1024) /* requires an extension of the undo log */
+#define CLASS_ALLOCS 10
+
+/*
+ * get_counter -- reads a single statistics counter
+ */
+static uint64_t
+get_counter(PMEMobjpool *pop, const char *name)
+{
+	uint64_t value;
+	int ret = pmemobj_ctl_get(pop, name, &value);
+	UT_ASSERTeq(ret, 0);
+
+	return value;
+}
+
+/*
+ * get_latency_count -- returns the number of operations in the histogram
+ */
+static uint64_t
+get_latency_count(PMEMobjpool *pop, const char *name)
+{
+	struct pobj_stats_latency latency;
+	int ret = pmemobj_ctl_get(pop, name, &latency);
+	UT_ASSERTeq(ret, 0);
+
+	uint64_t count = 0;
+	for (unsigned i = 0; i < POBJ_STATS_LATENCY_BUCKETS; ++i)
+		count += latency.buckets[i];
+
+	return count;
+}
+
+/*
+ * test_lane_stats -- verifies the transaction and allocation statistics
+ *	gathered per lane
+ */
+static void
+test_lane_stats(PMEMobjpool *pop)
+{
+	UT_ASSERTeq(get_counter(pop, "stats.tx.begin"), 0);
+	UT_ASSERTeq(get_counter(pop, "stats.tx.commit"), 0);
+	UT_ASSERTeq(get_counter(pop, "stats.tx.abort"), 0);
+	UT_ASSERTeq(get_counter(pop, "stats.tx.undo_bytes"), 0);
+	UT_ASSERTeq(get_counter(pop, "stats.tx.redo_bytes"), 0);
+
+	PMEMoid oid;
+	int ret = pmemobj_alloc(pop, &oid, SNAPSHOT_SIZE, 0, NULL, NULL);
+	UT_ASSERTeq(ret, 0);
+	void *ptr = pmemobj_direct(oid);
+
+	TX_BEGIN(pop) {
+		pmemobj_tx_add_range_direct(ptr, SNAPSHOT_SIZE);
+		memset(ptr, 0xc, SNAPSHOT_SIZE);
+		pmemobj_tx_alloc(1, 0);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	TX_BEGIN(pop) {
+		pmemobj_tx_add_range_direct(ptr, 64);
+		pmemobj_tx_abort(ECANCELED);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(get_counter(pop, "stats.tx.begin"), 2);
+	UT_ASSERTeq(get_counter(pop, "stats.tx.commit"), 1);
+	UT_ASSERTeq(get_counter(pop, "stats.tx.abort"), 1);
+	UT_ASSERT(get_counter(pop, "stats.tx.undo_bytes") > SNAPSHOT_SIZE);
+	UT_ASSERTne(get_counter(pop, "stats.tx.redo_bytes"), 0);
+	UT_ASSERTne(get_counter(pop, "stats.tx.log_extend"), 0);
+
+	/* a single thread never waits for a lane */
+	UT_ASSERTeq(get_counter(pop, "stats.tx.lane_retries"), 0);
+	UT_ASSERTeq(get_counter(pop, "stats.tx.lane_waits"), 0);
+	UT_ASSERTeq(get_counter(pop, "stats.tx.lane_handoffs"), 0);
+
+	/* detailed statistics are disabled by default */
+	UT_ASSERTeq(get_latency_count(pop, "stats.tx.commit_latency"), 0);
+	UT_ASSERTeq(get_latency_count(pop, "stats.heap.operation_latency"), 0);
+
+	int enabled;
+	ret = pmemobj_ctl_get(pop, "stats.detailed_enabled", &enabled);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTeq(enabled, 0);
+
+	enabled = 1;
+	ret = pmemobj_ctl_set(pop, "stats.detailed_enabled", &enabled);
+	UT_ASSERTeq(ret, 0);
+
+	struct pobj_alloc_class_desc desc;
+	desc.header_type = POBJ_HEADER_COMPACT;
+	desc.unit_size = 777;
+	desc.units_per_block = 200;
+	desc.alignment = 0;
+	ret = pmemobj_ctl_set(pop, "heap.alloc_class.new.desc", &desc);
+	UT_ASSERTeq(ret, 0);
+
+	for (int i = 0; i < CLASS_ALLOCS; ++i) {
+		ret = pmemobj_xalloc(pop, NULL, 100, 0,
+			POBJ_CLASS_ID(desc.class_id), NULL, NULL);
+		UT_ASSERTeq(ret, 0);
+	}
+
+	char name[64];
+	SNPRINTF(name, sizeof(name), "stats.heap.alloc_class.%u.allocs",
+		desc.class_id);
+	UT_ASSERTeq(get_counter(pop, name), CLASS_ALLOCS);
+	UT_ASSERTeq(get_latency_count(pop, "stats.heap.operation_latency"),
+		CLASS_ALLOCS);
+
+	struct pobj_action act;
+	pmemobj_xreserve(pop, &act, 100, 0, POBJ_CLASS_ID(desc.class_id));
+	ret = pmemobj_publish(pop, &act, 1);
+	UT_ASSERTeq(ret, 0);
+
+	UT_ASSERTeq(get_counter(pop, name), CLASS_ALLOCS + 1);
+	UT_ASSERTeq(get_latency_count(pop, "stats.heap.publish_latency"), 1);
+
+	TX_BEGIN(pop) {
+		pmemobj_tx_add_range_direct(ptr, 64);
+	} TX_END
+
+	UT_ASSERTeq(get_latency_count(pop, "stats.tx.commit_latency"), 1);
+
+	uint64_t value;
+	ret = pmemobj_ctl_get(pop, "stats.heap.alloc_class.255.allocs",
+		&value);
+	UT_ASSERTeq(ret, -1);
+	UT_ASSERTeq(errno, ERANGE);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -116,6 +249,8 @@ main(int argc, char *argv[])
 	UT_ASSERTeq(ret, 0);
 	UT_ASSERTeq(tmp, run_allocated + oid_size);
 
+	test_lane_stats(pop);
+
 	pmemobj_close(pop);
 
 	DONE(NULL);
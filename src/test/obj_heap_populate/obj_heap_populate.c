@@ -0,0 +1,221 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * obj_heap_populate.c -- test for the background population of the heap
+ *
+ * The pool spans multiple zones so that the populator has to stay ahead of
+ * the allocations which consume the zones one by one.
+ */
+
+#include <unistd.h>
+
+#include "unittest.h"
+
+#define LAYOUT_NAME "obj_heap_populate"
+
+#define ALLOC_SIZE ((8191 * (256 * 1024)) - 16) /* must evenly divide a zone */
+#define WAIT_STEP_US 1000
+#define WAIT_MAX_STEPS 30000
+
+#define TOGGLE_THREADS 4
+#define TOGGLE_ROUNDS 200
+
+/*
+ * get_val -- reads the per-pool ctl entry
+ */
+static ssize_t
+get_val(PMEMobjpool *pop, const char *name)
+{
+	ssize_t val;
+	int ret = pmemobj_ctl_get(pop, name, &val);
+	UT_ASSERTeq(ret, 0);
+
+	return val;
+}
+
+/*
+ * set_val -- writes the per-pool ctl entry
+ */
+static int
+set_val(PMEMobjpool *pop, const char *name, ssize_t val)
+{
+	return pmemobj_ctl_set(pop, name, &val);
+}
+
+/*
+ * wait_zones -- waits until the populator populates the given number of zones
+ */
+static void
+wait_zones(PMEMobjpool *pop, ssize_t zones)
+{
+	for (int i = 0; i < WAIT_MAX_STEPS; ++i) {
+		ssize_t populated = get_val(pop, "heap.populate.zones");
+		UT_ASSERT(populated <= zones);
+		if (populated == zones)
+			return;
+
+		usleep(WAIT_STEP_US);
+	}
+
+	UT_FATAL("the populator did not populate %zd zones", zones);
+}
+
+/*
+ * test_populate_ahead -- checks that the populator stays the requested number
+ *	of zones ahead of the allocations
+ */
+static void
+test_populate_ahead(const char *path)
+{
+	PMEMobjpool *pop;
+	if ((pop = pmemobj_create(path, LAYOUT_NAME,
+			0, S_IWUSR | S_IRUSR)) == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	UT_ASSERTeq(get_val(pop, "heap.populate.ahead"), 0);
+	UT_ASSERTeq(get_val(pop, "heap.populate.numa_node"), -1);
+	UT_ASSERTeq(get_val(pop, "heap.populate.zones"), 0);
+
+	UT_ASSERTne(set_val(pop, "heap.populate.ahead", -1), 0);
+	UT_ASSERTeq(errno, EINVAL);
+	UT_ASSERTne(set_val(pop, "heap.populate.numa_node", -2), 0);
+	UT_ASSERTeq(errno, EINVAL);
+
+	UT_ASSERTeq(set_val(pop, "heap.populate.numa_node", 0), 0);
+	UT_ASSERTeq(get_val(pop, "heap.populate.numa_node"), 0);
+
+	UT_ASSERTeq(set_val(pop, "heap.populate.ahead", 2), 0);
+	UT_ASSERTeq(get_val(pop, "heap.populate.ahead"), 2);
+
+	wait_zones(pop, 2);
+
+	/* the first object moves the frontier past zone 0 */
+	PMEMoid oid;
+	int ret = pmemobj_alloc(pop, &oid, ALLOC_SIZE, 0, NULL, NULL);
+	UT_ASSERTeq(ret, 0);
+
+	wait_zones(pop, 3);
+
+	int n = 1;
+	while (pmemobj_alloc(pop, &oid, ALLOC_SIZE, 0, NULL, NULL) == 0)
+		n++;
+
+	/* more objects than would fit in a single zone */
+	UT_ASSERT(n > 8);
+
+	ssize_t nzones = get_val(pop, "heap.populate.zones");
+	UT_ASSERT(nzones > 3);
+
+	UT_ASSERTeq(set_val(pop, "heap.populate.ahead", 0), 0);
+	UT_ASSERTeq(get_val(pop, "heap.populate.ahead"), 0);
+
+	pmemobj_free(&oid);
+
+	UT_OUT("allocated: %d", n);
+
+	pmemobj_close(pop);
+}
+
+/*
+ * toggle_worker -- keeps starting and stopping the populator
+ */
+static void *
+toggle_worker(void *arg)
+{
+	PMEMobjpool *pop = arg;
+
+	for (int i = 0; i < TOGGLE_ROUNDS; ++i) {
+		UT_ASSERTeq(set_val(pop, "heap.populate.ahead", i % 2), 0);
+		UT_ASSERTeq(set_val(pop, "heap.populate.ahead", 1), 0);
+	}
+
+	return NULL;
+}
+
+/*
+ * test_populate_toggle -- starts and stops the populator from many threads
+ */
+static void
+test_populate_toggle(PMEMobjpool *pop)
+{
+	os_thread_t threads[TOGGLE_THREADS];
+
+	for (int i = 0; i < TOGGLE_THREADS; ++i)
+		THREAD_CREATE(&threads[i], NULL, toggle_worker, pop);
+
+	for (int i = 0; i < TOGGLE_THREADS; ++i)
+		THREAD_JOIN(&threads[i], NULL);
+
+	UT_ASSERTeq(get_val(pop, "heap.populate.ahead"), 1);
+	UT_ASSERTeq(set_val(pop, "heap.populate.ahead", 0), 0);
+}
+
+/*
+ * test_populate_at_open -- checks that all the zones are populated when the
+ *	pool is opened
+ */
+static void
+test_populate_at_open(const char *path)
+{
+	int at_open;
+	int ret = pmemobj_ctl_get(NULL, "heap.populate.at_open", &at_open);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTeq(at_open, 0);
+
+	PMEMobjpool *pop;
+	if ((pop = pmemobj_open(path, LAYOUT_NAME)) == NULL)
+		UT_FATAL("!pmemobj_open: %s", path);
+
+	UT_ASSERTeq(get_val(pop, "heap.populate.zones"), 0);
+	pmemobj_close(pop);
+
+	at_open = 1;
+	ret = pmemobj_ctl_set(NULL, "heap.populate.at_open", &at_open);
+	UT_ASSERTeq(ret, 0);
+
+	if ((pop = pmemobj_open(path, LAYOUT_NAME)) == NULL)
+		UT_FATAL("!pmemobj_open: %s", path);
+
+	ssize_t nzones = get_val(pop, "heap.populate.zones");
+	UT_ASSERT(nzones > 3);
+
+	/* the populator has nothing to do in a fully populated heap */
+	UT_ASSERTeq(set_val(pop, "heap.populate.ahead", 1), 0);
+	UT_ASSERTeq(get_val(pop, "heap.populate.zones"), nzones);
+
+	test_populate_toggle(pop);
+
+	/* the object freed at the end of the create test */
+	ret = pmemobj_alloc(pop, NULL, ALLOC_SIZE, 0, NULL, NULL);
+	UT_ASSERTeq(ret, 0);
+
+	ret = pmemobj_alloc(pop, NULL, ALLOC_SIZE, 0, NULL, NULL);
+	UT_ASSERTne(ret, 0);
+
+	pmemobj_close(pop);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_heap_populate");
+
+	if (argc != 3)
+		UT_FATAL("usage: %s file-name c|o", argv[0]);
+
+	const char *path = argv[1];
+
+	switch (argv[2][0]) {
+	case 'c':
+		test_populate_ahead(path);
+		break;
+	case 'o':
+		test_populate_at_open(path);
+		break;
+	default:
+		UT_FATAL("invalid operation %s", argv[2]);
+	}
+
+	DONE(NULL);
+}
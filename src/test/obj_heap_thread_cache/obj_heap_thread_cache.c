@@ -0,0 +1,230 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * obj_heap_thread_cache.c -- test for the thread caches of the allocator
+ *
+ * The blocks kept in the caches of the threads must be given back to the
+ * heap when the threads exit, when the caches are flushed or disabled and
+ * when the pool is closed, so that the number of objects which fit into
+ * the pool doesn't depend on the caches.
+ */
+
+#include "os_thread.h"
+#include "unittest.h"
+
+#define LAYOUT "obj_heap_thread_cache"
+#define POOL_SIZE PMEMOBJ_MIN_POOL
+#define OBJ_SIZE 128
+#define THREADS 16
+#define THREAD_OBJS 100
+#define CACHE_BATCH 64
+#define TYPE_NUM 1
+
+static PMEMobjpool *pop;
+
+/*
+ * set_val -- writes the per-pool ctl entry
+ */
+static int
+set_val(const char *name, ssize_t val)
+{
+	return pmemobj_ctl_set(pop, name, &val);
+}
+
+/*
+ * get_val -- reads the per-pool ctl entry
+ */
+static ssize_t
+get_val(const char *name)
+{
+	ssize_t val;
+	int ret = pmemobj_ctl_get(pop, name, &val);
+	UT_ASSERTeq(ret, 0);
+
+	return val;
+}
+
+/*
+ * alloc_all -- allocates objects until the pool is full, returns the number
+ *	of the objects and frees them
+ */
+static unsigned
+alloc_all(void)
+{
+	unsigned n = 0;
+	PMEMoid oid;
+	while (pmemobj_alloc(pop, &oid, OBJ_SIZE, TYPE_NUM, NULL, NULL) == 0)
+		n++;
+
+	PMEMoid next;
+	POBJ_FOREACH_SAFE(pop, oid, next)
+		pmemobj_free(&oid);
+
+	return n;
+}
+
+/*
+ * worker -- allocates and fills its objects, verifies that no other thread
+ *	got the same memory, frees the objects and exits with the blocks
+ *	still in its cache
+ */
+static void *
+worker(void *arg)
+{
+	unsigned char pattern = (unsigned char)(uintptr_t)arg;
+	PMEMoid oids[THREAD_OBJS];
+
+	for (int i = 0; i < THREAD_OBJS; ++i) {
+		int ret = pmemobj_alloc(pop, &oids[i], OBJ_SIZE, 0, NULL, NULL);
+		UT_ASSERTeq(ret, 0);
+		pmemobj_memset_persist(pop, pmemobj_direct(oids[i]), pattern,
+			OBJ_SIZE);
+	}
+
+	for (int i = 0; i < THREAD_OBJS; ++i) {
+		unsigned char *buf = pmemobj_direct(oids[i]);
+		for (int j = 0; j < OBJ_SIZE; ++j)
+			UT_ASSERTeq(buf[j], pattern);
+
+		/* only half of the objects are freed */
+		if (i % 2 == 0)
+			pmemobj_free(&oids[i]);
+	}
+
+	for (int i = 1; i < THREAD_OBJS; i += 2)
+		pmemobj_free(&oids[i]);
+
+	/* keeps some blocks in the cache */
+	int ret = pmemobj_alloc(pop, NULL, OBJ_SIZE, TYPE_NUM, NULL, NULL);
+	UT_ASSERTeq(ret, 0);
+
+	return NULL;
+}
+
+/*
+ * constr_fail -- constructor which cancels the allocation
+ */
+static int
+constr_fail(PMEMobjpool *pop, void *ptr, void *arg)
+{
+	return -1;
+}
+
+/*
+ * test_ctl -- checks the values of the ctl entries
+ */
+static void
+test_ctl(void)
+{
+	UT_ASSERTeq(get_val("heap.thread_cache.batch"), 0);
+	UT_ASSERTeq(get_val("heap.thread_cache.max_size"), 1024);
+
+	UT_ASSERTne(set_val("heap.thread_cache.batch", -1), 0);
+	UT_ASSERTeq(errno, EINVAL);
+	UT_ASSERTne(set_val("heap.thread_cache.batch", 1 << 16), 0);
+	UT_ASSERTeq(errno, EINVAL);
+	UT_ASSERTne(set_val("heap.thread_cache.max_size", -1), 0);
+	UT_ASSERTeq(errno, EINVAL);
+
+	UT_ASSERTeq(set_val("heap.thread_cache.max_size", 256), 0);
+	UT_ASSERTeq(get_val("heap.thread_cache.max_size"), 256);
+
+	UT_ASSERTeq(set_val("heap.thread_cache.batch", CACHE_BATCH), 0);
+	UT_ASSERTeq(get_val("heap.thread_cache.batch"), CACHE_BATCH);
+}
+
+/*
+ * test_thread_cache -- checks that the cached blocks are not lost
+ */
+static void
+test_thread_cache(void)
+{
+	/* the number of objects without the caches */
+	unsigned nobjs = alloc_all();
+	UT_ASSERT(nobjs > THREADS * THREAD_OBJS);
+
+	test_ctl();
+
+	/* the caches of the exiting threads are flushed */
+	os_thread_t threads[THREADS];
+	for (uintptr_t i = 0; i < THREADS; ++i)
+		THREAD_CREATE(&threads[i], NULL, worker, (void *)(i + 1));
+
+	for (int i = 0; i < THREADS; ++i)
+		THREAD_JOIN(&threads[i], NULL);
+
+	unsigned n = 0;
+	PMEMoid oid;
+	POBJ_FOREACH(pop, oid)
+		n++;
+	UT_ASSERTeq(n, THREADS);
+
+	/* the objects of the threads are still there */
+	n = alloc_all();
+	UT_ASSERTeq(n, nobjs - THREADS);
+
+	/* a failed construction puts the block back into the cache */
+	int ret = pmemobj_alloc(pop, NULL, OBJ_SIZE, 0, constr_fail, NULL);
+	UT_ASSERTne(ret, 0);
+	UT_ASSERTeq(errno, ECANCELED);
+
+	ret = pmemobj_alloc(pop, NULL, OBJ_SIZE, TYPE_NUM, NULL, NULL);
+	UT_ASSERTeq(ret, 0);
+
+	ret = pmemobj_ctl_exec(pop, "heap.thread_cache.flush", NULL);
+	UT_ASSERTeq(ret, 0);
+
+	n = alloc_all();
+	UT_ASSERTeq(n, nobjs - 1);
+
+	/* disabling the caches gives the cached blocks back */
+	ret = pmemobj_alloc(pop, NULL, OBJ_SIZE, TYPE_NUM, NULL, NULL);
+	UT_ASSERTeq(ret, 0);
+
+	UT_ASSERTeq(set_val("heap.thread_cache.batch", 0), 0);
+
+	n = alloc_all();
+	UT_ASSERTeq(n, nobjs - 1);
+
+	/* the pool is closed with the blocks in the cache */
+	UT_ASSERTeq(set_val("heap.thread_cache.batch", CACHE_BATCH), 0);
+	ret = pmemobj_alloc(pop, NULL, OBJ_SIZE, TYPE_NUM, NULL, NULL);
+	UT_ASSERTeq(ret, 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_heap_thread_cache");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	pop = pmemobj_create(path, LAYOUT, POOL_SIZE, S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	test_thread_cache();
+
+	pmemobj_close(pop);
+
+	int ret = pmemobj_check(path, LAYOUT);
+	UT_ASSERTeq(ret, 1);
+
+	pop = pmemobj_open(path, LAYOUT);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", path);
+
+	unsigned nobjs = 0;
+	PMEMoid oid;
+	POBJ_FOREACH(pop, oid)
+		nobjs++;
+	UT_ASSERTeq(nobjs, 1);
+
+	pmemobj_close(pop);
+
+	DONE(NULL);
+}
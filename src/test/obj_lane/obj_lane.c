@@ -127,6 +127,8 @@ test_lane_hold_release(void)
 	pop->p.lanes_desc.runtime_nlanes = 1,
 	pop->p.lanes_desc.lane = &mock_lane;
 	pop->p.lanes_desc.next_lane_idx = 0;
+	pop->p.lanes_desc.ncpus = 1;
+	pop->p.lanes_desc.nwaiters = 0;
 
 	pop->p.lanes_desc.lane_locks = CALLOC(OBJ_NLANES, sizeof(uint64_t));
 	pop->p.lanes_offset = (uint64_t)&pop->l - (uint64_t)&pop->p;
@@ -266,6 +268,80 @@ test_lane_cleanup_in_separate_thread(void)
 	FREE(pop);
 }
 
+#define CONTENTION_LANES 2
+#define CONTENTION_THREADS 8
+#define CONTENTION_OPS 2000
+
+static unsigned Lane_holders[MAX_MOCK_LANES];
+
+/*
+ * lane_contention_thread -- holds and releases lanes, checking that no lane
+ *	is ever held by two threads at the same time
+ */
+static void *
+lane_contention_thread(void *arg)
+{
+	PMEMobjpool *pop = arg;
+
+	for (int i = 0; i < CONTENTION_OPS; ++i) {
+		unsigned idx = lane_hold(pop, NULL);
+		UT_ASSERT(idx < CONTENTION_LANES);
+		UT_ASSERTeq(util_fetch_and_add32(&Lane_holders[idx], 1), 0);
+		UT_ASSERTeq(util_fetch_and_sub32(&Lane_holders[idx], 1), 1);
+		lane_release(pop);
+	}
+
+	return NULL;
+}
+
+/*
+ * test_lane_hold_contention -- more threads than lanes, the threads have to
+ *	wait for the lanes to be released
+ */
+static void
+test_lane_hold_contention(void)
+{
+	struct mock_pop *pop = MALLOC(sizeof(struct mock_pop));
+	pop->p.nlanes = MAX_MOCK_LANES;
+
+	pop->p.p_ops.base = pop;
+	pop->p.p_ops.flush = mock_flush;
+	pop->p.p_ops.memset = mock_memset;
+	pop->p.p_ops.drain = mock_drain;
+	pop->p.p_ops.persist = mock_persist;
+
+	struct stats stats;
+	stats.enabled = POBJ_STATS_DISABLED;
+	pop->p.stats = &stats;
+	pop->p.uuid_lo = 123456;
+
+	base_ptr = &pop->p;
+
+	pop->p.lanes_offset = (uint64_t)&pop->l - (uint64_t)&pop->p;
+
+	lane_init_data(&pop->p);
+	lane_info_boot();
+	UT_ASSERTeq(lane_boot(&pop->p), 0);
+	pop->p.lanes_desc.runtime_nlanes = CONTENTION_LANES;
+
+	os_thread_t threads[CONTENTION_THREADS];
+	for (int i = 0; i < CONTENTION_THREADS; ++i)
+		THREAD_CREATE(&threads[i], NULL, lane_contention_thread,
+			&pop->p);
+
+	for (int i = 0; i < CONTENTION_THREADS; ++i)
+		THREAD_JOIN(&threads[i], NULL);
+
+	for (int i = 0; i < CONTENTION_LANES; ++i)
+		UT_ASSERTeq(pop->p.lanes_desc.lane_locks[i], 0);
+	UT_ASSERTeq(pop->p.lanes_desc.nwaiters, 0);
+
+	lane_cleanup(&pop->p);
+	lane_info_destroy();
+
+	FREE(pop);
+}
+
 static void
 test_fault_injection()
 {
@@ -306,6 +382,7 @@ main(int argc, char *argv[])
 		/* multithreaded scenarios */
 		test_lane_info_destroy_in_separate_thread();
 		test_lane_cleanup_in_separate_thread();
+		test_lane_hold_contention();
 		break;
 	case 'f':
 		/* fault injection */
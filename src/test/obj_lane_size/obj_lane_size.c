@@ -0,0 +1,229 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * obj_lane_size.c -- unit test for the lane.redo_size and lane.undo_size
+ *	ctl entries
+ */
+#include <string.h>
+
+#include "unittest.h"
+
+#define LAYOUT_NAME "lane_size"
+
+#define DEFAULT_REDO_SIZE	640
+#define DEFAULT_UNDO_SIZE	2048
+
+#define REDO_SIZE	(8 * 1024)
+#define UNDO_SIZE	(24 * 1024)
+
+#define POOL_SIZE	(64 * 1024 * 1024) /* fits 1024 enlarged lanes */
+
+#define SNAPSHOT_SIZE	(16 * 1024) /* does not fit in the default undo log */
+#define NALLOCS		50 /* do not fit in the default redo log */
+
+#define OLD_VALUE	0x11
+#define NEW_VALUE	0x22
+
+/*
+ * set_sizes -- sets the capacities of the lane logs of new pools
+ */
+static int
+set_sizes(long long redo_size, long long undo_size)
+{
+	int ret = pmemobj_ctl_set(NULL, "lane.redo_size", &redo_size);
+	if (ret != 0)
+		return ret;
+
+	return pmemobj_ctl_set(NULL, "lane.undo_size", &undo_size);
+}
+
+/*
+ * check_sizes -- verifies the capacities of the lane logs of new pools
+ */
+static void
+check_sizes(long long redo_size, long long undo_size)
+{
+	long long size;
+	int ret = pmemobj_ctl_get(NULL, "lane.redo_size", &size);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTeq(size, redo_size);
+
+	ret = pmemobj_ctl_get(NULL, "lane.undo_size", &size);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTeq(size, undo_size);
+}
+
+/*
+ * get_log_extend -- returns the number of the lane log extensions
+ */
+static uint64_t
+get_log_extend(PMEMobjpool *pop)
+{
+	uint64_t value;
+	int ret = pmemobj_ctl_get(pop, "stats.tx.log_extend", &value);
+	UT_ASSERTeq(ret, 0);
+
+	return value;
+}
+
+/*
+ * enable_stats -- enables the transient statistics of the pool
+ */
+static void
+enable_stats(PMEMobjpool *pop)
+{
+	int enabled = 1;
+	int ret = pmemobj_ctl_set(pop, "stats.enabled", &enabled);
+	UT_ASSERTeq(ret, 0);
+}
+
+/*
+ * test_invalid -- invalid capacities are rejected
+ */
+static void
+test_invalid(void)
+{
+	check_sizes(DEFAULT_REDO_SIZE, DEFAULT_UNDO_SIZE);
+
+	/* smaller than the default */
+	UT_ASSERTeq(set_sizes(DEFAULT_REDO_SIZE - 64, DEFAULT_UNDO_SIZE), -1);
+	UT_ASSERTeq(errno, EINVAL);
+	UT_ASSERTeq(set_sizes(DEFAULT_REDO_SIZE, DEFAULT_UNDO_SIZE - 64), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* not a multiple of the cache line size */
+	UT_ASSERTeq(set_sizes(REDO_SIZE + 1, DEFAULT_UNDO_SIZE), -1);
+	UT_ASSERTeq(errno, EINVAL);
+	UT_ASSERTeq(set_sizes(DEFAULT_REDO_SIZE, UNDO_SIZE + 8), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* too big */
+	UT_ASSERTeq(set_sizes(2 << 20, DEFAULT_UNDO_SIZE), -1);
+	UT_ASSERTeq(errno, EINVAL);
+	UT_ASSERTeq(set_sizes(DEFAULT_REDO_SIZE, -1), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	check_sizes(DEFAULT_REDO_SIZE, DEFAULT_UNDO_SIZE);
+}
+
+/*
+ * do_big_tx -- performs a transaction which snapshots and allocates more than
+ *	fits in the default lane logs
+ */
+static void
+do_big_tx(PMEMobjpool *pop, unsigned char *obj, int abort)
+{
+	TX_BEGIN(pop) {
+		pmemobj_tx_add_range_direct(obj, SNAPSHOT_SIZE);
+		memset(obj, NEW_VALUE, SNAPSHOT_SIZE);
+
+		for (int i = 0; i < NALLOCS; ++i)
+			pmemobj_tx_alloc(64, 1);
+
+		if (abort)
+			pmemobj_tx_abort(ECANCELED);
+	} TX_ONABORT {
+		UT_ASSERT(abort);
+	} TX_ONCOMMIT {
+		UT_ASSERT(!abort);
+	} TX_END
+
+	unsigned char value = abort ? OLD_VALUE : NEW_VALUE;
+	for (size_t i = 0; i < SNAPSHOT_SIZE; ++i)
+		UT_ASSERTeq(obj[i], value);
+}
+
+/*
+ * test_big_lanes -- transactions which fit in the enlarged logs do not extend
+ *	them, the capacities of the logs are persistent
+ */
+static void
+test_big_lanes(const char *path)
+{
+	UT_ASSERTeq(set_sizes(REDO_SIZE, UNDO_SIZE), 0);
+	check_sizes(REDO_SIZE, UNDO_SIZE);
+
+	PMEMobjpool *pop = pmemobj_create(path, LAYOUT_NAME,
+		POOL_SIZE, S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	/* the values only affect the pools created afterwards */
+	UT_ASSERTeq(set_sizes(DEFAULT_REDO_SIZE, DEFAULT_UNDO_SIZE), 0);
+
+	enable_stats(pop);
+
+	PMEMoid oid;
+	int ret = pmemobj_alloc(pop, &oid, SNAPSHOT_SIZE, 0, NULL, NULL);
+	UT_ASSERTeq(ret, 0);
+	unsigned char *obj = pmemobj_direct(oid);
+	pmemobj_memset_persist(pop, obj, OLD_VALUE, SNAPSHOT_SIZE);
+
+	do_big_tx(pop, obj, 1);
+	do_big_tx(pop, obj, 0);
+	UT_ASSERTeq(get_log_extend(pop), 0);
+
+	pmemobj_close(pop);
+
+	ret = pmemobj_check(path, LAYOUT_NAME);
+	UT_ASSERTeq(ret, 1);
+
+	pop = pmemobj_open(path, LAYOUT_NAME);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", path);
+
+	enable_stats(pop);
+
+	obj = pmemobj_direct(oid);
+	pmemobj_memset_persist(pop, obj, OLD_VALUE, SNAPSHOT_SIZE);
+
+	do_big_tx(pop, obj, 1);
+	do_big_tx(pop, obj, 0);
+	UT_ASSERTeq(get_log_extend(pop), 0);
+
+	pmemobj_close(pop);
+}
+
+/*
+ * test_default_lanes -- the same transactions extend the default logs
+ */
+static void
+test_default_lanes(const char *path)
+{
+	check_sizes(DEFAULT_REDO_SIZE, DEFAULT_UNDO_SIZE);
+
+	PMEMobjpool *pop = pmemobj_create(path, LAYOUT_NAME,
+		POOL_SIZE, S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	enable_stats(pop);
+
+	PMEMoid oid;
+	int ret = pmemobj_alloc(pop, &oid, SNAPSHOT_SIZE, 0, NULL, NULL);
+	UT_ASSERTeq(ret, 0);
+	unsigned char *obj = pmemobj_direct(oid);
+	pmemobj_memset_persist(pop, obj, OLD_VALUE, SNAPSHOT_SIZE);
+
+	do_big_tx(pop, obj, 1);
+	do_big_tx(pop, obj, 0);
+	UT_ASSERTne(get_log_extend(pop), 0);
+
+	pmemobj_close(pop);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_lane_size");
+
+	if (argc != 3)
+		UT_FATAL("usage: %s file-big file-default", argv[0]);
+
+	test_invalid();
+	test_big_lanes(argv[1]);
+	test_default_lanes(argv[2]);
+
+	DONE(NULL);
+}
@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2015-2020, Intel Corporation */
+/* Copyright 2015-2021, Intel Corporation */
 
 /*
  * obj_pmalloc_mt.c -- multithreaded test of allocator
@@ -17,6 +17,7 @@
 #define ALLOC_SIZE 104
 #define REALLOC_SIZE (ALLOC_SIZE * 3)
 #define MIX_RERUNS 2
+#define FREE_INTERLEAVED_RERUNS 5
 
 #define CHUNKSIZE (1 << 18)
 #define CHUNKS_PER_THREAD 3
@@ -286,6 +287,20 @@ action_mix_worker(void *arg)
 	return NULL;
 }
 
+/*
+ * objects_count -- returns the number of allocated objects in the pool
+ */
+static unsigned
+objects_count(PMEMobjpool *pop)
+{
+	unsigned n = 0;
+	for (PMEMoid oid = pmemobj_first(pop); !OID_IS_NULL(oid);
+			oid = pmemobj_next(oid))
+		n++;
+
+	return n;
+}
+
 static void
 actions_clear(PMEMobjpool *pop, struct root *r)
 {
@@ -314,6 +329,34 @@ run_worker(void *(worker_func)(void *arg), struct worker_args args[])
 		THREAD_JOIN(&t[i], NULL);
 }
 
+/*
+ * free_interleaved -- frees from all the threads at once the blocks which
+ *	were allocated one after another, so that the neighbouring blocks of
+ *	the same runs are freed concurrently by different threads
+ */
+static void
+free_interleaved(PMEMobjpool *pop, struct root *r, struct worker_args args[])
+{
+	unsigned nobjs = objects_count(pop);
+
+	/* the frees race only for a moment, so give them more chances */
+	for (unsigned j = 0; j < FREE_INTERLEAVED_RERUNS; ++j) {
+		for (unsigned i = 0; i < Ops_per_thread; ++i) {
+			for (unsigned t = 0; t < Threads; ++t) {
+				pmalloc(pop, &r->offs[t][i], ALLOC_SIZE, 0, 0);
+				UT_ASSERTne(r->offs[t][i], 0);
+			}
+		}
+		UT_ASSERTeq(objects_count(pop),
+			nobjs + Threads * Ops_per_thread);
+
+		run_worker(free_worker, args);
+
+		/* none of the bitmap updates can be lost */
+		UT_ASSERTeq(objects_count(pop), nobjs);
+	}
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -371,6 +414,7 @@ main(int argc, char *argv[])
 	run_worker(realloc_worker, args);
 	run_worker(free_worker, args);
 	run_worker(mix_worker, args);
+	free_interleaved(pop, r, args);
 	run_worker(alloc_free_worker, args);
 	run_worker(action_cancel_worker, args);
 	actions_clear(pop, r);
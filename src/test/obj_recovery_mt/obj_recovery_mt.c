@@ -0,0 +1,223 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * obj_recovery_mt.c -- test for the parallel recovery of a pool
+ *
+ * The pool is left with many transactions interrupted at the same time,
+ * each in a different lane, or with a single one which snapshotted a large
+ * object, and then it is opened with the given number of recovery threads.
+ */
+
+#include "sys_util.h"
+#include "unittest.h"
+
+#define THREADS 32
+#define SNAPSHOT_SIZE 8192 /* bigger than the lane undo log */
+#define LARGE_SIZE (1 << 20) /* requires many undo log extensions */
+#define ORIG_VALUE 0x5a
+#define CRASH_VALUE 0xa5
+#define TYPE_DATA 1
+#define TYPE_ALLOC 2
+
+struct data {
+	unsigned char buf[SNAPSHOT_SIZE];
+};
+
+struct root {
+	PMEMoid data[THREADS];
+	PMEMoid large;
+};
+
+static PMEMobjpool *pop;
+static struct root *rootp;
+
+static os_mutex_t lock;
+static os_cond_t cond;
+static unsigned ready;
+
+/*
+ * crash_worker -- modifies its object in a transaction which is never
+ *	committed
+ */
+static void *
+crash_worker(void *arg)
+{
+	int idx = (int)(uintptr_t)arg;
+	PMEMoid oid = rootp->data[idx];
+	struct data *d = pmemobj_direct(oid);
+
+	TX_BEGIN(pop) {
+		pmemobj_tx_add_range(oid, 0, sizeof(struct data));
+		memset(d->buf, CRASH_VALUE, sizeof(d->buf));
+		pmemobj_persist(pop, d->buf, sizeof(d->buf));
+
+		if (idx == 0) {
+			pmemobj_tx_add_range(rootp->large, 0, LARGE_SIZE);
+			pmemobj_memset_persist(pop,
+				pmemobj_direct(rootp->large), CRASH_VALUE,
+				LARGE_SIZE);
+		}
+
+		pmemobj_tx_zalloc(64, TYPE_ALLOC);
+
+		util_mutex_lock(&lock);
+		ready++;
+		os_cond_broadcast(&cond);
+
+		/* the process exits while the transaction is in progress */
+		while (1)
+			os_cond_wait(&cond, &lock);
+	} TX_END
+
+	return NULL;
+}
+
+/*
+ * do_crash -- creates the pool and exits with the transactions of the given
+ *	number of threads in progress
+ */
+static void
+do_crash(const char *path, int nworkers)
+{
+	pop = pmemobj_create(path, "obj_recovery_mt",
+		PMEMOBJ_MIN_POOL * 4, S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	rootp = pmemobj_direct(pmemobj_root(pop, sizeof(struct root)));
+
+	for (int i = 0; i < THREADS; ++i) {
+		int ret = pmemobj_alloc(pop, &rootp->data[i],
+			sizeof(struct data), TYPE_DATA, NULL, NULL);
+		UT_ASSERTeq(ret, 0);
+
+		struct data *d = pmemobj_direct(rootp->data[i]);
+		pmemobj_memset_persist(pop, d->buf, ORIG_VALUE,
+			sizeof(d->buf));
+	}
+
+	int ret = pmemobj_alloc(pop, &rootp->large, LARGE_SIZE, TYPE_DATA,
+		NULL, NULL);
+	UT_ASSERTeq(ret, 0);
+	pmemobj_memset_persist(pop, pmemobj_direct(rootp->large), ORIG_VALUE,
+		LARGE_SIZE);
+
+	pmemobj_persist(pop, rootp, sizeof(*rootp));
+
+	util_mutex_init(&lock);
+	util_cond_init(&cond);
+
+	os_thread_t threads[THREADS];
+	for (int i = 0; i < nworkers; ++i)
+		THREAD_CREATE(&threads[i], NULL, crash_worker,
+			(void *)(uintptr_t)i);
+
+	util_mutex_lock(&lock);
+	while (ready != (unsigned)nworkers)
+		os_cond_wait(&cond, &lock);
+	util_mutex_unlock(&lock);
+
+	exit(0); /* simulate a crash */
+}
+
+/*
+ * do_recover -- opens the pool with the given number of recovery threads and
+ *	verifies that all the transactions were rolled back
+ */
+static void
+do_recover(const char *path, int nthreads)
+{
+	int ret = pmemobj_ctl_set(NULL, "recovery.nthreads", &nthreads);
+	UT_ASSERTeq(ret, 0);
+
+	int value;
+	ret = pmemobj_ctl_get(NULL, "recovery.nthreads", &value);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTeq(value, nthreads);
+
+	pop = pmemobj_open(path, "obj_recovery_mt");
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", path);
+
+	rootp = pmemobj_direct(pmemobj_root(pop, sizeof(struct root)));
+
+	for (int i = 0; i < THREADS; ++i) {
+		struct data *d = pmemobj_direct(rootp->data[i]);
+		for (size_t j = 0; j < sizeof(d->buf); ++j)
+			UT_ASSERTeq(d->buf[j], ORIG_VALUE);
+	}
+
+	unsigned char *large = pmemobj_direct(rootp->large);
+	for (size_t j = 0; j < LARGE_SIZE; ++j)
+		UT_ASSERTeq(large[j], ORIG_VALUE);
+
+	PMEMoid oid;
+	int nalloc = 0;
+	POBJ_FOREACH(pop, oid) {
+		UT_ASSERTne(pmemobj_type_num(oid), TYPE_ALLOC);
+		nalloc++;
+	}
+	UT_ASSERTeq(nalloc, THREADS + 1);
+
+	uint64_t ns;
+	ret = pmemobj_ctl_get(pop, "stats.recovery.redo_ns", &ns);
+	UT_ASSERTeq(ret, 0);
+	ret = pmemobj_ctl_get(pop, "stats.recovery.heap_boot_ns", &ns);
+	UT_ASSERTeq(ret, 0);
+	ret = pmemobj_ctl_get(pop, "stats.recovery.undo_ns", &ns);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTne(ns, 0);
+
+	pmemobj_close(pop);
+
+	ret = pmemobj_check(path, "obj_recovery_mt");
+	UT_ASSERTeq(ret, 1);
+}
+
+/*
+ * test_ctl -- checks the invalid values of the number of recovery threads
+ */
+static void
+test_ctl(void)
+{
+	int value = 0;
+	int ret = pmemobj_ctl_set(NULL, "recovery.nthreads", &value);
+	UT_ASSERTeq(ret, -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	value = 257;
+	ret = pmemobj_ctl_set(NULL, "recovery.nthreads", &value);
+	UT_ASSERTeq(ret, -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	ret = pmemobj_ctl_get(NULL, "recovery.nthreads", &value);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTeq(value, 1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_recovery_mt");
+
+	if (argc != 4)
+		UT_FATAL("usage: %s file c|s|o nthreads", argv[0]);
+
+	const char *path = argv[1];
+	int nthreads = atoi(argv[3]);
+
+	if (argv[2][0] == 'c') {
+		do_crash(path, THREADS);
+	} else if (argv[2][0] == 's') {
+		/* a single transaction, for the pools with a single lane */
+		do_crash(path, 1);
+	} else if (argv[2][0] == 'o') {
+		test_ctl();
+		do_recover(path, nthreads);
+	} else {
+		UT_FATAL("invalid mode %s", argv[2]);
+	}
+
+	DONE(NULL);
+}
@@ -0,0 +1,158 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * obj_rep_fanout.c -- tests for the concurrent writes to local replicas
+ */
+
+#include "unittest.h"
+
+#define THREADS 4
+#define LOOPS 50
+#define THRESHOLD 4096
+
+/* a mix of writes below and above the fan-out threshold */
+#define BUF_SIZE (256 * 1024)
+#define SMALL_SIZE 256
+
+struct root {
+	char buf[THREADS][BUF_SIZE];
+	char src[BUF_SIZE];
+};
+
+static PMEMobjpool *pop;
+static struct root *rootp;
+
+/*
+ * writer -- writes to its own buffer with all kinds of the pmemobj primitives
+ */
+static void *
+writer(void *arg)
+{
+	unsigned idx = *(unsigned *)arg;
+	char *buf = rootp->buf[idx];
+
+	for (int i = 0; i < LOOPS; ++i) {
+		pmemobj_memset(pop, buf, i, BUF_SIZE, 0);
+		pmemobj_memset(pop, buf, i + 1, SMALL_SIZE, 0);
+
+		pmemobj_memcpy(pop, buf + SMALL_SIZE, rootp->src,
+			BUF_SIZE - SMALL_SIZE, PMEMOBJ_F_MEM_NONTEMPORAL);
+		pmemobj_memcpy(pop, buf, rootp->src, SMALL_SIZE,
+			PMEMOBJ_F_MEM_NODRAIN);
+		pmemobj_drain(pop);
+
+		memset(buf, (int)idx, BUF_SIZE / 2);
+		pmemobj_persist(pop, buf, BUF_SIZE / 2);
+
+		memset(buf + BUF_SIZE / 2, i, BUF_SIZE / 2);
+		pmemobj_flush(pop, buf + BUF_SIZE / 2, BUF_SIZE / 2);
+		pmemobj_drain(pop);
+	}
+
+	return NULL;
+}
+
+/*
+ * check_buf -- verifies the contents of the buffer written by the writer
+ */
+static void
+check_buf(unsigned idx)
+{
+	char *buf = rootp->buf[idx];
+
+	for (size_t i = 0; i < BUF_SIZE / 2; ++i)
+		UT_ASSERTeq(buf[i], (char)idx);
+
+	for (size_t i = BUF_SIZE / 2; i < BUF_SIZE; ++i)
+		UT_ASSERTeq(buf[i], (char)(LOOPS - 1));
+}
+
+/*
+ * check_pool -- verifies the contents of the pool
+ */
+static void
+check_pool(const char *path)
+{
+	pop = pmemobj_open(path, "rep_fanout");
+	UT_ASSERTne(pop, NULL);
+
+	rootp = pmemobj_direct(pmemobj_root(pop, sizeof(struct root)));
+	for (unsigned i = 0; i < THREADS; ++i)
+		check_buf(i);
+
+	pmemobj_close(pop);
+
+	int ret = pmemobj_check(path, "rep_fanout");
+	UT_ASSERTeq(ret, 1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_rep_fanout");
+
+	if (argc != 3 || strchr("wr", argv[1][0]) == NULL)
+		UT_FATAL("usage: %s w|r file-name", argv[0]);
+
+	const char *path = argv[2];
+
+	if (argv[1][0] == 'r') {
+		/* only verify the data recovered from one of the replicas */
+		check_pool(path);
+		DONE(NULL);
+	}
+
+	if ((pop = pmemobj_create(path, "rep_fanout", 0,
+			S_IWUSR | S_IRUSR)) == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	rootp = pmemobj_direct(pmemobj_root(pop, sizeof(struct root)));
+	UT_ASSERTne(rootp, NULL);
+
+	for (size_t i = 0; i < BUF_SIZE; ++i)
+		rootp->src[i] = (char)i;
+	pmemobj_persist(pop, rootp->src, BUF_SIZE);
+
+	ssize_t threshold;
+	int ret = pmemobj_ctl_get(pop, "replica.fanout.threshold", &threshold);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTeq(threshold, 0);
+
+	threshold = -1;
+	ret = pmemobj_ctl_set(pop, "replica.fanout.threshold", &threshold);
+	UT_ASSERTeq(ret, -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	threshold = THRESHOLD;
+	ret = pmemobj_ctl_set(pop, "replica.fanout.threshold", &threshold);
+	UT_ASSERTeq(ret, 0);
+
+	ret = pmemobj_ctl_get(pop, "replica.fanout.threshold", &threshold);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTeq(threshold, THRESHOLD);
+
+	os_thread_t threads[THREADS];
+	unsigned idx[THREADS];
+
+	for (unsigned i = 0; i < THREADS; ++i) {
+		idx[i] = i;
+		THREAD_CREATE(&threads[i], NULL, writer, &idx[i]);
+	}
+
+	for (unsigned i = 0; i < THREADS; ++i)
+		THREAD_JOIN(&threads[i], NULL);
+
+	/* the fan-out can be disabled at any point */
+	threshold = 0;
+	ret = pmemobj_ctl_set(pop, "replica.fanout.threshold", &threshold);
+	UT_ASSERTeq(ret, 0);
+
+	writer(&idx[0]);
+
+	pmemobj_close(pop);
+
+	check_pool(path);
+
+	DONE(NULL);
+}
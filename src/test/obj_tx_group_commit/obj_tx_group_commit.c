@@ -0,0 +1,174 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * obj_tx_group_commit.c -- tests for the transaction group commit
+ */
+
+#include "unittest.h"
+
+#define THREADS 16
+#define LOOPS 200
+
+struct root {
+	PMEMoid objs[THREADS];
+	uint64_t counters[THREADS];
+};
+
+static PMEMobjpool *pop;
+
+/*
+ * tx_worker -- replaces the object in its slot and bumps its counter in
+ *	every transaction, so that each commit has a non-trivial redo log
+ */
+static void *
+tx_worker(void *arg)
+{
+	unsigned idx = *(unsigned *)arg;
+	struct root *rootp = pmemobj_direct(pmemobj_root(pop,
+		sizeof(struct root)));
+
+	for (int i = 0; i < LOOPS; ++i) {
+		TX_BEGIN(pop) {
+			pmemobj_tx_add_range_direct(&rootp->counters[idx],
+				sizeof(uint64_t));
+			rootp->counters[idx]++;
+
+			pmemobj_tx_add_range_direct(&rootp->objs[idx],
+				sizeof(PMEMoid));
+			if (!OID_IS_NULL(rootp->objs[idx]))
+				pmemobj_tx_free(rootp->objs[idx]);
+			rootp->objs[idx] = pmemobj_tx_zalloc(100, 1);
+		} TX_ONABORT {
+			UT_ASSERT(0);
+		} TX_END
+	}
+
+	return NULL;
+}
+
+/*
+ * run_threads -- runs the transactions on all the threads
+ */
+static void
+run_threads(void)
+{
+	os_thread_t threads[THREADS];
+	unsigned idx[THREADS];
+
+	for (unsigned i = 0; i < THREADS; ++i) {
+		idx[i] = i;
+		THREAD_CREATE(&threads[i], NULL, tx_worker, &idx[i]);
+	}
+
+	for (unsigned i = 0; i < THREADS; ++i)
+		THREAD_JOIN(&threads[i], NULL);
+}
+
+/*
+ * count_objects -- returns the number of user objects in the pool
+ */
+static unsigned
+count_objects(void)
+{
+	unsigned n = 0;
+	PMEMoid oid;
+	POBJ_FOREACH(pop, oid)
+		n++;
+
+	return n;
+}
+
+/*
+ * ctl_set_int -- sets the integer ctl value and checks the result
+ */
+static void
+ctl_set_int(const char *name, int value, int result)
+{
+	int ret = pmemobj_ctl_set(pop, name, &value);
+	UT_ASSERTeq(ret, result);
+}
+
+/*
+ * ctl_get_int -- returns the integer ctl value
+ */
+static int
+ctl_get_int(const char *name)
+{
+	int value;
+	int ret = pmemobj_ctl_get(pop, name, &value);
+	UT_ASSERTeq(ret, 0);
+
+	return value;
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_tx_group_commit");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	if ((pop = pmemobj_create(path, "group_commit", PMEMOBJ_MIN_POOL * 4,
+			S_IWUSR | S_IRUSR)) == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	pmemobj_root(pop, sizeof(struct root));
+
+	UT_ASSERTeq(ctl_get_int("tx.group_commit.enabled"), 0);
+	UT_ASSERTeq(ctl_get_int("tx.group_commit.window_us"), 0);
+	UT_ASSERTeq(ctl_get_int("tx.group_commit.max_batch"), 64);
+
+	ctl_set_int("tx.group_commit.window_us", -1, -1);
+	ctl_set_int("tx.group_commit.window_us", 1000001, -1);
+	ctl_set_int("tx.group_commit.max_batch", 0, -1);
+
+	/* natural batching only */
+	ctl_set_int("tx.group_commit.enabled", 1, 0);
+	UT_ASSERTeq(ctl_get_int("tx.group_commit.enabled"), 1);
+	run_threads();
+
+	/* the leader waits for the other commits */
+	ctl_set_int("tx.group_commit.window_us", 50, 0);
+	ctl_set_int("tx.group_commit.max_batch", 4, 0);
+	UT_ASSERTeq(ctl_get_int("tx.group_commit.window_us"), 50);
+	UT_ASSERTeq(ctl_get_int("tx.group_commit.max_batch"), 4);
+	run_threads();
+
+	/* a single thread is never blocked for longer than the window */
+	unsigned idx = 0;
+	tx_worker(&idx);
+
+	ctl_set_int("tx.group_commit.enabled", 0, 0);
+	run_threads();
+
+	UT_ASSERTeq(count_objects(), THREADS);
+
+	pmemobj_close(pop);
+
+	pop = pmemobj_open(path, "group_commit");
+	UT_ASSERTne(pop, NULL);
+
+	/* group commit is a runtime property */
+	UT_ASSERTeq(ctl_get_int("tx.group_commit.enabled"), 0);
+
+	struct root *rootp = pmemobj_direct(pmemobj_root(pop,
+		sizeof(struct root)));
+	for (unsigned i = 0; i < THREADS; ++i) {
+		UT_ASSERT(!OID_IS_NULL(rootp->objs[i]));
+		UT_ASSERTeq(rootp->counters[i],
+			(uint64_t)LOOPS * (i == 0 ? 4 : 3));
+	}
+
+	UT_ASSERTeq(count_objects(), THREADS);
+
+	pmemobj_close(pop);
+
+	int ret = pmemobj_check(path, "group_commit");
+	UT_ASSERTeq(ret, 1);
+
+	DONE(NULL);
+}
@@ -0,0 +1,256 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * obj_tx_post_commit.c -- tests for the asynchronous post commit workers
+ */
+
+#include "sys_util.h"
+#include "unittest.h"
+
+#define THREADS 8
+#define WORKERS 2
+#define LOOPS 100
+
+/* big enough to require an extension of the undo log */
+#define SNAPSHOT_SIZE (16 * 1024)
+
+struct root {
+	PMEMoid objs[THREADS];
+	char buf[THREADS][SNAPSHOT_SIZE];
+};
+
+static PMEMobjpool *pop;
+
+static os_mutex_t lock;
+static os_cond_t cond;
+static int in_tx;
+
+/*
+ * worker -- runs the post commit worker until it's stopped
+ */
+static void *
+worker(void *arg)
+{
+	int ret = pmemobj_ctl_get(pop, "tx.post_commit.worker", pop);
+	UT_ASSERTeq(ret, 0);
+
+	return NULL;
+}
+
+/*
+ * tx_worker -- replaces the object in its slot and snapshots a large buffer
+ *	in every transaction
+ */
+static void *
+tx_worker(void *arg)
+{
+	unsigned idx = *(unsigned *)arg;
+	struct root *rootp = pmemobj_direct(pmemobj_root(pop,
+		sizeof(struct root)));
+
+	for (int i = 0; i < LOOPS; ++i) {
+		TX_BEGIN(pop) {
+			pmemobj_tx_add_range_direct(rootp->buf[idx],
+				SNAPSHOT_SIZE);
+			memset(rootp->buf[idx], i, SNAPSHOT_SIZE);
+
+			pmemobj_tx_add_range_direct(&rootp->objs[idx],
+				sizeof(PMEMoid));
+			if (!OID_IS_NULL(rootp->objs[idx]))
+				pmemobj_tx_free(rootp->objs[idx]);
+			rootp->objs[idx] = pmemobj_tx_zalloc(128, 1);
+		} TX_ONABORT {
+			UT_ASSERT(0);
+		} TX_END
+	}
+
+	return NULL;
+}
+
+/*
+ * tx_holder -- stays inside of a transaction until signaled by the main thread
+ */
+static void *
+tx_holder(void *arg)
+{
+	TX_BEGIN(pop) {
+		util_mutex_lock(&lock);
+		in_tx = 1;
+		os_cond_signal(&cond);
+		while (in_tx)
+			os_cond_wait(&cond, &lock);
+		util_mutex_unlock(&lock);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	return NULL;
+}
+
+/*
+ * set_depth_in_tx -- tries to change the queue depth while another thread is
+ *	in the middle of a transaction
+ */
+static void
+set_depth_in_tx(int depth)
+{
+	os_thread_t holder;
+
+	util_mutex_lock(&lock);
+	THREAD_CREATE(&holder, NULL, tx_holder, NULL);
+	while (!in_tx)
+		os_cond_wait(&cond, &lock);
+	util_mutex_unlock(&lock);
+
+	int ret = pmemobj_ctl_set(pop, "tx.post_commit.queue_depth", &depth);
+	UT_ASSERTeq(ret, -1);
+	UT_ASSERTeq(errno, EBUSY);
+
+	util_mutex_lock(&lock);
+	in_tx = 0;
+	os_cond_signal(&cond);
+	util_mutex_unlock(&lock);
+
+	THREAD_JOIN(&holder, NULL);
+}
+
+/*
+ * count_objects -- returns the number of user objects in the pool
+ */
+static unsigned
+count_objects(void)
+{
+	unsigned n = 0;
+	PMEMoid oid;
+	POBJ_FOREACH(pop, oid)
+		n++;
+
+	return n;
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_tx_post_commit");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	util_mutex_init(&lock);
+	util_cond_init(&cond);
+
+	if ((pop = pmemobj_create(path, "post_commit", PMEMOBJ_MIN_POOL * 4,
+			S_IWUSR | S_IRUSR)) == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	pmemobj_root(pop, sizeof(struct root));
+
+	int depth;
+	int ret = pmemobj_ctl_get(pop, "tx.post_commit.queue_depth", &depth);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTeq(depth, 0);
+
+	ret = pmemobj_ctl_get(pop, "tx.post_commit.worker", pop);
+	UT_ASSERTeq(ret, -1);
+
+	ret = pmemobj_ctl_get(pop, "tx.post_commit.stop", pop);
+	UT_ASSERTeq(ret, -1);
+
+	depth = -1;
+	ret = pmemobj_ctl_set(pop, "tx.post_commit.queue_depth", &depth);
+	UT_ASSERTeq(ret, -1);
+
+	depth = 3;
+	ret = pmemobj_ctl_set(pop, "tx.post_commit.queue_depth", &depth);
+	UT_ASSERTeq(ret, 0);
+
+	ret = pmemobj_ctl_get(pop, "tx.post_commit.queue_depth", &depth);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTeq(depth, 4); /* rounded up to a power of two */
+
+	os_thread_t workers[WORKERS];
+	os_thread_t threads[THREADS];
+	unsigned idx[THREADS];
+
+	for (unsigned i = 0; i < WORKERS; ++i)
+		THREAD_CREATE(&workers[i], NULL, worker, NULL);
+
+	/*
+	 * The queue cannot be replaced under the running workers, it's
+	 * replaced only until the first worker starts.
+	 */
+	do {
+		depth = 4;
+		ret = pmemobj_ctl_set(pop, "tx.post_commit.queue_depth",
+			&depth);
+	} while (ret == 0);
+	UT_ASSERTeq(errno, EBUSY);
+
+	for (unsigned i = 0; i < THREADS; ++i) {
+		idx[i] = i;
+		THREAD_CREATE(&threads[i], NULL, tx_worker, &idx[i]);
+	}
+
+	for (unsigned i = 0; i < THREADS; ++i)
+		THREAD_JOIN(&threads[i], NULL);
+
+	ret = pmemobj_ctl_get(pop, "tx.post_commit.stop", pop);
+	UT_ASSERTeq(ret, 0);
+
+	/* the queue is stopped, commits are finished synchronously */
+	tx_worker(&idx[0]);
+
+	/* waits for the stopped workers to exit */
+	depth = 8;
+	ret = pmemobj_ctl_set(pop, "tx.post_commit.queue_depth", &depth);
+	UT_ASSERTeq(ret, 0);
+
+	for (unsigned i = 0; i < WORKERS; ++i)
+		THREAD_JOIN(&workers[i], NULL);
+
+	ret = pmemobj_ctl_get(pop, "tx.post_commit.queue_depth", &depth);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTeq(depth, 8);
+
+	set_depth_in_tx(16);
+
+	/* without workers the commits are left in the queue until it's full */
+	tx_worker(&idx[1]);
+
+	UT_ASSERTeq(count_objects(), THREADS);
+
+	depth = 0;
+	ret = pmemobj_ctl_set(pop, "tx.post_commit.queue_depth", &depth);
+	UT_ASSERTeq(ret, 0);
+
+	tx_worker(&idx[0]);
+
+	pmemobj_close(pop);
+
+	pop = pmemobj_open(path, "post_commit");
+	UT_ASSERTne(pop, NULL);
+
+	struct root *rootp = pmemobj_direct(pmemobj_root(pop,
+		sizeof(struct root)));
+	for (unsigned i = 0; i < THREADS; ++i) {
+		UT_ASSERT(!OID_IS_NULL(rootp->objs[i]));
+		UT_ASSERTeq(rootp->buf[i][0], (char)(LOOPS - 1));
+		UT_ASSERTeq(rootp->buf[i][SNAPSHOT_SIZE - 1],
+			(char)(LOOPS - 1));
+	}
+
+	UT_ASSERTeq(count_objects(), THREADS);
+
+	pmemobj_close(pop);
+
+	ret = pmemobj_check(path, "post_commit");
+	UT_ASSERTeq(ret, 1);
+
+	util_cond_destroy(&cond);
+	util_mutex_destroy(&lock);
+
+	DONE(NULL);
+}
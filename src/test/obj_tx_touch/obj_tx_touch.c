@@ -0,0 +1,277 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * obj_tx_touch.c -- unit test for pmemobj_tx_touch_range and
+ * pmemobj_tx_touch_range_direct
+ */
+#include <string.h>
+
+#include "unittest.h"
+
+#define LAYOUT_NAME "tx_touch"
+
+#define OBJ_SIZE	4096
+#define FAR_OFF		2048 /* never in the same cache line as offset 0 */
+
+#define OLD_VALUE	0x11
+#define NEW_VALUE	0x22
+
+/*
+ * alloc_obj -- allocates an object filled with OLD_VALUE
+ */
+static unsigned char *
+alloc_obj(PMEMobjpool *pop, PMEMoid *oidp)
+{
+	PMEMoid oid;
+	int ret = pmemobj_alloc(pop, &oid, OBJ_SIZE, 0, NULL, NULL);
+	UT_ASSERTeq(ret, 0);
+
+	unsigned char *obj = pmemobj_direct(oid);
+	pmemobj_memset_persist(pop, obj, OLD_VALUE, OBJ_SIZE);
+
+	if (oidp)
+		*oidp = oid;
+
+	return obj;
+}
+
+/*
+ * check_range -- verifies that the given range is filled with the value
+ */
+static void
+check_range(unsigned char *obj, size_t off, size_t size, unsigned char value)
+{
+	for (size_t i = off; i < off + size; ++i)
+		UT_ASSERTeq(obj[i], value);
+}
+
+/*
+ * test_commit -- modifications of the touched lines are committed
+ */
+static void
+test_commit(PMEMobjpool *pop)
+{
+	unsigned char *obj = alloc_obj(pop, NULL);
+
+	TX_BEGIN(pop) {
+		int ret = pmemobj_tx_xadd_range_direct(obj, OBJ_SIZE,
+			POBJ_XADD_DEFERRED);
+		UT_ASSERTeq(ret, 0);
+
+		ret = pmemobj_tx_touch_range_direct(obj, 16);
+		UT_ASSERTeq(ret, 0);
+		memset(obj, NEW_VALUE, 16);
+
+		ret = pmemobj_tx_touch_range_direct(obj + FAR_OFF, 16);
+		UT_ASSERTeq(ret, 0);
+		memset(obj + FAR_OFF, NEW_VALUE, 16);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	check_range(obj, 0, 16, NEW_VALUE);
+	check_range(obj, 16, FAR_OFF - 16, OLD_VALUE);
+	check_range(obj, FAR_OFF, 16, NEW_VALUE);
+	check_range(obj, FAR_OFF + 16, OBJ_SIZE - FAR_OFF - 16, OLD_VALUE);
+}
+
+/*
+ * test_abort -- only the touched lines are rolled back
+ */
+static void
+test_abort(PMEMobjpool *pop)
+{
+	PMEMoid oid;
+	unsigned char *obj = alloc_obj(pop, &oid);
+
+	TX_BEGIN(pop) {
+		int ret = pmemobj_tx_xadd_range(oid, 0, OBJ_SIZE,
+			POBJ_XADD_DEFERRED);
+		UT_ASSERTeq(ret, 0);
+
+		ret = pmemobj_tx_touch_range(oid, 0, 16);
+		UT_ASSERTeq(ret, 0);
+		memset(obj, NEW_VALUE, 16);
+
+		/* touching the line again must not take a new snapshot */
+		ret = pmemobj_tx_touch_range(oid, 0, 16);
+		UT_ASSERTeq(ret, 0);
+		memset(obj, NEW_VALUE + 1, 16);
+
+		/* the line was never touched, so it's not in the undo log */
+		obj[FAR_OFF] = NEW_VALUE;
+
+		pmemobj_tx_abort(-1);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	check_range(obj, 0, FAR_OFF, OLD_VALUE);
+	UT_ASSERTeq(obj[FAR_OFF], NEW_VALUE);
+	check_range(obj, FAR_OFF + 1, OBJ_SIZE - FAR_OFF - 1, OLD_VALUE);
+}
+
+/*
+ * test_unaligned -- the touched lines are clamped to the deferred range
+ */
+static void
+test_unaligned(PMEMobjpool *pop)
+{
+	unsigned char *obj = alloc_obj(pop, NULL);
+	unsigned char *range = obj + 8;
+
+	TX_BEGIN(pop) {
+		int ret = pmemobj_tx_xadd_range_direct(range, 100,
+			POBJ_XADD_DEFERRED);
+		UT_ASSERTeq(ret, 0);
+
+		ret = pmemobj_tx_touch_range_direct(range, 100);
+		UT_ASSERTeq(ret, 0);
+		memset(range, NEW_VALUE, 100);
+
+		/* same cache lines, but outside of the deferred range */
+		obj[0] = NEW_VALUE;
+		range[100] = NEW_VALUE;
+
+		pmemobj_tx_abort(-1);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(obj[0], NEW_VALUE);
+	check_range(obj, 1, 107, OLD_VALUE);
+	UT_ASSERTeq(range[100], NEW_VALUE);
+}
+
+/*
+ * test_fallback -- touching memory outside of a deferred range snapshots it
+ *	like a regular add range does
+ */
+static void
+test_fallback(PMEMobjpool *pop)
+{
+	unsigned char *obj = alloc_obj(pop, NULL);
+
+	TX_BEGIN(pop) {
+		int ret = pmemobj_tx_xadd_range_direct(obj, 128,
+			POBJ_XADD_DEFERRED);
+		UT_ASSERTeq(ret, 0);
+
+		/* crosses the end of the deferred range */
+		ret = pmemobj_tx_touch_range_direct(obj + 64, 256);
+		UT_ASSERTeq(ret, 0);
+		memset(obj + 64, NEW_VALUE, 256);
+
+		/* not in any deferred range */
+		ret = pmemobj_tx_touch_range_direct(obj + FAR_OFF, 16);
+		UT_ASSERTeq(ret, 0);
+		memset(obj + FAR_OFF, NEW_VALUE, 16);
+
+		pmemobj_tx_abort(-1);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	check_range(obj, 0, OBJ_SIZE, OLD_VALUE);
+}
+
+/*
+ * test_nested -- deferred ranges are shared with the nested transactions and
+ *	dropped when the outermost one ends
+ */
+static void
+test_nested(PMEMobjpool *pop)
+{
+	unsigned char *obj = alloc_obj(pop, NULL);
+
+	TX_BEGIN(pop) {
+		int ret = pmemobj_tx_xadd_range_direct(obj, OBJ_SIZE,
+			POBJ_XADD_DEFERRED);
+		UT_ASSERTeq(ret, 0);
+
+		TX_BEGIN(pop) {
+			ret = pmemobj_tx_touch_range_direct(obj, 16);
+			UT_ASSERTeq(ret, 0);
+			memset(obj, NEW_VALUE, 16);
+		} TX_ONABORT {
+			UT_ASSERT(0);
+		} TX_END
+
+		pmemobj_tx_abort(-1);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	check_range(obj, 0, OBJ_SIZE, OLD_VALUE);
+
+	TX_BEGIN(pop) {
+		/* the range of the previous transaction is gone */
+		int ret = pmemobj_tx_touch_range_direct(obj + FAR_OFF, 16);
+		UT_ASSERTeq(ret, 0);
+		memset(obj + FAR_OFF, NEW_VALUE, 16);
+
+		pmemobj_tx_abort(-1);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	check_range(obj, 0, OBJ_SIZE, OLD_VALUE);
+}
+
+/*
+ * test_many_ranges -- touches lines of more deferred ranges than fit in the
+ *	inline ranges of the transaction
+ */
+static void
+test_many_ranges(PMEMobjpool *pop)
+{
+	unsigned char *obj = alloc_obj(pop, NULL);
+	const size_t step = 256;
+
+	TX_BEGIN(pop) {
+		for (size_t off = 0; off < OBJ_SIZE; off += step) {
+			int ret = pmemobj_tx_xadd_range_direct(obj + off, step,
+				POBJ_XADD_DEFERRED);
+			UT_ASSERTeq(ret, 0);
+		}
+
+		for (size_t off = 0; off < OBJ_SIZE; off += step) {
+			int ret = pmemobj_tx_touch_range_direct(
+				obj + off + step / 2, 1);
+			UT_ASSERTeq(ret, 0);
+			obj[off + step / 2] = NEW_VALUE;
+		}
+
+		pmemobj_tx_abort(-1);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	check_range(obj, 0, OBJ_SIZE, OLD_VALUE);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_tx_touch");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s [file]", argv[0]);
+
+	PMEMobjpool *pop;
+	if ((pop = pmemobj_create(argv[1], LAYOUT_NAME, PMEMOBJ_MIN_POOL,
+			S_IWUSR | S_IRUSR)) == NULL)
+		UT_FATAL("!pmemobj_create");
+
+	test_commit(pop);
+	test_abort(pop);
+	test_unaligned(pop);
+	test_fallback(pop);
+	test_nested(pop);
+	test_many_ranges(pop);
+
+	pmemobj_close(pop);
+
+	DONE(NULL);
+}
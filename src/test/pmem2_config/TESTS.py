@@ -1,6 +1,6 @@
 #!../env.py
 # SPDX-License-Identifier: BSD-3-Clause
-# Copyright 2019-2020, Intel Corporation
+# Copyright 2019-2021, Intel Corporation
 #
 
 
@@ -92,3 +92,8 @@ class TEST12(Pmem2ConfigNoDir):
     setting a invalid protection flags
     """
     test_case = "test_set_invalid_prot_flag"
+
+
+class TEST13(Pmem2ConfigNoDir):
+    """setting the non-temporal store thresholds"""
+    test_case = "test_set_movnt_threshold"
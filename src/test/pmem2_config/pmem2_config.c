@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2019-2020, Intel Corporation */
+/* Copyright 2019-2021, Intel Corporation */
 
 /*
  * pmem_config.c -- pmem2_config unittests
@@ -263,6 +263,39 @@ test_set_invalid_prot_flag(const struct test_case *tc, int argc,
 	return 0;
 }
 
+/*
+ * test_set_movnt_threshold -- set the non-temporal store thresholds
+ */
+static int
+test_set_movnt_threshold(const struct test_case *tc, int argc, char *argv[])
+{
+	struct pmem2_config cfg;
+	pmem2_config_init(&cfg);
+
+	/* check the default values */
+	UT_ASSERT(!cfg.movnt_threshold_set[PMEM2_MOVNT_MEMMOVE]);
+	UT_ASSERT(!cfg.movnt_threshold_set[PMEM2_MOVNT_MEMSET]);
+
+	int ret = pmem2_config_set_movnt_threshold(&cfg, PMEM2_MOVNT_MEMMOVE,
+			0);
+	UT_PMEM2_EXPECT_RETURN(ret, 0);
+	UT_ASSERT(cfg.movnt_threshold_set[PMEM2_MOVNT_MEMMOVE]);
+	UT_ASSERTeq(cfg.movnt_threshold[PMEM2_MOVNT_MEMMOVE], 0);
+	UT_ASSERT(!cfg.movnt_threshold_set[PMEM2_MOVNT_MEMSET]);
+
+	ret = pmem2_config_set_movnt_threshold(&cfg, PMEM2_MOVNT_MEMSET,
+			SIZE_MAX);
+	UT_PMEM2_EXPECT_RETURN(ret, 0);
+	UT_ASSERT(cfg.movnt_threshold_set[PMEM2_MOVNT_MEMSET]);
+	UT_ASSERTeq(cfg.movnt_threshold[PMEM2_MOVNT_MEMSET], SIZE_MAX);
+
+	unsigned invalid_op = 777;
+	ret = pmem2_config_set_movnt_threshold(&cfg, invalid_op, 1024);
+	UT_PMEM2_EXPECT_RETURN(ret, PMEM2_E_INVALID_MOVNT_OP);
+
+	return 0;
+}
+
 /*
  * test_cases -- available test cases
  */
@@ -280,6 +313,7 @@ static struct test_case test_cases[] = {
 	TEST_CASE(test_set_sharing_invalid),
 	TEST_CASE(test_set_valid_prot_flag),
 	TEST_CASE(test_set_invalid_prot_flag),
+	TEST_CASE(test_set_movnt_threshold),
 };
 
 #define NTESTS (sizeof(test_cases) / sizeof(test_cases[0]))
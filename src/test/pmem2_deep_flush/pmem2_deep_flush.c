@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2020, Intel Corporation */
+/* Copyright 2020-2021, Intel Corporation */
 
 /*
  * pmem2_deep_flush.c -- unit test for pmem_deep_flush()
@@ -183,6 +183,19 @@ pmem2_map_find(const void *addr, size_t len)
 	return NULL;
 }
 
+/*
+ * pmem2_map_movnt_threshold -- redefine libpmem2 function, redefinition is
+ * needed for a proper compilation of the test. NOTE: this function is not
+ * used in the test.
+ */
+size_t
+pmem2_map_movnt_threshold(const void *addr, size_t len,
+		enum pmem2_movnt_op op)
+{
+	UT_ASSERT(0);
+	return 0;
+}
+
 /*
  * pmem2_flush_file_buffers_os -- redefine libpmem2 function
  */
@@ -303,3 +303,17 @@ class TES40(PMEM2_INTEGRATION):
 class TEST41(PMEM2_INTEGRATION_DEV_DAXES):
     """compare normal map vs map_from_existing on devdax"""
     test_case = "test_map_from_existing"
+
+
+class TEST42(PMEM2_INTEGRATION):
+    """test asynchronous memcpy"""
+    test_case = "test_memcpy_async"
+
+
+class TEST43(PMEM2_INTEGRATION):
+    """test asynchronous memcpy with a single worker thread"""
+    test_case = "test_memcpy_async"
+
+    def run(self, ctx):
+        ctx.env['PMEM2_ASYNC_THREADS'] = '1'
+        super().run(ctx)
@@ -992,6 +992,135 @@ test_map_from_existing(const struct test_case *tc, int argc, char *argv[])
 }
 #undef COMPARE_FUNCS
 
+/*
+ * test_memcpy_async -- copy data asynchronously and verify it
+ */
+static int
+test_memcpy_async(const struct test_case *tc, int argc, char *argv[])
+{
+	if (argc < 1)
+		UT_FATAL("usage: test_memcpy_async <file>");
+
+	char *file = argv[0];
+	int fd = OPEN(file, O_RDWR);
+
+	struct pmem2_config *cfg;
+	struct pmem2_source *src;
+	PMEM2_PREPARE_CONFIG_INTEGRATION(&cfg, &src, fd,
+						PMEM2_GRANULARITY_PAGE);
+
+	size_t size;
+	UT_PMEM2_EXPECT_RETURN(pmem2_source_size(src, &size), 0);
+
+	struct pmem2_map *map = map_valid(cfg, src, size);
+	char *addr = pmem2_map_get_address(map);
+
+	/* unaligned, spanning a number of chunks */
+	size_t off = 13;
+	size_t len = size - 2 * off;
+	char *buf = MALLOC(len);
+	for (size_t i = 0; i < len; ++i)
+		buf[i] = (char)(i % 251);
+
+	struct pmem2_future *future;
+	UT_PMEM2_EXPECT_RETURN(pmem2_memcpy_async(&future, map, addr + off,
+			buf, len, 0), 0);
+	UT_ASSERTne(future, NULL);
+
+	while (pmem2_future_poll(future) != PMEM2_FUTURE_STATE_COMPLETE)
+		;
+	UT_ASSERTeq(memcmp(addr + off, buf, len), 0);
+	UT_PMEM2_EXPECT_RETURN(pmem2_future_delete(&future), 0);
+	UT_ASSERTeq(future, NULL);
+
+	/* many futures in flight, waited for in the reverse order */
+	struct pmem2_future *futures[8];
+	size_t part = len / ARRAY_SIZE(futures);
+	memset(buf, 0xc5, len);
+	for (size_t i = 0; i < ARRAY_SIZE(futures); ++i)
+		UT_PMEM2_EXPECT_RETURN(pmem2_memcpy_async(&futures[i], map,
+				addr + i * part, buf + i * part, part,
+				PMEM2_F_MEM_NONTEMPORAL), 0);
+	for (size_t i = ARRAY_SIZE(futures); i > 0; --i) {
+		pmem2_future_wait(futures[i - 1]);
+		UT_ASSERTeq(pmem2_future_poll(futures[i - 1]),
+				PMEM2_FUTURE_STATE_COMPLETE);
+		UT_PMEM2_EXPECT_RETURN(pmem2_future_delete(&futures[i - 1]),
+				0);
+	}
+	UT_ASSERTeq(memcmp(addr, buf, part * ARRAY_SIZE(futures)), 0);
+
+	/* small copies are complete on return */
+	UT_PMEM2_EXPECT_RETURN(pmem2_memcpy_async(&future, map, addr, "abc",
+			4, 0), 0);
+	UT_ASSERTeq(pmem2_future_poll(future), PMEM2_FUTURE_STATE_COMPLETE);
+	UT_ASSERTeq(strcmp(addr, "abc"), 0);
+	UT_PMEM2_EXPECT_RETURN(pmem2_future_delete(&future), 0);
+
+	UT_PMEM2_EXPECT_RETURN(pmem2_memcpy_async(&future, map, addr, buf,
+			0, 0), 0);
+	UT_ASSERTeq(pmem2_future_poll(future), PMEM2_FUTURE_STATE_COMPLETE);
+	UT_PMEM2_EXPECT_RETURN(pmem2_future_delete(&future), 0);
+
+	/* deleting a running future waits for it */
+	UT_PMEM2_EXPECT_RETURN(pmem2_memcpy_async(&future, map, addr + off,
+			buf, len, 0), 0);
+	UT_PMEM2_EXPECT_RETURN(pmem2_future_delete(&future), 0);
+	UT_ASSERTeq(memcmp(addr + off, buf, len), 0);
+
+#ifndef _WIN32
+	/* a child process doesn't inherit the worker threads */
+	memset(buf, 0x3a, len);
+	pid_t pid = fork();
+	UT_ASSERTne(pid, -1);
+	if (pid == 0) {
+		if (pmem2_memcpy_async(&future, map, addr + off, buf, len, 0))
+			_exit(1);
+		pmem2_future_wait(future);
+		_exit(memcmp(addr + off, buf, len) != 0);
+	}
+
+	int status;
+	UT_ASSERTeq(waitpid(pid, &status, 0), pid);
+	UT_ASSERT(WIFEXITED(status));
+	UT_ASSERTeq(WEXITSTATUS(status), 0);
+
+	/* the parent's workers keep working */
+	memset(buf, 0x5c, len);
+	UT_PMEM2_EXPECT_RETURN(pmem2_memcpy_async(&future, map, addr + off,
+			buf, len, 0), 0);
+	UT_PMEM2_EXPECT_RETURN(pmem2_future_delete(&future), 0);
+	UT_ASSERTeq(memcmp(addr + off, buf, len), 0);
+
+	/* the pending copies are finished before the library is unloaded */
+	memset(buf, 0x6e, len);
+	pid = fork();
+	UT_ASSERTne(pid, -1);
+	if (pid == 0) {
+		for (size_t i = 0; i < ARRAY_SIZE(futures); ++i) {
+			if (pmem2_memcpy_async(&futures[i], map,
+					addr + i * part, buf + i * part, part,
+					0))
+				_exit(1);
+		}
+		exit(0);
+	}
+
+	UT_ASSERTeq(waitpid(pid, &status, 0), pid);
+	UT_ASSERT(WIFEXITED(status));
+	UT_ASSERTeq(WEXITSTATUS(status), 0);
+	UT_ASSERTeq(memcmp(addr, buf, part * ARRAY_SIZE(futures)), 0);
+#endif
+
+	FREE(buf);
+	pmem2_map_delete(&map);
+	pmem2_config_delete(&cfg);
+	pmem2_source_delete(&src);
+	CLOSE(fd);
+
+	return 1;
+}
+
 /*
  * test_cases -- available test cases
  */
@@ -1018,7 +1147,8 @@ static struct test_case test_cases[] = {
 	TEST_CASE(test_source_anon_zero_len),
 	TEST_CASE(test_unaligned_persist),
 	TEST_CASE(test_map_from_existing_map),
-	TEST_CASE(test_map_from_existing)
+	TEST_CASE(test_map_from_existing),
+	TEST_CASE(test_memcpy_async),
 };
 
 #define NTESTS (sizeof(test_cases) / sizeof(test_cases[0]))
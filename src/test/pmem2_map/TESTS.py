@@ -232,3 +232,9 @@ class TEST30(PMEM2_MAP):
     """map alignment test for small pages"""
     test_case = "test_map_huge_alignment"
     filesize = 16 * t.KiB
+
+
+class TEST31(PMEM2_MAP):
+    """map with the different non-temporal store thresholds"""
+    test_case = "test_map_movnt_threshold"
+    with_size = False
@@ -876,6 +876,119 @@ test_map_huge_alignment(const struct test_case *tc, int argc,
 	return 2;
 }
 
+#define MOVNT_DATA_SIZE (64 * KILOBYTE)
+
+/*
+ * test_map_movnt_threshold - map the file with different non-temporal store
+ * thresholds and check if the mem[cpy|set] functions work in all of them
+ */
+static int
+test_map_movnt_threshold(const struct test_case *tc, int argc, char *argv[])
+{
+	if (argc < 1)
+		UT_FATAL("usage: test_map_movnt_threshold <file>");
+
+	char *file = argv[0];
+
+	struct pmem2_config cfg;
+	struct pmem2_source *src;
+	struct FHandle *fh;
+	size_t thr;
+
+	ut_pmem2_prepare_config(&cfg, &src, &fh, FH_FD, file, 0, 0, FH_RDWR);
+
+	struct pmem2_map *map_default;
+	int ret = pmem2_map_new(&map_default, &cfg, src);
+	UT_PMEM2_EXPECT_RETURN(ret, 0);
+
+	unsigned invalid_op = 777;
+	ret = pmem2_map_get_movnt_threshold(map_default, invalid_op, &thr);
+	UT_PMEM2_EXPECT_RETURN(ret, PMEM2_E_INVALID_MOVNT_OP);
+
+	ret = pmem2_config_set_movnt_threshold(&cfg, PMEM2_MOVNT_MEMMOVE, 0);
+	UT_PMEM2_EXPECT_RETURN(ret, 0);
+	ret = pmem2_config_set_movnt_threshold(&cfg, PMEM2_MOVNT_MEMSET,
+			SIZE_MAX);
+	UT_PMEM2_EXPECT_RETURN(ret, 0);
+
+	struct pmem2_map *map_set;
+	ret = pmem2_map_new(&map_set, &cfg, src);
+	UT_PMEM2_EXPECT_RETURN(ret, 0);
+
+	ret = pmem2_map_get_movnt_threshold(map_set, PMEM2_MOVNT_MEMMOVE,
+			&thr);
+	UT_PMEM2_EXPECT_RETURN(ret, 0);
+	UT_ASSERTeq(thr, 0);
+	ret = pmem2_map_get_movnt_threshold(map_set, PMEM2_MOVNT_MEMSET,
+			&thr);
+	UT_PMEM2_EXPECT_RETURN(ret, 0);
+	UT_ASSERTeq(thr, SIZE_MAX);
+
+	/* fill the beginning of the file with a known pattern */
+	char *data = MALLOC(MOVNT_DATA_SIZE);
+	for (size_t i = 0; i < MOVNT_DATA_SIZE; ++i)
+		data[i] = (char)(i * 31);
+
+	char *addr_default = pmem2_map_get_address(map_default);
+	char *addr_set = pmem2_map_get_address(map_set);
+	pmem2_memcpy_fn memcpy_set = pmem2_get_memcpy_fn(map_set);
+	memcpy_set(addr_set, data, MOVNT_DATA_SIZE, 0);
+	UT_ASSERTeq(memcmp(addr_default, data, MOVNT_DATA_SIZE), 0);
+
+	/* a threshold in the middle of the tested lengths */
+	pmem2_config_init(&cfg);
+	cfg.requested_max_granularity = PMEM2_GRANULARITY_PAGE;
+	ret = pmem2_config_set_movnt_threshold(&cfg, PMEM2_MOVNT_MEMMOVE,
+			4 * KILOBYTE);
+	UT_PMEM2_EXPECT_RETURN(ret, 0);
+	ret = pmem2_config_set_movnt_threshold(&cfg, PMEM2_MOVNT_MEMSET,
+			4 * KILOBYTE);
+	UT_PMEM2_EXPECT_RETURN(ret, 0);
+
+	struct pmem2_map *map_mid;
+	ret = pmem2_map_new(&map_mid, &cfg, src);
+	UT_PMEM2_EXPECT_RETURN(ret, 0);
+
+	char *addr_mid = pmem2_map_get_address(map_mid);
+	UT_ASSERTeq(memcmp(addr_mid, data, MOVNT_DATA_SIZE), 0);
+
+	/* write through all the mappings with lengths around the thresholds */
+	pmem2_memset_fn memset_fns[] = {
+		pmem2_get_memset_fn(map_default),
+		pmem2_get_memset_fn(map_set),
+		pmem2_get_memset_fn(map_mid),
+	};
+	pmem2_memcpy_fn memcpy_fns[] = {
+		pmem2_get_memcpy_fn(map_default),
+		pmem2_get_memcpy_fn(map_set),
+		pmem2_get_memcpy_fn(map_mid),
+	};
+	char *addrs[] = {addr_default, addr_set, addr_mid};
+
+	for (size_t len = 1; len <= MOVNT_DATA_SIZE; len *= 2) {
+		for (int m = 0; m < 3; ++m) {
+			memset_fns[m](addrs[m], m + 1, len, 0);
+			for (size_t i = 0; i < len; ++i)
+				UT_ASSERTeq(addr_default[i], m + 1);
+
+			memcpy_fns[m](addrs[m], data, len, 0);
+			UT_ASSERTeq(memcmp(addr_default, data, len), 0);
+		}
+	}
+
+	FREE(data);
+	unmap_map(map_mid);
+	FREE(map_mid);
+	unmap_map(map_set);
+	FREE(map_set);
+	unmap_map(map_default);
+	FREE(map_default);
+	PMEM2_SOURCE_DELETE(&src);
+	UT_FH_CLOSE(fh);
+
+	return 1;
+}
+
 /*
  * test_cases -- available test cases
  */
@@ -902,6 +1015,7 @@ static struct test_case test_cases[] = {
 	TEST_CASE(test_map_sharing_private_rdonly_file),
 	TEST_CASE(test_map_sharing_private_devdax),
 	TEST_CASE(test_map_huge_alignment),
+	TEST_CASE(test_map_movnt_threshold),
 };
 
 #define NTESTS (sizeof(test_cases) / sizeof(test_cases[0]))
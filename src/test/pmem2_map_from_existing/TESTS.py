@@ -40,3 +40,8 @@ class TEST3(Pmem2_from_existing):
 class TEST4(Pmem2_from_existing):
     """inject enomem during adding map to ravl"""
     test_case = "test_register_mapping_enomem"
+
+
+class TEST5(Pmem2_from_existing):
+    """look up the mappings while they are being registered by other thread"""
+    test_case = "test_map_find_mt"
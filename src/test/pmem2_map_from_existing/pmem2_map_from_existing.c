@@ -7,7 +7,9 @@
 
 #include <stdbool.h>
 #include "fault_injection.h"
+#include "map.h"
 #include "unittest.h"
+#include "ut_pmem2_source.h"
 #include "ut_pmem2_utils.h"
 
 /*
@@ -161,6 +163,112 @@ test_register_mapping_enomem(const struct test_case *tc, int argc, char *argv[])
 	return 1;
 }
 
+#define FIND_MT_BASE 0x10000000ULL
+#define FIND_MT_STRIDE 0x2000
+#define FIND_MT_LEN 0x1000
+#define FIND_MT_NMAPS 64 /* even slots are stable, odd ones are churned */
+#define FIND_MT_NTHREADS 4
+#define FIND_MT_ROUNDS 100
+
+static struct pmem2_map *Find_mt_maps[FIND_MT_NMAPS];
+static int Find_mt_stop;
+
+/*
+ * find_mt_addr -- returns the address of the given mapping slot
+ */
+static char *
+find_mt_addr(unsigned slot)
+{
+	return (char *)(FIND_MT_BASE + (uint64_t)slot * FIND_MT_STRIDE);
+}
+
+/*
+ * find_mt_reader -- looks up all the slots and the gaps between them
+ *	until stopped
+ */
+static void *
+find_mt_reader(void *arg)
+{
+	int stop = 0;
+	while (!stop) {
+		for (unsigned i = 0; i < FIND_MT_NMAPS; ++i) {
+			char *addr = find_mt_addr(i);
+			struct pmem2_map *map = pmem2_map_find(addr + 16, 1);
+			if (i % 2 == 0) {
+				UT_ASSERTeq(map, Find_mt_maps[i]);
+			} else {
+				/* a churned slot never resolves to a stable */
+				for (unsigned j = 0; j < FIND_MT_NMAPS; j += 2)
+					UT_ASSERTne(map, Find_mt_maps[j]);
+			}
+
+			map = pmem2_map_find(addr + FIND_MT_LEN, 16);
+			UT_ASSERTeq(map, NULL);
+		}
+
+		util_atomic_load_explicit32(&Find_mt_stop, &stop,
+			memory_order_acquire);
+	}
+
+	return NULL;
+}
+
+/*
+ * test_map_find_mt -- look up the mappings while they are being registered
+ *	and unregistered by another thread
+ */
+static int
+test_map_find_mt(const struct test_case *tc, int argc, char *argv[])
+{
+	struct pmem2_source *src;
+
+	int fd = OPEN(argv[0], O_RDWR);
+	int ret = pmem2_source_from_fd(&src, fd);
+	UT_ASSERTeq(ret, 0);
+
+	for (unsigned i = 0; i < FIND_MT_NMAPS; i += 2) {
+		ret = pmem2_map_from_existing(&Find_mt_maps[i], src,
+			find_mt_addr(i), FIND_MT_LEN, PMEM2_GRANULARITY_PAGE);
+		UT_PMEM2_EXPECT_RETURN(ret, 0);
+	}
+
+	os_thread_t threads[FIND_MT_NTHREADS];
+	for (unsigned i = 0; i < FIND_MT_NTHREADS; ++i)
+		THREAD_CREATE(&threads[i], NULL, find_mt_reader, NULL);
+
+	for (unsigned r = 0; r < FIND_MT_ROUNDS; ++r) {
+		struct pmem2_map *churn[FIND_MT_NMAPS];
+		for (unsigned i = 1; i < FIND_MT_NMAPS; i += 2) {
+			ret = pmem2_map_from_existing(&churn[i], src,
+				find_mt_addr(i), FIND_MT_LEN,
+				PMEM2_GRANULARITY_PAGE);
+			UT_PMEM2_EXPECT_RETURN(ret, 0);
+		}
+
+		for (unsigned i = 1; i < FIND_MT_NMAPS; i += 2) {
+			struct pmem2_map *map = pmem2_map_find(
+				find_mt_addr(i), FIND_MT_LEN);
+			UT_ASSERTeq(map, churn[i]);
+
+			ret = pmem2_map_delete(&churn[i]);
+			UT_PMEM2_EXPECT_RETURN(ret, 0);
+		}
+	}
+
+	util_atomic_store_explicit32(&Find_mt_stop, 1, memory_order_release);
+	for (unsigned i = 0; i < FIND_MT_NTHREADS; ++i)
+		THREAD_JOIN(&threads[i], NULL);
+
+	for (unsigned i = 0; i < FIND_MT_NMAPS; i += 2) {
+		ret = pmem2_map_delete(&Find_mt_maps[i]);
+		UT_PMEM2_EXPECT_RETURN(ret, 0);
+	}
+
+	PMEM2_SOURCE_DELETE(&src);
+	CLOSE(fd);
+	return 1;
+}
+
 /*
  * test_cases -- available test cases
  */
@@ -170,6 +278,7 @@ static struct test_case test_cases[] = {
 	TEST_CASE(test_mapping_overlap_upper),
 	TEST_CASE(test_map_allocation_enomem),
 	TEST_CASE(test_register_mapping_enomem),
+	TEST_CASE(test_map_find_mt),
 
 };
 
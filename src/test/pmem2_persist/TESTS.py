@@ -1,7 +1,7 @@
 #!../env.py
 #
 # SPDX-License-Identifier: BSD-3-Clause
-# Copyright 2019, Intel Corporation
+# Copyright 2019-2021, Intel Corporation
 
 import testframework as t
 from testframework import granularity as g
@@ -28,3 +28,8 @@ class TEST1(PMEM2_PERSIST):
 class TEST2(PMEM2_PERSIST):
     """test getting pmem2 drain functions"""
     test_case = "test_get_drain_funcs"
+
+
+class TEST3(PMEM2_PERSIST):
+    """test getting pmem2 vectored persist functions"""
+    test_case = "test_get_persistv_funcs"
@@ -1,8 +1,8 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2019-2020, Intel Corporation */
+/* Copyright 2019-2021, Intel Corporation */
 
 /*
- * pmem2_persist.c -- pmem2_get_[flush|drain|persist]_fn unittests
+ * pmem2_persist.c -- pmem2_get_[flush|drain|persist|persistv]_fn unittests
  */
 
 #include "mmap.h"
@@ -60,6 +60,16 @@ pmem2_map_find(const void *addr, size_t len)
 	return &cur;
 }
 
+/*
+ * pmem2_map_movnt_threshold -- redefine libpmem2 function
+ */
+size_t
+pmem2_map_movnt_threshold(const void *addr, size_t len,
+		enum pmem2_movnt_op op)
+{
+	return SIZE_MAX;
+}
+
 /*
  * pmem2_flush_file_buffers_os -- redefine libpmem2 function
  */
@@ -114,6 +124,20 @@ do_persist(struct pmem2_map *map, enum pmem2_granularity granularity)
 	func(map->addr, map->content_length);
 }
 
+/*
+ * do_persistv -- call vectored persist function according to a granularity
+ */
+static void
+do_persistv(struct pmem2_map *map, enum pmem2_granularity granularity,
+		const struct pmem2_range *ranges, size_t nranges)
+{
+	map->effective_granularity = granularity;
+	pmem2_set_flush_fns(map);
+	pmem2_persistv_fn func = pmem2_get_persistv_fn(map);
+	UT_ASSERTne(func, NULL);
+	func(ranges, nranges);
+}
+
 /*
  * do_flush -- call flush function according to a granularity
  */
@@ -163,6 +187,58 @@ test_get_persist_funcs(const struct test_case *tc, int argc, char *argv[])
 	return 0;
 }
 
+/*
+ * test_get_persistv_funcs -- test getting pmem2 vectored persist functions
+ */
+static int
+test_get_persistv_funcs(const struct test_case *tc, int argc, char *argv[])
+{
+	struct pmem2_map map;
+	prepare_map(&map);
+
+	char *base = (char *)ALIGN_UP((uintptr_t)map.addr, Pagesize);
+
+	/*
+	 * The first three ranges share the first page and are adjacent
+	 * at the cache line level, the last one is in a separate page.
+	 */
+	struct pmem2_range ranges[] = {
+		{base + 64, 64},
+		{base + 8, 8},
+		{base, 8},
+		{base + 32, 0},
+		{base + 3 * Pagesize + 10, 100},
+	};
+	size_t nranges = ARRAY_SIZE(ranges);
+
+	do_persistv(&map, PMEM2_GRANULARITY_PAGE, ranges, nranges);
+	counters_check_n_reset(2, 0, 0);
+
+	do_persistv(&map, PMEM2_GRANULARITY_CACHE_LINE, ranges, nranges);
+	counters_check_n_reset(0, 2, 1);
+
+	do_persistv(&map, PMEM2_GRANULARITY_BYTE, ranges, nranges);
+	counters_check_n_reset(0, 0, 1);
+
+	do_persistv(&map, PMEM2_GRANULARITY_CACHE_LINE, ranges, 0);
+	counters_check_n_reset(0, 0, 1);
+
+	/* ranges are coalesced in batches of 32 */
+	struct pmem2_range same[40];
+	for (size_t i = 0; i < ARRAY_SIZE(same); ++i) {
+		same[i].ptr = base + i;
+		same[i].size = 1;
+	}
+
+	do_persistv(&map, PMEM2_GRANULARITY_CACHE_LINE, same,
+			ARRAY_SIZE(same));
+	counters_check_n_reset(0, 2, 1);
+
+	FREE(map.addr);
+
+	return 0;
+}
+
 /*
  * test_get_flush_funcs -- test getting pmem2 flush functions
  */
@@ -216,6 +292,7 @@ static struct test_case test_cases[] = {
 	TEST_CASE(test_get_persist_funcs),
 	TEST_CASE(test_get_flush_funcs),
 	TEST_CASE(test_get_drain_funcs),
+	TEST_CASE(test_get_persistv_funcs),
 };
 
 #define NTESTS (sizeof(test_cases) / sizeof(test_cases[0]))
@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2014-2019, Intel Corporation */
+/* Copyright 2014-2021, Intel Corporation */
 
 /*
  * spoil.c -- pmempool spoil command source file
@@ -1207,7 +1207,8 @@ pmemspoil_process_pmemobj(struct pmemspoil *psp,
 		PROCESS_FIELD(pop, lanes_offset, uint64_t);
 		PROCESS_FIELD(pop, nlanes, uint64_t);
 		PROCESS_FIELD(pop, heap_offset, uint64_t);
-		PROCESS_FIELD(pop, unused3, uint64_t);
+		PROCESS_FIELD(pop, lane_redo_size, uint32_t);
+		PROCESS_FIELD(pop, lane_undo_size, uint32_t);
 		PROCESS_FIELD(pop, unused, char);
 		PROCESS_FIELD(pop, checksum, uint64_t);
 		PROCESS_FIELD(pop, run_id, uint64_t);
@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2018-2020, Intel Corporation */
+/* Copyright 2018-2021, Intel Corporation */
 
 /*
  * util_ravl.c -- unit test for ravl tree
@@ -201,6 +201,58 @@ test_emplace(void)
 	ravl_delete(r);
 }
 
+static int nallocs;
+static int nfrees;
+
+static void *
+node_alloc(size_t size, void *arg)
+{
+	UT_ASSERTeq(arg, &nallocs);
+	nallocs++;
+
+	return MALLOC(size);
+}
+
+static void
+node_free(void *ptr, void *arg)
+{
+	UT_ASSERTeq(arg, &nallocs);
+	nfrees++;
+
+	FREE(ptr);
+}
+
+static void
+test_custom_alloc(void)
+{
+	struct ravl *r = ravl_new_sized_alloc(cmpfoo, sizeof(struct foo),
+		node_alloc, node_free, &nallocs);
+	UT_ASSERTne(r, NULL);
+
+	struct foo a = {1, 2, 3};
+	struct foo b = {2, 3, 4};
+	struct foo c = {3, 4, 5};
+
+	UT_ASSERTeq(ravl_emplace_copy(r, &a), 0);
+	UT_ASSERTeq(ravl_emplace_copy(r, &b), 0);
+	UT_ASSERTeq(ravl_emplace_copy(r, &c), 0);
+	UT_ASSERTeq(nallocs, 3);
+
+	/* duplicates are freed right away */
+	UT_ASSERTne(ravl_emplace_copy(r, &a), 0);
+	UT_ASSERTeq(errno, EEXIST);
+	UT_ASSERTeq(nallocs, 4);
+	UT_ASSERTeq(nfrees, 1);
+
+	struct ravl_node *n = ravl_find(r, &b, RAVL_PREDICATE_EQUAL);
+	UT_ASSERTne(n, NULL);
+	ravl_remove(r, n);
+	UT_ASSERTeq(nfrees, 2);
+
+	ravl_delete(r);
+	UT_ASSERTeq(nfrees, nallocs);
+}
+
 static void
 test_fault_injection_ravl_sized()
 {
@@ -238,6 +290,7 @@ main(int argc, char *argv[])
 	test_misc();
 	test_stress();
 	test_emplace();
+	test_custom_alloc();
 
 	test_fault_injection_ravl_sized();
 	test_fault_injection_ravl_node();
@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2014-2019, Intel Corporation */
+/* Copyright 2014-2021, Intel Corporation */
 
 /*
  * info_obj.c -- pmempool info command source file for obj pool
@@ -33,9 +33,12 @@
 static int
 lane_need_recovery(struct pmem_info *pip, struct lane_layout *lane)
 {
+	struct ulog *undo = (struct ulog *)((char *)lane +
+		OBJ_LANE_UNDO_OFFSET(pip->obj.pop));
+
 	return ulog_recovery_needed((struct ulog *)&lane->external, 1) ||
 		ulog_recovery_needed((struct ulog *)&lane->internal, 1) ||
-		ulog_recovery_needed((struct ulog *)&lane->undo, 0);
+		ulog_recovery_needed(undo, 0);
 }
 
 #define RUN_BITMAP_SEPARATOR_DISTANCE 8
@@ -209,7 +212,8 @@ info_obj_lane(struct pmem_info *pip, int v, struct lane_layout *lane)
 
 	outv_title(v, "Undo Log");
 	outv_indent(v, 1);
-	info_obj_ulog(pip, v, (struct ulog *)&lane->undo, &p_ops);
+	info_obj_ulog(pip, v, (struct ulog *)((char *)lane +
+		OBJ_LANE_UNDO_OFFSET(pip->obj.pop)), &p_ops);
 	outv_indent(v, -1);
 
 	outv_nl(v);
@@ -240,23 +244,26 @@ info_obj_lanes(struct pmem_info *pip)
 	 * Iterate through all lanes from specified range and print
 	 * specified sections.
 	 */
-	struct lane_layout *lanes = (void *)((char *)pip->obj.pop +
-			pop->lanes_offset);
+	char *lanes = (char *)pip->obj.pop + pop->lanes_offset;
+	size_t lane_size = OBJ_LANE_SIZE(pop);
 	struct range *curp = NULL;
 	FOREACH_RANGE(curp, &pip->args.obj.lane_ranges) {
 		for (uint64_t i = curp->first;
 			i <= curp->last && i < pop->nlanes; i++) {
 
+			struct lane_layout *lane =
+				(void *)(lanes + lane_size * i);
+
 			/* For -R check print lane only if needs recovery */
 			if (pip->args.obj.lanes_recovery &&
-				!lane_need_recovery(pip, &lanes[i]))
+				!lane_need_recovery(pip, lane))
 				continue;
 
 			outv_title(v, "Lane %" PRIu64, i);
 
 			outv_indent(v, 1);
 
-			info_obj_lane(pip, v, &lanes[i]);
+			info_obj_lane(pip, v, lane);
 
 			outv_indent(v, -1);
 		}
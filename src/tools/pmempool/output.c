@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2014-2020, Intel Corporation */
+/* Copyright 2014-2021, Intel Corporation */
 
 /*
  * output.c -- definitions of output printing related functions
@@ -829,6 +829,13 @@ out_get_incompat_features_str(uint32_t incompat)
 				return "";
 		}
 
+		/* lane size cannot be toggled, it is not a pmempool feature */
+		if (features.incompat & POOL_FEAT_LANE_SIZE) {
+			features.incompat &= ~POOL_FEAT_LANE_SIZE;
+			if (out_concat(str_buff, &curr, &count, "LANE_SIZE"))
+				return "";
+		}
+
 		/* check if any unknown flags are set */
 		if (!util_feature_is_zero(features)) {
 			if (out_concat(str_buff, &curr, &count,
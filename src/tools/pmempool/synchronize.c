@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2016-2018, Intel Corporation */
+/* Copyright 2016-2021, Intel Corporation */
 
 /*
  * synchronize.c -- pmempool sync command source file
@@ -16,16 +16,22 @@
 #include <stdbool.h>
 #include <sys/mman.h>
 #include <endian.h>
+#include <errno.h>
 #include "common.h"
 #include "output.h"
+#include "os.h"
 #include "libpmempool.h"
 
+/* the environment variable read by libpmempool, see pmempool_sync(3) */
+#define COPY_THREADS_ENV_VARIABLE "PMEMPOOL_COPY_THREADS"
+
 /*
  * pmempool_sync_context -- context and arguments for sync command
  */
 struct pmempool_sync_context {
 	unsigned flags;		/* flags which modify the command execution */
 	char *poolset_file;	/* a path to a poolset file */
+	char *threads;		/* the number of copying threads */
 };
 
 /*
@@ -34,6 +40,7 @@ struct pmempool_sync_context {
 static const struct pmempool_sync_context pmempool_sync_default = {
 	.flags		= 0,
 	.poolset_file	= NULL,
+	.threads	= NULL,
 };
 
 /*
@@ -45,6 +52,7 @@ static const char * const help_str =
 "Common options:\n"
 "  -b, --bad-blocks     fix bad blocks - it requires creating or reading special recovery files\n"
 "  -d, --dry-run        do not apply changes, only check for viability of synchronization\n"
+"  -t, --threads <num>  number of threads used to copy the data of the recreated parts\n"
 "  -v, --verbose        increase verbosity level\n"
 "  -h, --help           display this help and exit\n"
 "\n"
@@ -58,6 +66,7 @@ static const struct option long_options[] = {
 	{"bad-blocks",	no_argument,		NULL,	'b'},
 	{"dry-run",	no_argument,		NULL,	'd'},
 	{"help",	no_argument,		NULL,	'h'},
+	{"threads",	required_argument,	NULL,	't'},
 	{"verbose",	no_argument,		NULL,	'v'},
 	{NULL,		0,			NULL,	 0 },
 };
@@ -91,6 +100,20 @@ pmempool_sync_help(const char *appname)
 	printf(help_str, appname);
 }
 
+/*
+ * pmempool_sync_threads_valid -- (internal) check the number of threads
+ */
+static bool
+pmempool_sync_threads_valid(const char *str)
+{
+	char *endptr;
+	errno = 0;
+	long nthreads = strtol(str, &endptr, 10);
+
+	return errno == 0 && endptr != str && *endptr == '\0' &&
+		nthreads > 0 && nthreads <= UINT16_MAX;
+}
+
 /*
  * pmempool_sync_parse_args -- (internal) parse command line arguments
  */
@@ -99,7 +122,7 @@ pmempool_sync_parse_args(struct pmempool_sync_context *ctx, const char *appname,
 		int argc, char *argv[])
 {
 	int opt;
-	while ((opt = getopt_long(argc, argv, "bdhv",
+	while ((opt = getopt_long(argc, argv, "bdht:v",
 			long_options, NULL)) != -1) {
 		switch (opt) {
 		case 'd':
@@ -111,6 +134,14 @@ pmempool_sync_parse_args(struct pmempool_sync_context *ctx, const char *appname,
 		case 'h':
 			pmempool_sync_help(appname);
 			exit(EXIT_SUCCESS);
+		case 't':
+			if (!pmempool_sync_threads_valid(optarg)) {
+				outv_err("invalid number of threads: '%s'\n",
+					optarg);
+				exit(EXIT_FAILURE);
+			}
+			ctx->threads = optarg;
+			break;
 		case 'v':
 			out_set_vlevel(1);
 			break;
@@ -143,6 +174,13 @@ pmempool_sync_func(const char *appname, int argc, char *argv[])
 	if ((ret = pmempool_sync_parse_args(&ctx, appname, argc, argv)))
 		return ret;
 
+	/* the thread count is passed to the library through its environment */
+	if (ctx.threads != NULL &&
+			os_setenv(COPY_THREADS_ENV_VARIABLE, ctx.threads, 1)) {
+		outv_err("!cannot set the number of copying threads");
+		return -1;
+	}
+
 	ret = pmempool_sync(ctx.poolset_file, ctx.flags);
 
 	if (ret) {